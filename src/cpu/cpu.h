@@ -38,6 +38,12 @@ void	ppc_machine_check_exception();
 void	ppc_cpu_raise_ext_exception();
 void	ppc_cpu_cancel_ext_exception();
 
+/*
+ * Thread-safe. The CPU thread calls io_run_completions()
+ * at its next heartbeat (regardless of MSR[EE]).
+ */
+void	ppc_cpu_raise_io_exception();
+
 /*
  * May only be called from within a CPU thread.
  */
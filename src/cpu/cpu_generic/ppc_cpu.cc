@@ -29,6 +29,7 @@
 #include "cpu/cpu.h"
 #include "cpu/debug.h"
 #include "info.h"
+#include "io/io.h"
 #include "io/pic/pic.h"
 #include "debug/debugger.h"
 #include "debug/tracers.h"
@@ -89,6 +90,17 @@ void ppc_cpu_atomic_cancel_ext_exception()
 	sys_unlock_mutex(exception_mutex);
 }
 
+/*
+ *	Not part of exception_pending, it's checked separately
+ *	before each instruction
+ */
+void ppc_cpu_atomic_raise_io_exception()
+{
+	sys_lock_mutex(exception_mutex);
+	gCPU.io_exception = true;
+	sys_unlock_mutex(exception_mutex);
+}
+
 void ppc_cpu_atomic_raise_dec_exception()
 {
 	sys_lock_mutex(exception_mutex);
@@ -173,6 +185,10 @@ void ppc_cpu_run()
 		
 		gCPU.pc = gCPU.npc;
 		
+		if (gCPU.io_exception) {
+			gCPU.io_exception = false;
+			io_run_completions();
+		}
 		if (gCPU.exception_pending) {
 			if (gCPU.stop_exception) {
 				gCPU.stop_exception = false;
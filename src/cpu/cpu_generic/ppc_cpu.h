@@ -85,6 +85,7 @@ struct PPC_CPU_State {
 	bool   ext_exception;
 	bool   stop_exception;
 	bool   singlestep_ignore;
+	bool   io_exception;
 
 	uint32 pagetable_base;
 	int    pagetable_hashmask;
@@ -108,6 +109,7 @@ extern PPC_CPU_State gCPU;
 
 void ppc_cpu_atomic_raise_ext_exception();
 void ppc_cpu_atomic_cancel_ext_exception();
+void ppc_cpu_atomic_raise_io_exception();
 
 extern uint32 gBreakpoint;
 extern uint32 gBreakpoint2;
@@ -126,3 +126,8 @@ void ppc_cpu_cancel_ext_exception()
 {
 	ppc_cpu_atomic_cancel_ext_exception();
 }
+
+void ppc_cpu_raise_io_exception()
+{
+	ppc_cpu_atomic_raise_io_exception();
+}
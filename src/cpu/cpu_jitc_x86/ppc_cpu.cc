@@ -82,23 +82,54 @@ uint64 ppc_get_cpu_timebase()
 
 sys_timer gDECtimer;
 sys_semaphore gCPUDozeSem;
+// DEC callbacks may take gCPUDozeSem, so cpu_doze can sleep without a bound
+static bool gDECtimerThreaded;
+static uint64 gCPUDozeStart;
+static uint64 gCPUDozes;
+static uint64 gCPUDozeWakeups;
 
 extern "C" void cpu_doze()
 {
 	sys_lock_semaphore(gCPUDozeSem);
-	if (!gCPU.exception_pending) sys_wait_semaphore_bounded(gCPUDozeSem, 10);	
+	if (!gCPU.exception_pending) {
+		gCPUDozes++;
+		if (gDECtimerThreaded) {
+			/*
+			 *	Everything that ends a doze (DEC, interrupts,
+			 *	I/O completions, stop) calls ppc_cpu_wakeup(),
+			 *	so sleep until the next one of them.
+			 */
+			do {
+				sys_wait_semaphore(gCPUDozeSem);
+				gCPUDozeWakeups++;
+			} while (!gCPU.exception_pending);
+		} else {
+			// DEC signal handlers can't wake us up, poll for them
+			sys_wait_semaphore_bounded(gCPUDozeSem, 10);
+			gCPUDozeWakeups++;
+		}
+	}
 	sys_unlock_semaphore(gCPUDozeSem);
 }
 
 void ppc_cpu_wakeup()
 {
-	sys_signal_semaphore(gCPUDozeSem);	
+	sys_lock_semaphore(gCPUDozeSem);
+	sys_signal_semaphore(gCPUDozeSem);
+	sys_unlock_semaphore(gCPUDozeSem);
 }
 
 static void decTimerCB(sys_timer t)
 {
 	ppc_cpu_atomic_raise_dec_exception();
-//	cpu_wakeup();
+	if (gDECtimerThreaded) ppc_cpu_wakeup();
+}
+
+static void ppc_cpu_display_idle_stats()
+{
+	uint64 secs = (sys_get_hiresclk_ticks() - gCPUDozeStart) / sys_get_hiresclk_ticks_per_second();
+	ht_printf("[CPU] idle: %qd dozes   %qd wakeups (%qd/s)\n",
+		gCPUDozes, gCPUDozeWakeups, secs ? gCPUDozeWakeups / secs : gCPUDozeWakeups);
 }
 
 void ppc_cpu_run()
@@ -123,7 +154,10 @@ void ppc_cpu_run()
 		ht_printf("Unable to create timer\n");
 		exit(1);
 	}
+	gDECtimerThreaded = sys_timer_callback_is_threaded(gDECtimer);
+	gCPUDozeStart = sys_get_hiresclk_ticks();
 	ppc_start_jitc_asm(gCPU.pc);
+	ppc_cpu_display_idle_stats();
 }
 
 void ppc_cpu_map_framebuffer(uint32 pa, uint32 ea)
@@ -144,6 +178,7 @@ void ppc_cpu_stop()
 {
 	gCPU.exception_pending = true;
 	gCPU.stop_exception = true;
+	ppc_cpu_wakeup();
 }
 
 uint64	ppc_get_clock_frequency(int cpu)
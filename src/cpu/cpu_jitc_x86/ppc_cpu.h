@@ -94,7 +94,8 @@ struct PPC_CPU_State {
 	bool   ext_exception;
 	bool   stop_exception;
 	bool   singlestep_ignore;
-	byte   align[3];	
+	bool   io_exception;
+	byte   align[2];
 
 	uint32 pagetable_base;
 	int    pagetable_hashmask;
@@ -202,6 +203,7 @@ void ppc_set_singlestep_nonverbose(bool v);
 extern "C" void ppc_cpu_atomic_raise_dec_exception();
 extern "C" void ppc_cpu_atomic_raise_ext_exception();
 extern "C" void ppc_cpu_atomic_cancel_ext_exception();
+extern "C" void ppc_cpu_io_exception();
 
 void cpu_wakeup();
 
@@ -20,6 +20,7 @@
  */
 
 #include "tools/snprintf.h"
+#include "io/io.h"
 #include "debug/tracers.h"
 #include "info.h"
 #include "ppc_cpu.h"
@@ -120,3 +121,29 @@ void ppc_cpu_cancel_ext_exception()
 {
 	ppc_cpu_atomic_cancel_ext_exception();
 }
+
+void ppc_cpu_raise_io_exception()
+{
+	gCPU.io_exception = true;
+	// the cancel macros keep exception_pending set while io_exception is
+	__sync_fetch_and_or((uint32 *)&gCPU.exception_pending, 1);
+	ppc_cpu_wakeup();
+}
+
+/*
+ *	Called by the heartbeat if io_exception is set
+ */
+extern "C" void ppc_cpu_io_exception()
+{
+	gCPU.io_exception = false;
+	__sync_synchronize();
+	io_run_completions();
+	// keep exception_pending if something else (or a new completion) is pending
+	uint32 *flags = (uint32 *)&gCPU.exception_pending;
+	uint32 old, val;
+	do {
+		old = *flags;
+		val = old & ~1;
+		if (val || gCPU.io_exception) val |= 1;
+	} while (!__sync_bool_compare_and_swap(flags, old, val));
+}
@@ -921,6 +921,17 @@ bool	ppc_dma_set(uint32 dest, int c, uint32 size)
 	return true;
 }
 
+bool	ppc_dma_map(uint32 addr, uint32 size, byte *&ptr)
+{
+	if (addr > gMemorySize || (addr+size) > gMemorySize) return false;
+	ppc_direct_physical_memory_handle(addr, ptr);
+	return true;
+}
+
+void	ppc_dma_written(uint32 dest, uint32 size)
+{
+}
+
 
 /***************************************************************************
  *	DEPRECATED prom interface
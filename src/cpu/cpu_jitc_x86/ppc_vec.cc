@@ -59,6 +59,9 @@ static inline void noncommutative_operation(X86ALUPSopc opc, int vrD, int vrA, i
 static inline void commutative_operation(X86PALUopc opc, int vrD, int vrA, int vrB);
 static inline void noncommutative_operation(X86PALUopc opc, int vrD, int vrA, int vrB);
 
+static inline void commutative_operation(X86PALU38opc opc, int vrD, int vrA, int vrB);
+static inline void noncommutative_operation(X86PALU38opc opc, int vrD, int vrA, int vrB);
+
 /*	PACK_PIXEL	Packs a uint32 pixel to uint16 pixel
  *	v.219
  */
@@ -391,9 +394,34 @@ static inline void vec_setWord(int dest, int i, NativeReg src)
 #define SSE2_AVAIL	gJITC.hostCPUCaps.sse2
 //#define SSE2_AVAIL	0
 
+#define SSSE3_AVAIL	gJITC.hostCPUCaps.ssse3
+#define SSE4_AVAIL	gJITC.hostCPUCaps.sse4
+
 #define SSE_NO		0
 #define SSE2_NO		0
 
+/*
+ *	PSHUFB masks to splat byte / half word i (host order)
+ */
+#define VEC_SPLAT_B(i)	{{0x0101010101010101ULL*(i), 0x0101010101010101ULL*(i)}}
+#define VEC_SPLAT_H(i)	{{0x0001000100010001ULL*(0x0100+0x0202*(i)), \
+			  0x0001000100010001ULL*(0x0100+0x0202*(i))}}
+
+static const Vector_t vec_splat_b[16] ALIGN_STRUCT(16) = {
+	VEC_SPLAT_B(0),  VEC_SPLAT_B(1),  VEC_SPLAT_B(2),  VEC_SPLAT_B(3),
+	VEC_SPLAT_B(4),  VEC_SPLAT_B(5),  VEC_SPLAT_B(6),  VEC_SPLAT_B(7),
+	VEC_SPLAT_B(8),  VEC_SPLAT_B(9),  VEC_SPLAT_B(10), VEC_SPLAT_B(11),
+	VEC_SPLAT_B(12), VEC_SPLAT_B(13), VEC_SPLAT_B(14), VEC_SPLAT_B(15),
+};
+
+static const Vector_t vec_splat_h[8] ALIGN_STRUCT(16) = {
+	VEC_SPLAT_H(0),  VEC_SPLAT_H(1),  VEC_SPLAT_H(2),  VEC_SPLAT_H(3),
+	VEC_SPLAT_H(4),  VEC_SPLAT_H(5),  VEC_SPLAT_H(6),  VEC_SPLAT_H(7),
+};
+
+static const Vector_t vec_uhalf_max_b ALIGN_STRUCT(16) = {{0x00ff00ff00ff00ffULL, 0x00ff00ff00ff00ffULL}};
+static const Vector_t vec_uword_max_h ALIGN_STRUCT(16) = {{0x0000ffff0000ffffULL, 0x0000ffff0000ffffULL}};
+
 const static sint32 sint32_max = 2147483647;
 const static sint32 sint32_min = -2147483648;
 const static double uint32_max = 4294967295;
@@ -424,6 +452,54 @@ static inline void vec_Copy(int dest, int src)
 	}
 }
 
+/*
+ *	Sets up d := vrA for a two operand SSE instruction with the
+ *	source vrB, which is returned in s.
+ *	Must be followed by vec_endOperation.
+ */
+static inline NativeVectorReg vec_beginOperation(int vrD, int vrA, int vrB, NativeVectorReg &s)
+{
+	NativeVectorReg d;
+
+	if (vrA == vrD) {
+		d = jitcGetClientVectorRegisterDirty(vrA);
+	} else {
+		if (vrB == vrD)
+			d = jitcAllocVectorRegister();
+		else
+			d = jitcMapClientVectorRegisterDirty(vrD);
+
+		NativeVectorReg a = jitcGetClientVectorRegisterMapping(vrA);
+
+		if (a == VECTREG_NO)
+			asmMOVAPS(d, &gCPU.vr[vrA]);
+		else
+			asmALUPS(X86_MOVAPS, d, a);
+	}
+
+	s = jitcGetClientVectorRegister(vrB);
+
+	return d;
+}
+
+static inline void vec_endOperation(NativeVectorReg d, int vrD, int vrB)
+{
+	if (vrB == vrD)
+		jitcRenameVectorRegisterDirty(d, vrD);
+}
+
+/*
+ *	Returns a scratch register holding a copy of s
+ */
+static inline NativeVectorReg vec_tempCopy(NativeVectorReg s)
+{
+	NativeVectorReg t = jitcAllocVectorRegister();
+
+	asmALUPS(X86_MOVAPS, t, s);
+
+	return t;
+}
+
 static inline void vec_Zero(int dest)
 {
 	if (SSE_AVAIL) {
@@ -1369,6 +1445,23 @@ JITCFlow ppc_opc_gen_vsldoi()
 	int shift, ashift, pshift, bshift;
 	PPC_OPC_TEMPL_A(gJITC.current_opc, vrD, vrA, vrB, shift);
 
+	if (SSSE3_AVAIL) {
+		shift &= 0xf;
+
+		if (shift == 0) {
+			vec_Copy(vrD, vrA);
+			return flowContinue;
+		}
+
+		NativeVectorReg s;
+		NativeVectorReg d = vec_beginOperation(vrD, vrA, vrB, s);
+
+		asmPALIGNR(d, s, 16 - shift);
+		vec_endOperation(d, vrD, vrB);
+
+		return flowContinue;
+	}
+
 	jitcFlushClientVectorRegister(vrA);
 	jitcFlushClientVectorRegister(vrB);
 	jitcDropClientVectorRegister(vrD);
@@ -2027,6 +2120,15 @@ JITCFlow ppc_opc_gen_vspltb()
 	uint32 uimm;
 	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, uimm, vrB);
 
+	if (SSSE3_AVAIL) {
+		vec_Copy(vrD, vrB);
+		NativeVectorReg reg = jitcGetClientVectorRegisterDirty(vrD);
+
+		asmPALU38(X86_PSHUFB, reg, &vec_splat_b[15 - (uimm & 0xf)]);
+
+		return flowContinue;
+	}
+
 	jitcFlushClientVectorRegister(vrB);
 	jitcDropClientVectorRegister(vrD);
 
@@ -2086,6 +2188,15 @@ JITCFlow ppc_opc_gen_vsplth()
 	uint32 uimm;
 	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, uimm, vrB);
 
+	if (SSSE3_AVAIL) {
+		vec_Copy(vrD, vrB);
+		NativeVectorReg reg = jitcGetClientVectorRegisterDirty(vrD);
+
+		asmPALU38(X86_PSHUFB, reg, &vec_splat_h[7 - (uimm & 0x7)]);
+
+		return flowContinue;
+	}
+
 	jitcFlushClientVectorRegister(vrB);
 	jitcDropClientVectorRegister(vrD);
 
@@ -2510,6 +2621,24 @@ JITCFlow ppc_opc_gen_vpkuhum()
 	int vrD, vrA, vrB;
 	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
 
+	if (SSE2_AVAIL) {
+		/* sign extend the low part, so the saturation of PACKSSWB
+		 *	does the truncation
+		 */
+		NativeVectorReg s;
+		NativeVectorReg d = vec_beginOperation(vrD, vrB, vrA, s);
+		NativeVectorReg t = vec_tempCopy(s);
+
+		asmPShift(X86_PSLLWi, d, 8);
+		asmPShift(X86_PSRAWi, d, 8);
+		asmPShift(X86_PSLLWi, t, 8);
+		asmPShift(X86_PSRAWi, t, 8);
+		asmPALU(X86_PACKSSWB, d, t);
+		vec_endOperation(d, vrD, vrA);
+
+		return flowContinue;
+	}
+
 	jitcFlushClientVectorRegister(vrA);
 	jitcFlushClientVectorRegister(vrB);
 	jitcDropClientVectorRegister(vrD);
@@ -2583,6 +2712,24 @@ JITCFlow ppc_opc_gen_vpkuwum()
 	int vrD, vrA, vrB;
 	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
 
+	if (SSE2_AVAIL) {
+		/* sign extend the low part, so the saturation of PACKSSDW
+		 *	does the truncation
+		 */
+		NativeVectorReg s;
+		NativeVectorReg d = vec_beginOperation(vrD, vrB, vrA, s);
+		NativeVectorReg t = vec_tempCopy(s);
+
+		asmPShift(X86_PSLLDi, d, 16);
+		asmPShift(X86_PSRADi, d, 16);
+		asmPShift(X86_PSLLDi, t, 16);
+		asmPShift(X86_PSRADi, t, 16);
+		asmPALU(X86_PACKSSDW, d, t);
+		vec_endOperation(d, vrD, vrA);
+
+		return flowContinue;
+	}
+
 	jitcFlushClientVectorRegister(vrA);
 	jitcFlushClientVectorRegister(vrB);
 	jitcDropClientVectorRegister(vrD);
@@ -2769,6 +2916,19 @@ JITCFlow ppc_opc_gen_vpkuhus()
 	int vrD, vrA, vrB;
 	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
 
+	if (SSE4_AVAIL) {
+		NativeVectorReg s;
+		NativeVectorReg d = vec_beginOperation(vrD, vrB, vrA, s);
+		NativeVectorReg t = vec_tempCopy(s);
+
+		asmPALU38(X86_PMINUW, d, &vec_uhalf_max_b);
+		asmPALU38(X86_PMINUW, t, &vec_uhalf_max_b);
+		asmPALU(X86_PACKUSWB, d, t);
+		vec_endOperation(d, vrD, vrA);
+
+		return flowContinue;
+	}
+
 	jitcFlushClientVectorRegister(vrA);
 	jitcFlushClientVectorRegister(vrB);
 	jitcDropClientVectorRegister(vrD);
@@ -2857,6 +3017,14 @@ void ppc_opc_vpkshss()
 }
 JITCFlow ppc_opc_gen_vpkshss()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE2_AVAIL) {
+		noncommutative_operation(X86_PACKSSWB, vrD, vrB, vrA);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vpkshss);
 	return flowEndBlock;
 }
@@ -2885,6 +3053,22 @@ void ppc_opc_vpkuwus()
 }
 JITCFlow ppc_opc_gen_vpkuwus()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE4_AVAIL) {
+		NativeVectorReg s;
+		NativeVectorReg d = vec_beginOperation(vrD, vrB, vrA, s);
+		NativeVectorReg t = vec_tempCopy(s);
+
+		asmPALU38(X86_PMINUD, d, &vec_uword_max_h);
+		asmPALU38(X86_PMINUD, t, &vec_uword_max_h);
+		asmPALU38(X86_PACKUSDW, d, t);
+		vec_endOperation(d, vrD, vrA);
+
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vpkuwus);
 	return flowEndBlock;
 }
@@ -3102,6 +3286,14 @@ void ppc_opc_vpkswus()
 }
 JITCFlow ppc_opc_gen_vpkswus()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE4_AVAIL) {
+		noncommutative_operation(X86_PACKUSDW, vrD, vrB, vrA);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vpkswus);
 	return flowEndBlock;
 }
@@ -3137,6 +3329,16 @@ JITCFlow ppc_opc_gen_vupkhsb()
 	int vrD, vrA, vrB;
 	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
 
+	if (SSE2_AVAIL) {
+		vec_Copy(vrD, vrB);
+		NativeVectorReg reg = jitcGetClientVectorRegisterDirty(vrD);
+
+		asmPALU(PALUB(X86_PUNPCKH), reg, reg);
+		asmPShift(X86_PSRAWi, reg, 8);
+
+		return flowContinue;
+	}
+
 	jitcFlushClientVectorRegister(vrB);
 	jitcDropClientVectorRegister(vrD);
 
@@ -3196,6 +3398,19 @@ void ppc_opc_vupkhsh()
 }
 JITCFlow ppc_opc_gen_vupkhsh()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE2_AVAIL) {
+		vec_Copy(vrD, vrB);
+		NativeVectorReg reg = jitcGetClientVectorRegisterDirty(vrD);
+
+		asmPALU(PALUW(X86_PUNPCKH), reg, reg);
+		asmPShift(X86_PSRADi, reg, 16);
+
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vupkhsh);
 	return flowEndBlock;
 }
@@ -3231,6 +3446,25 @@ JITCFlow ppc_opc_gen_vupklsb()
 	int vrD, vrA, vrB;
 	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
 
+	if (SSE4_AVAIL) {
+		NativeVectorReg s = jitcGetClientVectorRegister(vrB);
+		NativeVectorReg d = jitcMapClientVectorRegisterDirty(vrD);
+
+		asmPALU38(X86_PMOVSXBW, d, s);
+
+		return flowContinue;
+	}
+
+	if (SSE2_AVAIL) {
+		vec_Copy(vrD, vrB);
+		NativeVectorReg reg = jitcGetClientVectorRegisterDirty(vrD);
+
+		asmPALU(PALUB(X86_PUNPCKL), reg, reg);
+		asmPShift(X86_PSRAWi, reg, 8);
+
+		return flowContinue;
+	}
+
 	jitcFlushClientVectorRegister(vrB);
 	jitcDropClientVectorRegister(vrD);
 
@@ -3290,6 +3524,28 @@ void ppc_opc_vupklsh()
 }
 JITCFlow ppc_opc_gen_vupklsh()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE4_AVAIL) {
+		NativeVectorReg s = jitcGetClientVectorRegister(vrB);
+		NativeVectorReg d = jitcMapClientVectorRegisterDirty(vrD);
+
+		asmPALU38(X86_PMOVSXWD, d, s);
+
+		return flowContinue;
+	}
+
+	if (SSE2_AVAIL) {
+		vec_Copy(vrD, vrB);
+		NativeVectorReg reg = jitcGetClientVectorRegisterDirty(vrD);
+
+		asmPALU(PALUW(X86_PUNPCKL), reg, reg);
+		asmPShift(X86_PSRADi, reg, 16);
+
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vupklsh);
 	return flowEndBlock;
 }
@@ -5936,6 +6192,14 @@ void ppc_opc_vmaxuh()
 }
 JITCFlow ppc_opc_gen_vmaxuh()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE4_AVAIL) {
+		commutative_operation(X86_PMAXUW, vrD, vrA, vrB);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vmaxuh);
 	return flowEndBlock;
 }
@@ -5961,6 +6225,14 @@ void ppc_opc_vmaxuw()
 }
 JITCFlow ppc_opc_gen_vmaxuw()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE4_AVAIL) {
+		commutative_operation(X86_PMAXUD, vrD, vrA, vrB);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vmaxuw);
 	return flowEndBlock;
 }
@@ -5986,6 +6258,14 @@ void ppc_opc_vmaxsb()
 }
 JITCFlow ppc_opc_gen_vmaxsb()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE4_AVAIL) {
+		commutative_operation(X86_PMAXSB, vrD, vrA, vrB);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vmaxsb);
 	return flowEndBlock;
 }
@@ -6011,6 +6291,14 @@ void ppc_opc_vmaxsh()
 }
 JITCFlow ppc_opc_gen_vmaxsh()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE2_AVAIL) {
+		commutative_operation(X86_PMAXSW, vrD, vrA, vrB);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vmaxsh);
 	return flowEndBlock;
 }
@@ -6036,6 +6324,14 @@ void ppc_opc_vmaxsw()
 }
 JITCFlow ppc_opc_gen_vmaxsw()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE4_AVAIL) {
+		commutative_operation(X86_PMAXSD, vrD, vrA, vrB);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vmaxsw);
 	return flowEndBlock;
 }
@@ -6170,6 +6466,14 @@ void ppc_opc_vminuh()
 }
 JITCFlow ppc_opc_gen_vminuh()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE4_AVAIL) {
+		commutative_operation(X86_PMINUW, vrD, vrA, vrB);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vminuh);
 	return flowEndBlock;
 }
@@ -6195,6 +6499,14 @@ void ppc_opc_vminuw()
 }
 JITCFlow ppc_opc_gen_vminuw()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE4_AVAIL) {
+		commutative_operation(X86_PMINUD, vrD, vrA, vrB);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vminuw);
 	return flowEndBlock;
 }
@@ -6220,6 +6532,14 @@ void ppc_opc_vminsb()
 }
 JITCFlow ppc_opc_gen_vminsb()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE4_AVAIL) {
+		commutative_operation(X86_PMINSB, vrD, vrA, vrB);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vminsb);
 	return flowEndBlock;
 }
@@ -6245,6 +6565,14 @@ void ppc_opc_vminsh()
 }
 JITCFlow ppc_opc_gen_vminsh()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE2_AVAIL) {
+		commutative_operation(X86_PMINSW, vrD, vrA, vrB);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vminsh);
 	return flowEndBlock;
 }
@@ -6270,6 +6598,14 @@ void ppc_opc_vminsw()
 }
 JITCFlow ppc_opc_gen_vminsw()
 {
+	int vrD, vrA, vrB;
+	PPC_OPC_TEMPL_X(gJITC.current_opc, vrD, vrA, vrB);
+
+	if (SSE4_AVAIL) {
+		commutative_operation(X86_PMINSD, vrD, vrA, vrB);
+		return flowContinue;
+	}
+
 	ppc_opc_gen_interpret(ppc_opc_vminsw);
 	return flowEndBlock;
 }
@@ -7141,6 +7477,30 @@ static inline void noncommutative_operation(X86PALUopc opc, int vrD, int vrA, in
 		jitcRenameVectorRegisterDirty(d, vrD);
 }
 
+static inline void commutative_operation(X86PALU38opc opc, int vrD, int vrA, int vrB)
+{
+	if (vrB == vrD) {
+		int t = vrA;
+		vrA = vrB;
+		vrB = t;
+	}
+
+	NativeVectorReg s;
+	NativeVectorReg d = vec_beginOperation(vrD, vrA, vrB, s);
+
+	asmPALU38(opc, d, s);
+	vec_endOperation(d, vrD, vrB);
+}
+
+static inline void noncommutative_operation(X86PALU38opc opc, int vrD, int vrA, int vrB)
+{
+	NativeVectorReg s;
+	NativeVectorReg d = vec_beginOperation(vrD, vrA, vrB, s);
+
+	asmPALU38(opc, d, s);
+	vec_endOperation(d, vrD, vrB);
+}
+
 /*	vand		Vector Logical AND
  *	v.147
  */
@@ -63,6 +63,8 @@ void x86GetCaps(X86CPUCaps &caps)
 	caps.sse = id2.features & (1<<25);
 	caps.sse2 = id2.features & (1<<26);
 	caps.sse3 = id2.features2 & (1<<0);
+	caps.ssse3 = id2.features2 & (1<<9);
+	caps.sse4 = id2.features2 & (1<<19);	// SSE4.1
 	
 	ppc_cpuid_asm(0x80000000, &id);
 	if (id.level >= 0x80000001) {
@@ -74,14 +76,16 @@ void x86GetCaps(X86CPUCaps &caps)
 		caps._3dnow2 = id2.features & (1<<30);
 	}
 	
-	ht_printf("%s%s%s%s%s%s%s\n",
+	ht_printf("%s%s%s%s%s%s%s%s%s\n",
 		caps.cmov?" CMOV":"",
 		caps.mmx?" MMX":"",
 		caps._3dnow?" 3DNOW":"",
 		caps._3dnow2?" 3DNOW+":"",
 		caps.sse?" SSE":"",
 		caps.sse2?" SSE2":"",
-		caps.sse3?" SSE3":"");
+		caps.sse3?" SSE3":"",
+		caps.ssse3?" SSSE3":"",
+		caps.sse4?" SSE4.1":"");
 }
 
 /*
@@ -2401,6 +2405,35 @@ void FASTCALL asmPALU(X86PALUopc opc, NativeVectorReg reg1, const void *mem)
 	jitcEmit(instr, sizeof instr);
 }
 
+void FASTCALL asmPALU38(X86PALU38opc opc, NativeVectorReg reg1, NativeVectorReg reg2)
+{
+	byte instr[5] = {0x66, 0x0f, 0x38, opc, byte(0xc0 + (reg1 << 3) + reg2)};
+
+	jitcEmit(instr, sizeof instr);
+}
+
+void FASTCALL asmPALU38(X86PALU38opc opc, NativeVectorReg reg1, const void *mem)
+{
+	byte instr[9] = {0x66, 0x0f, 0x38, opc, byte(0x05+(reg1 << 3))};
+
+	*((uint32*)(&instr[5])) = uint32(mem);
+	jitcEmit(instr, sizeof instr);
+}
+
+void FASTCALL asmPALIGNR(NativeVectorReg reg1, NativeVectorReg reg2, int imm)
+{
+	byte instr[6] = {0x66, 0x0f, 0x3a, 0x0f, byte(0xc0 + (reg1 << 3) + reg2), byte(imm)};
+
+	jitcEmit(instr, sizeof instr);
+}
+
+void FASTCALL asmPShift(X86PShiftOpc opc, NativeVectorReg reg, int imm)
+{
+	byte instr[5] = {0x66, 0x0f, byte(opc >> 8), byte(0xc0 + ((opc & 7) << 3) + reg), byte(imm)};
+
+	jitcEmit(instr, sizeof instr);
+}
+
 void FASTCALL asmSHUFPS(NativeVectorReg reg1, NativeVectorReg reg2, int order)
 {
 	byte instr[4] = {0x0f, 0xc6, 0xc0+(reg1<<3)+reg2, order};
@@ -544,6 +544,38 @@ enum X86PALUopc {
 	X86_PADD    = 0xFC,
 };
 
+/*
+ *	SSSE3 / SSE4.1 (66 0F 38 xx)
+ */
+enum X86PALU38opc {
+	X86_PSHUFB   = 0x00,	// SSSE3
+	X86_PMOVSXBW = 0x20,	// SSE4.1 from here
+	X86_PMOVSXWD = 0x23,
+	X86_PACKUSDW = 0x2B,
+	X86_PMINSB   = 0x38,
+	X86_PMINSD   = 0x39,
+	X86_PMINUW   = 0x3A,
+	X86_PMINUD   = 0x3B,
+	X86_PMAXSB   = 0x3C,
+	X86_PMAXSD   = 0x3D,
+	X86_PMAXUW   = 0x3E,
+	X86_PMAXUD   = 0x3F,
+};
+
+/*
+ *	Shift by immediate, opcode << 8 | reg field
+ */
+enum X86PShiftOpc {
+	X86_PSRLWi  = 0x7102,
+	X86_PSRAWi  = 0x7104,
+	X86_PSLLWi  = 0x7106,
+	X86_PSRLDi  = 0x7202,
+	X86_PSRADi  = 0x7204,
+	X86_PSLLDi  = 0x7206,
+	X86_PSRLDQi = 0x7303,
+	X86_PSLLDQi = 0x7307,
+};
+
 #define PALUB(op)	((X86PALUopc)((op) | 0x00))
 #define PALUW(op)	((X86PALUopc)((op) | 0x01))
 #define PALUD(op)	((X86PALUopc)((op) | 0x02))
@@ -600,6 +632,11 @@ static inline void asmALUPS(X86ALUPSopc opc, NativeVectorReg reg1, const void *m
 void FASTCALL asmPALU(X86PALUopc opc, NativeVectorReg reg1, NativeVectorReg reg2);
 void FASTCALL asmPALU(X86PALUopc opc, NativeVectorReg reg1, const void *mem);
 
+void FASTCALL asmPALU38(X86PALU38opc opc, NativeVectorReg reg1, NativeVectorReg reg2);
+void FASTCALL asmPALU38(X86PALU38opc opc, NativeVectorReg reg1, const void *mem);
+void FASTCALL asmPALIGNR(NativeVectorReg reg1, NativeVectorReg reg2, int imm);
+void FASTCALL asmPShift(X86PShiftOpc opc, NativeVectorReg reg, int imm);
+
 void FASTCALL asmSHUFPS(NativeVectorReg reg1, NativeVectorReg reg2, int order);
 void FASTCALL asmSHUFPS(NativeVectorReg reg1, const void *mem, int order);
 void FASTCALL asmPSHUFD(NativeVectorReg reg1, NativeVectorReg reg2, int order);
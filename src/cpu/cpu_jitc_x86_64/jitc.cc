@@ -18,7 +18,9 @@
  *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#include <cstdio>
 #include <cstdlib>
+#include <cstddef>
 #include <cstring>
 
 #include "system/sysvm.h"
@@ -33,34 +35,54 @@
 #include "ppc_mmu.h"
 #include "ppc_tools.h"
 
-static TranslationCacheFragment *jitcAllocFragment(JITC &jitc);
+static void jitcNextGeneration(JITC &jitc, ClientPage *keep);
+static void jitcNewChunk(JITC &jitc, ClientPage *cp);
+static TranslationCacheChunk *jitcAddChunk(JITC &jitc, ClientPage *cp, NativeAddress base, uint32 size);
+
+extern PPC_CPU_State *gCPU;
 
 /*
  *	Intern
- *	Called whenever a new fragment is needed
- *	returns true if a new fragment was really necessary
- */
-static bool jitcEmitNextFragment(JITC &jitc)
-{
-	// save old
-	TranslationCacheFragment *tcf_old = jitc.currentPage->tcf_current;
-	NativeAddress tcp_old = jitc.currentPage->tcp;
-	// alloc new
-	jitc.currentPage->tcf_current = jitcAllocFragment(jitc);
-	jitc.currentPage->tcf_current->prev = tcf_old;
-	if (uint64(jitc.currentPage->tcf_current->base - jitc.currentPage->tcp) < 20) {
-		// next Fragment directly follows
-		jitc.currentPage->bytesLeft += FRAGMENT_SIZE;
-		return false;
-	} else {
-		jitc.currentPage->tcp = jitc.currentPage->tcf_current->base;
-		jitc.currentPage->bytesLeft = FRAGMENT_SIZE;
-		// hardcoded JMP from old to new fragment
-		// FIXME: use 0xeb if possible
-		tcp_old[0] = 0xe9;
-		*((uint32 *)&tcp_old[1]) = jitc.currentPage->tcp - (tcp_old+5);
+ *	Called whenever the current generation is full
+ *	while translating. Continues in the next generation.
+ *	returns true if the translation pointer has moved
+ */
+static bool jitcEmitNextGeneration(JITC &jitc)
+{
+	ClientPage *cp = jitc.currentPage;
+	if (jitc.traceTail && !jitc.traceLoop) {
+		// dry run of a trace, just start over
+		cp->tcp = jitc.traceStart;
+		cp->bytesLeft = jitc.traceBytesLeft;
+		jitc.traceOverflow = true;
 		return true;
 	}
+	NativeAddress tcp_old = cp->tcp;
+	// the jump belongs to the old chunk
+	NativeAddress oldBase = cp->chunks->base;
+	cp->chunks->size = tcp_old + 5 - oldBase;
+	jitc.arena_bytes += tcp_old + 5 - jitc.arenaHead;
+	jitc.arena_waste += cp->bytesLeft - 5;
+	uint32 oldGeneration = 1 << jitc.generation;
+	jitcNextGeneration(jitc, cp);
+	if (!cp->chunks) {
+		/*
+		 *	cp has been restarted, but the block being translated
+		 *	continues, so its beginning must stay with cp. Its relocs
+		 *	are gone, so cp can't be saved (see jitcSaveSnapshotPage).
+		 */
+		jitcAddChunk(jitc, cp, oldBase, tcp_old + 5 - oldBase);
+		cp->generations |= oldGeneration;
+		jitc.asmReloc(oldBase, relocPinned);
+	}
+	jitcNewChunk(jitc, cp);
+	// hardcoded JMP from old to new chunk
+	tcp_old[0] = 0xe9;
+	*((uint32 *)&tcp_old[1]) = cp->tcp - (tcp_old+5);
+	jitc.asmReloc(tcp_old+1);
+	jitc.arena_link++;
+	jitcDebugSplit(jitc, tcp_old + 5);
+	return true;
 }
 
 /*
@@ -68,13 +90,12 @@ static bool jitcEmitNextFragment(JITC &jitc)
  */
 void JITC::emit1(byte b)
 {
-	jitcDebugLogEmit(*this, &b, 1);
 	/*
 	 *	We always have to leave at least 5 bytes in the fragment
 	 *	to issue a final JMP
 	 */
 	if (currentPage->bytesLeft <= 5) {
-		jitcEmitNextFragment(*this);
+		jitcEmitNextGeneration(*this);
 	}
 	*(currentPage->tcp++) = b;
 	currentPage->bytesLeft--;
@@ -85,9 +106,8 @@ void JITC::emit1(byte b)
  */
 void JITC::emit(byte *instr, uint size)
 {
-	jitcDebugLogEmit(*this, instr, size);
 	if (int(currentPage->bytesLeft) - int(size) < 5) {
-		jitcEmitNextFragment(*this);
+		jitcEmitNextGeneration(*this);
 	}
 	memcpy(currentPage->tcp, instr, size);
 	currentPage->tcp += size;
@@ -101,7 +121,7 @@ void JITC::emit(byte *instr, uint size)
 bool JITC::emitAssure(uint size)
 {
 	if (int(currentPage->bytesLeft) - int(size) < 5) {
-		jitcEmitNextFragment(*this);
+		jitcEmitNextGeneration(*this);
 		return false;
 	}
 	return true;
@@ -114,7 +134,7 @@ static void jitcEmitAlign(JITC &jitc, uint align)
 		if (missalign) {
 			int bytes = align - missalign;
 			if (jitc.currentPage->bytesLeft - bytes < 5) {
-				if (jitcEmitNextFragment(jitc)) continue;
+				if (jitcEmitNextGeneration(jitc)) continue;
 			}
 			jitc.currentPage->tcp += bytes;
 			jitc.currentPage->bytesLeft -= bytes;
@@ -176,31 +196,197 @@ static ClientPage *jitcTouchClientPage(JITC &jitc, ClientPage *cp)
 }
 
 /*
- *	Puts fragments into the freeFragmentsList
+ *	Puts chunks into the freeChunks list
+ *	The code itself is reclaimed when its generation is recycled
+ */
+static void jitcDestroyChunks(JITC &jitc, TranslationCacheChunk *tcc)
+{
+	while (tcc) {
+		TranslationCacheChunk *next = tcc->prev;
+		tcc->prev = jitc.freeChunks;
+		jitc.freeChunks = tcc;
+		tcc = next;
+	}
+}
+
+#define U32(dest) (*(uint32 *)(void *)(dest))
+#define U64(dest) (*(uint64 *)(void *)(dest))
+
+/*
+ *	Layout of a chaining site, see jitcEmitChainedJump()
+ */
+#define CHAIN_EPOCH	2	// mov rax, epoch
+#define CHAIN_MODE	33	// cmp eax, mode
+#define CHAIN_BASE	46	// cmp dword [current_code_base], base
+#define CHAIN_DELTA	59	// add dword [current_code_base], delta
+#define CHAIN_TARGET	64	// jmp target
+#define CHAIN_SLOW	68	// mov eax, li
+#define CHAIN_SIZE	78	// up to and including the call
+
+#define CHAIN_MODE_MASK	(MSR_IR | MSR_PR)
+
+/*
+ *	Layout of an inline cache, see jitcEmitIndirectJump()
+ *	The epoch is at the same place as in a chaining site.
+ */
+#define IC_EPOCH	CHAIN_EPOCH	// mov rdx, epoch
+#define IC_MODE		35		// cmp edx, mode
+#define IC_EA0		42		// cmp eax, ea0
+#define IC_TARGET0	48		// je target0
+#define IC_EA1		53		// cmp eax, ea1
+#define IC_TARGET1	59		// je target1
+#define IC_SIZE		68		// up to and including the call
+
+#define IC_NONE		1		// never an aligned address
+
+/*
+ *	Intern.
+ *	Lets the site fall back to ppc_new_pc_chain_asm
+ *	(or ppc_new_pc_indirect_asm for an inline cache)
+ */
+static inline void jitcUnchainSite(NativeAddress site)
+{
+	// no valid epoch
+	U64(site + CHAIN_EPOCH) = uint64(-1);
+}
+
+/*
+ *	Unlinks all chained jumps into ClientPage
+ */
+static void jitcUnlinkClientPage(JITC &jitc, ClientPage *cp)
+{
+	ClientPageLink *l = cp->links;
+	while (l) {
+		ClientPageLink *next = l->next;
+		if (l->from->version == l->fromVersion) {
+			jitcUnchainSite(l->site);
+			jitc.chain_unlink++;
+		}
+		l->next = jitc.freeLinks;
+		jitc.freeLinks = l;
+		l = next;
+	}
+	cp->links = NULL;
+}
+
+/*
+ *	Puts stale links (whose site was destroyed) into freeLinks
+ */
+static void jitcSweepLinks(JITC &jitc)
+{
+	for (ClientPage *cp = jitc.LRUpage; cp; cp = cp->moreRU) {
+		ClientPageLink **p = &cp->links;
+		while (*p) {
+			ClientPageLink *l = *p;
+			if (l->from->version != l->fromVersion) {
+				*p = l->next;
+				l->next = jitc.freeLinks;
+				jitc.freeLinks = l;
+			} else {
+				p = &l->next;
+			}
+		}
+	}
+}
+
+/*
+ *	Makes sure the site in from gets unchained when to is destroyed.
+ *	Returns false if there are no links left.
+ */
+static bool jitcLinkSite(JITC &jitc, NativeAddress site, ClientPage *from, ClientPage *to)
+{
+	ClientPageLink *l;
+	for (l = to->links; l; l = l->next) {
+		if (l->site == site && l->from == from && l->fromVersion == from->version) return true;
+	}
+	if (!jitc.freeLinks) jitcSweepLinks(jitc);
+	if (!jitc.freeLinks) return false;
+	l = jitc.freeLinks;
+	jitc.freeLinks = l->next;
+	l->site = site;
+	l->from = from;
+	l->fromVersion = from->version;
+	l->next = to->links;
+	to->links = l;
+	return true;
+}
+
+/*
+ *	Patches the chaining site to jump directly to target
+ *	as long as epoch, mode and code base stay the same
+ */
+static void jitcChainSite(JITC &jitc, NativeAddress site, ClientPage *from, ClientPage *to, NativeAddress target, PPC_CPU_State &aCPU, uint32 base, uint64 epoch)
+{
+	if (!jitcLinkSite(jitc, site, from, to)) {
+		// site stays unchained
+		return;
+	}
+	U64(site + CHAIN_EPOCH) = epoch;
+	U32(site + CHAIN_MODE) = aCPU.msr & CHAIN_MODE_MASK;
+	U32(site + CHAIN_BASE) = base;
+	U32(site + CHAIN_TARGET) = target - (site + CHAIN_TARGET + 4);
+	jitc.chain_link++;
+}
+
+/*
+ *	Marks or unmarks baseaddr as containing translated code,
+ *	stores into it are checked against translatedLines then
+ */
+static void jitcSetTranslatedPage(JITC &jitc, uint32 baseaddr, bool translated)
+{
+	uint32 page = baseaddr >> 12;
+	if (translated) {
+		jitc.translatedPages[page >> 5] |= 1 << (page & 31);
+	} else {
+		jitc.translatedPages[page >> 5] &= ~(1 << (page & 31));
+	}
+	ppc_mmu_tlb_tag_code(*gCPU, baseaddr, translated);
+}
+
+static void jitcReleaseSnapshotPage(ClientPage *cp);
+
+/*
+ *	Puts the entrypoint blocks of cp into the freeEntrypoints list
+ */
+static void jitcDestroyEntrypoints(JITC &jitc, ClientPage *cp)
+{
+	for (int i=0; i < JITC_ENTRYPOINT_BLOCKS; i++) {
+		NativeAddress *block = cp->entrypoints[i];
+		if (block) {
+			block[0] = (NativeAddress)jitc.freeEntrypoints;
+			jitc.freeEntrypoints = block;
+			cp->entrypoints[i] = NULL;
+		}
+	}
+}
+
+/*
+ *	Empties the return stack (see ppc_new_pc_return_asm)
  */
-//#include <valgrind/valgrind.h>
-static void jitcDestroyFragments(JITC &jitc, TranslationCacheFragment *tcf)
+void jitcResetReturnStack(PPC_CPU_State &aCPU)
 {
-	// FIXME: this could be done in O(1) with an additional
-	// variable in ClientPage
-	while (tcf) {
-		//VALGRIND_DISCARD_TRANSLATIONS(tcf->base, FRAGMENT_SIZE);
-		TranslationCacheFragment *next = tcf->prev;
-		tcf->prev = jitc.freeFragmentsList;
-		jitc.freeFragmentsList = tcf;
-		tcf = next;
+	for (int i=0; i < PPC_RAS_SIZE; i++) {
+		aCPU.ras[i].ea = PPC_RAS_EMPTY;
 	}
 }
 
 /*
- *	Unmaps ClientPage and destroys fragments
+ *	Unmaps ClientPage and destroys its code
  */
 static void jitcDestroyClientPage(JITC &jitc, ClientPage *cp)
 {
-	// assert(cp->tcf_current)
-	jitcDestroyFragments(jitc, cp->tcf_current);
-	memset(cp->entrypoints, 0, sizeof cp->entrypoints);
-	cp->tcf_current = NULL;
+	// assert(cp->chunks)
+	cp->version++;
+	jitcUnlinkClientPage(jitc, cp);
+	// the return stack may point into the code
+	jitcResetReturnStack(*gCPU);
+	jitcDestroyChunks(jitc, cp->chunks);
+	jitcDestroyEntrypoints(jitc, cp);
+	cp->chunks = NULL;
+	cp->generations = 0;
+	if (cp->snapshot) jitcReleaseSnapshotPage(cp);
+	cp->relocCount = 0;
+	jitcSetTranslatedPage(jitc, cp->baseaddress, false);
 	jitcUnmapClientPage(jitc, cp);
 }
 
@@ -262,32 +448,131 @@ static void jitcDestroyAndTouchClientPage(JITC &jitc, ClientPage *cp)
 }
 
 /*
- *	Removes and returns fragment from top of freeFragmentsList
+ *	Intern.
+ *	Lets the arena start at start (the snapshot code is before it)
  */
-static TranslationCacheFragment *jitcGetFragment(JITC &jitc)
+static void jitcInitArena(JITC &jitc, NativeAddress start)
+{
+	NativeAddress end = jitc.translationCache + jitc.translationCacheSize;
+	jitc.arenaStart = start;
+	jitc.generationSize = (end - start) / JITC_GENERATIONS & ~63;
+	jitc.generation = 0;
+	jitc.arenaHead = start;
+}
+
+static inline NativeAddress jitcGenerationEnd(JITC &jitc)
 {
-	TranslationCacheFragment *tcf = jitc.freeFragmentsList;
-	jitc.freeFragmentsList = tcf->prev;
-	tcf->prev = NULL;
-	return tcf;
+	return jitc.arenaStart + (jitc.generation + 1) * jitc.generationSize;
 }
 
 /*
- *	Returns free fragment
- *	May destroy a page to make new free fragments
+ *	Intern.
+ *	Destroys the code of cp, which is being translated,
+ *	but keeps cp mapped and marked as translated
  */
-static TranslationCacheFragment *jitcAllocFragment(JITC &jitc)
+static void jitcRestartClientPage(JITC &jitc, ClientPage *cp)
 {
-	if (!jitc.freeFragmentsList) {
-		/*
-		 *	There are no free fragments
-		 *	-> must free a ClientPage
-		 */
-		jitc.destroy_write--;	// destroy and free will increase this
-		jitc.destroy_ootc++;
-		jitcDestroyAndFreeClientPage(jitc, jitc.LRUpage);
+	jitc.destroy_ootc++;
+	jitcDestroyClientPage(jitc, cp);
+	jitcMapClientPage(jitc, cp->baseaddress, cp);
+	jitcSetTranslatedPage(jitc, cp->baseaddress, true);
+}
+
+/*
+ *	Recycles the next generation and makes it the current one.
+ *	All pages with code in it are destroyed, except keep (the page
+ *	being translated). Generations containing code of keep are skipped.
+ *	If keep has code in all of them (e.g. a page which keeps being
+ *	retranslated), keep is destroyed as well and starts over,
+ *	callers must check its chunks.
+ */
+static void jitcNextGeneration(JITC &jitc, ClientPage *keep)
+{
+	for (int i=0; i < JITC_GENERATIONS; i++) {
+		jitc.generation = (jitc.generation + 1) % JITC_GENERATIONS;
+		uint32 mask = 1 << jitc.generation;
+		if (keep && (keep->generations & mask)) {
+			jitc.arena_skip++;
+			continue;
+		}
+		ClientPage *cp = jitc.LRUpage;
+		while (cp) {
+			ClientPage *next = cp->moreRU;
+			if (cp->generations & mask) {
+				jitc.destroy_ootc++;
+				jitcDestroyClientPage(jitc, cp);
+				jitcFreeClientPage(jitc, cp);
+			}
+			cp = next;
+		}
+		jitc.arenaHead = jitc.arenaStart + jitc.generation * jitc.generationSize;
+		jitc.arena_evict++;
+		return;
+	}
+	jitcRestartClientPage(jitc, keep);
+	jitcNextGeneration(jitc, keep);
+}
+
+/*
+ *	Intern.
+ *	Adds a chunk of code to cp
+ */
+static TranslationCacheChunk *jitcAddChunk(JITC &jitc, ClientPage *cp, NativeAddress base, uint32 size)
+{
+	TranslationCacheChunk *tcc = jitc.freeChunks;
+	if (!tcc) {
+		tcc = ppc_malloc(sizeof (TranslationCacheChunk));
+	} else {
+		jitc.freeChunks = tcc->prev;
 	}
-	return jitcGetFragment(jitc);
+	tcc->base = base;
+	tcc->size = size;
+	tcc->prev = cp->chunks;
+	cp->chunks = tcc;
+	return tcc;
+}
+
+/*
+ *	Intern.
+ *	Starts a new chunk of code of cp at arenaHead
+ */
+static void jitcNewChunk(JITC &jitc, ClientPage *cp)
+{
+	jitcAddChunk(jitc, cp, jitc.arenaHead, 0);
+	cp->generations |= 1 << jitc.generation;
+	cp->tcp = jitc.arenaHead;
+	cp->bytesLeft = jitcGenerationEnd(jitc) - jitc.arenaHead;
+}
+
+/*
+ *	Intern.
+ *	Called before translating code of cp. Code is appended
+ *	to the last chunk of cp if it ends at arenaHead.
+ */
+static void jitcOpenChunk(JITC &jitc, ClientPage *cp, uint32 min = JITC_CHUNK_MIN)
+{
+	if (jitcGenerationEnd(jitc) - jitc.arenaHead < min) {
+		jitc.arena_waste += jitcGenerationEnd(jitc) - jitc.arenaHead;
+		jitcNextGeneration(jitc, cp);
+	}
+	TranslationCacheChunk *tcc = cp->chunks;
+	if (tcc && tcc->base + tcc->size == jitc.arenaHead) {
+		cp->tcp = jitc.arenaHead;
+		cp->bytesLeft = jitcGenerationEnd(jitc) - jitc.arenaHead;
+	} else {
+		jitcNewChunk(jitc, cp);
+	}
+}
+
+/*
+ *	Intern.
+ *	Called after translating code of cp
+ */
+static void jitcCloseChunk(JITC &jitc, ClientPage *cp)
+{
+	cp->chunks->size = cp->tcp - cp->chunks->base;
+	jitc.arena_bytes += cp->tcp - jitc.arenaHead;
+	jitc.arenaHead = cp->tcp;
 }
 
 /*
@@ -338,42 +623,55 @@ static ClientPage *jitcGetOrCreateClientPage(JITC &jitc, uint32 baseaddr)
 	}
 }
 
-static inline void jitcCreateEntrypoint(ClientPage *cp, uint32 ofs)
+static void jitcSetEntrypoint(JITC &jitc, ClientPage *cp, uint32 ofs, NativeAddress entry)
+{
+	NativeAddress *&block = cp->entrypoints[ofs / (JITC_ENTRYPOINT_BLOCK*4)];
+	if (!block) {
+		if (jitc.freeEntrypoints) {
+			block = jitc.freeEntrypoints;
+			jitc.freeEntrypoints = (NativeAddress *)block[0];
+		} else {
+			block = (NativeAddress *)ppc_malloc(JITC_ENTRYPOINT_BLOCK * sizeof (NativeAddress));
+		}
+		memset(block, 0, JITC_ENTRYPOINT_BLOCK * sizeof (NativeAddress));
+	}
+	block[(ofs >> 2) % JITC_ENTRYPOINT_BLOCK] = entry;
+}
+
+static inline void jitcCreateEntrypoint(JITC &jitc, ClientPage *cp, uint32 ofs)
 {
-	cp->entrypoints[ofs >> 2] = cp->tcp;
+	jitcSetEntrypoint(jitc, cp, ofs, cp->tcp);
 }
 
 static inline NativeAddress jitcGetEntrypoint(ClientPage *cp, uint32 ofs)
 {
-	return cp->entrypoints[ofs >> 2];
+	NativeAddress *block = cp->entrypoints[ofs / (JITC_ENTRYPOINT_BLOCK*4)];
+	return block ? block[(ofs >> 2) % JITC_ENTRYPOINT_BLOCK] : NULL;
 }
 
-extern uint64 jitcCompileTicks;
-extern uint64 jitcRunTicks;
-extern uint64 jitcRunTicksStart;
+/*
+ *	Must be called before the code is read: either jitcInvalidateDMA
+ *	sees the line or we see what the DMA has written
+ */
+static inline void jitcMarkTranslatedLine(ClientPage *cp, uint32 ofs)
+{
+	uint32 line = ofs / JITC_CODE_LINE_SIZE;
+	uint32 bit = 1 << (line & 31);
+	if (!(cp->translatedLines[line >> 5] & bit)) {
+		__atomic_fetch_or(&cp->translatedLines[line >> 5], bit, __ATOMIC_SEQ_CST);
+	}
+}
 
 extern JITC *gJITC;
 
-#define U32(dest) (*(uint32 *)(void *)(dest))
-static NativeAddress jitcNewEntrypoint(JITC &jitc, ClientPage *cp, uint32 baseaddr, uint32 ofs)
-{
 /*
-	jitcRunTicks += jitcDebugGetTicks() - jitcRunTicksStart;
-	uint64 jitcCompileStartTicks = jitcDebugGetTicks();
-*/
-	jitcDebugLogAdd("=== jitcNewEntrypoint: %08x Beginning jitc ===\n", baseaddr+ofs);
-	jitc.currentPage = cp;
-	
-	jitcEmitAlign(jitc, jitc.hostCPUCaps.loop_align);
-
-	NativeAddress entry = cp->tcp;
-	jitcCreateEntrypoint(cp, ofs);
-
-	byte *physpage;
-	ppc_direct_physical_memory_handle(baseaddr, physpage);
-
+ *	Intern.
+ *	Translates the client code at ofs until the end of the block
+ *	(or the end of the page)
+ */
+static void jitcTranslate(JITC &jitc, ClientPage *cp, byte *physpage, uint32 ofs)
+{
 	jitc.pc = ofs;
-        jitc.invalidateAll();
 	jitc.checkedPriviledge = false;
 	jitc.checkedFloat = false;
 	jitc.checkedVector = false;
@@ -383,8 +681,10 @@ static NativeAddress jitcNewEntrypoint(JITC &jitc, ClientPage *cp, uint32 basead
 	byte instr[8] = {0x48, 0x3b, 0x3c, 0x25};
 	U32(instr + 4) = uint32(uint64(&gJITC));
 	while (1) {
+		jitcMarkTranslatedLine(cp, ofs);
 		jitc.current_opc = ppc_word_from_BE(*(uint32 *)&physpage[ofs]);
-		jitcDebugLogNewInstruction(jitc);
+		jitcDebugInstruction(jitc);
+		jitc.translate_insns++;
 		
 //		jitc.clobberAll();
 //		jitc.clobberCarryAndFlags();
@@ -401,7 +701,20 @@ static NativeAddress jitcNewEntrypoint(JITC &jitc, ClientPage *cp, uint32 basead
 #endif
 		// >>
 		
+		if (jitc.flagsMapped() && jitc.getFlagsMapping() != PPC_CR0
+		 && PPC_OPC_MAIN(jitc.current_opc) != 16) {
+			/*
+			 *	Flags of compares into crX are only kept for a
+			 *	following bc. Record forms may overwrite the flags
+			 *	without flushing them, since they expect cr0.
+			 */
+			jitc.clobberFlags();
+		}
 		JITCFlow flow = ppc_gen_opc(jitc);
+		if (jitc.traceTail && !jitc.traceLoop && ofs == jitc.traceTail) {
+			// dry run of a trace, we're only interested in the loop
+			break;
+		}
 		if (flow == flowContinue) {
 			/* nothing to do */
 		} else if (flow == flowEndBlock) {
@@ -410,8 +723,8 @@ static NativeAddress jitcNewEntrypoint(JITC &jitc, ClientPage *cp, uint32 basead
 			jitc.checkedPriviledge = false;
 			jitc.checkedFloat = false;
 			jitc.checkedVector = false;
-			if (ofs+4 < 4096) {
-				jitcCreateEntrypoint(cp, ofs+4);
+			if (ofs+4 < 4096 && (!jitc.traceTail || jitc.traceLoop)) {
+				jitcCreateEntrypoint(jitc, cp, ofs+4);
 			}
 		} else {
 			/* flowEndBlockUnreachable */
@@ -422,31 +735,220 @@ static NativeAddress jitcNewEntrypoint(JITC &jitc, ClientPage *cp, uint32 basead
 			/*
 			 *	End of page.
 			 *	We must use jump to the next page via 
-			 *	ppc_new_pc_asm
+			 *	a chaining site
 			 */
 			jitc.clobberAll();
-			jitc.asmALU32(X86_MOV, RAX, 4096);
-			jitc.asmJMP((NativeAddress)ppc_new_pc_rel_asm);
+			jitcEmitChainedJump(jitc, 4096);
 			break;
 		}
 		jitc.pc += 4;
 	}
+}
+
+static NativeAddress jitcNewEntrypoint(JITC &jitc, ClientPage *cp, uint32 baseaddr, uint32 ofs)
+{
+	uint64 startTicks = jitcDebugGetTicks();
+	jitc.currentPage = cp;
+	jitcOpenChunk(jitc, cp);
+	
+	jitcEmitAlign(jitc, jitc.hostCPUCaps.loop_align);
+
+	NativeAddress entry = cp->tcp;
+	jitcDebugBegin(jitc, baseaddr + ofs);
+	jitcCreateEntrypoint(jitc, cp, ofs);
+
+	byte *physpage;
+	ppc_direct_physical_memory_handle(baseaddr, physpage);
+
+        jitc.invalidateAll();
+	jitcTranslate(jitc, cp, physpage, ofs);
+	jitcDebugEnd(jitc);
+	jitcCloseChunk(jitc, cp);
+	jitc.translate_blocks++;
+	jitc.translate_ticks += jitcDebugGetTicks() - startTicks;
+	return entry;
+}
+
 /*
-	jitcRunTicksStart = jitcDebugGetTicks();
-	jitcCompileTicks += jitcDebugGetTicks() - jitcCompileStartTicks;	
-*/
+ *	Hot loops
+ *
+ *	A loop is translated like any other code, so every iteration
+ *	goes through the heartbeat and the (patched) jump to the entrypoint
+ *	of its head, which starts with no registers mapped. Once the
+ *	backward branch tail of a loop is taken often enough, the loop is
+ *	translated again as a trace starting at head:
+ *
+ *	The trace loads the registers which are mapped at its backward
+ *	branch, so the branch can jump right behind these loads (if no
+ *	exception is pending) and the registers stay in host registers
+ *	around the loop. Dirty registers are only written back when the
+ *	loop is left (e.g. a bdnz loop keeps ctr in a host register).
+ *	The registers mapped (and dirty) at the branch are found by
+ *	translating the loop (without keeping the code) until the mapping
+ *	at the branch is the same as at the head.
+ */
+static NativeAddress jitcNewTrace(JITC &jitc, ClientPage *cp, uint32 baseaddr, uint32 head, uint32 tail)
+{
+	uint64 startTicks = jitcDebugGetTicks();
+	jitc.currentPage = cp;
+	// the dry runs must fit into the current generation
+	jitcOpenChunk(jitc, cp, MIN(JITC_TRACE_MAX * 64U, jitc.generationSize));
+	jitcEmitAlign(jitc, jitc.hostCPUCaps.loop_align);
+
+	byte *physpage;
+	ppc_direct_physical_memory_handle(baseaddr, physpage);
+
+	jitc.traceHead = head;
+	jitc.traceTail = tail;
+	jitc.traceLoop = NULL;
+	jitc.traceStart = cp->tcp;
+	jitc.traceBytesLeft = cp->bytesLeft;
+	uint relocCount = cp->relocCount;
+
+	jitc.invalidateAll();
+	jitc.getRegisterState(jitc.traceState);
+	bool ok = false;
+	for (int pass=0; pass < JITC_TRACE_PASSES; pass++) {
+		jitc.traceReached = false;
+		jitc.traceOverflow = false;
+		jitc.setRegisterState(jitc.traceState, false);
+		jitcTranslate(jitc, cp, physpage, head);
+		cp->tcp = jitc.traceStart;
+		cp->bytesLeft = jitc.traceBytesLeft;
+		cp->relocCount = relocCount;
+		if (!jitc.traceReached || jitc.traceOverflow) break;
+		if (memcmp(&jitc.traceEndState, &jitc.traceState, sizeof jitc.traceState) == 0) {
+			ok = true;
+			break;
+		}
+		jitc.traceState = jitc.traceEndState;
+	}
+
+	NativeAddress entry = NULL;
+	if (ok) {
+		entry = cp->tcp;
+		jitcSetEntrypoint(jitc, cp, head, entry);
+		jitcDebugBegin(jitc, baseaddr + head, JITC_DEBUG_BLOCK_TRACE);
+		jitc.setRegisterState(jitc.traceState, true);
+		int align = jitc.hostCPUCaps.loop_align;
+		if (align > 1) {
+			int missalign = uint64(cp->tcp) % align;
+			if (missalign) jitc.asmNOP(align - missalign);
+		}
+		jitc.traceLoop = jitc.asmHERE();
+		jitcTranslate(jitc, cp, physpage, head);
+		jitcDebugEnd(jitc);
+		jitc.trace_built++;
+	} else {
+		jitc.trace_fail++;
+	}
+	jitc.traceTail = 0;
+	jitc.traceLoop = NULL;
+	jitcCloseChunk(jitc, cp);
+	jitc.translate_blocks++;
+	jitc.translate_ticks += jitcDebugGetTicks() - startTicks;
 	return entry;
 }
 
+/*
+ *	Called by ppc_opc_gen_set_pc_rel for the backward branch of a trace
+ *	(see jitcNewTrace). The dirty registers are written back behind
+ *	the jump to the loop, i.e. only when the loop is left.
+ */
+void jitcEmitTraceBackEdge(JITC &jitc)
+{
+	if (!jitc.traceLoop) {
+		jitc.getRegisterState(jitc.traceEndState);
+		jitc.traceReached = true;
+	} else {
+		JITCRegisterState state;
+		jitc.getRegisterState(state);
+		if (memcmp(&state, &jitc.traceState, sizeof state) == 0) {
+			jitc.asmALU8(X86_TEST, curCPU(exception_pending), 1);
+			jitc.asmJxx(X86_Z, jitc.traceLoop);
+			jitc.trace_loop++;
+		}
+	}
+	jitc.flushRegisterDirty();
+}
+
+static bool jitcUseSnapshotPage(JITC &jitc, ClientPage *cp, uint32 baseaddr);
+
 extern "C" NativeAddress jitcStartTranslation(JITC &jitc, ClientPage *cp, uint32 baseaddr, uint32 ofs)
 {
-	cp->tcf_current = jitcAllocFragment(jitc);
-	cp->tcp = cp->tcf_current->base;
-	cp->bytesLeft = FRAGMENT_SIZE;
-	
+	memset(cp->translatedLines, 0, sizeof cp->translatedLines);
+	jitcSetTranslatedPage(jitc, baseaddr, true);
+
+	if (jitc.snapshotCount && jitcUseSnapshotPage(jitc, cp, baseaddr)) {
+		NativeAddress entry = jitcGetEntrypoint(cp, ofs);
+		if (entry) return entry;
+	}
 	return jitcNewEntrypoint(jitc, cp, baseaddr, ofs);
 }
 
+/*
+ *	Destroys the pages marked by jitcInvalidateDMA
+ */
+static void jitcDestroyDirtyPages(JITC &jitc)
+{
+	__atomic_store_n(&jitc.dirtyPending, false, __ATOMIC_RELAXED);
+	uint words = (gMemorySize / 4096 + 31) / 32;
+	for (uint i=0; i < words; i++) {
+		if (!jitc.dirtyPages[i]) continue;
+		uint32 bits = __sync_fetch_and_and(&jitc.dirtyPages[i], 0);
+		while (bits) {
+			int b = __builtin_ctz(bits);
+			bits &= bits - 1;
+			ClientPage *cp = jitc.clientPages[i*32 + b];
+			if (cp) {
+				jitc.destroy_write--;	// destroy and free will increase this
+				jitc.destroy_dma++;
+				jitcDestroyAndFreeClientPage(jitc, cp);
+			}
+		}
+	}
+}
+
+/*
+ *	Called by ppc_dma_write and ppc_dma_set, possibly from another
+ *	thread. Marks all pages with translated lines in pa..pa+size-1
+ *	to be destroyed by the cpu thread.
+ */
+void jitcInvalidateDMA(JITC &jitc, uint32 pa, uint32 size)
+{
+	if (!size) return;
+	uint32 end = pa + size - 1;
+	bool dirty = false;
+	/*
+	 *	Pairs with jitcMarkTranslatedLine. ClientPages are never
+	 *	freed, so a page which is reused meanwhile at worst
+	 *	gets destroyed needlessly.
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (uint32 page = pa >> 12; page <= (end >> 12); page++) {
+		if (!(__atomic_load_n(&jitc.translatedPages[page >> 5], __ATOMIC_RELAXED) & (1 << (page & 31)))) continue;
+		ClientPage *cp = __atomic_load_n(&jitc.clientPages[page], __ATOMIC_RELAXED);
+		if (!cp) continue;
+		uint32 first = (page == (pa >> 12)) ? (pa & 0xfff) : 0;
+		uint32 last = (page == (end >> 12)) ? (end & 0xfff) : 0xfff;
+		for (uint32 line = first / JITC_CODE_LINE_SIZE; line <= last / JITC_CODE_LINE_SIZE; line++) {
+			if (__atomic_load_n(&cp->translatedLines[line >> 5], __ATOMIC_RELAXED) & (1 << (line & 31))) {
+				__sync_fetch_and_or(&jitc.dirtyPages[page >> 5], 1 << (page & 31));
+				dirty = true;
+				break;
+			}
+		}
+	}
+	if (dirty) {
+		__atomic_store_n(&jitc.dirtyPending, true, __ATOMIC_RELEASE);
+		/*
+		 *	Make chained jumps go through jitcNewPC. Whoever
+		 *	sees the new epoch also sees dirtyPending.
+		 */
+		__atomic_fetch_add(&gCPU->chain_epoch, 1, __ATOMIC_RELEASE);
+	}
+}
+
 /*
  *	Called whenever the client PC changes (to a new BB)
  *	Note that entry is a physical address
@@ -457,10 +959,13 @@ extern "C" NativeAddress jitcNewPC(JITC &jitc, uint32 entry)
 		ht_printf("entry not physical: %08x\n", entry);
 		exit(-1);
 	}
+	if (__atomic_load_n(&jitc.dirtyPending, __ATOMIC_ACQUIRE)) {
+		jitcDestroyDirtyPages(jitc);
+	}
 	uint32 baseaddr = entry & 0xfffff000;
 	ClientPage *cp = jitcGetOrCreateClientPage(jitc, baseaddr);
 	jitcTouchClientPage(jitc, cp);
-	if (!cp->tcf_current) {
+	if (!cp->chunks) {
 		return jitcStartTranslation(jitc, cp, baseaddr, entry & 0xfff);
 	} else {
 		NativeAddress ofs = jitcGetEntrypoint(cp, entry & 0xfff);
@@ -472,6 +977,794 @@ extern "C" NativeAddress jitcNewPC(JITC &jitc, uint32 entry)
 	}
 }
 
+/*
+ *	Intern.
+ *	Patches an in-page jump site to jump directly to target
+ */
+static inline void jitcPatchSite(NativeAddress site, NativeAddress target)
+{
+	site[0] = 0xe9;
+	U32(site + 1) = target - (site + 5);
+}
+
+/*
+ *	Intern.
+ *	Returns the counter of site (in cp, jumping to target). A new
+ *	site replaces the one with the lowest count in its set, the
+ *	others age a little, so sites which have gone cold (or were
+ *	destroyed) don't stay forever. The replaced site is patched to
+ *	its plain target, so every site is patched eventually.
+ */
+static JITCHotSite &jitcHotSite(JITC &jitc, NativeAddress site, ClientPage *cp, NativeAddress target)
+{
+	JITCHotSite *set = jitc.hotSites[(uint64(site) >> 2) % JITC_HOT_SETS];
+	int victim = 0;
+	for (int i=0; i < JITC_HOT_WAYS; i++) {
+		if (set[i].site == site) {
+			victim = i;
+			// the code may be new
+			if (set[i].page == cp && set[i].version == cp->version) return set[i];
+			break;
+		}
+		if (set[i].count < set[victim].count) victim = i;
+	}
+	JITCHotSite &h = set[victim];
+	if (h.site != site) {
+		for (int i=0; i < JITC_HOT_WAYS; i++) {
+			if (set[i].count) set[i].count--;
+		}
+		if (h.site && h.page->version == h.version) {
+			jitcPatchSite(h.site, h.target);
+		}
+	}
+	h.site = site;
+	h.target = target;
+	h.page = cp;
+	h.version = cp->version;
+	h.count = 0;
+	return h;
+}
+
+/*
+ *	Called by ppc_new_pc_this_page_asm when an in-page jump site
+ *	isn't patched (yet). ret is the return address of its call.
+ *	Note that entry is a physical address
+ *
+ *	The site is patched to jump directly to the target, but
+ *	backward branches are only patched after they have been taken
+ *	traceThreshold times, and then to a trace of their loop
+ *	(or when they are evicted from the hot sites before).
+ */
+extern "C" NativeAddress jitcNewPCThisPage(JITC &jitc, uint32 entry, NativeAddress ret)
+{
+	NativeAddress site = ret - 10;
+	uint32 tail = U32(ret);
+	uint32 head = entry & 0xfff;
+	ClientPage *cp = jitc.clientPages[entry >> 12];
+	uint version = cp ? cp->version : 0;
+	NativeAddress target = jitcNewPC(jitc, entry);
+	/*
+	 *	The site is in the same page as the target,
+	 *	it may have been destroyed by jitcNewPC
+	 */
+	if (!cp || cp->version != version) return target;
+	if (jitc.traceThreshold && !(tail & JITC_SITE_NO_TRACE)
+	 && head <= tail && tail && tail - head < JITC_TRACE_MAX) {
+		JITCHotSite &h = jitcHotSite(jitc, site, cp, target);
+		if (++h.count < jitc.traceThreshold) return target;
+		h.site = NULL;
+		h.count = 0;
+		jitc.trace_hot++;
+		NativeAddress trace = jitcNewTrace(jitc, cp, entry & 0xfffff000, head, tail);
+		// cp may have been restarted (see jitcNextGeneration)
+		if (cp->version != version) return jitcNewPC(jitc, entry);
+		if (trace) target = trace;
+	}
+	jitcPatchSite(site, target);
+	return target;
+}
+
+/*
+ *	Emits a jump to a client address outside of the current page
+ *	(li is relative to the current page).
+ *
+ *	The jump first goes through ppc_new_pc_chain_asm, which
+ *	patches it to jump directly into the translated target.
+ *	The direct jump is only taken if chain_epoch, MSR[IR,PR]
+ *	and current_code_base are the same as when it was patched,
+ *	otherwise it falls back to ppc_new_pc_chain_asm again.
+ */
+void jitcEmitChainedJump(JITC &jitc, uint32 li)
+{
+	jitc.asmMOV32_NoFlags(RAX, li);
+	jitc.asmCALL((NativeAddress)ppc_heartbeat_ext_rel_asm);
+
+	byte instr[CHAIN_SIZE-5] = {
+		0x48, 0xb8, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,	// mov rax, epoch
+		0x48, 0x39, 0x84, 0x24, 0, 0, 0, 0,		// cmp [chain_epoch], rax
+		0x75, CHAIN_SLOW-20,				// jne slow
+		0x8b, 0x84, 0x24, 0, 0, 0, 0,			// mov eax, [msr]
+		0x25, 0, 0, 0, 0,				// and eax, CHAIN_MODE_MASK
+		0x3d, 0, 0, 0, 0,				// cmp eax, mode
+		0x75, CHAIN_SLOW-39,				// jne slow
+		0x81, 0xbc, 0x24, 0, 0, 0, 0, 0, 0, 0, 0,	// cmp dword [current_code_base], base
+		0x75, CHAIN_SLOW-52,				// jne slow
+		0x81, 0x84, 0x24, 0, 0, 0, 0, 0, 0, 0, 0,	// add dword [current_code_base], delta
+		0xe9, 0, 0, 0, 0,				// jmp target
+		0xb8, 0, 0, 0, 0,				// slow: mov eax, li
+	};
+	U32(instr + 14) = uint32(RSP_OFFSET + offsetof(PPC_CPU_State, chain_epoch));
+	U32(instr + 23) = uint32(RSP_OFFSET + offsetof(PPC_CPU_State, msr));
+	U32(instr + 28) = CHAIN_MODE_MASK;
+	U32(instr + 42) = uint32(RSP_OFFSET + offsetof(PPC_CPU_State, current_code_base));
+	U32(instr + 55) = uint32(RSP_OFFSET + offsetof(PPC_CPU_State, current_code_base));
+	U32(instr + CHAIN_DELTA) = li & 0xfffff000;
+	U32(instr + CHAIN_SLOW + 1) = li;
+
+	/*
+	 *	The site, the call and the page pointer
+	 *	must not be split
+	 */
+	jitc.emitAssure(CHAIN_SIZE + 8);
+	jitc.emit(instr, sizeof instr);
+	jitc.asmReloc(jitc.currentPage->tcp - sizeof instr, relocChain);
+	jitc.asmCALL((NativeAddress)ppc_new_pc_chain_asm);
+	ClientPage *cp = jitc.currentPage;
+	jitc.emit((byte *)&cp, sizeof cp);
+}
+
+/*
+ *	Called by ppc_new_pc_chain_asm when a chaining site
+ *	isn't chained (yet). ret is the return address of its call.
+ *	Note that entry is a physical address
+ */
+extern "C" NativeAddress jitcNewPCChained(JITC &jitc, uint32 entry, NativeAddress ret, PPC_CPU_State &aCPU)
+{
+	NativeAddress site = ret - CHAIN_SIZE;
+	ClientPage *from = *(ClientPage **)ret;
+	uint version = from->version;
+	uint32 base = aCPU.current_code_base;
+	// before jitcNewPC, see jitcInvalidateDMA
+	uint64 epoch = __atomic_load_n(&aCPU.chain_epoch, __ATOMIC_ACQUIRE);
+
+	aCPU.current_code_base = base + U32(site + CHAIN_DELTA);
+	NativeAddress target = jitcNewPC(jitc, entry);
+	/*
+	 *	Translating the target may have destroyed
+	 *	the page containing the site
+	 */
+	if (from->version == version) {
+		jitcChainSite(jitc, site, from, jitc.clientPages[entry >> 12], target, aCPU, base, epoch);
+	}
+	return target;
+}
+
+/*
+ *	Emits a jump to the client address in eax (bctr).
+ *
+ *	The last two targets are cached in the site, for the same
+ *	chain_epoch and MSR[IR,PR]. Misses go through
+ *	ppc_new_pc_indirect_asm, which fills the cache. Like a chaining
+ *	site, the cache is emptied (by an invalid epoch) when the page
+ *	of one of the targets is destroyed.
+ */
+void jitcEmitIndirectJump(JITC &jitc)
+{
+	jitc.asmCALL((NativeAddress)ppc_heartbeat_ext_asm);
+
+	byte instr[IC_SIZE-5] = {
+		0x48, 0xba, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,	// mov rdx, epoch
+		0x48, 0x39, 0x94, 0x24, 0, 0, 0, 0,		// cmp [chain_epoch], rdx
+		0x75, IC_SIZE-5-20,				// jne slow
+		0x8b, 0x94, 0x24, 0, 0, 0, 0,			// mov edx, [msr]
+		0x81, 0xe2, 0, 0, 0, 0,				// and edx, CHAIN_MODE_MASK
+		0x81, 0xfa, 0, 0, 0, 0,				// cmp edx, mode
+		0x75, IC_SIZE-5-41,				// jne slow
+		0x3d, IC_NONE, 0, 0, 0,				// cmp eax, ea0
+		0x0f, 0x84, 0, 0, 0, 0,				// je target0
+		0x3d, IC_NONE, 0, 0, 0,				// cmp eax, ea1
+		0x0f, 0x84, 0, 0, 0, 0,				// je target1
+	};
+	U32(instr + 14) = uint32(RSP_OFFSET + offsetof(PPC_CPU_State, chain_epoch));
+	U32(instr + 23) = uint32(RSP_OFFSET + offsetof(PPC_CPU_State, msr));
+	U32(instr + 29) = CHAIN_MODE_MASK;
+
+	/*
+	 *	The site, the call and the page pointer
+	 *	must not be split
+	 */
+	jitc.emitAssure(IC_SIZE + 8);
+	jitc.emit(instr, sizeof instr);
+	jitc.asmReloc(jitc.currentPage->tcp - sizeof instr, relocIndirect);
+	// slow:
+	jitc.asmCALL((NativeAddress)ppc_new_pc_indirect_asm);
+	ClientPage *cp = jitc.currentPage;
+	jitc.emit((byte *)&cp, sizeof cp);
+}
+
+/*
+ *	Called by ppc_new_pc_indirect_asm on a miss of an inline cache.
+ *	ret is the return address of its call.
+ *	Note that entry is a physical address
+ */
+extern "C" NativeAddress jitcNewPCIndirect(JITC &jitc, uint32 entry, NativeAddress ret, PPC_CPU_State &aCPU)
+{
+	NativeAddress site = ret - IC_SIZE;
+	ClientPage *from = *(ClientPage **)ret;
+	uint version = from->version;
+	// set by the heartbeat
+	uint32 ea = aCPU.current_code_base | (entry & 0xfff);
+	// before jitcNewPC, see jitcInvalidateDMA
+	uint64 epoch = __atomic_load_n(&aCPU.chain_epoch, __ATOMIC_ACQUIRE);
+
+	NativeAddress target = jitcNewPC(jitc, entry);
+	if (from->version != version
+	 || !jitcLinkSite(jitc, site, from, jitc.clientPages[entry >> 12])) {
+		return target;
+	}
+	uint32 mode = aCPU.msr & CHAIN_MODE_MASK;
+	if (U64(site + IC_EPOCH) == epoch && U32(site + IC_MODE) == mode) {
+		// the previous target becomes the second one
+		NativeAddress target0 = site + IC_TARGET0 + 4 + sint32(U32(site + IC_TARGET0));
+		U32(site + IC_EA1) = U32(site + IC_EA0);
+		U32(site + IC_TARGET1) = target0 - (site + IC_TARGET1 + 4);
+	} else {
+		U64(site + IC_EPOCH) = epoch;
+		U32(site + IC_MODE) = mode;
+		U32(site + IC_EA1) = IC_NONE;
+	}
+	U32(site + IC_EA0) = ea;
+	U32(site + IC_TARGET0) = target - (site + IC_TARGET0 + 4);
+	jitc.indirect_fill++;
+	return target;
+}
+
+/*
+ *	Translation snapshot
+ *
+ *	When the client stops, the translated code of all pages is
+ *	written to the snapshot file. At the next start it is loaded
+ *	into the beginning of the translation cache. Whenever a page is
+ *	translated for the first time, it is looked up there by a hash
+ *	of its (physical) contents, so code which is loaded again (e.g.
+ *	after rebooting the client) doesn't have to be translated again.
+ *
+ *	Translated code isn't position independent, so all rel32 calls
+ *	and jumps, all chaining sites and inline caches are recorded while emitting
+ *	(see JITC::asmReloc). Calls into the emulator are stored relative
+ *	to jitcNewPC, which is enough to survive address space layout
+ *	randomization but not a rebuild (see JITCSnapshotHeader::anchors).
+ *
+ *	The translation doesn't depend on the MSR (privilege and FPU
+ *	checks are emitted as code), so the contents are the only key.
+ */
+#define SNAPSHOT_MAGIC		"PPCJITC4"
+#define SNAPSHOT_ALIGN		64
+
+struct JITCSnapshotHeader {
+	char magic[8];
+	uint32 align;
+	uint32 cpuStateSize;
+	uint32 caps;
+	uint32 pageCount;
+	/*
+	 *	Offsets of some functions of different object files
+	 *	to jitcNewPC. If they differ, the emulator was rebuilt.
+	 */
+	sint64 anchors[4];
+};
+
+struct JITCSnapshotPageHeader {
+	uint64 hash;
+	uint32 codeSize;
+	uint32 relocCount;
+	uint32 chainCount;
+	uint32 indirectCount;
+	uint32 translatedLines[4096 / JITC_CODE_LINE_SIZE / 32];
+	uint32 entrypoints[1024];	// offset into code + 1, 0 if none
+	/*
+	 *	followed by:
+	 *	byte contents[4096];
+	 *	JITCSnapshotReloc relocs[relocCount];
+	 *	uint32 chains[chainCount];
+	 *	uint32 indirects[indirectCount];
+	 *	byte code[codeSize];
+	 *	padded to 8 bytes
+	 */
+};
+
+enum JITCSnapshotRelocKind {
+	snapshotInternal,	// target is in the code of the page
+	snapshotExternal,	// target is relative to jitcNewPC
+	snapshotPatch,		// an unpatched in-page jump site
+};
+
+struct JITCSnapshotReloc {
+	uint32 site;		// offset into code
+	uint32 kind;		// JITCSnapshotRelocKind
+	sint64 target;		// relative to jitcNewPC if external
+};
+
+struct JITCSnapshotPage {
+	uint64 hash;
+	JITCSnapshotPageHeader *header;
+	byte *contents;
+	JITCSnapshotReloc *relocs;
+	uint32 *chains;
+	uint32 *indirects;
+	NativeAddress code;
+	ClientPage *owner;	// NULL if unused
+};
+
+/*
+ *	Intern.
+ *	A segment of the code of a page to be saved
+ */
+struct JITCSnapshotSegment {
+	NativeAddress base;
+	uint32 size;
+	uint32 ofs;		// in the saved code
+};
+
+#define SNAPSHOT_ANCHOR	((NativeAddress)jitcNewPC)
+
+static void jitcSnapshotHeader(JITC &jitc, JITCSnapshotHeader &h)
+{
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, SNAPSHOT_MAGIC, sizeof h.magic);
+	h.align = SNAPSHOT_ALIGN;
+	h.cpuStateSize = sizeof (PPC_CPU_State);
+	h.caps = jitc.hostCPUCaps.sse3 | (jitc.hostCPUCaps.ssse3 << 1)
+		| (jitc.hostCPUCaps.sse4 << 2) | (jitc.hostCPUCaps._3dnow << 3)
+		| (jitc.hostCPUCaps._3dnow2 << 4) | (jitc.hostCPUCaps.fma << 5)
+		| (jitc.hostCPUCaps.loop_align << 8);
+	h.anchors[0] = (NativeAddress)ppc_new_pc_asm - SNAPSHOT_ANCHOR;
+	h.anchors[1] = (NativeAddress)ppc_read_effective_word_asm - SNAPSHOT_ANCHOR;
+	h.anchors[2] = (NativeAddress)ppc_gen_opc - SNAPSHOT_ANCHOR;
+	h.anchors[3] = (NativeAddress)jitcEmitChainedJump - SNAPSHOT_ANCHOR;
+}
+
+static uint64 jitcSnapshotHash(const byte *page)
+{
+	// FNV-1a, 64 bits at a time
+	uint64 h = 0xcbf29ce484222325ULL;
+	for (int i=0; i < 4096; i += 8) {
+		h = (h ^ U64(page + i)) * 0x100000001b3ULL;
+	}
+	return h;
+}
+
+void jitcAddReloc(ClientPage *cp, NativeAddress site, ClientPageRelocType type)
+{
+	if (cp->relocCount == cp->relocMax) {
+		cp->relocMax = cp->relocMax ? cp->relocMax * 2 : 64;
+		cp->relocs = (ClientPageReloc *)realloc(cp->relocs, cp->relocMax * sizeof (ClientPageReloc));
+	}
+	cp->relocs[cp->relocCount].site = site;
+	cp->relocs[cp->relocCount].type = type;
+	cp->relocCount++;
+}
+
+/*
+ *	Intern.
+ *	Uses the snapshot code for the contents of cp (if there is any
+ *	and it isn't already used by another page)
+ */
+static bool jitcUseSnapshotPage(JITC &jitc, ClientPage *cp, uint32 baseaddr)
+{
+	byte *physpage;
+	ppc_direct_physical_memory_handle(baseaddr, physpage);
+	uint64 hash = jitcSnapshotHash(physpage);
+
+	int l = 0, r = jitc.snapshotCount - 1;
+	while (l < r) {
+		int m = (l + r) / 2;
+		if (jitc.snapshotPages[m].hash < hash) {
+			l = m + 1;
+		} else {
+			r = m;
+		}
+	}
+	for (uint i = l; i < jitc.snapshotCount && jitc.snapshotPages[i].hash == hash; i++) {
+		JITCSnapshotPage *sp = &jitc.snapshotPages[i];
+		if (sp->owner) continue;
+		// mark the lines before comparing, see jitcMarkTranslatedLine
+		memcpy(cp->translatedLines, sp->header->translatedLines, sizeof cp->translatedLines);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (memcmp(sp->contents, physpage, 4096) != 0) {
+			memset(cp->translatedLines, 0, sizeof cp->translatedLines);
+			continue;
+		}
+
+		sp->owner = cp;
+		cp->snapshot = sp;
+		jitcAddChunk(jitc, cp, sp->code, sp->header->codeSize);
+		/*
+		 *	A previous owner may have patched the in-page sites
+		 *	to its own (recycled) code, so unpatch them again
+		 *	like jitcSaveSnapshotPage does
+		 */
+		for (uint j=0; j < sp->header->relocCount; j++) {
+			if (sp->relocs[j].kind != snapshotPatch) continue;
+			NativeAddress site = sp->code + sp->relocs[j].site;
+			site[0] = 0xb8;
+			U32(site + 1) = U32(site - 9);
+		}
+		for (uint j=0; j < sp->header->chainCount; j++) {
+			NativeAddress site = sp->code + sp->chains[j];
+			jitcUnchainSite(site);
+			*(ClientPage **)(site + CHAIN_SIZE) = cp;
+		}
+		for (uint j=0; j < sp->header->indirectCount; j++) {
+			NativeAddress site = sp->code + sp->indirects[j];
+			jitcUnchainSite(site);
+			*(ClientPage **)(site + IC_SIZE) = cp;
+		}
+		for (int j=0; j < 1024; j++) {
+			uint32 e = sp->header->entrypoints[j];
+			if (e) jitcSetEntrypoint(jitc, cp, j*4, sp->code + e - 1);
+		}
+		jitcDebugCode(baseaddr, sp->code, sp->header->codeSize, JITC_DEBUG_BLOCK_SNAPSHOT);
+		jitc.snapshot_hit++;
+		return true;
+	}
+	return false;
+}
+
+/*
+ *	Intern.
+ *	Called when a page using snapshot code is destroyed
+ */
+static void jitcReleaseSnapshotPage(ClientPage *cp)
+{
+	cp->snapshot->owner = NULL;
+	cp->snapshot = NULL;
+}
+
+/*
+ *	Intern.
+ *	Checks that everything which will be patched or jumped to
+ *	lies within the code of the page
+ */
+static bool jitcSnapshotPageValid(const JITCSnapshotPageHeader *ph, const JITCSnapshotReloc *relocs,
+	const uint32 *chains, const uint32 *indirects)
+{
+	uint64 codeSize = ph->codeSize;
+	for (uint i=0; i < ph->relocCount; i++) {
+		const JITCSnapshotReloc &r = relocs[i];
+		switch (r.kind) {
+		case snapshotInternal:
+		case snapshotExternal:
+			if (uint64(r.site) + 4 > codeSize) return false;
+			break;
+		case snapshotPatch:
+			// mov eax, li at site-9 is read when saving again
+			if (r.site < 9 || uint64(r.site) + 5 > codeSize) return false;
+			break;
+		default:
+			return false;
+		}
+	}
+	for (uint i=0; i < ph->chainCount; i++) {
+		if (uint64(chains[i]) + CHAIN_SIZE + 8 > codeSize) return false;
+	}
+	for (uint i=0; i < ph->indirectCount; i++) {
+		if (uint64(indirects[i]) + IC_SIZE + 8 > codeSize) return false;
+	}
+	for (int i=0; i < 1024; i++) {
+		if (ph->entrypoints[i] > codeSize) return false;
+	}
+	return true;
+}
+
+static int jitcSnapshotPageCompare(const void *a, const void *b)
+{
+	uint64 ha = ((JITCSnapshotPage *)a)->hash;
+	uint64 hb = ((JITCSnapshotPage *)b)->hash;
+	return ha < hb ? -1 : (ha > hb ? 1 : 0);
+}
+
+/*
+ *	Sets the snapshot file and loads it (if it exists).
+ *	Must be called right after JITC::init(), since the
+ *	code is put at the start of the translation cache.
+ */
+void jitcLoadSnapshot(JITC &jitc, const char *filename)
+{
+	jitc.snapshotFile = strdup(filename);
+
+	FILE *f = fopen(filename, "rb");
+	if (!f) return;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (size < long(sizeof (JITCSnapshotHeader))) {
+		fclose(f);
+		return;
+	}
+	byte *data = ppc_malloc(size);
+	bool ok = fread(data, size, 1, f) == 1;
+	fclose(f);
+
+	JITCSnapshotHeader h;
+	jitcSnapshotHeader(jitc, h);
+	JITCSnapshotHeader *fh = (JITCSnapshotHeader *)data;
+	if (!ok || memcmp(&h, fh, offsetof(JITCSnapshotHeader, pageCount)) != 0
+	 || memcmp(h.anchors, fh->anchors, sizeof h.anchors) != 0) {
+		ht_printf("translation snapshot %s doesn't match, ignored\n", filename);
+		free(data);
+		return;
+	}
+
+	/*
+	 *	Use at most half of the translation cache
+	 */
+	uint32 maxCode = jitc.translationCacheSize / 2;
+	uint32 codeSize = 0;
+	JITCSnapshotPage *pages = ppc_malloc(fh->pageCount * sizeof (JITCSnapshotPage));
+	uint count = 0, invalid = 0;
+	byte *p = data + sizeof (JITCSnapshotHeader);
+	for (uint i=0; i < fh->pageCount; i++) {
+		if (p + sizeof (JITCSnapshotPageHeader) > data + size) break;
+		JITCSnapshotPageHeader *ph = (JITCSnapshotPageHeader *)p;
+		uint64 recSize = sizeof *ph + 4096 + uint64(ph->relocCount) * sizeof (JITCSnapshotReloc)
+			+ uint64(ph->chainCount) * 4 + uint64(ph->indirectCount) * 4 + ph->codeSize;
+		recSize = (recSize + 7) & ~7ULL;
+		if (ph->codeSize % SNAPSHOT_ALIGN || recSize > uint64(data + size - p)) break;
+		JITCSnapshotReloc *relocs = (JITCSnapshotReloc *)(p + sizeof *ph + 4096);
+		uint32 *chains = (uint32 *)(relocs + ph->relocCount);
+		uint32 *indirects = chains + ph->chainCount;
+		if (!jitcSnapshotPageValid(ph, relocs, chains, indirects)) {
+			invalid++;
+		} else if (codeSize + ph->codeSize <= maxCode) {
+			JITCSnapshotPage &sp = pages[count++];
+			sp.hash = ph->hash;
+			sp.header = ph;
+			sp.contents = p + sizeof *ph;
+			sp.relocs = relocs;
+			sp.chains = chains;
+			sp.indirects = indirects;
+			sp.code = jitc.translationCache + codeSize;
+			sp.owner = NULL;
+			codeSize += ph->codeSize;
+		}
+		p += recSize;
+	}
+
+	/*
+	 *	Copy and relocate the code, the arena starts behind it
+	 */
+	jitcInitArena(jitc, jitc.translationCache + codeSize);
+	for (uint i=0; i < count; i++) {
+		JITCSnapshotPage &sp = pages[i];
+		byte *code = (byte *)(sp.indirects + sp.header->indirectCount);
+		memcpy(sp.code, code, sp.header->codeSize);
+		for (uint j=0; j < sp.header->relocCount; j++) {
+			JITCSnapshotReloc &r = sp.relocs[j];
+			if (r.kind == snapshotExternal) {
+				NativeAddress site = sp.code + r.site;
+				U32(site) = SNAPSHOT_ANCHOR + r.target - (site + 4);
+			}
+		}
+	}
+	qsort(pages, count, sizeof (JITCSnapshotPage), jitcSnapshotPageCompare);
+
+	jitc.snapshotData = data;
+	jitc.snapshotPages = pages;
+	jitc.snapshotCount = count;
+	if (invalid) {
+		ht_printf("translation snapshot %s: %d corrupt pages ignored\n", filename, invalid);
+	}
+	ht_printf("translation snapshot: %d pages, %d bytes of code\n", count, codeSize);
+}
+
+static int jitcSnapshotSegmentCompare(const void *a, const void *b)
+{
+	NativeAddress ba = ((JITCSnapshotSegment *)a)->base;
+	NativeAddress bb = ((JITCSnapshotSegment *)b)->base;
+	return ba < bb ? -1 : (ba > bb ? 1 : 0);
+}
+
+/*
+ *	Intern.
+ *	Returns the offset of addr in the saved code or -1
+ */
+static sint64 jitcSnapshotOffset(JITCSnapshotSegment *seg, int count, NativeAddress addr)
+{
+	for (int i=0; i < count; i++) {
+		if (addr >= seg[i].base && addr < seg[i].base + seg[i].size) {
+			return seg[i].ofs + (addr - seg[i].base);
+		}
+	}
+	return -1;
+}
+
+/*
+ *	Intern.
+ *	Writes the code of cp. Returns false if cp can't be saved.
+ */
+static bool jitcSaveSnapshotPage(JITC &jitc, ClientPage *cp, FILE *f)
+{
+	JITCSnapshotPage *sp = cp->snapshot;
+	int count = 0;
+	for (TranslationCacheChunk *tcc = cp->chunks; tcc; tcc = tcc->prev) count++;
+
+	JITCSnapshotSegment *seg = ppc_malloc(count * sizeof (JITCSnapshotSegment));
+	count = 0;
+	for (TranslationCacheChunk *tcc = cp->chunks; tcc; tcc = tcc->prev) {
+		seg[count].base = tcc->base;
+		seg[count].size = tcc->size;
+		count++;
+	}
+	qsort(seg, count, sizeof *seg, jitcSnapshotSegmentCompare);
+	/*
+	 *	Short jumps may go to other chunks nearby,
+	 *	so these must keep their distance
+	 */
+	int n = 0;
+	for (int i=1; i < count; i++) {
+		if (seg[i].base < seg[n].base + seg[n].size + 256) {
+			NativeAddress end = seg[i].base + seg[i].size;
+			if (end > seg[n].base + seg[n].size) seg[n].size = end - seg[n].base;
+		} else {
+			seg[++n] = seg[i];
+		}
+	}
+	count = n + 1;
+	// keep the alignment of the code
+	uint32 codeSize = 0;
+	for (int i=0; i < count; i++) {
+		codeSize = ((codeSize + SNAPSHOT_ALIGN - 1) & ~(SNAPSHOT_ALIGN - 1)) + (uint64(seg[i].base) & (SNAPSHOT_ALIGN - 1));
+		seg[i].ofs = codeSize;
+		codeSize += seg[i].size;
+	}
+	codeSize = (codeSize + SNAPSHOT_ALIGN - 1) & ~(SNAPSHOT_ALIGN - 1);
+
+	uint maxRelocs = cp->relocCount + (sp ? sp->header->relocCount + sp->header->chainCount + sp->header->indirectCount : 0);
+	ClientPageReloc *sites = ppc_malloc((maxRelocs + 1) * sizeof (ClientPageReloc));
+	uint siteCount = 0;
+	if (sp) {
+		for (uint i=0; i < sp->header->relocCount; i++) {
+			sites[siteCount].site = sp->code + sp->relocs[i].site;
+			sites[siteCount++].type = (sp->relocs[i].kind == snapshotPatch) ? relocPatch : relocRel32;
+		}
+		for (uint i=0; i < sp->header->chainCount; i++) {
+			sites[siteCount].site = sp->code + sp->chains[i];
+			sites[siteCount++].type = relocChain;
+		}
+		for (uint i=0; i < sp->header->indirectCount; i++) {
+			sites[siteCount].site = sp->code + sp->indirects[i];
+			sites[siteCount++].type = relocIndirect;
+		}
+	}
+	memcpy(sites + siteCount, cp->relocs, cp->relocCount * sizeof (ClientPageReloc));
+	siteCount += cp->relocCount;
+
+	byte *code = ppc_malloc(codeSize);
+	memset(code, 0, codeSize);
+	for (int i=0; i < count; i++) {
+		memcpy(code + seg[i].ofs, seg[i].base, seg[i].size);
+	}
+	JITCSnapshotReloc *relocs = ppc_malloc((siteCount + 1) * sizeof (JITCSnapshotReloc));
+	uint32 *chains = ppc_malloc((siteCount + 1) * sizeof (uint32));
+	uint32 *indirects = ppc_malloc((siteCount + 1) * sizeof (uint32));
+	uint relocCount = 0, chainCount = 0, indirectCount = 0;
+	bool ok = true;
+	for (uint i=0; i < siteCount && ok; i++) {
+		NativeAddress site = sites[i].site;
+		sint64 ofs = jitcSnapshotOffset(seg, count, site);
+		if (ofs < 0 || sites[i].type == relocPinned) {
+			ok = false;
+			break;
+		}
+		if (sites[i].type == relocChain) {
+			chains[chainCount++] = ofs;
+			continue;
+		}
+		if (sites[i].type == relocIndirect) {
+			indirects[indirectCount++] = ofs;
+			continue;
+		}
+		if (sites[i].type == relocPatch) {
+			/*
+			 *	Saved unpatched (the target may be a trace),
+			 *	li is the same as for the heartbeat before
+			 */
+			code[ofs] = 0xb8;
+			U32(code + ofs + 1) = U32(site - 9);
+			JITCSnapshotReloc &r = relocs[relocCount++];
+			r.site = ofs;
+			r.kind = snapshotPatch;
+			r.target = 0;
+			continue;
+		}
+		NativeAddress target = site + 4 + sint32(U32(site));
+		sint64 tofs = jitcSnapshotOffset(seg, count, target);
+		JITCSnapshotReloc &r = relocs[relocCount++];
+		r.site = ofs;
+		if (tofs >= 0) {
+			// the segments may be moved relative to each other
+			U32(code + ofs) = tofs - (ofs + 4);
+			r.kind = snapshotInternal;
+			r.target = 0;
+		} else if (target >= jitc.translationCache && target < jitc.translationCache + jitc.translationCacheSize) {
+			// into the code of another page
+			ok = false;
+		} else {
+			r.kind = snapshotExternal;
+			r.target = target - SNAPSHOT_ANCHOR;
+		}
+	}
+
+	JITCSnapshotPageHeader ph;
+	memset(&ph, 0, sizeof ph);
+	for (int i=0; i < 1024 && ok; i++) {
+		NativeAddress entry = jitcGetEntrypoint(cp, i*4);
+		if (!entry) continue;
+		sint64 ofs = jitcSnapshotOffset(seg, count, entry);
+		if (ofs < 0) {
+			ok = false;
+		} else {
+			ph.entrypoints[i] = ofs + 1;
+		}
+	}
+	if (ok) {
+		byte *physpage;
+		ppc_direct_physical_memory_handle(cp->baseaddress, physpage);
+		ph.hash = jitcSnapshotHash(physpage);
+		ph.codeSize = codeSize;
+		ph.relocCount = relocCount;
+		ph.chainCount = chainCount;
+		ph.indirectCount = indirectCount;
+		memcpy(ph.translatedLines, cp->translatedLines, sizeof ph.translatedLines);
+		uint64 zero = 0;
+		uint32 recSize = sizeof ph + 4096 + relocCount * sizeof *relocs + (chainCount + indirectCount) * 4 + codeSize;
+		fwrite(&ph, sizeof ph, 1, f);
+		fwrite(physpage, 4096, 1, f);
+		fwrite(relocs, sizeof *relocs, relocCount, f);
+		fwrite(chains, 4, chainCount, f);
+		fwrite(indirects, 4, indirectCount, f);
+		fwrite(code, codeSize, 1, f);
+		fwrite(&zero, (8 - recSize % 8) % 8, 1, f);
+	}
+	free(indirects);
+	free(chains);
+	free(relocs);
+	free(code);
+	free(sites);
+	free(seg);
+	return ok;
+}
+
+/*
+ *	Writes the snapshot file (if there is one).
+ *	Called when the client has stopped.
+ */
+void jitcSaveSnapshot(JITC &jitc)
+{
+	if (!jitc.snapshotFile) return;
+	if (__atomic_load_n(&jitc.dirtyPending, __ATOMIC_ACQUIRE)) {
+		jitcDestroyDirtyPages(jitc);
+	}
+	FILE *f = fopen(jitc.snapshotFile, "wb");
+	if (!f) {
+		ht_printf("can't write translation snapshot %s\n", jitc.snapshotFile);
+		return;
+	}
+	JITCSnapshotHeader h;
+	jitcSnapshotHeader(jitc, h);
+	fwrite(&h, sizeof h, 1, f);
+	for (ClientPage *cp = jitc.MRUpage; cp; cp = cp->lessRU) {
+		if (cp->chunks && jitcSaveSnapshotPage(jitc, cp, f)) {
+			h.pageCount++;
+		}
+	}
+	fseek(f, 0, SEEK_SET);
+	fwrite(&h, sizeof h, 1, f);
+	fclose(f);
+	ht_printf("translation snapshot: saved %d pages\n", h.pageCount);
+}
+
 extern "C" void jitc_error_msr_unsupported_bits(uint32 a)
 {
 	ht_printf("JITC msr Error: %08x\n", a);
@@ -523,6 +1816,7 @@ bool JITC::init(uint maxClientPages, uint32 tcSize)
 	x86GetCaps(hostCPUCaps);
 
 	translationCache = (byte*)sys_alloc_read_write_execute(tcSize);
+	translationCacheSize = tcSize;
 	
 	ht_printf("translation cache: %p\n", translationCache);
 	
@@ -530,22 +1824,24 @@ bool JITC::init(uint maxClientPages, uint32 tcSize)
 	int maxPages = gMemorySize / 4096;
 	clientPages = ppc_malloc(maxPages * sizeof (ClientPage *));
 	memset(clientPages, 0, maxPages * sizeof (ClientPage *));
+	int bitmapSize = (maxPages + 31) / 32 * sizeof (uint32);
+	translatedPages = ppc_malloc(bitmapSize);
+	memset(translatedPages, 0, bitmapSize);
+	dirtyPages = ppc_malloc(bitmapSize);
+	memset(dirtyPages, 0, bitmapSize);
 
-	// allocate fragments
-	TranslationCacheFragment *tcf = ppc_malloc(sizeof (TranslationCacheFragment));
-	freeFragmentsList = tcf;
-	tcf->base = translationCache;
-	for (uint32 addr=FRAGMENT_SIZE; addr < tcSize; addr += FRAGMENT_SIZE) {
-		tcf->prev = ppc_malloc(sizeof (TranslationCacheFragment));
-		tcf = tcf->prev;
-		tcf->base = translationCache + addr;
-	}
-	tcf->prev = NULL;
+	jitcInitArena(*this, translationCache);
 	
 	// allocate client pages
 	ClientPage *cp = ppc_malloc(sizeof (ClientPage));
 	memset(cp->entrypoints, 0, sizeof cp->entrypoints);
-	cp->tcf_current = NULL; // not translated yet
+	cp->chunks = NULL; // not translated yet
+	cp->generations = 0;
+	cp->links = NULL;
+	cp->version = 0;
+	cp->snapshot = NULL;
+	cp->relocs = NULL;
+	cp->relocCount = cp->relocMax = 0;
 	cp->lessRU = NULL;
 	LRUpage = NULL;
 	freeClientPages = cp;
@@ -555,10 +1851,24 @@ bool JITC::init(uint maxClientPages, uint32 tcSize)
 		cp = cp->moreRU;
 		
 		memset(cp->entrypoints, 0, sizeof cp->entrypoints);
-		cp->tcf_current = NULL; // not translated yet
+		cp->chunks = NULL; // not translated yet
+		cp->generations = 0;
+		cp->links = NULL;
+		cp->version = 0;
+		cp->snapshot = NULL;
+		cp->relocs = NULL;
+		cp->relocCount = cp->relocMax = 0;
 	}
 	cp->moreRU = NULL;
 	MRUpage = NULL;
+
+	// allocate links for chained jumps
+	freeLinks = NULL;
+	for (uint i=0; i < maxClientPages*8; i++) {
+		ClientPageLink *l = ppc_malloc(sizeof (ClientPageLink));
+		l->next = freeLinks;
+		freeLinks = l;
+	}
 	
 	// initialize native registers
 	NativeRegType *nr = ppc_malloc(sizeof (NativeRegType));
@@ -71,32 +71,96 @@ enum NativeVectorReg {
 };
 
 /*
- *	The size of a fragment
- *	This is the size of portion of translated client code
+ *	The translation cache is a code arena divided into
+ *	this many generations. Code is allocated by bumping a pointer
+ *	through the current generation. When it is full, the next
+ *	generation is recycled by destroying all pages with code in it
+ *	(so the oldest code is evicted first).
+ *	Must be <= 32, see ClientPage::generations
  */
-#define FRAGMENT_SIZE 512
+#define JITC_GENERATIONS 16
 
 /*
- *	Used to describe a fragment of translated client code
- *	If fragment is empty/invalid it isn't assigned to a
- *	client page but in the freeFragmentsList
+ *	A new translation is started in the next generation
+ *	if less than this is left in the current one
  */
-struct TranslationCacheFragment {
+#define JITC_CHUNK_MIN 1024
+
+/*
+ *	Used to describe a contiguous chunk of translated client code
+ *	If chunk is unused it isn't assigned to a client page
+ *	but in the freeChunks list
+ */
+struct TranslationCacheChunk {
 	/*
-	 *	The start address of this fragement in the 
-	 *	translation cache.
+	 *	The start address of this chunk in the
+	 *	translation cache and its size.
+	 *	The size of the chunk being emitted is only valid
+	 *	after the translation.
 	 */
 	NativeAddress base;
+	uint32 size;
 	/*
-	 *	If fragment is assigned to a client page
-	 *	this points to the previous used segment of this page.
-	 *	Used when freeing pages.
+	 *	If chunk is assigned to a client page
+	 *	this points to the previous chunk of this page.
 	 *
-	 *	Else this points to the next entry in the list of free fragments.
+	 *	Else this points to the next entry in the list of free chunks.
+	 */
+	TranslationCacheChunk *prev;
+};
+
+struct ClientPage;
+struct JITCSnapshotPage;
+
+#define JITC_CODE_LINE_SIZE 32
+
+/*
+ *	Positions in the translated code of a client page that must
+ *	be adjusted when it is saved to or loaded from the translation
+ *	snapshot (see jitcSaveSnapshot)
+ */
+enum ClientPageRelocType {
+	relocRel32,	// rel32 of a call or jump
+	relocChain,	// a chaining site, see jitcEmitChainedJump
+	relocPinned,	// absolute host address, page can't be saved
+	relocPatch,	// an in-page jump site, see ppc_opc_gen_set_pc_rel
+	relocIndirect,	// an inline cache of bctr, see jitcEmitIndirectJump
+};
+
+struct ClientPageReloc {
+	NativeAddress site;
+	ClientPageRelocType type;
+};
+
+/*
+ *	Used to describe a chained jump from one client page
+ *	into another (see jitcEmitChainedJump)
+ *	Every page keeps a list of all jumps into it, so
+ *	they can be unlinked when the page is destroyed.
+ */
+struct ClientPageLink {
+	/*
+	 *	The chaining site (or inline cache) in the translation cache
+	 */
+	NativeAddress site;
+	/*
+	 *	The page containing the site and its version
+	 *	when the link was made. If the versions differ,
+	 *	the site has been destroyed and the link is stale.
 	 */
-	TranslationCacheFragment *prev;
+	ClientPage *from;
+	uint fromVersion;
+
+	ClientPageLink *next;
 };
 
+/*
+ *	The entrypoints of a page are kept in blocks of this many
+ *	entries, which are only allocated when needed
+ */
+#define JITC_ENTRYPOINT_BLOCK	64
+#define JITC_ENTRYPOINT_BLOCKS	(1024 / JITC_ENTRYPOINT_BLOCK)
+
 /*
  *	Used to describe a (not neccessarily translated) client page
  */
@@ -104,31 +168,58 @@ struct ClientPage {
 	/*
 	 *	This is used to translate client page addresses 
 	 *	into host addresses. Address isn't (yet) an entrypoint 
-	 *	or not yet translated if entrypoints[page_offset] == 0
+	 *	or not yet translated if its entry is 0 or its
+	 *	block is NULL (see jitcGetEntrypoint)
 	 *
 	 *	Note that a client page has 4096 bytes, but there are only
 	 *	1024 possible entries per page.
 	 */
-	NativeAddress entrypoints[1024];
+	NativeAddress *entrypoints[JITC_ENTRYPOINT_BLOCKS];
 
 	/*
-	 *	The fragment which has space left
+	 *	The most recent chunk of code of this page
 	 *	== NULL if page isn't translated yet
 	 */
-	TranslationCacheFragment *tcf_current; 
+	TranslationCacheChunk *chunks;
 	
 	/*
 	 *	The (physical) address of the page
 	 */
 	uint32 baseaddress;
 	
-	uint bytesLeft;		// Remaining bytes in current fragment
-	NativeAddress tcp;	// Translation cache pointer
+	uint bytesLeft;		// Remaining bytes in current generation
+	NativeAddress tcp;	// Translation cache pointer (while translating)
 
 	ClientPage *moreRU;	// points to a page which was used more recently
 	ClientPage *lessRU;	// points to a page which was used less recently
+
+	/*
+	 *	One bit per cache line (32 bytes) of the page, set
+	 *	if the line contains translated instructions.
+	 *	Only writes into these lines destroy the page.
+	 */
+	uint32 translatedLines[4096 / JITC_CODE_LINE_SIZE / 32];
+
+	/*
+	 *	Chained jumps from other pages into this page
+	 */
+	ClientPageLink *links;
+	uint version;		// incremented whenever the page is destroyed
+	uint32 generations;	// bitmask of generations with code of this page
+
+	/*
+	 *	Only used with a translation snapshot: the snapshot code
+	 *	this page was loaded from (or NULL) and the relocations
+	 *	of all code translated since.
+	 */
+	JITCSnapshotPage *snapshot;
+	ClientPageReloc *relocs;
+	uint relocCount;
+	uint relocMax;
 };
 
+void jitcAddReloc(ClientPage *cp, NativeAddress site, ClientPageRelocType type);
+
 struct NativeRegType {
 	NativeReg reg;
 	NativeRegType *moreRU;	// points to a register which was used more recently
@@ -147,6 +238,54 @@ enum RegisterState {
 	rsDirty = 2,
 };
 
+/*
+ *	The mapping of the native registers,
+ *	see JITC::getRegisterState
+ */
+struct JITCRegisterState {
+	PPC_Register nativeReg[16];
+	RegisterState nativeRegState[16];
+	NativeReg lru[16];	// least recently used first, REG_NO terminated
+};
+
+/*
+ *	Backward in-page branches are counted (see jitcNewPCThisPage)
+ *	in a set associative table of this many entries.
+ *	If a branch is taken JITC::traceThreshold times, its loop
+ *	is translated again as a trace (see jitcNewTrace). Branches
+ *	evicted from the table before are patched to their plain target.
+ */
+#define JITC_HOT_SITES		256
+#define JITC_HOT_WAYS		4
+#define JITC_HOT_SETS		(JITC_HOT_SITES / JITC_HOT_WAYS)
+#define JITC_TRACE_MAX		1024	// max. bytes of client code of a loop
+#define JITC_TRACE_PASSES	4
+
+struct JITCHotSite {
+	NativeAddress site;
+	NativeAddress target;	// patched in when evicted
+	ClientPage *page;	// of the site, it's gone if
+	uint version;		// the page has another version
+	uint count;
+};
+
+/*
+ *	Stored behind the call of an in-page jump site:
+ *	The offset of the branch, or'ed with this if the site
+ *	must not start a trace
+ */
+#define JITC_SITE_NO_TRACE	0x80000000
+
+/*
+ *	What the x86 flags mapped to a crX field are
+ *	the result of (see JITC::mapFlagsDirty)
+ */
+enum JITCFlagsType {
+	flagsResult,	// sign and zero of a result (record forms)
+	flagsSigned,	// a signed CMP
+	flagsUnsigned,	// an unsigned CMP
+};
+
 #define NATIVE_REG	(2<<8)	 // used as a bitmask to specify register
 #define NATIVE_REG_PREFER (4<<8) // used as a bitmask to specify register
 
@@ -159,6 +298,7 @@ struct X86CPUCaps {
 	bool sse3;
 	bool ssse3;
 	bool sse4;
+	bool fma;
 	uint loop_align;
 };
 
@@ -262,6 +402,30 @@ enum X86BitSearch {
 	X86_BSR  = 0xbd,
 };
 
+/*
+ *	Scalar SSE2 operations, the high byte is the prefix
+ */
+enum X86ALUSDopc {
+	X86_ADDSD    = 0xf258,
+	X86_MULSD    = 0xf259,
+	X86_SUBSD    = 0xf25c,
+	X86_DIVSD    = 0xf25e,
+	X86_SQRTSD   = 0xf251,
+	X86_CVTSD2SS = 0xf25a,
+	X86_CVTSS2SD = 0xf35a,
+	X86_UCOMISD  = 0x662e,
+};
+
+enum X86CVTSD2SIopc {
+	X86_CVTSD2SI  = 0x2d,	// rounds according to MXCSR
+	X86_CVTTSD2SI = 0x2c,	// truncates
+};
+
+enum X86FMAopc {
+	X86_VFMADD213SD = 0xa9,
+	X86_VFMSUB213SD = 0xab,
+};
+
 enum X86ALUPSopc {
 	X86_ANDPS  = 0x54,
 	X86_ANDNPS = 0x55,
@@ -340,6 +504,22 @@ struct JITC {
 	 */
 	ClientPage **clientPages;
 
+	/*
+	 *	One bit per (physical) page of the client, set if the
+	 *	page contains translated code. Writes into such a page
+	 *	are checked against ClientPage::translatedLines.
+	 */
+	uint32 *translatedPages;
+
+	/*
+	 *	Pages with translated code overwritten by DMA. DMA can
+	 *	happen in other threads, so they are only marked here
+	 *	and destroyed by the next jitcNewPC. dirtyPending is
+	 *	accessed with __atomic builtins (see jitcInvalidateDMA).
+	 */
+	uint32 *dirtyPages;
+	bool dirtyPending;
+
 	/*
 	 *	If nativeReg[i] is set, it indicates to which client
 	 *	register this native register corrensponds.
@@ -352,6 +532,7 @@ struct JITC {
 	 *
 	 */
 	PPC_CRx nativeFlags;
+	JITCFlagsType nativeFlagsType;
 	RegisterState nativeFlagsState;
 	RegisterState nativeCarryState;
 	
@@ -383,27 +564,58 @@ struct JITC {
 	/*
 	 *	This is the least recently used page
 	 *	(ie. the page that is freed if no more pages are available)
-	 *	Must can be NULL if freeFragmentsList is != NULL
 	 */
 	ClientPage *LRUpage;
 	ClientPage *MRUpage;
 
 	/*
-	 *	These are the unused fragments as a linked list.
+	 *	These are the unused chunk descriptions as a linked list.
 	 *	Can be NULL.
 	 */
-	TranslationCacheFragment *freeFragmentsList;
+	TranslationCacheChunk *freeChunks;
+
+	/*
+	 *	Unused blocks of entrypoints as a linked list
+	 *	(through their first entry). Can be NULL.
+	 */
+	NativeAddress *freeEntrypoints;
 
 	/*
 	 *	These are the unused client pages as a linked list.
 	 *	Can be NULL.
 	 */
 	ClientPage *freeClientPages;
+
+	/*
+	 *	These are the unused links as a linked list.
+	 *	Can be NULL.
+	 */
+	ClientPageLink *freeLinks;
 	
 	/*
 	 *
 	 */
 	byte *translationCache;
+	uint32 translationCacheSize;
+
+	/*
+	 *	The code arena (the translation cache without the
+	 *	snapshot code). arenaHead is the next free byte
+	 *	in the current generation.
+	 */
+	NativeAddress arenaStart;
+	uint32 generationSize;
+	uint generation;
+	NativeAddress arenaHead;
+
+	/*
+	 *	The translation snapshot, see jitcLoadSnapshot.
+	 *	snapshotFile is NULL if there is none.
+	 */
+	char *snapshotFile;
+	byte *snapshotData;
+	JITCSnapshotPage *snapshotPages;	// sorted by hash
+	uint snapshotCount;
 	
 	/*
 	 *	Capabilities of the host cpu
@@ -416,6 +628,31 @@ struct JITC {
 	uint64	destroy_write;
 	uint64	destroy_oopages;
 	uint64	destroy_ootc;
+	uint64	destroy_dma;
+	uint64	chain_link;
+	uint64	chain_unlink;
+	uint64	indirect_fill;	// misses of the inline caches of bctr
+	uint64	snapshot_hit;
+	uint64	arena_bytes;	// code emitted
+	uint64	arena_waste;	// left unused at the end of generations
+	uint64	arena_evict;	// generations recycled
+	uint64	arena_skip;	// generations skipped (owned by the page being translated)
+	uint64	arena_link;	// jumps to the next generation while translating
+	uint64	trace_hot;	// loops which got hot
+	uint64	trace_built;	// traces translated
+	uint64	trace_loop;	// traces which keep the registers around the loop
+	uint64	trace_fail;	// loops which can't be traced
+	uint64	flags_dead;	// flushes of crX dropped since crX was overwritten
+	uint64	translate_blocks;	// entrypoints and traces translated
+	uint64	translate_insns;	// client instructions translated (including dry runs of traces)
+	uint64	translate_ticks;	// host cycles spent translating
+
+	/*
+	 *	Profiling of the in-page branches, see jitcNewPCThisPage.
+	 *	0 disables traces.
+	 */
+	uint traceThreshold;
+	JITCHotSite hotSites[JITC_HOT_SETS][JITC_HOT_WAYS];
 	
 	/*********************************************************************
 	 *	Only valid while compiling
@@ -424,6 +661,22 @@ struct JITC {
 	uint32 pc;
 	uint32 current_opc;
 
+	/*
+	 *	Only valid while translating a trace (see jitcNewTrace),
+	 *	traceTail is 0 otherwise.
+	 *	traceLoop is NULL while looking for the register state
+	 *	(in a dry run, which emits garbage)
+	 */
+	uint32 traceHead;
+	uint32 traceTail;
+	NativeAddress traceLoop;
+	NativeAddress traceStart;
+	uint traceBytesLeft;
+	bool traceReached;
+	bool traceOverflow;
+	JITCRegisterState traceState;
+	JITCRegisterState traceEndState;
+
 	/*
 	 *	If nativeVectorReg[i] is set, it indicates to which client
 	 *	vector register this native vector register corrensponds.
@@ -457,12 +710,16 @@ public:
 	void flushAll();
 	void clobberAll();
 	void invalidateAll();
+	void getRegisterState(JITCRegisterState &state);
+	void setRegisterState(const JITCRegisterState &state, bool load);
 	void touchRegister(NativeReg reg);
 	void flushRegister(int options = NATIVE_REGS_ALL);
 	void flushRegisterDirty(int options = NATIVE_REGS_ALL);
 	void clobberRegister(int options = NATIVE_REGS_ALL);
 	void getClientCarry();
-	void mapFlagsDirty(PPC_CRx cr = PPC_CR0);
+	void mapFlagsDirty(PPC_CRx cr = PPC_CR0, JITCFlagsType type = flagsResult);
+	void overwriteFlags(PPC_CRx cr);
+	void flushFlagsDirty();
 	void mapCarryDirty();
 	void clobberFlags();
 	void clobberCarry();
@@ -470,6 +727,7 @@ public:
 	void flushCarryAndFlagsDirty(); // ONLY FOR DEBUG! DON'T CALL!
 
 	PPC_CRx getFlagsMapping();
+	JITCFlagsType getFlagsType();
 
 	bool flagsMapped();
 	bool carryMapped();
@@ -516,6 +774,7 @@ public:
 	void asmALU64(X86ALUopc opc, NativeReg reg, NativeReg base, uint32 disp);
 	void asmALU64(X86ALUopc opc, NativeReg base, uint32 disp, NativeReg reg);
 	void asmALU64(X86ALUopc opc, NativeReg reg, NativeReg base, int scale, NativeReg index, uint32 disp);
+	void asmALU64(X86ALUopc opc, NativeReg base, uint32 disp, uint32 imm);
 
 	void asmALU32(X86ALUopc opc, NativeReg reg1, NativeReg reg2);
 	void asmALU32(X86ALUopc opc, NativeReg reg, uint32 imm);
@@ -530,6 +789,7 @@ public:
 
 	void asmALU8(X86ALUopc opc, NativeReg reg1, NativeReg reg2);
 	void asmALU8(X86ALUopc opc, NativeReg base, uint32 disp, uint8 imm);
+	void asmALU8(X86ALUopc opc, NativeReg base, int scale, NativeReg index, uint32 disp, uint8 imm);
 	void asmALU8(X86ALUopc opc, NativeReg reg, NativeReg base, uint32 disp);
 	void asmALU8(X86ALUopc opc, NativeReg base, uint32 disp, NativeReg reg);
 	
@@ -546,6 +806,8 @@ public:
 	void asmMOVxx32_8(X86MOVxx opc, NativeReg reg1, NativeReg reg2);
 	void asmMOVxx32_8(X86MOVxx opc, NativeReg reg1, NativeReg base, uint32 disp);
 	void asmMOVxx32_16(X86MOVxx opc, NativeReg reg1, NativeReg reg2);
+	void asmMOVxx32_16(X86MOVxx opc, NativeReg reg1, NativeReg base, uint32 disp);
+	void asmMOV16(NativeReg base, uint32 disp, NativeReg reg);
 	void asmShift16(X86ShiftOpc opc, NativeReg reg, uint imm);
 	void asmShift32(X86ShiftOpc opc, NativeReg reg, uint imm);
 	void asmShift64(X86ShiftOpc opc, NativeReg reg, uint imm);
@@ -560,14 +822,38 @@ public:
 	void asmBTx32(X86BitTest opc, NativeReg base, uint32 disp, int value);
 	void asmBSx32(X86BitSearch opc, NativeReg reg1, NativeReg reg2);
 
+	void asmBTx64(X86BitTest opc, NativeReg reg, int value);
+
 	void asmBSWAP32(NativeReg reg);
 	void asmBSWAP64(NativeReg reg);
 
+	void asmALUSD(X86ALUSDopc opc, NativeVectorReg reg1, NativeVectorReg reg2);
+	void asmMOVSD(NativeVectorReg reg, NativeReg base, uint32 disp);
+	void asmMOVQ(NativeVectorReg reg1, NativeReg reg2);
+	void asmMOVQ(NativeReg reg1, NativeVectorReg reg2);
+	void asmCVTSD2SI32(X86CVTSD2SIopc opc, NativeReg reg1, NativeVectorReg reg2);
+	void asmFMA(X86FMAopc opc, NativeVectorReg reg1, NativeVectorReg reg2, NativeVectorReg reg3);
+
 	void asmJMP(NativeAddress to);
 	void asmJxx(X86FlagTest flags, NativeAddress to);
 	NativeAddress asmJMPFixup();
 	NativeAddress asmJxxFixup(X86FlagTest flags);
 	void asmCALL(NativeAddress to);
+	void asmCALLInPlace(NativeAddress func);
+	void asmCALLInterpret(NativeAddress func, const PPC_Register *reads, const PPC_Register *writes);
+
+	void asmReloc(NativeAddress site, ClientPageRelocType type = relocRel32)
+	{
+		if (snapshotFile) jitcAddReloc(currentPage, site, type);
+	}
+
+	/*
+	 *	li is relative to the page
+	 */
+	bool isTraceBackEdge(uint32 li)
+	{
+		return traceTail && pc == traceTail && li == traceHead;
+	}
  
 	void asmResolveFixup(NativeAddress at, NativeAddress to=0)
 	{
@@ -638,5 +924,15 @@ public:
 
 extern "C" void jitcDestroyAndFreeClientPage(JITC &aJITC, ClientPage *cp);
 extern "C" NativeAddress jitcNewPC(JITC &aJITC, uint32 entry);
+void jitcInvalidateDMA(JITC &aJITC, uint32 pa, uint32 size);
+extern "C" NativeAddress jitcNewPCChained(JITC &aJITC, uint32 entry, NativeAddress ret, PPC_CPU_State &aCPU);
+void jitcEmitChainedJump(JITC &jitc, uint32 li);
+extern "C" NativeAddress jitcNewPCIndirect(JITC &aJITC, uint32 entry, NativeAddress ret, PPC_CPU_State &aCPU);
+void jitcEmitIndirectJump(JITC &jitc);
+void jitcResetReturnStack(PPC_CPU_State &aCPU);
+extern "C" NativeAddress jitcNewPCThisPage(JITC &aJITC, uint32 entry, NativeAddress ret);
+void jitcEmitTraceBackEdge(JITC &jitc);
+void jitcLoadSnapshot(JITC &jitc, const char *filename);
+void jitcSaveSnapshot(JITC &jitc);
 
 #endif
@@ -53,24 +53,40 @@ extern "C" void ppc_no_fpu_exception_asm();
 extern "C" void ppc_no_vec_exception_asm();
 extern "C" void ppc_sc_exception_asm();
 extern "C" void ppc_flush_flags_asm();
-extern "C" void ppc_flush_flags_signed_even_asm();
-extern "C" void ppc_flush_flags_signed_odd_asm();
-extern "C" void ppc_flush_flags_signed_0_asm();
-extern "C" void ppc_flush_flags_unsigned_even_asm();
-extern "C" void ppc_flush_flags_unsigned_odd_asm();
-extern "C" void ppc_flush_flags_unsigned_0_asm();
+extern "C" void ppc_flush_flags_signed_cr0_asm();
+extern "C" void ppc_flush_flags_signed_cr1_asm();
+extern "C" void ppc_flush_flags_signed_cr2_asm();
+extern "C" void ppc_flush_flags_signed_cr3_asm();
+extern "C" void ppc_flush_flags_signed_cr4_asm();
+extern "C" void ppc_flush_flags_signed_cr5_asm();
+extern "C" void ppc_flush_flags_signed_cr6_asm();
+extern "C" void ppc_flush_flags_signed_cr7_asm();
+extern "C" void ppc_flush_flags_unsigned_cr0_asm();
+extern "C" void ppc_flush_flags_unsigned_cr1_asm();
+extern "C" void ppc_flush_flags_unsigned_cr2_asm();
+extern "C" void ppc_flush_flags_unsigned_cr3_asm();
+extern "C" void ppc_flush_flags_unsigned_cr4_asm();
+extern "C" void ppc_flush_flags_unsigned_cr5_asm();
+extern "C" void ppc_flush_flags_unsigned_cr6_asm();
+extern "C" void ppc_flush_flags_unsigned_cr7_asm();
 extern "C" void ppc_new_pc_asm();
 extern "C" void ppc_new_pc_rel_asm();
 extern "C" void ppc_new_pc_this_page_asm();
+extern "C" void ppc_new_pc_chain_asm();
+extern "C" void ppc_new_pc_indirect_asm();
+extern "C" void ppc_new_pc_return_asm();
+extern "C" void ppc_ras_push_asm();
 extern "C" void ppc_heartbeat_ext_asm();
 extern "C" void ppc_heartbeat_ext_rel_asm();
 
 
 extern "C" void ppc_set_msr_asm();
 extern "C" void ppc_mmu_tlb_invalidate_all_asm(PPC_CPU_State *cpu);
+extern "C" void ppc_mmu_tlb_invalidate_all_chains_asm(PPC_CPU_State *cpu);
 extern "C" void ppc_mmu_tlb_invalidate_entry_asm();
 
 extern "C" void FASTCALL ppc_start_jitc_asm(uint32 newpc, PPC_CPU_State **cpu, uint32 size);
 extern "C" bool FASTCALL ppc_cpuid_asm(uint32 level, void *struc);
+extern "C" uint64 FASTCALL ppc_xgetbv_asm(uint32 xcr);
 
 #endif
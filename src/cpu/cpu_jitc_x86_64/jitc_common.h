@@ -1,7 +1,21 @@
 // as does not have a ~ operator..
 #define ASM_NEG32(a) (0xffffffff-(a))
 
-#define TLB_ENTRIES 32
+// keep in sync with ppc_cpu.h
+#ifndef TLB_ENTRIES
+#define TLB_ENTRIES 512
+#endif
+#define TLB_SETS (TLB_ENTRIES / 2)
+
+#ifndef TLB_STATS
+#define TLB_STATS 0
+#endif
+
+// keep in sync with display.h
+#define DAMAGE_BLOCK_SHIFT 8
+
+#define PPC_RAS_SIZE 16
+#define PPC_RAS_EMPTY 1
 
 
 //STRUCT(PPC_CPU_State)
@@ -56,6 +70,7 @@
 #define ext_exception (exception_pending+2)
 #define stop_exception (exception_pending+3)
 #define singlestep_ignore (exception_pending+4)
+#define io_exception (exception_pending+5)
 
 #define pagetable_base (exception_pending+8)
 #define pagetable_hashmask (pagetable_base+4)
@@ -73,25 +88,49 @@
 #define x87cw (temp2 + 4)
 #define pc_ofs (x87cw + 4)
 #define current_code_base (pc_ofs + 4)
+#define tlb_context (current_code_base + 4)
+#define chain_epoch (tlb_context + 8)
 
-#define tlb_code_0_eff (current_code_base + 4)
+#define tlb_code_0_eff (chain_epoch + 8)
 #define tlb_data_0_eff (tlb_code_0_eff + TLB_ENTRIES*4)
 #define tlb_data_8_eff (tlb_data_0_eff + TLB_ENTRIES*4)
 #define tlb_code_0_phys (tlb_data_8_eff + TLB_ENTRIES*4)
 #define tlb_data_0_phys  (tlb_code_0_phys + TLB_ENTRIES*8)
 #define tlb_data_8_phys (tlb_data_0_phys + TLB_ENTRIES*8)
+#define tlb_code_0_hits (tlb_data_8_phys + TLB_ENTRIES*8)
+#define tlb_data_0_hits (tlb_code_0_hits + 8)
+#define tlb_data_8_hits (tlb_data_0_hits + 8)
+#define tlb_code_0_misses (tlb_data_8_hits + 8)
+#define tlb_data_0_misses (tlb_code_0_misses + 8)
+#define tlb_data_8_misses (tlb_data_0_misses + 8)
+#define tlb_code_0_lru (tlb_data_8_misses + 8)
+#define tlb_data_0_lru (tlb_code_0_lru + TLB_SETS)
+#define tlb_data_8_lru (tlb_data_0_lru + TLB_SETS)
+
+#define ras (tlb_data_8_lru + TLB_SETS + 4)
+#define ras_hits (ras + PPC_RAS_SIZE*32)
+#define ras_misses (ras_hits + 8)
+#define ras_top (ras_misses + 8)
+
+//STRUCT(PPC_RAS_Entry)
+#define ras_epoch 0
+#define ras_host 8
+#define ras_ea 16
+#define ras_mode 20
 
 //STRUCT(JITC)
 #define clientPages 0
+#define translatedPages (clientPages + 8)
 
 //STRUCT(ClientPage)
 #define entrypoints 0
-#define tcf_current (entrypoints + 1024*8)
-#define baseaddress (tcf_current + 8)
+#define chunks (entrypoints + 16*8)
+#define baseaddress (chunks + 8)
 #define bytesLeft (baseaddress + 4)
 #define tcp (bytesLeft + 4)
 #define moreRU (tcp + 8)
 #define lessRU (moreRU + 8)
+#define translatedLines (lessRU + 8)
 
 #define curCPU(r) rdi+r
 #define curCPUoffset(frame) rsp+(8+8*frame)
@@ -117,4 +156,31 @@
 	checkCurCPU
 .endm
 
+/*
+ *	Calls host code with the MXCSR of the client restored afterwards.
+ *	Its exception flags are collected for the FPSCR (see
+ *	ppc_fpu_sync_fpscr), so host floating-point code must not
+ *	add to them. Preserves rax and rdx.
+ */
+.macro call_host func
+	sub	rsp, 16
+	stmxcsr	[rsp]
+	call	\func
+	ldmxcsr	[rsp]
+	add	rsp, 16
+.endm
+
+/*
+ *	Like call_host, but instead of "jmp func" (with the
+ *	same stack alignment in func)
+ */
+.macro jmp_host func
+	sub	rsp, 8
+	stmxcsr	[rsp]
+	call	\func
+	ldmxcsr	[rsp]
+	add	rsp, 8
+	ret
+.endm
+
 .text
@@ -1,6 +1,6 @@
 /*
  *	PearPC
- *	jitc_debug.h
+ *	jitc_debug.cc
  *
  *	Copyright (C) 2004 Sebastian Biallas (sb@biallas.net)
  *
@@ -20,7 +20,14 @@
 
 #include <cstdarg>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#ifdef __linux__
+#include <ctime>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 
 #include "tools/data.h"
 #include "tools/str.h"
@@ -33,13 +40,33 @@
 #include "jitc_asm.h"
 #include "jitc_debug.h"
 
-#ifdef JITC_DEBUG
-
 #include "io/prom/promosi.h"
 
+uint gJITCDebug;
+
+static FILE *gPerfMap;
+static FILE *gJitdump;
+static void *gJitdumpMarker;
+static uint64 gJitdumpIndex;
+static FILE *gBinLog;
 static FILE *gDebugLog;
 static AVLTree *symbols;
 
+/*
+ *	The block being translated
+ */
+struct JITCDebugInsnPos {
+	uint32 pa;
+	uint32 opc;
+	NativeAddress host;
+};
+
+static NativeAddress gBlockStart;	// of the current part, NULL if none
+static uint32 gBlockPA;
+static uint gBlockFlags;
+static JITCDebugInsnPos *gInsns;
+static uint gInsnCount, gInsnMax;
+
 static char *symbol_lookup(CPU_ADDR addr, int *symstrlen, void *context)
 {
 /*	foreach(KeyValue, kv, *symbols, {
@@ -73,55 +100,226 @@ inline static void disasmPPC(uint32 code, uint32 ea, char *result)
 	strcpy(result, dis.str(dis.decode(code_buf, 4, addr), 0));
 }
 
-inline static int disasmX86(const byte *code, uint64 ea, char *result)
+inline static int disasmX86(const byte *code, int maxlen, char *result)
 {
 	x86_64dis dis;
 	CPU_ADDR addr;
-	addr.flat64.addr = ea;
+	addr.flat64.addr = uint64(code);
 	addr_sym_func = symbol_lookup;
-	dis_insn *ret = dis.decode(code, 15, addr);
+	dis_insn *ret = dis.decode(code, MIN(maxlen, 15), addr);
 	strcpy(result, dis.str(ret, DIS_STYLE_HEX_NOZEROPAD));
 	return dis.getSize(ret);
 }
 
-void jitcDebugLogAdd(const char *fmt, ...)
+static void jitcDebugLogAdd(const char *fmt, ...)
 {
 	va_list ap;
 
 	va_start(ap, fmt);
 	ht_vfprintf(gDebugLog, fmt, ap);
 	va_end(ap);
+}
+
+static void jitcDebugLogCode(NativeAddress start, NativeAddress end)
+{
+	while (start < end) {
+		char str[128];
+		int size = disasmX86(start, end - start, str);
+		if (size < 1 || size > end - start) size = end - start;
+		jitcDebugLogAdd("  %p ", start);
+		for (int i=0; i < 15; i++) {
+			if (i < size) {
+				jitcDebugLogAdd("%02x", start[i]);
+			} else {
+				jitcDebugLogAdd("  ");
+			}
+		}
+		jitcDebugLogAdd("  %s\n", str);
+		start += size;
+	}
+}
+
+/*
+ *	The host code is disassembled in pieces between the client
+ *	instructions, since it can contain data (e.g. at chaining sites).
+ */
+static void jitcDebugLogBlock(const char *name, NativeAddress start, NativeAddress end)
+{
+	jitcDebugLogAdd("=== %s: %p, %d bytes ===\n", name, start, int(end - start));
+	NativeAddress p = start;
+	for (uint i=0; i < gInsnCount; i++) {
+		jitcDebugLogCode(p, gInsns[i].host);
+		char str[128];
+		disasmPPC(gInsns[i].opc, gInsns[i].pa, str);
+		jitcDebugLogAdd("%08x   %08x  %s\n", gInsns[i].pa, gInsns[i].opc, str);
+		p = gInsns[i].host;
+	}
+	jitcDebugLogCode(p, end);
 	fflush(gDebugLog);
 }
 
-void jitcDebugLogNewInstruction(JITC &jitc)
+#ifdef __linux__
+/*
+ *	See tools/perf/Documentation/jitdump-specification.txt
+ *	in the Linux sources
+ */
+#define JITDUMP_MAGIC		0x4a695444
+#define JITDUMP_VERSION		1
+#define JITDUMP_EM_X86_64	62
+#define JITDUMP_CODE_LOAD	0
+#define JITDUMP_CODE_CLOSE	3
+
+struct JitdumpHeader {
+	uint32	magic;
+	uint32	version;
+	uint32	totalSize;
+	uint32	elfMach;
+	uint32	pad1;
+	uint32	pid;
+	uint64	timestamp;
+	uint64	flags;
+};
+
+struct JitdumpRecord {
+	uint32	id;
+	uint32	totalSize;
+	uint64	timestamp;
+};
+
+struct JitdumpCodeLoad {
+	JitdumpRecord r;
+	uint32	pid;
+	uint32	tid;
+	uint64	vma;
+	uint64	codeAddr;
+	uint64	codeSize;
+	uint64	codeIndex;
+	// followed by the name (0-terminated) and the code
+};
+
+/*
+ *	perf must be told to use the same clock (perf record -k mono)
+ */
+static uint64 jitdumpTimestamp()
 {
-	char str[128];
-	disasmPPC(jitc.current_opc, jitc.pc, str);
-	jitcDebugLogAdd("%08x   %08x  %s\n", jitc.pc, jitc.current_opc, str);
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
 }
+#endif
 
-void jitcDebugLogEmit(JITC &jitc, const byte *insn, int size)
+/*
+ *	Writes the code from start to end (of the current block)
+ *	to all enabled outputs
+ */
+static void jitcDebugWrite(NativeAddress start, NativeAddress end)
 {
-	char str[128];
-	int size1 = disasmX86(insn, uint64(jitc.currentPage->tcp), str);
-	if (size != size1) jitcDebugLogAdd(" kaputt! ");
-	jitcDebugLogAdd("  ");
-	jitcDebugLogAdd("%p ", jitc.currentPage->tcp);
-	for (int i=0; i < 15; i++) {
-		if (i < size) {
-			jitcDebugLogAdd("%02x", insn[i]);
-		} else {
-			jitcDebugLogAdd("  ");
+	uint32 size = end - start;
+	if (!size) return;
+
+	char name[32];
+	const char *prefix = "ppc_";
+	if (gBlockFlags & JITC_DEBUG_BLOCK_TRACE) prefix = "ppc_trace_";
+	if (gBlockFlags & JITC_DEBUG_BLOCK_SNAPSHOT) prefix = "ppc_page_";
+	ht_snprintf(name, sizeof name, "%s%08x", prefix, gBlockPA);
+
+	if (gPerfMap) {
+		uint64 host = uint64(start);
+		ht_fprintf(gPerfMap, "%qx %x %s\n", &host, size, name);
+		fflush(gPerfMap);
+	}
+#ifdef __linux__
+	if (gJitdump) {
+		uint nameSize = strlen(name) + 1;
+		JitdumpCodeLoad load;
+		load.r.id = JITDUMP_CODE_LOAD;
+		load.r.totalSize = sizeof load + nameSize + size;
+		load.r.timestamp = jitdumpTimestamp();
+		load.pid = getpid();
+		load.tid = syscall(SYS_gettid);
+		load.vma = load.codeAddr = uint64(start);
+		load.codeSize = size;
+		load.codeIndex = gJitdumpIndex++;
+		fwrite(&load, sizeof load, 1, gJitdump);
+		fwrite(name, nameSize, 1, gJitdump);
+		fwrite(start, size, 1, gJitdump);
+	}
+#endif
+	if (gBinLog) {
+		JITCDebugBlock block;
+		block.host = uint64(start);
+		block.codeSize = size;
+		block.insnCount = gInsnCount;
+		block.pa = gBlockPA;
+		block.flags = gBlockFlags;
+		fwrite(&block, sizeof block, 1, gBinLog);
+		for (uint i=0; i < gInsnCount; i++) {
+			JITCDebugInsn insn;
+			insn.pa = gInsns[i].pa;
+			insn.opc = gInsns[i].opc;
+			insn.hostOfs = gInsns[i].host - start;
+			fwrite(&insn, sizeof insn, 1, gBinLog);
 		}
+		fwrite(start, size, 1, gBinLog);
+	}
+	if (gDebugLog) jitcDebugLogBlock(name, start, end);
+}
+
+void jitcDebugBeginIntern(JITC &jitc, uint32 pa, uint flags)
+{
+	gBlockStart = jitc.currentPage->tcp;
+	gBlockPA = pa;
+	gBlockFlags = flags;
+	gInsnCount = 0;
+}
+
+void jitcDebugInstructionIntern(JITC &jitc)
+{
+	// not within a block while looking for the register state of a trace
+	if (!gBlockStart) return;
+	if (gInsnCount == gInsnMax) {
+		gInsnMax = gInsnMax ? gInsnMax * 2 : 256;
+		gInsns = (JITCDebugInsnPos *)realloc(gInsns, gInsnMax * sizeof *gInsns);
 	}
-	jitcDebugLogAdd("  %s\n", str);
+	JITCDebugInsnPos &insn = gInsns[gInsnCount++];
+	insn.pa = jitc.currentPage->baseaddress + jitc.pc;
+	insn.opc = jitc.current_opc;
+	insn.host = jitc.currentPage->tcp;
 }
-                                                  
-void jitcDebugInit()
+
+void jitcDebugSplitIntern(JITC &jitc, NativeAddress end)
+{
+	if (!gBlockStart) return;
+	// an instruction which hasn't emitted anything before the jump moves along
+	uint count = gInsnCount;
+	while (count && gInsns[count-1].host >= end - 5) count--;
+	uint moved = gInsnCount - count;
+	gInsnCount = count;
+	jitcDebugWrite(gBlockStart, end);
+	gBlockStart = jitc.currentPage->tcp;
+	memmove(gInsns, gInsns + count, moved * sizeof *gInsns);
+	for (uint i=0; i < moved; i++) gInsns[i].host = gBlockStart;
+	gInsnCount = moved;
+}
+
+void jitcDebugEndIntern(JITC &jitc)
+{
+	if (!gBlockStart) return;
+	jitcDebugWrite(gBlockStart, jitc.currentPage->tcp);
+	gBlockStart = NULL;
+	gInsnCount = 0;
+}
+
+void jitcDebugCodeIntern(uint32 pa, NativeAddress code, uint32 size, uint flags)
+{
+	gBlockPA = pa;
+	gBlockFlags = flags;
+	gInsnCount = 0;
+	jitcDebugWrite(code, code + size);
+}
+
+static void jitcDebugInitSymbols()
 {
-//	gDebugLog = stdout;
-	gDebugLog = fopen("jitc.log", "w");
 	symbols = new AVLTree(true);
 #if 0
 	for (int i=0; i<32; i++) {
@@ -222,15 +420,103 @@ void jitcDebugInit()
 	symbols->insert(new KeyValue(new UInt64(uint64(&ppc_mmu_tlb_invalidate_all_asm)), new String("ppc_mmu_tlb_invalidate_all_asm")));
 	symbols->insert(new KeyValue(new UInt64(uint64(&ppc_start_jitc_asm)), new String("ppc_start_jitc_asm")));
 	symbols->insert(new KeyValue(new UInt64(uint64(&ppc_new_pc_this_page_asm)), new String("ppc_new_pc_this_page_asm")));
+	symbols->insert(new KeyValue(new UInt64(uint64(&ppc_new_pc_indirect_asm)), new String("ppc_new_pc_indirect_asm")));
+	symbols->insert(new KeyValue(new UInt64(uint64(&ppc_new_pc_return_asm)), new String("ppc_new_pc_return_asm")));
+	symbols->insert(new KeyValue(new UInt64(uint64(&ppc_ras_push_asm)), new String("ppc_ras_push_asm")));
 	symbols->insert(new KeyValue(new UInt64(uint64(&ppc_heartbeat_ext_rel_asm)), new String("ppc_heartbeat_ext_rel_asm")));
-	symbols->insert(new KeyValue(new UInt64(uint64(&ppc_flush_flags_signed_0_asm)), new String("ppc_flush_flags_signed_0_asm")));
-	symbols->insert(new KeyValue(new UInt64(uint64(&ppc_flush_flags_unsigned_0_asm)), new String("ppc_flush_flags_unsigned_0_asm")));
+	symbols->insert(new KeyValue(new UInt64(uint64(&ppc_flush_flags_signed_cr0_asm)), new String("ppc_flush_flags_signed_cr0_asm")));
+	symbols->insert(new KeyValue(new UInt64(uint64(&ppc_flush_flags_unsigned_cr0_asm)), new String("ppc_flush_flags_unsigned_cr0_asm")));
 	symbols->insert(new KeyValue(new UInt64(uint64(&call_prom_osi)), new String("call_prom_osi")));
 }
 
-void jitcDebugDone()
+void jitcDebugInit(uint flags)
 {
-	fclose(gDebugLog);
+#ifdef __linux__
+	char name[64];
+	if (flags & JITC_DEBUG_PERF_MAP) {
+		ht_snprintf(name, sizeof name, "/tmp/perf-%d.map", int(getpid()));
+		gPerfMap = fopen(name, "w");
+		if (gPerfMap) {
+			ht_printf("[JITC] writing perf map to %s\n", name);
+		} else {
+			ht_printf("[JITC] can't create %s\n", name);
+		}
+	}
+	if (flags & JITC_DEBUG_JITDUMP) {
+		ht_snprintf(name, sizeof name, "jit-%d.dump", int(getpid()));
+		gJitdump = fopen(name, "w+");
+		if (gJitdump) {
+			JitdumpHeader h;
+			memset(&h, 0, sizeof h);
+			h.magic = JITDUMP_MAGIC;
+			h.version = JITDUMP_VERSION;
+			h.totalSize = sizeof h;
+			h.elfMach = JITDUMP_EM_X86_64;
+			h.pid = getpid();
+			h.timestamp = jitdumpTimestamp();
+			fwrite(&h, sizeof h, 1, gJitdump);
+			fflush(gJitdump);
+			// perf record finds the file by this (executable) mapping
+			gJitdumpMarker = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC, MAP_PRIVATE, fileno(gJitdump), 0);
+			if (gJitdumpMarker == MAP_FAILED) gJitdumpMarker = NULL;
+			ht_printf("[JITC] writing jitdump to %s\n", name);
+		} else {
+			ht_printf("[JITC] can't create %s\n", name);
+		}
+	}
+#else
+	if (flags & (JITC_DEBUG_PERF_MAP | JITC_DEBUG_JITDUMP)) {
+		ht_printf("[JITC] perf map and jitdump are only supported on Linux\n");
+	}
+#endif
+	if (flags & JITC_DEBUG_BINLOG) {
+		gBinLog = fopen("jitc.bin", "wb");
+		if (gBinLog) {
+			fwrite(JITC_DEBUG_BINLOG_MAGIC, 8, 1, gBinLog);
+		} else {
+			ht_printf("[JITC] can't create jitc.bin\n");
+		}
+	}
+	if (flags & JITC_DEBUG_LOG) {
+		gDebugLog = fopen("jitc.log", "w");
+		if (gDebugLog) {
+			jitcDebugInitSymbols();
+		} else {
+			ht_printf("[JITC] can't create jitc.log\n");
+		}
+	}
+	gJITCDebug = (gPerfMap ? JITC_DEBUG_PERF_MAP : 0)
+		| (gJitdump ? JITC_DEBUG_JITDUMP : 0)
+		| (gBinLog ? JITC_DEBUG_BINLOG : 0)
+		| (gDebugLog ? JITC_DEBUG_LOG : 0);
 }
 
+void jitcDebugDone()
+{
+	gJITCDebug = 0;
+	if (gPerfMap) {
+		fclose(gPerfMap);
+		gPerfMap = NULL;
+	}
+#ifdef __linux__
+	if (gJitdump) {
+		JitdumpRecord close;
+		close.id = JITDUMP_CODE_CLOSE;
+		close.totalSize = sizeof close;
+		close.timestamp = jitdumpTimestamp();
+		fwrite(&close, sizeof close, 1, gJitdump);
+		if (gJitdumpMarker) munmap(gJitdumpMarker, sysconf(_SC_PAGESIZE));
+		gJitdumpMarker = NULL;
+		fclose(gJitdump);
+		gJitdump = NULL;
+	}
 #endif
+	if (gBinLog) {
+		fclose(gBinLog);
+		gBinLog = NULL;
+	}
+	if (gDebugLog) {
+		fclose(gDebugLog);
+		gDebugLog = NULL;
+	}
+}
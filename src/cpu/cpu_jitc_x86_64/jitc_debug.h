@@ -21,8 +21,6 @@
 #ifndef __JITC_DEBUG_H__
 #define __JITC_DEBUG_H__
 
-#define JITC_DEBUG
-
 static inline UNUSED uint64 jitcDebugGetTicks()
 {
 	uint32 s0, s1;
@@ -30,32 +28,92 @@ static inline UNUSED uint64 jitcDebugGetTicks()
 	return ((uint64)s1)<<32 | s0;
 }
 
-#ifdef JITC_DEBUG
+/*
+ *	Instrumentation of the translated code, selected at runtime
+ *	(config key jitc_debug) by a combination of
+ */
+#define JITC_DEBUG_PERF_MAP	1	// /tmp/perf-<pid>.map, for perf top/report
+#define JITC_DEBUG_JITDUMP	2	// jit-<pid>.dump, for perf inject --jit
+#define JITC_DEBUG_BINLOG	4	// jitc.bin, see JITCDebugBlock
+#define JITC_DEBUG_LOG		8	// jitc.log, disassembly of all code (slow)
+
+/*
+ *	jitc.bin starts with JITC_DEBUG_BINLOG_MAGIC, followed by one
+ *	record for every piece of code translated (a block can be split
+ *	if it continues in the next generation):
+ *	a JITCDebugBlock, insnCount JITCDebugInsn and codeSize bytes of code.
+ *	All in host byte order.
+ */
+#define JITC_DEBUG_BINLOG_MAGIC	"PPCJITB1"
+
+struct JITCDebugBlock {
+	uint64	host;		// address of the code
+	uint32	codeSize;
+	uint32	insnCount;
+	uint32	pa;		// client (physical) address of the first instruction
+	uint32	flags;		// JITC_DEBUG_BLOCK_*
+} PACKED;
+
+#define JITC_DEBUG_BLOCK_TRACE		1
+#define JITC_DEBUG_BLOCK_SNAPSHOT	2
+
+struct JITCDebugInsn {
+	uint32	pa;
+	uint32	opc;
+	uint32	hostOfs;	// relative to JITCDebugBlock::host
+} PACKED;
 
-void jitcDebugLogNewInstruction(JITC &jitc);
-void jitcDebugLogEmit(JITC &jitc, const byte *insn, int size);
-void jitcDebugLogAdd(const char *fmt, ...);
+extern uint gJITCDebug;
 
-void jitcDebugInit();
+void jitcDebugInit(uint flags);
 void jitcDebugDone();
 
-#else
+void jitcDebugBeginIntern(JITC &jitc, uint32 pa, uint flags);
+void jitcDebugInstructionIntern(JITC &jitc);
+void jitcDebugSplitIntern(JITC &jitc, NativeAddress end);
+void jitcDebugEndIntern(JITC &jitc);
+void jitcDebugCodeIntern(uint32 pa, NativeAddress code, uint32 size, uint flags);
 
-static inline UNUSED void jitcDebugLogNewInstruction(JITC &jitc)
+/*
+ *	Called before the code of a block (starting at the client physical address pa)
+ *	is emitted at jitc.currentPage->tcp
+ */
+static inline void jitcDebugBegin(JITC &jitc, uint32 pa, uint flags = 0)
 {
+	if (gJITCDebug) jitcDebugBeginIntern(jitc, pa, flags);
 }
-static inline UNUSED void jitcDebugLogEmit(JITC &jitc, const byte *insn, int size)
+
+/*
+ *	Called before each client instruction is translated
+ */
+static inline void jitcDebugInstruction(JITC &jitc)
 {
+	if (gJITCDebug & (JITC_DEBUG_BINLOG | JITC_DEBUG_LOG)) jitcDebugInstructionIntern(jitc);
 }
-static inline UNUSED void jitcDebugLogAdd(const char *fmt, ...)
+
+/*
+ *	Called when the block continues in the next generation,
+ *	the old part ends at end.
+ */
+static inline void jitcDebugSplit(JITC &jitc, NativeAddress end)
 {
+	if (gJITCDebug) jitcDebugSplitIntern(jitc, end);
 }
-static inline UNUSED void jitcDebugInit()
+
+/*
+ *	Called after the block has been translated
+ */
+static inline void jitcDebugEnd(JITC &jitc)
 {
+	if (gJITCDebug) jitcDebugEndIntern(jitc);
 }
-static inline UNUSED void jitcDebugDone()
+
+/*
+ *	Code which hasn't been translated right now (e.g. from the snapshot)
+ */
+static inline void jitcDebugCode(uint32 pa, NativeAddress code, uint32 size, uint flags)
 {
+	if (gJITCDebug) jitcDebugCodeIntern(pa, code, size, flags);
 }
-#endif
 
 #endif
@@ -449,8 +449,10 @@ void ppc_opc_addmex(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_addmex(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_addmex);
-	return flowEndBlock;
+	ppc_opc_gen_interpret_inline(jitc, ppc_opc_addmex,
+		PPC_INTERPRET_GPR_A | PPC_INTERPRET_Rc,
+		PPC_INTERPRET_GPR_D | PPC_INTERPRET_Rc);
+	return flowContinue;
 	
 }
 /*
@@ -720,25 +722,11 @@ JITCFlow ppc_opc_gen_cmp(JITC &jitc)
 	int rA, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, cr, rA, rB);
 	cr >>= 2;
-	jitc.clobberCarryAndFlags();
+	jitc.overwriteFlags(PPC_CRx(cr));
 	NativeReg a = jitc.getClientRegister(PPC_GPR(rA));
 	NativeReg b = jitc.getClientRegister(PPC_GPR(rB));
 	jitc.asmALU32(X86_CMP, a, b);
-#if 1
-	if (cr == 0) {
-		jitc.asmCALL((NativeAddress)ppc_flush_flags_signed_0_asm);
-	} else {
-		jitc.clobberRegister(RAX | NATIVE_REG);
-		jitc.asmMOV32_NoFlags(RAX, (7-cr)/2);
-		jitc.asmCALL((cr & 1) ? (NativeAddress)ppc_flush_flags_signed_odd_asm : (NativeAddress)ppc_flush_flags_signed_even_asm);
-	}
-#else
-	if (cr & 1) {
-		jitc.flushFlagsAfterCMP_L((7-cr)/2);
-	} else {
-		jitc.flushFlagsAfterCMP_U((7-cr)/2);
-	}
-#endif
+	jitc.mapFlagsDirty(PPC_CRx(cr), flagsSigned);
 	return flowContinue;
 }
 /*
@@ -774,24 +762,10 @@ JITCFlow ppc_opc_gen_cmpi(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, cr, rA, imm);
 	cr >>= 2;
-	jitc.clobberCarryAndFlags();
+	jitc.overwriteFlags(PPC_CRx(cr));
 	NativeReg a = jitc.getClientRegister(PPC_GPR(rA));
 	jitc.asmALU32(X86_CMP, a, imm);
-#if 1
-	if (cr == 0) {
-		jitc.asmCALL((NativeAddress)ppc_flush_flags_signed_0_asm);
-	} else {
-		jitc.clobberRegister(RAX | NATIVE_REG);
-		jitc.asmMOV32_NoFlags(RAX, (7-cr)/2);
-		jitc.asmCALL((cr & 1) ? (NativeAddress)ppc_flush_flags_signed_odd_asm : (NativeAddress)ppc_flush_flags_signed_even_asm);
-	}
-#else
-	if (cr & 1) {
-		jitc.flushFlagsAfterCMP_L((7-cr)/2);
-	} else {
-		jitc.flushFlagsAfterCMP_U((7-cr)/2);
-	}
-#endif
+	jitc.mapFlagsDirty(PPC_CRx(cr), flagsSigned);
 	return flowContinue;
 }
 /*
@@ -825,25 +799,11 @@ JITCFlow ppc_opc_gen_cmpl(JITC &jitc)
 	int rA, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, cr, rA, rB);
 	cr >>= 2;
-	jitc.clobberCarryAndFlags();
+	jitc.overwriteFlags(PPC_CRx(cr));
 	NativeReg a = jitc.getClientRegister(PPC_GPR(rA));
 	NativeReg b = jitc.getClientRegister(PPC_GPR(rB));
 	jitc.asmALU32(X86_CMP, a, b);
-#if 1
-	if (cr == 0) {
-		jitc.asmCALL((NativeAddress)ppc_flush_flags_unsigned_0_asm);
-	} else {
-		jitc.clobberRegister(RAX | NATIVE_REG);
-	        jitc.asmMOV32_NoFlags(RAX, (7-cr)/2);
-		jitc.asmCALL((cr & 1) ? (NativeAddress)ppc_flush_flags_unsigned_odd_asm : (NativeAddress)ppc_flush_flags_unsigned_even_asm);
-	}
-#else
-	if (cr & 1) {
-		jitc.flushFlagsAfterCMPL_L((7-cr)/2);
-	} else {
-		jitc.flushFlagsAfterCMPL_U((7-cr)/2);
-	}
-#endif
+	jitc.mapFlagsDirty(PPC_CRx(cr), flagsUnsigned);
 	return flowContinue;
 }
 /*
@@ -879,24 +839,10 @@ JITCFlow ppc_opc_gen_cmpli(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_UImm(jitc.current_opc, cr, rA, imm);
 	cr >>= 2;
-	jitc.clobberCarryAndFlags();
+	jitc.overwriteFlags(PPC_CRx(cr));
 	NativeReg a = jitc.getClientRegister(PPC_GPR(rA));
 	jitc.asmALU32(X86_CMP, a, imm);
-#if 1
-	if (cr == 0) {
-		jitc.asmCALL((NativeAddress)ppc_flush_flags_unsigned_0_asm);
-	} else {
-		jitc.clobberRegister(RAX | NATIVE_REG);
-		jitc.asmMOV32_NoFlags(RAX, (7-cr)/2);
-		jitc.asmCALL((cr & 1) ? (NativeAddress)ppc_flush_flags_unsigned_odd_asm : (NativeAddress)ppc_flush_flags_unsigned_even_asm);
-	}
-#else
-	if (cr & 1) {
-		jitc.flushFlagsAfterCMPL_L((7-cr)/2);
-	} else {
-		jitc.flushFlagsAfterCMPL_U((7-cr)/2);
-	}
-#endif
+	jitc.mapFlagsDirty(PPC_CRx(cr), flagsUnsigned);
 	return flowContinue;
 }
 
@@ -2270,8 +2216,10 @@ JITCFlow ppc_opc_gen_srawx(JITC &jitc)
 
 	return flowContinue;
 #endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_srawx);
-	return flowEndBlock;
+	ppc_opc_gen_interpret_inline(jitc, ppc_opc_srawx,
+		PPC_INTERPRET_GPR_D | PPC_INTERPRET_GPR_B | PPC_INTERPRET_Rc,
+		PPC_INTERPRET_GPR_A | PPC_INTERPRET_Rc);
+	return flowContinue;
 }
 /*
  *	srawix		Shift Right Algebraic Word Immediate
@@ -2662,8 +2610,10 @@ void ppc_opc_subfmex(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_subfmex(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_subfmex);
-	return flowEndBlock;
+	ppc_opc_gen_interpret_inline(jitc, ppc_opc_subfmex,
+		PPC_INTERPRET_GPR_A | PPC_INTERPRET_Rc,
+		PPC_INTERPRET_GPR_D | PPC_INTERPRET_Rc);
+	return flowContinue;
 }
 /*
  *	subfmeox	Subtract From Minus One Extended with Overflow
@@ -43,10 +43,34 @@ uint32 gBreakpoint2;
 extern "C" void ppc_display_jitc_stats(PPC_CPU_State &aCPU)
 {
 	JITC &jitc = *aCPU.jitc;
-	ht_printf("pg.dest:   write: %qd    out of pages: %qd   out of tc: %qd\r", &jitc.destroy_write, &jitc.destroy_oopages, &jitc.destroy_ootc);
+	ht_printf("pg.dest:   write: %qd    dma: %qd    out of pages: %qd   out of tc: %qd   chain: %qd   unchain: %qd\r", &jitc.destroy_write, &jitc.destroy_dma, &jitc.destroy_oopages, &jitc.destroy_ootc, &jitc.chain_link, &jitc.chain_unlink);
+	ht_printf("\nsnapshot: %d pages   hits: %qd\r", jitc.snapshotCount, &jitc.snapshot_hit);
+	uint64 live = 0;
+	for (ClientPage *cp = jitc.LRUpage; cp; cp = cp->moreRU) {
+		for (TranslationCacheChunk *tcc = cp->chunks; tcc; tcc = tcc->prev) live += tcc->size;
+	}
+	ht_printf("\narena: emitted: %qd   live: %qd   wasted: %qd   gen. recycled: %qd   skipped: %qd   links: %qd\r",
+		&jitc.arena_bytes, &live, &jitc.arena_waste, &jitc.arena_evict, &jitc.arena_skip, &jitc.arena_link);
+	ht_printf("\ntraces: hot loops: %qd   built: %qd   looping: %qd   failed: %qd\r",
+		&jitc.trace_hot, &jitc.trace_built, &jitc.trace_loop, &jitc.trace_fail);
+	ht_printf("\nflags: dead cr flushes: %qd\r", &jitc.flags_dead);
+	uint64 ticksPerInsn = jitc.translate_insns ? jitc.translate_ticks / jitc.translate_insns : 0;
+	ht_printf("\ntranslate: blocks: %qd   instructions: %qd   cycles: %qd (%qd per instruction)\r",
+		&jitc.translate_blocks, &jitc.translate_insns, &jitc.translate_ticks, &ticksPerInsn);
+	ht_printf("\nindirect: inline cache fills: %qd   return stack hit/miss: %qd/%qd\r",
+		&jitc.indirect_fill, &aCPU.ras_hits, &aCPU.ras_misses);
+#if TLB_STATS
+	ht_printf("\ntlb hit/miss:   code: %qd/%qd    read: %qd/%qd    write: %qd/%qd\r",
+		&aCPU.tlb_code_hits, &aCPU.tlb_code_misses,
+		&aCPU.tlb_data_read_hits, &aCPU.tlb_data_read_misses,
+		&aCPU.tlb_data_write_hits, &aCPU.tlb_data_write_misses);
+#endif
 }
 
 void ppc_fpu_test();
+void ppc_fpu_clear_host_flags();
+
+extern JITC *gJITC;
 
 uint64 gJITCCompileTicks;
 uint64 gJITCRunTicks;
@@ -85,29 +109,54 @@ uint64 ppc_get_cpu_timebase()
 
 sys_timer gDECtimer;
 sys_semaphore gCPUDozeSem;
+// DEC callbacks may take gCPUDozeSem, so cpu_doze can sleep without a bound
+static bool gDECtimerThreaded;
+static uint64 gCPUDozeStart;
+static uint64 gCPUDozes;
+static uint64 gCPUDozeWakeups;
 
 extern "C" void cpu_doze()
 {
+	sys_lock_semaphore(gCPUDozeSem);
 	if (!gCPU->exception_pending) {
-//		printf("*doze %08x %08x %d\n", gCPU->dec, ppc_cpu_get_pc(0), blbl);
-		sys_lock_semaphore(gCPUDozeSem);
-		sys_wait_semaphore_bounded(gCPUDozeSem, 10);
-		sys_unlock_semaphore(gCPUDozeSem);
-//	sys_timer_struct *timer = reinterpret_cast<sys_timer_struct *>(gDECtimer);
-
-//		printf("/doze (%d)\n", timer_getoverrun(timer->timer_id));
+		gCPUDozes++;
+		if (gDECtimerThreaded) {
+			/*
+			 *	Everything that ends a doze (DEC, interrupts,
+			 *	I/O completions, stop) calls ppc_cpu_wakeup(),
+			 *	so sleep until the next one of them.
+			 */
+			do {
+				sys_wait_semaphore(gCPUDozeSem);
+				gCPUDozeWakeups++;
+			} while (!gCPU->exception_pending);
+		} else {
+			// DEC signal handlers can't wake us up, poll for them
+			sys_wait_semaphore_bounded(gCPUDozeSem, 10);
+			gCPUDozeWakeups++;
+		}
 	}
+	sys_unlock_semaphore(gCPUDozeSem);
 }
 
 void ppc_cpu_wakeup()
 {
+	sys_lock_semaphore(gCPUDozeSem);
 	sys_signal_semaphore(gCPUDozeSem);
+	sys_unlock_semaphore(gCPUDozeSem);
 }
 
 static void decTimerCB(sys_timer t)
 {
 	ppc_cpu_atomic_raise_dec_exception(*gCPU);
-//	cpu_wakeup();
+	if (gDECtimerThreaded) ppc_cpu_wakeup();
+}
+
+static void ppc_cpu_display_idle_stats()
+{
+	uint64 secs = (sys_get_hiresclk_ticks() - gCPUDozeStart) / sys_get_hiresclk_ticks_per_second();
+	ht_printf("[CPU] idle: %qd dozes   %qd wakeups (%qd/s)\n",
+		gCPUDozes, gCPUDozeWakeups, secs ? gCPUDozeWakeups / secs : gCPUDozeWakeups);
 }
 
 void ppc_cpu_run()
@@ -118,7 +167,6 @@ void ppc_cpu_run()
 	gJITCCompileTicks = 0;
 	gJITCRunTicksStart = jitcDebugGetTicks();
 	PPC_CPU_TRACE("execution started at %08x\n", gCPU->pc);
-	jitcDebugInit();
 /*
 	PPC_CPU_WARN("clock ticks / second = %08qx\n", q);
 	q = sys_get_cpu_ticks();
@@ -132,13 +180,19 @@ void ppc_cpu_run()
 		ht_printf("Unable to create timer\n");
 		exit(1);
 	}
+	gDECtimerThreaded = sys_timer_callback_is_threaded(gDECtimer);
+	gCPUDozeStart = sys_get_hiresclk_ticks();
 	if ((sizeof *gCPU) % 8) {
 		ht_printf("compilation problem: sizeof gCPU is not multiple of 8\n");
 		exit(1);
 	}
 	ht_printf("*** &gCPU: %p, &gJITC: %p\n", gCPU, gCPU->jitc);
 	ht_printf("sizeof cpu: %d\n", int(sizeof(*gCPU)));
+	ppc_fpu_clear_host_flags();
 	ppc_start_jitc_asm(gCPU->pc, &gCPU, sizeof *gCPU);
+	ppc_cpu_display_idle_stats();
+	jitcSaveSnapshot(*gJITC);
+	jitcDebugDone();
 }
 
 void ppc_cpu_map_framebuffer(uint32 pa, uint32 ea)
@@ -158,6 +212,7 @@ void ppc_cpu_map_framebuffer(uint32 pa, uint32 ea)
 void ppc_cpu_stop()
 {
 	ppc_cpu_atomic_raise_stop_exception(*gCPU);
+	ppc_cpu_wakeup();
 }
 
 uint64	ppc_get_clock_frequency(int cpu)
@@ -194,6 +249,7 @@ void	ppc_cpu_set_gpr(int cpu, int i, uint32 newvalue)
 void	ppc_cpu_set_msr(int cpu, uint32 newvalue)
 {
 	gCPU->msr = newvalue;
+	gCPU->tlb_context = PPC_MMU_TLB_CONTEXT(newvalue);
 }
 
 void	ppc_cpu_set_pc(int cpu, uint32 newvalue)
@@ -229,6 +285,11 @@ void ppc_set_singlestep_nonverbose(bool v)
 }
 
 #define CPU_KEY_PVR	"cpu_pvr"
+#define CPU_KEY_JITC_SNAPSHOT	"jitc_snapshot_file"
+#define CPU_KEY_JITC_PAGES	"jitc_client_pages"
+#define CPU_KEY_JITC_TC_SIZE	"jitc_cache_size"
+#define CPU_KEY_JITC_TRACE	"jitc_trace_threshold"
+#define CPU_KEY_JITC_DEBUG	"jitc_debug"
 
 #include "configparser.h"
 
@@ -246,6 +307,7 @@ bool ppc_cpu_init()
 	}
 	
 	gCPU->x87cw = 0x37f;
+	jitcResetReturnStack(*gCPU);
 
 	sys_create_semaphore(&gCPUDozeSem);
 
@@ -268,10 +330,53 @@ bool ppc_cpu_init()
 //	exit(1);
 	gCPU->jitc = new JITC;
 	gJITC = gCPU->jitc;
-	return gCPU->jitc->init(4096, 64*1024*1024);
+	/*
+	 *	By default scale with the client memory:
+	 *	1/8 of the client pages, at least 4096, and
+	 *	half the client memory as translation cache,
+	 *	32 MiB .. 1 GiB (so rel32 can reach everything,
+	 *	it is mapped into the low 2 GiB)
+	 *	Configured values are kept within the same limits,
+	 *	at most all client pages.
+	 */
+	uint minClientPages = 4096;
+	uint maxPages = MAX(minClientPages, gMemorySize / 4096);
+	uint maxClientPages = gConfig->getConfigInt(CPU_KEY_JITC_PAGES);
+	if (!maxClientPages) {
+		maxClientPages = MAX(minClientPages, gMemorySize / 4096 / 8);
+	} else if (maxClientPages < minClientPages || maxClientPages > maxPages) {
+		uint pages = MIN(MAX(maxClientPages, minClientPages), maxPages);
+		PPC_CPU_WARN("%s = %d is out of range, using %d\n", CPU_KEY_JITC_PAGES, maxClientPages, pages);
+		maxClientPages = pages;
+	}
+	uint32 minTCSize = 32U*1024*1024;
+	uint32 maxTCSize = 1024U*1024*1024;
+	uint32 tcSize = gConfig->getConfigInt(CPU_KEY_JITC_TC_SIZE);
+	if (!tcSize) {
+		tcSize = MIN(MAX(gMemorySize / 2, minTCSize), maxTCSize);
+	} else if (tcSize < minTCSize || tcSize > maxTCSize) {
+		uint32 size = MIN(MAX(tcSize, minTCSize), maxTCSize);
+		PPC_CPU_WARN("%s = %u is out of range, using %u\n", CPU_KEY_JITC_TC_SIZE, tcSize, size);
+		tcSize = size;
+	}
+	if (!gCPU->jitc->init(maxClientPages, tcSize)) return false;
+	gJITC->traceThreshold = gConfig->getConfigInt(CPU_KEY_JITC_TRACE);
+	jitcDebugInit(gConfig->getConfigInt(CPU_KEY_JITC_DEBUG));
+
+	String snapshot;
+	gConfig->getConfigString(CPU_KEY_JITC_SNAPSHOT, snapshot);
+	if (!snapshot.isEmpty()) {
+		jitcLoadSnapshot(*gJITC, snapshot.contentChar());
+	}
+	return true;
 }
 
 void ppc_cpu_init_config()
 {
 	gConfig->acceptConfigEntryIntDef("cpu_pvr", 0x000c0201);
+	gConfig->acceptConfigEntryStringDef(CPU_KEY_JITC_SNAPSHOT, "");
+	gConfig->acceptConfigEntryIntDef(CPU_KEY_JITC_PAGES, 0);
+	gConfig->acceptConfigEntryIntDef(CPU_KEY_JITC_TC_SIZE, 0);
+	gConfig->acceptConfigEntryIntDef(CPU_KEY_JITC_TRACE, 64);
+	gConfig->acceptConfigEntryIntDef(CPU_KEY_JITC_DEBUG, 0);
 }
@@ -34,7 +34,44 @@
 #define PPC_BUS_FREQUENCY	(PPC_CLOCK_FREQUENCY/5)
 #define PPC_TIMEBASE_FREQUENCY	(PPC_BUS_FREQUENCY/4)
 
-#define TLB_ENTRIES 32
+/*
+ *	The soft TLB is 2-way set associative with TLB_ENTRIES/2 sets,
+ *	TLB_ENTRIES must be a power of 2. Keep in sync with jitc_common.h
+ */
+#ifndef TLB_ENTRIES
+#define TLB_ENTRIES 512
+#endif
+#define TLB_WAYS 2
+#define TLB_SETS (TLB_ENTRIES / TLB_WAYS)
+
+/*
+ *	Count TLB hits and misses (see ppc_display_jitc_stats).
+ *	This costs a memory add per access, build with -DTLB_STATS=1.
+ */
+#ifndef TLB_STATS
+#define TLB_STATS 0
+#endif
+
+/*
+ *	The return stack predicts the target of blr, see
+ *	ppc_opc_gen_set_lr. PPC_RAS_SIZE must be a power of 2.
+ *	Keep in sync with jitc_common.h
+ */
+#define PPC_RAS_SIZE 16
+
+/*
+ *	The client returns to ea (with the same chain_epoch and
+ *	MSR[IR,PR] as when it called) by jumping to host
+ */
+struct PPC_RAS_Entry {
+	uint64 epoch;
+	byte *host;
+	uint32 ea;		// PPC_RAS_EMPTY if invalid
+	uint32 mode;
+	byte align[8];
+} PACKED;
+
+#define PPC_RAS_EMPTY 1
 
 struct JITC;
 
@@ -100,7 +137,8 @@ struct PPC_CPU_State {
 	bool   ext_exception;
 	bool   stop_exception;
 	bool   singlestep_ignore;
-	byte   align[3];
+	bool   io_exception;
+	byte   align[2];
 
 	uint32 pagetable_base;
 	uint32 pagetable_hashmask;
@@ -124,20 +162,52 @@ struct PPC_CPU_State {
 	uint32 current_code_base;
 
 	/*
-	 *	These are the TLB-Entries
+	 *	Translation context of the current MSR, see
+	 *	PPC_MMU_TLB_CONTEXT. New TLB entries are tagged with it
+	 *	and only entries with the current tag hit.
+	 */
+	uint32 tlb_context;
+	byte   align3[4];
+
+	/*
+	 *	Incremented whenever the effective-to-physical mapping
+	 *	changes (mtsr, BATs, tlbie...). Chained jumps between pages
+	 *	are only valid while this is unchanged. DMA threads increment
+	 *	it too (jitcInvalidateDMA), so it is only changed atomically.
+	 */
+	uint64 chain_epoch;
+
+	/*
+	 *	These are the TLB-Entries, tlb_*[w][s] is way w of set s.
+	 *	tlb_*_lru[s] is the way of set s to be replaced next.
 	 */
-	uint32 tlb_code_eff[TLB_ENTRIES];
-	uint32 tlb_data_read_eff[TLB_ENTRIES];
-	uint32 tlb_data_write_eff[TLB_ENTRIES];
-	uint64 tlb_code_phys[TLB_ENTRIES];
-	uint64 tlb_data_read_phys[TLB_ENTRIES];
-	uint64 tlb_data_write_phys[TLB_ENTRIES];
+	uint32 tlb_code_eff[TLB_WAYS][TLB_SETS];
+	uint32 tlb_data_read_eff[TLB_WAYS][TLB_SETS];
+	uint32 tlb_data_write_eff[TLB_WAYS][TLB_SETS];
+	uint64 tlb_code_phys[TLB_WAYS][TLB_SETS];
+	uint64 tlb_data_read_phys[TLB_WAYS][TLB_SETS];
+	uint64 tlb_data_write_phys[TLB_WAYS][TLB_SETS];
 	uint64 tlb_code_hits;
 	uint64 tlb_data_read_hits;
 	uint64 tlb_data_write_hits;
 	uint64 tlb_code_misses;
 	uint64 tlb_data_read_misses;
 	uint64 tlb_data_write_misses;
+	uint8 tlb_code_lru[TLB_SETS];
+	uint8 tlb_data_read_lru[TLB_SETS];
+	uint8 tlb_data_write_lru[TLB_SETS];
+
+	byte   align4[4];
+	PPC_RAS_Entry ras[PPC_RAS_SIZE];
+	uint64 ras_hits;
+	uint64 ras_misses;
+	uint32 ras_top;
+	byte   align5[8];
+
+	// last result of the native FPU code, see ppc_fpu_sync_fpscr
+	uint64 fprf_result;
+	uint32 fprf_pending;	// 0 or PPC_FPRF_DOUBLE/SINGLE
+	byte   align6[4];
 
 	// for altivec
 	uint32 vscr;
@@ -228,6 +298,7 @@ extern "C" void ppc_cpu_atomic_raise_dec_exception(PPC_CPU_State &aCPU);
 extern "C" void ppc_cpu_atomic_raise_ext_exception(PPC_CPU_State &aCPU);
 extern "C" void ppc_cpu_atomic_raise_stop_exception(PPC_CPU_State &aCPU);
 extern "C" void ppc_cpu_atomic_cancel_ext_exception(PPC_CPU_State &aCPU);
+extern "C" void ppc_cpu_io_exception(PPC_CPU_State &aCPU);
 
 void cpu_wakeup();
 
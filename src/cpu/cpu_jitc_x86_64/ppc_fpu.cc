@@ -19,6 +19,8 @@
  *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#include <xmmintrin.h>
+
 #include "debug/tracers.h"
 #include "ppc_cpu.h"
 #include "ppc_dec.h"
@@ -760,209 +762,236 @@ double ppc_fpu_get_double(ppc_double &d)
  *
  */
 
-#define SWAP do {                                                    \
-	int tmp = frA; frA = frB; frB = tmp;                         \
-	tmp = a; a = b; b = tmp;                                     \
-	X86FloatArithOp tmpop = op; op = rop; rop = tmpop;           \
-} while(0);
+/*
+ *	Native code generation
+ *
+ *	The client FPRs are cached in the native registers like the
+ *	other client registers and moved into XMM0-XMM2 for the
+ *	operation. (The XMM registers hold no client state, so they
+ *	are free to use as scratch.)
+ *
+ *	SSE2 gives the same results as the interpreter as long as
+ *	FPSCR[RN] is round to nearest and the result isn't a NaN.
+ *	Otherwise the interpreter is called in place, so the VX bits
+ *	and the encoding of the NaNs stay exact.
+ *	XX, OX, UX and ZX are collected in the MXCSR by the native
+ *	code and folded into the FPSCR when it is accessed
+ *	(see ppc_fpu_sync_fpscr). So is FPRF: the native code only
+ *	stores its result, which is classified then. Instructions which
+ *	are always interpreted leave FPRF alone, as they did before.
+ */
 
-#if 0 
-static void ppc_opc_gen_binary_floatop(X86FloatArithOp op, X86FloatArithOp rop, int frD, int frA, int frB)
-{
-	jitcFloatRegisterClobberAll();
-//	jitcSetFPUPrecision(53);
-	
-//	ht_printf("binfloatop: %x: %d: %d, %d, %d\n", jitc.pc, op, frD, frA, frB);
-	// op == st(i)/st(0)
-	// rop == st(0)/st(i)
+/*
+ *	Returns the FPRF class of d (C and FPCC), as a single
+ *	precision number if single is set
+ */
+static uint32 ppc_fpu_fprf(uint64 d, bool single)
+{
+	bool sign = d >> 63;
+	uint32 e = (d >> 52) & 0x7ff;
+	uint64 m = d & ((1ULL << 52) - 1);
+	if (e == 0x7ff) {
+		if (m) return 0x11;			// NaN
+		return sign ? 0x09 : 0x05;		// infinity
+	}
+	if (!e && !m) return sign ? 0x12 : 0x02;	// zero
+	if (!e || (single && e < 1023 - 126)) {
+		return sign ? 0x18 : 0x14;		// denormalized
+	}
+	return sign ? 0x08 : 0x04;			// normalized
+}
 
-	// op == st(0)/mem
-	// rop == mem/st(0)
+/*
+ *	Folds the exception flags and the FPRF of the native code
+ *	into the FPSCR. The MXCSR is shared with the host, so host
+ *	code called from translated code restores it afterwards
+ *	(see call_host in jitc_common.h).
+ */
+void ppc_fpu_sync_fpscr(PPC_CPU_State &aCPU)
+{
+	uint32 csr = _mm_getcsr();
+	if (csr & 0x3d) {
+		if (csr & 0x20) aCPU.fpscr |= FPSCR_XX;
+		if (csr & 0x10) aCPU.fpscr |= FPSCR_UX;
+		if (csr & 0x08) aCPU.fpscr |= FPSCR_OX;
+		if (csr & 0x04) aCPU.fpscr |= FPSCR_ZX;
+		_mm_setcsr(csr & ~0x3f);
+	}
+	if (aCPU.fprf_pending) {
+		uint32 fprf = ppc_fpu_fprf(aCPU.fprf_result, aCPU.fprf_pending == PPC_FPRF_SINGLE);
+		aCPU.fpscr = (aCPU.fpscr & ~0x1f000) | (fprf << 12);
+		aCPU.fprf_pending = 0;
+	}
+}
 
-	// frD := frA (op) frB = frB (rop) frA
+/*
+ *	Drops the exception flags the host has collected so far,
+ *	called before entering translated code
+ */
+void ppc_fpu_clear_host_flags()
+{
+	_mm_setcsr(_mm_getcsr() & ~0x3f);
+}
 
-	// make sure client float register aren't mapped to integer registers
-	jitcClobberClientRegisterForFloat(frA);
-	jitcClobberClientRegisterForFloat(frB);
-	jitcInvalidateClientRegisterForFloat(frD);
+/*
+ *	Must come after all other code which changes the
+ *	register mapping, see ppc_opc_gen_fpu_result
+ */
+static NativeAddress ppc_opc_gen_fpu_check_rn(JITC &jitc)
+{
+	NativeReg fpscr = jitc.getClientRegister(PPC_FPSCR);
+	jitc.asmALU32(X86_TEST, fpscr, 3);
+	return jitc.asmJxxFixup(X86_NZ);
+}
 
-	JitcFloatReg a = jitcGetClientFloatRegisterMapping(frA);
-	JitcFloatReg b = jitcGetClientFloatRegisterMapping(frB);
-//	ht_printf("%d -> %d\n", frA, a);
-//	ht_printf("%d -> %d\n", frB, b);
-	if (a == JITC_FLOAT_REG_NONE && b != JITC_FLOAT_REG_NONE) {
-		// b is mapped but not a, swap them
-		SWAP;
-	}
-	if (a != JITC_FLOAT_REG_NONE) {
-		// a is mapped
-		if (frB == frD && frA != frD) {
-			// b = st(a) (op) b
-//			ht_printf("case a\n");
-			b = jitcGetClientFloatRegister(frB, a);
-			if (jitcFloatRegisterIsTOP(b)) {
-				asmFArith_ST0(op, jitcFloatRegisterToNative(a));
-			} else {
-				jitcFloatRegisterXCHGToFront(a);
-				asmFArith_STi(rop, jitcFloatRegisterToNative(b));
-			}
-			jitcFloatRegisterDirty(b);
-		} else if (frA == frD) {
-			// st(a) = st(a) (op) b
-//			ht_printf("case b\n");
-			b = jitcGetClientFloatRegister(frB, a);
-			if (jitcFloatRegisterIsTOP(b)) {
-				asmFArith_STi(op, jitcFloatRegisterToNative(a));
-			} else {
-				jitcFloatRegisterXCHGToFront(a);
-				asmFArith_ST0(rop, jitcFloatRegisterToNative(b));
-			}
-			jitcFloatRegisterDirty(a);
-		} else {
-//			ht_printf("case c\n");
-			// frA != frD != frB (and frA is mapped, frD isn't mapped)
-			a = jitcFloatRegisterDup(a, b);
-//			ht_printf("%d\n", b);
-			// now a is TOP
-			if (b != JITC_FLOAT_REG_NONE) {
-				asmFArith_ST0(rop, jitcFloatRegisterToNative(b));
-			} else {
-				modrm_o modrm;
-				asmFArith(op, x86_mem2(modrm, &aCPU.fpr[frB]));
-			}
-			JitcFloatReg d = jitcGetClientFloatRegisterMapping(frD);
-			if (d == JITC_FLOAT_REG_NONE) {
-				jitcMapClientFloatRegisterDirty(frD, a);
-			} else {
-				jitcFloatRegisterStoreAndPopTOP(d);
-				jitcFloatRegisterDirty(d);
-			}
-		}
-	} else {
-//			ht_printf("case d\n");
-		// neither a nor b is mapped
-		if (frB == frD && frA != frD) {
-			// frB = frA (op) frB, none of them is mapped
-			b = jitcGetClientFloatRegister(frB);
-			jitcFloatRegisterDirty(b);
-			modrm_o modrm;
-			asmFArith(rop, x86_mem2(modrm, &aCPU.fpr[frA]));
-			return;
-		}
-		if (frA == frD) {
-			// frA = frA (op) frB, none of them is mapped
-			a = jitcGetClientFloatRegister(frA);
-			jitcFloatRegisterDirty(a);
-			modrm_o modrm;
-			asmFArith(op, x86_mem2(modrm, &aCPU.fpr[frB]));
-		} else {
-			// frA != frD != frB (and frA, frB aren't mapped)
-			a = jitcGetClientFloatRegisterUnmapped(frA);
-			modrm_o modrm;
-			asmFArith(op, x86_mem2(modrm, &aCPU.fpr[frB]));
-			JitcFloatReg d = jitcGetClientFloatRegisterMapping(frD);
-			if (d == JITC_FLOAT_REG_NONE) {
-				jitcMapClientFloatRegisterDirty(frD, a);
-			} else {
-				jitcFloatRegisterStoreAndPopTOP(d);
-				jitcFloatRegisterDirty(d);
-			}
-		}
-	}
+static NativeAddress ppc_opc_gen_fpu_check_nan(JITC &jitc)
+{
+	jitc.asmALUSD(X86_UCOMISD, XMM0, XMM0);
+	return jitc.asmJxxFixup(X86_PO);
 }
 
-static inline void ppc_opc_gen_unary_floatop(X86FloatOp op, int frD, int frA)
-{
-	jitcClobberClientRegisterForFloat(frA);
-	jitcInvalidateClientRegisterForFloat(frD);
-	if (frD == frA) {
-		JitcFloatReg a = jitcGetClientFloatRegister(frA);
-		jitcFloatRegisterDirty(a);
-		jitcFloatRegisterXCHGToFront(a);
-	} else {
-		JitcFloatReg a = jitcGetClientFloatRegisterMapping(frA);
-		if (a == JITC_FLOAT_REG_NONE) {
-			a = jitcGetClientFloatRegisterUnmapped(frA);
-		} else {
-			a = jitcFloatRegisterDup(a);
-		}
-		JitcFloatReg d = jitcGetClientFloatRegisterMapping(frD);
-		if (d == JITC_FLOAT_REG_NONE) {
-			jitcMapClientFloatRegisterDirty(frD, a);
-		} else {
-			asmFSimple(op);
-			jitcFloatRegisterStoreAndPopTOP(d);
-			jitcFloatRegisterDirty(d);
-			return;
-		}
-	}
-	asmFSimple(op);
+static void ppc_opc_gen_fpu_load(JITC &jitc, NativeVectorReg vreg, int frX)
+{
+	jitc.asmMOVQ(vreg, jitc.getClientRegister(PPC_FPR(frX)));
 }
 
+static void ppc_opc_gen_fpu_round_single(JITC &jitc)
+{
+	jitc.asmALUSD(X86_CVTSD2SS, XMM0, XMM0);
+	jitc.asmALUSD(X86_CVTSS2SD, XMM0, XMM0);
+}
 
 /*
- fmadd     FADD  false
- fmsub     FSUB  false
- fnmadd    FADD  true
- fnmsub    FSUBR false
-*/
+ *	The result is in XMM0. Both fixups lead here,
+ *	|slow| to the interpreter (can be NULL), |fast| to the
+ *	write back of the result.
+ *	The slow path leaves the register mapping as it is,
+ *	so both paths continue with the same mapping.
+ *	fprf is PPC_FPRF_DOUBLE/SINGLE if the result sets FPRF.
+ */
+static void ppc_opc_gen_fpu_result(JITC &jitc, NativeAddress slow, NativeAddress fast, int frD, ppc_opc_function func, uint32 fprf)
+{
+	if (slow) jitc.asmResolveFixup(slow);
+	jitc.asmALU32(X86_MOV, curCPU(current_opc), jitc.current_opc);
+	jitc.asmCALLInPlace((NativeAddress)func);
+	jitc.asmMOVSD(XMM0, curCPUreg(PPC_FPR(frD)));
+	jitc.asmResolveFixup(fast);
+	NativeReg d = jitc.mapClientRegisterDirty(PPC_FPR(frD));
+	jitc.asmMOVQ(d, XMM0);
+	if (fprf) {
+		jitc.asmALU64(X86_MOV, curCPU(fprf_result), d);
+		jitc.asmALU32(X86_MOV, curCPU(fprf_pending), fprf);
+	}
+}
 
-static void ppc_opc_gen_ternary_floatop(X86FloatArithOp op, X86FloatArithOp rop, bool chs, int frD, int frA, int frC, int frB)
-{
-	jitcFloatRegisterClobberAll();
-//	jitcSetFPUPrecision(64);
-	jitcClobberClientRegisterForFloat(frA);
-	jitcClobberClientRegisterForFloat(frC);
-	jitcClobberClientRegisterForFloat(frB);
-	jitcInvalidateClientRegisterForFloat(frD);
+/*
+ *	frD := frA op frB
+ */
+static JITCFlow ppc_opc_gen_fpu_binary(JITC &jitc, X86ALUSDopc op, int frD, int frA, int frB, bool single, ppc_opc_function func)
+{
+	if (jitc.current_opc & PPC_OPC_Rc) {
+		// cr1 isn't implemented, let the interpreter complain
+		ppc_opc_gen_interpret(jitc, func);
+		return flowEndBlock;
+	}
+	jitc.clobberCarryAndFlags();
+	ppc_opc_gen_fpu_load(jitc, XMM0, frA);
+	ppc_opc_gen_fpu_load(jitc, XMM1, frB);
+	NativeAddress slow = ppc_opc_gen_fpu_check_rn(jitc);
+	jitc.asmALUSD(op, XMM0, XMM1);
+	if (single) ppc_opc_gen_fpu_round_single(jitc);
+	ppc_opc_gen_fpu_result(jitc, slow, ppc_opc_gen_fpu_check_nan(jitc), frD, func,
+		single ? PPC_FPRF_SINGLE : PPC_FPRF_DOUBLE);
+	return flowContinue;
+}
 
-	JitcFloatReg a = jitcGetClientFloatRegisterMapping(frA);
-	if (a != JITC_FLOAT_REG_NONE) {
-		ht_printf("askf lsa flsd\n");
-		a = jitcFloatRegisterDup(a, jitcGetClientFloatRegisterMapping(frC));
-	} else {
-		a = jitcGetClientFloatRegisterUnmapped(frA, jitcGetClientFloatRegisterMapping(frC), jitcGetClientFloatRegisterMapping(frB));
-	}
-	// a is TOP now
-	JitcFloatReg c = jitcGetClientFloatRegisterMapping(frC);
-	if (c != JITC_FLOAT_REG_NONE) {
-		asmFArith_ST0(X86_FMUL, jitcFloatRegisterToNative(c));
-	} else {
-		modrm_o modrm;
-		asmFArith(X86_FMUL, x86_mem2(modrm, &aCPU.fpr[frC]));
-	}
-	JitcFloatReg b = jitcGetClientFloatRegisterMapping(frB);
-	if (b != JITC_FLOAT_REG_NONE) {
-		asmFArith_ST0(rop, jitcFloatRegisterToNative(b));
-	} else {
-		modrm_o modrm;
-		asmFArith(op, x86_mem2(modrm, &aCPU.fpr[frB]));
-	}
-	if (chs) {
-		asmFSimple(FCHS);
+/*
+ *	frD := (+/-)(frA * frC +/- frB)
+ */
+static JITCFlow ppc_opc_gen_fpu_muladd(JITC &jitc, bool sub, bool negate, bool single, ppc_opc_function func)
+{
+	if (jitc.current_opc & PPC_OPC_Rc) {
+		ppc_opc_gen_interpret(jitc, func);
+		return flowEndBlock;
 	}
-	JitcFloatReg d = jitcGetClientFloatRegisterMapping(frD);
-	if (d == JITC_FLOAT_REG_NONE) {
-		jitcMapClientFloatRegisterDirty(frD, a);
+	int frD, frA, frB, frC;
+	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
+	jitc.clobberCarryAndFlags();
+	ppc_opc_gen_fpu_load(jitc, XMM0, frA);
+	ppc_opc_gen_fpu_load(jitc, XMM1, frC);
+	ppc_opc_gen_fpu_load(jitc, XMM2, frB);
+	NativeReg t = negate ? jitc.allocRegister() : REG_NO;
+	NativeAddress slow = ppc_opc_gen_fpu_check_rn(jitc);
+	if (jitc.hostCPUCaps.fma) {
+		jitc.asmFMA(sub ? X86_VFMSUB213SD : X86_VFMADD213SD, XMM0, XMM1, XMM2);
 	} else {
-		jitcFloatRegisterStoreAndPopTOP(d);
-		jitcFloatRegisterDirty(d);
-	}		
+		// not fused, so the last bit may differ
+		jitc.asmALUSD(X86_MULSD, XMM0, XMM1);
+		jitc.asmALUSD(sub ? X86_SUBSD : X86_ADDSD, XMM0, XMM2);
+	}
+	if (negate) {
+		jitc.asmMOVQ(t, XMM0);
+		jitc.asmBTx64(X86_BTC, t, 63);
+		jitc.asmMOVQ(XMM0, t);
+	}
+	if (single) ppc_opc_gen_fpu_round_single(jitc);
+	ppc_opc_gen_fpu_result(jitc, slow, ppc_opc_gen_fpu_check_nan(jitc), frD, func,
+		single ? PPC_FPRF_SINGLE : PPC_FPRF_DOUBLE);
+	return flowContinue;
 }
 
-//#define JITC
- 
-static void FASTCALL ppc_opc_gen_update_cr1_output_err(const char *err)
+static JITCFlow ppc_opc_gen_fpu_to_int(JITC &jitc, X86CVTSD2SIopc op, ppc_opc_function func)
 {
-	PPC_FPU_ERR("%s\n", err);
+	if (jitc.current_opc & PPC_OPC_Rc) {
+		ppc_opc_gen_interpret(jitc, func);
+		return flowEndBlock;
+	}
+	int frD, frA UNUSED, frB;
+	PPC_OPC_TEMPL_X(jitc.current_opc, frD, frA, frB);
+	PPC_OPC_ASSERT(frA==0);
+	jitc.clobberCarryAndFlags();
+	ppc_opc_gen_fpu_load(jitc, XMM0, frB);
+	NativeReg t = jitc.allocRegister();
+	// truncating doesn't depend on RN
+	NativeAddress slow = (op == X86_CVTSD2SI) ? ppc_opc_gen_fpu_check_rn(jitc) : NULL;
+	jitc.asmCVTSD2SI32(op, t, XMM0);
+	jitc.asmMOVQ(XMM0, t);
+	// 0x80000000 is returned for NaNs and on overflow
+	jitc.asmALU32(X86_CMP, t, 0x80000000);
+	// FPRF is undefined
+	ppc_opc_gen_fpu_result(jitc, slow, jitc.asmJxxFixup(X86_NE), frD, func, 0);
+	return flowContinue;
 }
 
-static void ppc_opc_gen_update_cr1(const char *err)
+/*
+ *	frD := frB with the sign bit changed by opc
+ *	(frB if opc is X86_BT)
+ */
+static JITCFlow ppc_opc_gen_fpu_sign(JITC &jitc, X86BitTest opc, ppc_opc_function func)
 {
-	asmALU(X86_MOV, EAX, (uint32)err);
-	asmCALL((NativeAddress)ppc_opc_gen_update_cr1_output_err);
+	if (jitc.current_opc & PPC_OPC_Rc) {
+		ppc_opc_gen_interpret(jitc, func);
+		return flowEndBlock;
+	}
+	int frD, frA UNUSED, frB;
+	PPC_OPC_TEMPL_X(jitc.current_opc, frD, frA, frB);
+	PPC_OPC_ASSERT(frA==0);
+	if (opc == X86_BT) {
+		if (frD == frB) return flowContinue;
+	} else {
+		jitc.clobberCarryAndFlags();
+	}
+	NativeReg b = jitc.getClientRegister(PPC_FPR(frB));
+	NativeReg d;
+	if (frD == frB) {
+		d = jitc.dirtyRegister(b);
+	} else {
+		d = jitc.mapClientRegisterDirty(PPC_FPR(frD));
+		jitc.asmALU64(X86_MOV, d, b);
+	}
+	if (opc != X86_BT) jitc.asmBTx64(opc, d, 63);
+	return flowContinue;
 }
-#endif
 
 /*
  *	fabsx		Floating Absolute Value
@@ -981,36 +1010,7 @@ void ppc_opc_fabsx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fabsx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB;
-	PPC_OPC_TEMPL_X(jitc.current_opc, frD, frA, frB);
-	if (jitcGetClientFloatRegisterMapping(frB) == JITC_FLOAT_REG_NONE) {
-		JitcFloatReg d = jitcGetClientFloatRegisterMapping(frD);
-		if (d != JITC_FLOAT_REG_NONE) jitcFloatRegisterInvalidate(d);
-		jitcClobberCarryAndFlags();	
-		if (frD != frB) {
-			NativeReg bh = jitcGetClientRegister(PPC_FPR_U(frB));
-			NativeReg bl = jitcGetClientRegister(PPC_FPR_L(frB));
-			NativeReg dh = jitcMapClientRegisterDirty(PPC_FPR_U(frD));
-			NativeReg dl = jitcMapClientRegisterDirty(PPC_FPR_L(frD));
-			asmALU(X86_MOV, dh, bh);
-			asmALU(X86_MOV, dl, bl);
-			asmALU(X86_AND, dh, 0x7fffffff);
-		} else {
-			NativeReg b = jitcGetClientRegisterDirty(PPC_FPR_U(frB));
-			asmALU(X86_AND, b, 0x7fffffff);
-		}
-	} else {
-		ppc_opc_gen_unary_floatop(FABS, frD, frB);
-	}
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fabs.\n");
-	}	
-	return flowContinue;
-#endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_fabsx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_sign(jitc, X86_BTR, ppc_opc_fabsx);
 }
 /*
  *	faddx		Floating Add (Double-Precision)
@@ -1036,20 +1036,10 @@ void ppc_opc_faddx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_faddx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB, frC;
+	int frD, frA, frB, frC UNUSED;
 	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
 	PPC_OPC_ASSERT(frC==0);
-	ppc_opc_gen_binary_floatop(X86_FADD, X86_FADD, frD, frA, frB);
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fadd.\n");
-	}
-	return flowContinue;
-#else
-	ppc_opc_gen_interpret(jitc, ppc_opc_faddx);
-	return flowEndBlock;
-#endif
+	return ppc_opc_gen_fpu_binary(jitc, X86_ADDSD, frD, frA, frB, false, ppc_opc_faddx);
 }
 /*
  *	faddsx		Floating Add Single
@@ -1075,8 +1065,10 @@ void ppc_opc_faddsx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_faddsx(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_faddsx);
-	return flowEndBlock;
+	int frD, frA, frB, frC UNUSED;
+	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
+	PPC_OPC_ASSERT(frC==0);
+	return ppc_opc_gen_fpu_binary(jitc, X86_ADDSD, frD, frA, frB, true, ppc_opc_faddsx);
 }
 /*
  *	fcmpo		Floating Compare Ordered
@@ -1109,6 +1101,8 @@ void ppc_opc_fcmpo(PPC_CPU_State &aCPU)
 		cmp = ppc_fpu_compare(A, B);
 	}
 	crfD = 7-crfD;
+	// replaces FPRF, see ppc_fpu_sync_fpscr
+	aCPU.fprf_pending = 0;
 	aCPU.fpscr &= ~0x1f000;
 	aCPU.fpscr |= (cmp << 12);
 	aCPU.cr &= ppc_fpu_cmp_and_mask[crfD];
@@ -1116,8 +1110,10 @@ void ppc_opc_fcmpo(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fcmpo(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_fcmpo);
-	return flowEndBlock;
+	ppc_opc_gen_interpret_inline(jitc, ppc_opc_fcmpo,
+		PPC_INTERPRET_FPR_A | PPC_INTERPRET_FPR_B | PPC_INTERPRET_CR | PPC_INTERPRET_FPSCR,
+		PPC_INTERPRET_CR | PPC_INTERPRET_FPSCR);
+	return flowContinue;
 }
 /*
  *	fcmpu		Floating Compare Unordered
@@ -1139,6 +1135,8 @@ void ppc_opc_fcmpu(PPC_CPU_State &aCPU)
 		cmp = ppc_fpu_compare(A, B);
 	}
 	crfD = 7-crfD;
+	// replaces FPRF, see ppc_fpu_sync_fpscr
+	aCPU.fprf_pending = 0;
 	aCPU.fpscr &= ~0x1f000;
 	aCPU.fpscr |= (cmp << 12);
 	aCPU.cr &= ppc_fpu_cmp_and_mask[crfD];
@@ -1146,8 +1144,10 @@ void ppc_opc_fcmpu(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fcmpu(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_fcmpu);
-	return flowEndBlock;
+	ppc_opc_gen_interpret_inline(jitc, ppc_opc_fcmpu,
+		PPC_INTERPRET_FPR_A | PPC_INTERPRET_FPR_B | PPC_INTERPRET_CR | PPC_INTERPRET_FPSCR,
+		PPC_INTERPRET_CR | PPC_INTERPRET_FPSCR);
+	return flowContinue;
 }
 /*
  *	fctiwx		Floating Convert to Integer Word
@@ -1168,37 +1168,7 @@ void ppc_opc_fctiwx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fctiwx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB;
-	PPC_OPC_TEMPL_X(jitc.current_opc, frD, frA, frB);
-	PPC_OPC_ASSERT(frA==0);
-	jitcClobberClientRegisterForFloat(frB);
-	jitcInvalidateClientRegisterForFloat(frD);
-
-	JitcFloatReg d = jitcGetClientFloatRegisterMapping(frD);
-	if (frB != frD && d != JITC_FLOAT_REG_NONE) {
-		jitcFloatRegisterXCHGToFront(d);
-		asmFFREEP(Float_ST0);
-		jitc.nativeFloatRegState[d] = rsUnused;
-		jitc.clientFloatReg[frD] = JITC_FLOAT_REG_NONE;
-		jitc.nativeFloatTOP--;	
-	}
-
-	modrm_o modrm;
-	JitcFloatReg b = jitcGetClientFloatRegisterUnmapped(frB);
-	asmFISTP_D(x86_mem2(modrm, &aCPU.fpr[frD]));
-	jitc.nativeFloatRegState[b] = rsUnused;
-	jitc.clientFloatReg[frB] = JITC_FLOAT_REG_NONE;
-	jitc.nativeFloatTOP--;
-	
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fctiw.\n");
-	}
-	return flowContinue;
-#endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_fctiwx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_to_int(jitc, X86_CVTSD2SI, ppc_opc_fctiwx);
 }
 /*
  *	fctiwzx		Floating Convert to Integer Word with Round toward Zero
@@ -1223,52 +1193,7 @@ void ppc_opc_fctiwzx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fctiwzx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB;
-	PPC_OPC_TEMPL_X(jitc.current_opc, frD, frA, frB);
-	PPC_OPC_ASSERT(frA==0);
-	
-	static uint16 cw = 0xfff;
-	
-	modrm_o modrm;
-	if (!jitc.hostCPUCaps.sse3) {
-		asmFLDCW(x86_mem2(modrm, &cw));
-	}
-	
-	jitcClobberClientRegisterForFloat(frB);
-	jitcInvalidateClientRegisterForFloat(frD);
-
-	JitcFloatReg d = jitcGetClientFloatRegisterMapping(frD);
-	if (frB != frD && d != JITC_FLOAT_REG_NONE) {
-		jitcFloatRegisterXCHGToFront(d);
-		asmFFREEP(Float_ST0);
-		jitc.nativeFloatRegState[d] = rsUnused;
-		jitc.clientFloatReg[frD] = JITC_FLOAT_REG_NONE;
-		jitc.nativeFloatTOP--;	
-	}
-
-	JitcFloatReg b = jitcGetClientFloatRegisterUnmapped(frB);
-	if (jitc.hostCPUCaps.sse3) {
-		asmFISTTP(x86_mem2(modrm, &aCPU.fpr[frD]));
-	} else {
-		asmFISTP_D(x86_mem2(modrm, &aCPU.fpr[frD]));
-	}
-	jitc.nativeFloatRegState[b] = rsUnused;
-	jitc.clientFloatReg[frB] = JITC_FLOAT_REG_NONE;
-	jitc.nativeFloatTOP--;
-	
-	if (!jitc.hostCPUCaps.sse3) {
-		asmFLDCW(x86_mem2(modrm, &aCPU.x87cw));
-	}
-	
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fctiwz.\n");
-	}
-	return flowContinue;
-#endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_fctiwzx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_to_int(jitc, X86_CVTTSD2SI, ppc_opc_fctiwzx);
 }
 /*
  *	fdivx		Floating Divide (Double-Precision)
@@ -1301,20 +1226,10 @@ void ppc_opc_fdivx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fdivx(JITC &jitc)
 {
-#if 1
-	ppc_opc_gen_interpret(jitc, ppc_opc_fdivx);
-	return flowEndBlock;
-#else
-	int frD, frA, frB, frC;
+	int frD, frA, frB, frC UNUSED;
 	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
 	PPC_OPC_ASSERT(frC==0);
-	ppc_opc_gen_binary_floatop(X86_FDIV, X86_FDIVR, frD, frA, frB);
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fdiv.\n");
-	}
-	return flowContinue;
-#endif
+	return ppc_opc_gen_fpu_binary(jitc, X86_DIVSD, frD, frA, frB, false, ppc_opc_fdivx);
 }
 /*
  *	fdivsx		Floating Divide Single
@@ -1347,8 +1262,10 @@ void ppc_opc_fdivsx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fdivsx(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_fdivsx);
-	return flowEndBlock;
+	int frD, frA, frB, frC UNUSED;
+	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
+	PPC_OPC_ASSERT(frC==0);
+	return ppc_opc_gen_fpu_binary(jitc, X86_DIVSD, frD, frA, frB, true, ppc_opc_fdivsx);
 }
 /*
  *	fmaddx		Floating Multiply-Add (Double-Precision)
@@ -1371,18 +1288,7 @@ void ppc_opc_fmaddx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fmaddx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB, frC;
-	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
-	ppc_opc_gen_ternary_floatop(X86_FADD, X86_FADD, false, frD, frA, frC, frB);
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fmadd.\n");
-	}
-	return flowContinue;
-#endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_fmaddx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_muladd(jitc, false, false, false, ppc_opc_fmaddx);
 }
 /*
  *	fmaddx		Floating Multiply-Add Single
@@ -1405,8 +1311,7 @@ void ppc_opc_fmaddsx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fmaddsx(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_fmaddsx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_muladd(jitc, false, false, true, ppc_opc_fmaddsx);
 }
 /*
  *	fmrx		Floating Move Register
@@ -1425,41 +1330,7 @@ void ppc_opc_fmrx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fmrx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB;
-	PPC_OPC_TEMPL_X(jitc.current_opc, frD, frA, frB);
-	if (frD != frB) {
-		JitcFloatReg a = jitcGetClientFloatRegisterMapping(frB);
-		if (a == JITC_FLOAT_REG_NONE) {
-			JitcFloatReg d = jitcGetClientFloatRegisterMapping(frD);
-			if (d != JITC_FLOAT_REG_NONE) jitcFloatRegisterInvalidate(d);
-			NativeReg bu = jitcGetClientRegister(PPC_FPR_U(frB));
-			NativeReg bl = jitcGetClientRegister(PPC_FPR_L(frB));
-			NativeReg du = jitcMapClientRegisterDirty(PPC_FPR_U(frD));
-			NativeReg dl = jitcMapClientRegisterDirty(PPC_FPR_L(frD));
-			asmALU(X86_MOV, du, bu);
-        		asmALU(X86_MOV, dl, bl);
-		} else {
-			jitcInvalidateClientRegisterForFloat(frD);
-			JitcFloatReg d = jitcGetClientFloatRegisterMapping(frD);
-			if (d == JITC_FLOAT_REG_NONE) {
-				d = jitcFloatRegisterDup(a);
-				jitcMapClientFloatRegisterDirty(frD, d);
-			} else {
-				jitcFloatRegisterXCHGToFront(a);
-				asmFST(jitcFloatRegisterToNative(d));
-				jitcFloatRegisterDirty(d);
-			}
-		}
-	}
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fabs.\n");
-	}	
-	return flowContinue;
-#endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_fmrx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_sign(jitc, X86_BT, ppc_opc_fmrx);
 }
 /*
  *	fmsubx		Floating Multiply-Subtract (Double-Precision)
@@ -1483,18 +1354,7 @@ void ppc_opc_fmsubx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fmsubx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB, frC;
-	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
-	ppc_opc_gen_ternary_floatop(X86_FSUB, X86_FSUBR, false, frD, frA, frC, frB);
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fmsub.\n");
-	}
-	return flowContinue;
-#endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_fmsubx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_muladd(jitc, true, false, false, ppc_opc_fmsubx);
 }
 /*
  *	fmsubsx		Floating Multiply-Subtract Single
@@ -1518,8 +1378,7 @@ void ppc_opc_fmsubsx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fmsubsx(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_fmsubsx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_muladd(jitc, true, false, true, ppc_opc_fmsubsx);
 }
 /*
  *	fmulx		Floating Multiply (Double-Precision)
@@ -1546,20 +1405,10 @@ void ppc_opc_fmulx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fmulx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB, frC;
+	int frD, frA, frB UNUSED, frC;
 	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
 	PPC_OPC_ASSERT(frB==0);
-	ppc_opc_gen_binary_floatop(X86_FMUL, X86_FMUL, frD, frA, frC);
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fmul.\n");
-	}
-	return flowContinue;
-#else
-	ppc_opc_gen_interpret(jitc, ppc_opc_fmulx);
-	return flowEndBlock;
-#endif
+	return ppc_opc_gen_fpu_binary(jitc, X86_MULSD, frD, frA, frC, false, ppc_opc_fmulx);
 }
 /*
  *	fmulsx		Floating Multiply Single
@@ -1586,8 +1435,10 @@ void ppc_opc_fmulsx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fmulsx(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_fmulsx);
-	return flowEndBlock;
+	int frD, frA, frB UNUSED, frC;
+	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
+	PPC_OPC_ASSERT(frB==0);
+	return ppc_opc_gen_fpu_binary(jitc, X86_MULSD, frD, frA, frC, true, ppc_opc_fmulsx);
 }
 /*
  *	fnabsx		Floating Negative Absolute Value
@@ -1606,37 +1457,7 @@ void ppc_opc_fnabsx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fnabsx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB;
-	PPC_OPC_TEMPL_X(jitc.current_opc, frD, frA, frB);
-	if (jitcGetClientFloatRegisterMapping(frB) == JITC_FLOAT_REG_NONE) {
-		JitcFloatReg d = jitcGetClientFloatRegisterMapping(frD);
-		if (d != JITC_FLOAT_REG_NONE) jitcFloatRegisterInvalidate(d);
-		jitcClobberCarryAndFlags();
-		if (frD != frB) {
-			NativeReg bh = jitcGetClientRegister(PPC_FPR_U(frB));
-			NativeReg bl = jitcGetClientRegister(PPC_FPR_L(frB));
-			NativeReg dh = jitcMapClientRegisterDirty(PPC_FPR_U(frD));
-			NativeReg dl = jitcMapClientRegisterDirty(PPC_FPR_L(frD));
-			asmALU(X86_MOV, dh, bh);
-			asmALU(X86_MOV, dl, bl);
-			asmALU(X86_OR, dh, 0x80000000);
-		} else {
-			NativeReg b = jitcGetClientRegisterDirty(PPC_FPR_U(frB));
-			asmALU(X86_OR, b, 0x80000000);
-		}
-	} else {
-		ppc_opc_gen_unary_floatop(FABS, frD, frB);
-		asmFSimple(FCHS);
-	}
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fnabs.\n");
-	}	
-	return flowContinue;
-#endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_fnabsx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_sign(jitc, X86_BTS, ppc_opc_fnabsx);
 }
 /*
  *	fnegx		Floating Negate
@@ -1655,36 +1476,7 @@ void ppc_opc_fnegx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fnegx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB;
-	PPC_OPC_TEMPL_X(jitc.current_opc, frD, frA, frB);
-	if (jitcGetClientFloatRegisterMapping(frB) == JITC_FLOAT_REG_NONE) {
-		JitcFloatReg d = jitcGetClientFloatRegisterMapping(frD);
-		if (d != JITC_FLOAT_REG_NONE) jitcFloatRegisterInvalidate(d);
-		jitcClobberCarryAndFlags();
-		if (frD != frB) {
-			NativeReg bh = jitcGetClientRegister(PPC_FPR_U(frB));
-			NativeReg bl = jitcGetClientRegister(PPC_FPR_L(frB));
-			NativeReg dh = jitcMapClientRegisterDirty(PPC_FPR_U(frD));
-			NativeReg dl = jitcMapClientRegisterDirty(PPC_FPR_L(frD));
-			asmALU(X86_MOV, dh, bh);
-			asmALU(X86_MOV, dl, bl);
-			asmALU(X86_XOR, dh, 0x80000000);
-		} else {
-			NativeReg b = jitcGetClientRegisterDirty(PPC_FPR_U(frB));
-			asmALU(X86_XOR, b, 0x80000000);
-		}
-	} else {
-		ppc_opc_gen_unary_floatop(FCHS, frD, frB);
-	}
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fneg.\n");
-	}	
-	return flowContinue;
-#endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_fnegx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_sign(jitc, X86_BTC, ppc_opc_fnegx);
 }
 /*
  *	fnmaddx		Floating Negative Multiply-Add (Double-Precision) 
@@ -1708,18 +1500,7 @@ void ppc_opc_fnmaddx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fnmaddx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB, frC;
-	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
-	ppc_opc_gen_ternary_floatop(X86_FADD, X86_FADD, true, frD, frA, frC, frB);
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fnmadd.\n");
-	}
-	return flowContinue;
-#endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_fnmaddx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_muladd(jitc, false, true, false, ppc_opc_fnmaddx);
 }
 /*
  *	fnmaddsx	Floating Negative Multiply-Add Single
@@ -1743,8 +1524,7 @@ void ppc_opc_fnmaddsx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fnmaddsx(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_fnmaddsx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_muladd(jitc, false, true, true, ppc_opc_fnmaddsx);
 }
 /*
  *	fnmsubx		Floating Negative Multiply-Subtract (Double-Precision)
@@ -1769,18 +1549,7 @@ void ppc_opc_fnmsubx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fnmsubx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB, frC;
-	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
-	ppc_opc_gen_ternary_floatop(X86_FSUBR, X86_FSUB, false, frD, frA, frC, frB);
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fnmsub.\n");
-	}
-	return flowContinue;
-#endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_fnmsubx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_muladd(jitc, true, true, false, ppc_opc_fnmsubx);
 }
 /*
  *	fnmsubsx	Floating Negative Multiply-Subtract Single
@@ -1805,8 +1574,7 @@ void ppc_opc_fnmsubsx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fnmsubsx(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_fnmsubsx);
-	return flowEndBlock;
+	return ppc_opc_gen_fpu_muladd(jitc, true, true, true, ppc_opc_fnmsubsx);
 }
 /*
  *	fresx		Floating Reciprocal Estimate Single
@@ -1847,8 +1615,19 @@ void ppc_opc_frspx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_frspx(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_frspx);
-	return flowEndBlock;
+	if (jitc.current_opc & PPC_OPC_Rc) {
+		ppc_opc_gen_interpret(jitc, ppc_opc_frspx);
+		return flowEndBlock;
+	}
+	int frD, frA UNUSED, frB;
+	PPC_OPC_TEMPL_X(jitc.current_opc, frD, frA, frB);
+	PPC_OPC_ASSERT(frA==0);
+	jitc.clobberCarryAndFlags();
+	ppc_opc_gen_fpu_load(jitc, XMM0, frB);
+	NativeAddress slow = ppc_opc_gen_fpu_check_rn(jitc);
+	ppc_opc_gen_fpu_round_single(jitc);
+	ppc_opc_gen_fpu_result(jitc, slow, ppc_opc_gen_fpu_check_nan(jitc), frD, ppc_opc_frspx, PPC_FPRF_SINGLE);
+	return flowContinue;
 }
 /*
  *	frsqrtex	Floating Reciprocal Square Root Estimate
@@ -1876,7 +1655,7 @@ void ppc_opc_frsqrtex(PPC_CPU_State &aCPU)
 JITCFlow ppc_opc_gen_frsqrtex(JITC &jitc)
 {
 #if 0
-	int frD, frA, frB, frC;
+	int frD, frA UNUSED, frB, frC UNUSED;
 	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
 	PPC_OPC_ASSERT(frA==0 && frC==0);
 	ppc_opc_gen_unary_floatop(FSQRT, frD, frB);
@@ -1893,8 +1672,10 @@ JITCFlow ppc_opc_gen_frsqrtex(JITC &jitc)
 	}
 	return flowContinue;
 #endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_frsqrtex);
-	return flowEndBlock;
+	ppc_opc_gen_interpret_inline(jitc, ppc_opc_frsqrtex,
+		PPC_INTERPRET_FPR_B | PPC_INTERPRET_FPSCR,
+		PPC_INTERPRET_FPR_D | PPC_INTERPRET_FPSCR);
+	return flowContinue;
 }
 /*
  *	fselx		Floating Select
@@ -1918,8 +1699,10 @@ void ppc_opc_fselx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fselx(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_fselx);
-	return flowEndBlock;
+	ppc_opc_gen_interpret_inline(jitc, ppc_opc_fselx,
+		PPC_INTERPRET_FPR_A | PPC_INTERPRET_FPR_B | PPC_INTERPRET_FPR_C,
+		PPC_INTERPRET_FPR_D);
+	return flowContinue;
 }
 /*
  *	fsqrtx		Floating Square Root (Double-Precision)
@@ -1942,19 +1725,19 @@ void ppc_opc_fsqrtx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fsqrtx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB, frC;
-	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
-	PPC_OPC_ASSERT(frA==0 && frC==0);
-	ppc_opc_gen_unary_floatop(FSQRT, frD, frB);
 	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fsqrt.\n");
+		ppc_opc_gen_interpret(jitc, ppc_opc_fsqrtx);
+		return flowEndBlock;
 	}
+	int frD, frA UNUSED, frB, frC UNUSED;
+	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
+	PPC_OPC_ASSERT(frA==0 && frC==0);
+	jitc.clobberCarryAndFlags();
+	ppc_opc_gen_fpu_load(jitc, XMM0, frB);
+	NativeAddress slow = ppc_opc_gen_fpu_check_rn(jitc);
+	jitc.asmALUSD(X86_SQRTSD, XMM0, XMM0);
+	ppc_opc_gen_fpu_result(jitc, slow, ppc_opc_gen_fpu_check_nan(jitc), frD, ppc_opc_fsqrtx, PPC_FPRF_DOUBLE);
 	return flowContinue;
-#endif
-	ppc_opc_gen_interpret(jitc, ppc_opc_fsqrtx);
-	return flowEndBlock;
 }
 /*
  *	fsqrtsx		Floating Square Root Single
@@ -2003,25 +1786,10 @@ void ppc_opc_fsubx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fsubx(JITC &jitc)
 {
-#if 0
-	int frD, frA, frB, frC;
+	int frD, frA, frB, frC UNUSED;
 	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
 	PPC_OPC_ASSERT(frC==0);
-	ppc_opc_gen_binary_floatop(X86_FSUB, X86_FSUBR, frD, frA, frB);
-	/*
-	 *	FIXME: This solves the a floating point bug.
-	 *	I have no idea why.
-	 */
-	jitcFloatRegisterClobberAll();
-	if (jitc.current_opc & PPC_OPC_Rc) {
-		// update cr1 flags
-		ppc_opc_gen_update_cr1("fsub.\n");
-	}
-	return flowContinue;
-#else
-	ppc_opc_gen_interpret(jitc, ppc_opc_fsubx);
-	return flowEndBlock;
-#endif
+	return ppc_opc_gen_fpu_binary(jitc, X86_SUBSD, frD, frA, frB, false, ppc_opc_fsubx);
 }
 /*
  *	fsubsx		Floating Subtract Single
@@ -2050,7 +1818,9 @@ void ppc_opc_fsubsx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_fsubsx(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_fsubsx);
-	return flowEndBlock;
+	int frD, frA, frB, frC UNUSED;
+	PPC_OPC_TEMPL_A(jitc.current_opc, frD, frA, frB, frC);
+	PPC_OPC_ASSERT(frC==0);
+	return ppc_opc_gen_fpu_binary(jitc, X86_SUBSD, frD, frA, frB, true, ppc_opc_fsubsx);
 }
 
@@ -636,6 +636,12 @@ inline uint32 ppc_fpu_double_to_int(uint32 fpscr, ppc_double &d)
 double ppc_fpu_get_double(uint64 d);
 double ppc_fpu_get_double(ppc_double &d);
 
+#define PPC_FPRF_DOUBLE	1
+#define PPC_FPRF_SINGLE	2
+
+void ppc_fpu_sync_fpscr(PPC_CPU_State &aCPU);
+void ppc_fpu_clear_host_flags();
+
 #include "jitc.h"
 #include "jitc_asm.h"
 #include "ppc_exc.h"
@@ -660,6 +666,15 @@ static UNUSED void ppc_opc_gen_check_fpu(JITC &jitc)
 	}
 }
 
+/*
+ *	Must be called before the FPSCR is accessed
+ */
+static UNUSED void ppc_opc_gen_sync_fpscr(JITC &jitc)
+{
+	jitc.clobberCarryAndFlags();
+	jitc.asmCALLInPlace((NativeAddress)ppc_fpu_sync_fpscr);
+}
+
 void ppc_opc_fabsx(PPC_CPU_State &aCPU);
 void ppc_opc_faddx(PPC_CPU_State &aCPU);
 void ppc_opc_faddsx(PPC_CPU_State &aCPU);
@@ -414,6 +414,56 @@ void ppc_mmu_tlb_invalidate(PPC_CPU_State &aCPU)
 	ppc_mmu_tlb_invalidate_all_asm(&aCPU);
 }
 
+/*
+ *	Invalidates the TLB entries (of all contexts) of the
+ *	effective addresses in segment sr
+ */
+void ppc_mmu_tlb_invalidate_segment(PPC_CPU_State &aCPU, int sr)
+{
+	uint32 *eff[3] = {&aCPU.tlb_code_eff[0][0], &aCPU.tlb_data_read_eff[0][0], &aCPU.tlb_data_write_eff[0][0]};
+	for (int i=0; i < 3; i++) {
+		for (int e=0; e < TLB_ENTRIES; e++) {
+			if ((eff[i][e] >> 28) == uint32(sr)) eff[i][e] = 0xffffffff;
+		}
+	}
+}
+
+/*
+ *	mtsr/mtsrin: Only the translations of one segment depend on
+ *	its register. Kernels reload the segment registers on every
+ *	return to user mode, mostly with the values they already have,
+ *	which then costs nothing.
+ */
+void FASTCALL ppc_mmu_set_sr(PPC_CPU_State &aCPU, uint32 sr, uint32 value)
+{
+	sr &= 0xf;
+	if (aCPU.sr[sr] == value) return;
+	aCPU.sr[sr] = value;
+	__atomic_fetch_add(&aCPU.chain_epoch, 1, __ATOMIC_RELAXED);
+	ppc_mmu_tlb_invalidate_segment(aCPU, sr);
+}
+
+/*
+ *	Tags (or untags) all write TLB entries of physical page pa.
+ *	Stores never hit a tagged entry in the inline TLB lookup, so they
+ *	are checked for writing into translated code by ppc_write_code_check
+ */
+void ppc_mmu_tlb_tag_code(PPC_CPU_State &aCPU, uint32 pa, bool code)
+{
+	uint64 host = uint64(gMemory + pa);
+	for (int w=0; w < TLB_WAYS; w++) {
+		for (int s=0; s < TLB_SETS; s++) {
+			if (aCPU.tlb_data_write_phys[w][s] != host) continue;
+			if (aCPU.tlb_data_write_eff[w][s] == 0xffffffff) continue;
+			if (code) {
+				aCPU.tlb_data_write_eff[w][s] |= 1;
+			} else {
+				aCPU.tlb_data_write_eff[w][s] &= ~1;
+			}
+		}
+	}
+}
+
 /*
 pagetable:
 min. 2^10 (64k) PTEGs
@@ -449,6 +499,7 @@ bool FASTCALL ppc_mmu_set_sdr1(PPC_CPU_State &aCPU, uint32 newval, bool quiesce)
 	aCPU.pagetable_base = htaborg<<16;
 	aCPU.sdr1 = newval;
 	aCPU.pagetable_hashmask = ((xx<<10)|0x3ff);
+	__atomic_fetch_add(&aCPU.chain_epoch, 1, __ATOMIC_RELAXED);
 	uint a = (0xffffffff & aCPU.pagetable_hashmask) | aCPU.pagetable_base;
 	if (a > gMemorySize) {
 		PPC_MMU_WARN("new pagetable: not in memory (%08x)\n", a);
@@ -844,6 +895,8 @@ uint32  ppc_get_memory_size()
  *	DMA Interface
  */
 
+extern JITC *gJITC;
+
 bool	ppc_dma_write(uint32 dest, const void *src, uint32 size)
 {
 	if (dest > gMemorySize || (dest+size) > gMemorySize) return false;
@@ -852,6 +905,7 @@ bool	ppc_dma_write(uint32 dest, const void *src, uint32 size)
 	ppc_direct_physical_memory_handle(dest, ptr);
 	
 	memcpy(ptr, src, size);
+	if (gJITC) jitcInvalidateDMA(*gJITC, dest, size);
 	return true;
 }
 
@@ -874,9 +928,22 @@ bool	ppc_dma_set(uint32 dest, int c, uint32 size)
 	ppc_direct_physical_memory_handle(dest, ptr);
 	
 	memset(ptr, c, size);
+	if (gJITC) jitcInvalidateDMA(*gJITC, dest, size);
+	return true;
+}
+
+bool	ppc_dma_map(uint32 addr, uint32 size, byte *&ptr)
+{
+	if (addr > gMemorySize || (addr+size) > gMemorySize) return false;
+	ppc_direct_physical_memory_handle(addr, ptr);
 	return true;
 }
 
+void	ppc_dma_written(uint32 dest, uint32 size)
+{
+	if (gJITC) jitcInvalidateDMA(*gJITC, dest, size);
+}
+
 
 /***************************************************************************
  *	DEPRECATED prom interface
@@ -1171,13 +1238,136 @@ static void ppc_opc_gen_helper_stx(JITC &jitc, PPC_Register cr1, PPC_Register cr
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
 }
 
-static void ppc_opc_gen_helper_tlb(JITC &jitc, NativeReg src, NativeReg d1, NativeReg d2)
+/*
+ *	d1 = TLB set of src
+ *	d2 = TLB tag of the last byte of a size byte access at src,
+ *	     so accesses crossing a page boundary never match
+ */
+static void ppc_opc_gen_helper_tlb(JITC &jitc, NativeReg src, int size, NativeReg d1, NativeReg d2)
 {
 	jitc.asmALU32(X86_MOV, d1, src);
-	jitc.asmALU32(X86_MOV, d2, src);
+	if (size > 1) {
+		jitc.asmALU32(X86_LEA, d2, src, size-1);
+	} else {
+		jitc.asmALU32(X86_MOV, d2, src);
+	}
 	jitc.asmShift32(X86_SHR, d1, 12);
 	jitc.asmALU32(X86_AND, d2, 0xfffff000);
-	jitc.asmALU32(X86_AND, d1, TLB_ENTRIES-1);
+	jitc.asmALU32(X86_AND, d1, TLB_SETS-1);
+}
+
+/*
+ *	Looks up the effective address in RAX in the data TLB for reads
+ *	or writes. On a hit, RAX is translated into the host address
+ *	and the emitted code falls through to the access, which the
+ *	caller emits next. On a miss func is called instead.
+ *	Returns the fixup to be resolved after the access.
+ *
+ *	RCX and idx are clobbered.
+ */
+static NativeAddress ppc_opc_gen_tlb_lookup(JITC &jitc, NativeAddress func, int size, bool write, NativeReg idx)
+{
+	uint32 eff = RSP_OFFSET + (write ? offsetof(PPC_CPU_State, tlb_data_write_eff)
+	                                 : offsetof(PPC_CPU_State, tlb_data_read_eff));
+	uint32 phys = RSP_OFFSET + (write ? offsetof(PPC_CPU_State, tlb_data_write_phys)
+	                                  : offsetof(PPC_CPU_State, tlb_data_read_phys));
+	uint32 lru = RSP_OFFSET + (write ? offsetof(PPC_CPU_State, tlb_data_write_lru)
+	                                 : offsetof(PPC_CPU_State, tlb_data_read_lru));
+
+	ppc_opc_gen_helper_tlb(jitc, RAX, size, idx, RCX);
+	jitc.asmALU32(X86_OR, RCX, curCPU(tlb_context));
+
+	jitc.asmALU32(X86_CMP, RCX, RSP, 4, idx, eff);
+	NativeAddress way0 = jitc.asmJxxFixup(X86_E);
+	jitc.asmALU32(X86_CMP, RCX, RSP, 4, idx, eff + TLB_SETS*4);
+	NativeAddress way1 = jitc.asmJxxFixup(X86_E);
+	jitc.asmCALL(func);
+	NativeAddress done = jitc.asmJMPFixup();
+
+	// way 1 hit, so way 0 is to be replaced next
+	jitc.asmResolveFixup(way1, jitc.asmHERE());
+	jitc.asmALU8(X86_MOV, RSP, 1, idx, lru, 0);
+	jitc.asmALU32(X86_ADD, idx, TLB_SETS);
+	NativeAddress hit = jitc.asmJMPFixup();
+
+	jitc.asmResolveFixup(way0, jitc.asmHERE());
+	jitc.asmALU8(X86_MOV, RSP, 1, idx, lru, 1);
+
+	jitc.asmResolveFixup(hit, jitc.asmHERE());
+#if TLB_STATS
+	if (write) {
+		jitc.asmALU64(X86_ADD, curCPU(tlb_data_write_hits), 1);
+	} else {
+		jitc.asmALU64(X86_ADD, curCPU(tlb_data_read_hits), 1);
+	}
+#endif
+	jitc.asmALU32(X86_AND, RAX, 0xfff);
+	jitc.asmALU64(X86_ADD, RAX, RSP, 8, idx, phys);
+	return done;
+}
+
+/*
+ *	Loads size bytes from the effective address in RAX into RDX.
+ *	The TLB lookup is done inline, func (one of the
+ *	ppc_read_effective_*_asm) is only called on a TLB miss,
+ *	a page crossing access or I/O (which is never in the TLB).
+ *
+ *	RSI must be set to the pc (see ppc_opc_gen_helper_l*),
+ *	RAX, RCX and RDX are clobbered.
+ */
+static void ppc_opc_gen_read_effective(JITC &jitc, NativeAddress func, int size, bool sign = false)
+{
+	NativeAddress done = ppc_opc_gen_tlb_lookup(jitc, func, size, false, RDX);
+	switch (size) {
+	case 1:
+		jitc.asmMOVxx32_8(X86_MOVZX, RDX, RAX, 0u);
+		break;
+	case 2:
+		jitc.asmMOVxx32_16(X86_MOVZX, RDX, RAX, 0u);
+		jitc.asmShift16(X86_ROL, RDX, 8);
+		if (sign) jitc.asmMOVxx32_16(X86_MOVSX, RDX, RDX);
+		break;
+	case 4:
+		jitc.asmALU32(X86_MOV, RDX, RAX, 0u);
+		jitc.asmBSWAP32(RDX);
+		break;
+	case 8:
+		jitc.asmALU64(X86_MOV, RDX, RAX, 0u);
+		jitc.asmBSWAP64(RDX);
+		break;
+	}
+	jitc.asmResolveFixup(done, jitc.asmHERE());
+}
+
+/*
+ *	Stores size bytes of RDX to the effective address in RAX.
+ *	Like ppc_opc_gen_read_effective, func (one of the
+ *	ppc_write_effective_*_asm) is only called on the slow path.
+ *
+ *	RSI must be set to the pc (see ppc_opc_gen_helper_st*),
+ *	RAX, RBX, RCX and RDX are clobbered.
+ */
+static void ppc_opc_gen_write_effective(JITC &jitc, NativeAddress func, int size)
+{
+	NativeAddress done = ppc_opc_gen_tlb_lookup(jitc, func, size, true, RBX);
+	switch (size) {
+	case 1:
+		jitc.asmALU8(X86_MOV, RAX, 0u, RDX);
+		break;
+	case 2:
+		jitc.asmShift16(X86_ROL, RDX, 8);
+		jitc.asmMOV16(RAX, 0u, RDX);
+		break;
+	case 4:
+		jitc.asmBSWAP32(RDX);
+		jitc.asmALU32(X86_MOV, RAX, 0u, RDX);
+		break;
+	case 8:
+		jitc.asmBSWAP64(RDX);
+		jitc.asmALU64(X86_MOV, RAX, 0u, RDX);
+		break;
+	}
+	jitc.asmResolveFixup(done, jitc.asmHERE());
 }
 
 static uint64 FASTCALL ppc_opc_single_to_double(uint32 fpscr, uint32 r)
@@ -1229,22 +1419,22 @@ JITCFlow ppc_opc_gen_dcbz(JITC &jitc)
 	jitc.asmALU32(X86_XOR, RDX, RDX);
 	jitc.asmALU32(X86_MOV, curCPU(temp), RAX);
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_dword_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_dword_asm, 8);
 	jitc.asmALU32(X86_MOV, RAX, curCPU(temp));
 	jitc.asmALU32(X86_XOR, RDX, RDX);
 	jitc.asmALU32(X86_ADD, RAX, 8);
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_dword_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_dword_asm, 8);
 	jitc.asmALU32(X86_MOV, RAX, curCPU(temp));
 	jitc.asmALU32(X86_XOR, RDX, RDX);
 	jitc.asmALU32(X86_ADD, RAX, 16);
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_dword_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_dword_asm, 8);
 	jitc.asmALU32(X86_MOV, RAX, curCPU(temp));
 	jitc.asmALU32(X86_XOR, RDX, RDX);
 	jitc.asmALU32(X86_ADD, RAX, 24);
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_dword_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_dword_asm, 8);
 	return flowEndBlock;
 }
 
@@ -1269,22 +1459,7 @@ JITCFlow ppc_opc_gen_lbz(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rD, rA, imm);
 	ppc_opc_gen_helper_l(jitc, PPC_GPR(rA), imm);
-#if 0
-	ppc_opc_gen_helper_tlb(jitc, RAX, RDX, RCX);
-	
-	jitc.asmALU32(X86_CMP, RCX, curCPUsib(tlb_data_read_eff, 4, RDX));
-	NativeAddress fixup1 = jitc.asmJxxFixup(X86_E);
-	jitc.asmCALL((NativeAddress)ppc_read_effective_byte_asm);
-	NativeAddress fixup2 = jitc.asmJMPFixup();
-	
-	jitc.asmResolveFixup(fixup1, jitc.asmHERE());
-	jitc.asmALU64(X86_ADD, RAX, curCPUsib(tlb_data_read_phys, 8, RDX));
-	jitc.asmMOVxx32_8(X86_MOVZX, RDX, RAX, 0u);
-	
-	jitc.asmResolveFixup(fixup2, jitc.asmHERE());
-#else
-	jitc.asmCALL((NativeAddress)ppc_read_effective_byte_asm);
-#endif
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_byte_asm, 1);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	return flowContinue;
 }
@@ -1311,32 +1486,12 @@ JITCFlow ppc_opc_gen_lbzu(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rD, rA, imm);
 	ppc_opc_gen_helper_lu(jitc, PPC_GPR(rA), imm);
-#if 0
-	ppc_opc_gen_helper_tlb(jitc, RAX, RDX, RCX);
-	
-	jitc.asmALU32(X86_CMP, RCX, curCPUsib(tlb_data_read_eff, 4, RDX));
-	NativeAddress fixup1 = jitc.asmJxxFixup(X86_E);
-	jitc.asmCALL((NativeAddress)ppc_read_effective_byte_asm);
-	NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA), NATIVE_REG | RAX);
-	if (imm) {
-		jitc.asmALU32(X86_ADD, a, imm);
-	}
-	NativeAddress fixup2 = jitc.asmJMPFixup();
-	
-	jitc.asmResolveFixup(fixup1, jitc.asmHERE());
-	jitc.asmALU64(X86_MOV, RDX, curCPUsib(tlb_data_read_phys, 8, RDX));
-	jitc.asmALU32(X86_ADD, RDX, RAX);
-	jitc.asmMOVxx32_8(X86_MOVZX, RDX, RDX, 0u);
-	
-	jitc.asmResolveFixup(fixup2, jitc.asmHERE());
-#else
-	jitc.asmCALL((NativeAddress)ppc_read_effective_byte_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_byte_asm, 1);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	if (imm) {
 		NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA));
 		jitc.asmALU32(X86_ADD, a, imm);
 	}
-#endif
 	return flowContinue;
 }
 /*
@@ -1360,7 +1515,7 @@ JITCFlow ppc_opc_gen_lbzux(JITC &jitc)
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rD, rA, rB);
 	ppc_opc_gen_helper_lux(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_byte_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_byte_asm, 1);
 	if (rD == rB) {
 		// don't ask...
 		NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA), NATIVE_REG | RAX);
@@ -1393,7 +1548,7 @@ JITCFlow ppc_opc_gen_lbzx(JITC &jitc)
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rD, rA, rB);
 	ppc_opc_gen_helper_lx(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_byte_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_byte_asm, 1);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	return flowContinue;
 }
@@ -1424,26 +1579,7 @@ JITCFlow ppc_opc_gen_lfd(JITC &jitc)
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, frD, rA, imm);
 	jitc.floatRegisterClobberAll();
 	ppc_opc_gen_helper_l(jitc, PPC_GPR(rA), imm);
-#if 0
-	jitc.asmALU32(X86_TEST, RAX, 7);
-	NativeAddress fixup3 = jitc.asmJxxFixup(X86_NZ);
-	ppc_opc_gen_helper_tlb(jitc, RAX, RDX, RCX);
-	
-	jitc.asmALU32(X86_CMP, RCX, curCPUsib(tlb_data_read_eff, 4, RDX));
-	NativeAddress fixup1 = jitc.asmJxxFixup(X86_E);
-	jitc.asmResolveFixup(fixup3, jitc.asmHERE());
-	jitc.asmCALL((NativeAddress)ppc_read_effective_dword_asm);
-	NativeAddress fixup2 = jitc.asmJMPFixup();
-	
-	jitc.asmResolveFixup(fixup1, jitc.asmHERE());
-	jitc.asmALU64(X86_ADD, RAX, curCPUsib(tlb_data_read_phys, 8, RDX));
-	jitc.asmALU64(X86_MOV, RDX, RAX, 0u);
-	jitc.asmBSWAP64(RDX);
-
-	jitc.asmResolveFixup(fixup2, jitc.asmHERE());
-#else
-	jitc.asmCALL((NativeAddress)ppc_read_effective_dword_asm);
-#endif
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_dword_asm, 8);
 	jitc.mapClientRegisterDirty(PPC_FPR(frD), NATIVE_REG | RDX);
 	return flowContinue;
 }
@@ -1476,7 +1612,7 @@ JITCFlow ppc_opc_gen_lfdu(JITC &jitc)
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, frD, rA, imm);
 	jitc.floatRegisterClobberAll();
 	ppc_opc_gen_helper_lu(jitc, PPC_GPR(rA), imm);
-	jitc.asmCALL((NativeAddress)ppc_read_effective_dword_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_dword_asm, 8);
 	jitc.mapClientRegisterDirty(PPC_FPR(frD), NATIVE_REG | RDX);
 	if (imm) {
 		NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA));
@@ -1511,7 +1647,7 @@ JITCFlow ppc_opc_gen_lfdux(JITC &jitc)
 	PPC_OPC_TEMPL_X(jitc.current_opc, frD, rA, rB);
 	ppc_opc_gen_helper_lux(jitc, PPC_GPR(rA), PPC_GPR(rB));
 	jitc.floatRegisterClobberAll();
-	jitc.asmCALL((NativeAddress)ppc_read_effective_dword_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_dword_asm, 8);
 	jitc.mapClientRegisterDirty(PPC_FPR(frD), NATIVE_REG | RDX);
 	NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA));
 	NativeReg b = jitc.getClientRegister(PPC_GPR(rB));
@@ -1543,7 +1679,7 @@ JITCFlow ppc_opc_gen_lfdx(JITC &jitc)
 	PPC_OPC_TEMPL_X(jitc.current_opc, frD, rA, rB);
 	jitc.floatRegisterClobberAll();
 	ppc_opc_gen_helper_lx(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_dword_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_dword_asm, 8);
 	jitc.mapClientRegisterDirty(PPC_FPR(frD), NATIVE_REG | RDX);
 	return flowContinue;
 }
@@ -1578,7 +1714,7 @@ JITCFlow ppc_opc_gen_lfs(JITC &jitc)
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, frD, rA, imm);
 	jitc.floatRegisterClobberAll();
 	ppc_opc_gen_helper_l(jitc, PPC_GPR(rA), imm);
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 	jitc.asmALU32(X86_MOV, RDI, curCPU(fpscr));	
 	jitc.asmALU32(X86_MOV, RSI, RDX);
 	jitc.asmCALL((NativeAddress)ppc_opc_single_to_double);
@@ -1618,7 +1754,7 @@ JITCFlow ppc_opc_gen_lfsu(JITC &jitc)
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, frD, rA, imm);
 	jitc.floatRegisterClobberAll();
 	ppc_opc_gen_helper_lu(jitc, PPC_GPR(rA), imm);
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 	jitc.asmALU32(X86_MOV, RSI, RDX);
 	jitc.asmALU32(X86_MOV, RDI, curCPU(fpscr));	
 	jitc.asmCALL((NativeAddress)ppc_opc_single_to_double);
@@ -1660,7 +1796,7 @@ JITCFlow ppc_opc_gen_lfsux(JITC &jitc)
 	PPC_OPC_TEMPL_X(jitc.current_opc, frD, rA, rB);
 	jitc.floatRegisterClobberAll();
 	ppc_opc_gen_helper_lux(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 	jitc.asmALU32(X86_MOV, RSI, RDX);
 	jitc.asmALU32(X86_MOV, RDI, curCPU(fpscr));	
 	jitc.asmCALL((NativeAddress)ppc_opc_single_to_double);
@@ -1699,7 +1835,7 @@ JITCFlow ppc_opc_gen_lfsx(JITC &jitc)
 	PPC_OPC_TEMPL_X(jitc.current_opc, frD, rA, rB);
 	jitc.floatRegisterClobberAll();
 	ppc_opc_gen_helper_lx(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 	jitc.asmALU32(X86_MOV, RSI, RDX);
 	jitc.asmALU32(X86_MOV, RDI, curCPU(fpscr));	
 	jitc.asmCALL((NativeAddress)ppc_opc_single_to_double);
@@ -1727,7 +1863,7 @@ JITCFlow ppc_opc_gen_lha(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rD, rA, imm);
 	ppc_opc_gen_helper_l(jitc, PPC_GPR(rA), imm);
-	jitc.asmCALL((NativeAddress)ppc_read_effective_half_s_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_half_s_asm, 2, true);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	return flowContinue;
 }
@@ -1754,7 +1890,7 @@ JITCFlow ppc_opc_gen_lhau(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rD, rA, imm);
 	ppc_opc_gen_helper_lu(jitc, PPC_GPR(rA), imm);
-	jitc.asmCALL((NativeAddress)ppc_read_effective_half_s_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_half_s_asm, 2, true);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	if (imm) {
 		NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA));
@@ -1783,7 +1919,7 @@ JITCFlow ppc_opc_gen_lhaux(JITC &jitc)
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rD, rA, rB);
 	ppc_opc_gen_helper_lux(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_half_s_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_half_s_asm, 2, true);
 	if (rD == rB) {
 		NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA), NATIVE_REG | RAX);
 		jitc.asmALU32(X86_ADD, a, curCPUreg(PPC_GPR(rB)));
@@ -1816,7 +1952,7 @@ JITCFlow ppc_opc_gen_lhax(JITC &jitc)
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rD, rA, rB);
 	ppc_opc_gen_helper_lx(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_half_s_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_half_s_asm, 2, true);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	return flowContinue;
 }
@@ -1839,7 +1975,7 @@ JITCFlow ppc_opc_gen_lhbrx(JITC &jitc)
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rD, rA, rB);
 	ppc_opc_gen_helper_lx(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_half_z_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_half_z_asm, 2);
 	jitc.asmShift16(X86_ROL, RDX, 8);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	return flowContinue;
@@ -1865,7 +2001,7 @@ JITCFlow ppc_opc_gen_lhz(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rD, rA, imm);
 	ppc_opc_gen_helper_l(jitc, PPC_GPR(rA), imm);
-	jitc.asmCALL((NativeAddress)ppc_read_effective_half_z_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_half_z_asm, 2);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	return flowContinue;
 }
@@ -1892,7 +2028,7 @@ JITCFlow ppc_opc_gen_lhzu(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rD, rA, imm);
 	ppc_opc_gen_helper_lu(jitc, PPC_GPR(rA), imm);
-	jitc.asmCALL((NativeAddress)ppc_read_effective_half_z_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_half_z_asm, 2);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	if (imm) {
 		NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA));
@@ -1921,7 +2057,7 @@ JITCFlow ppc_opc_gen_lhzux(JITC &jitc)
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rD, rA, rB);
 	ppc_opc_gen_helper_lux(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_half_z_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_half_z_asm, 2);
 	if (rD == rB) {
 		NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA), NATIVE_REG | RAX);
 		jitc.asmALU32(X86_ADD, a, curCPUreg(PPC_GPR(rB)));
@@ -1953,7 +2089,7 @@ JITCFlow ppc_opc_gen_lhzx(JITC &jitc)
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rD, rA, rB);
 	ppc_opc_gen_helper_lx(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_half_z_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_half_z_asm, 2);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	return flowContinue;
 }
@@ -1983,7 +2119,7 @@ JITCFlow ppc_opc_gen_lmw(JITC &jitc)
 	
 	while (rD <= 31) {
 		ppc_opc_gen_helper_l(jitc, PPC_GPR(rA), imm);
-		jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
+		ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 		jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 		rD += 1;
 		imm += 4;
@@ -2119,7 +2255,7 @@ JITCFlow ppc_opc_gen_lwarx(JITC &jitc)
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rD, rA, rB);
 	ppc_opc_gen_helper_lx(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	jitc.asmALU32(X86_MOV, curCPU(reserve), RDX);
 	jitc.asmALU8(X86_MOV, curCPU(have_reservation), 1);
@@ -2144,7 +2280,7 @@ JITCFlow ppc_opc_gen_lwbrx(JITC &jitc)
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rD, rA, rB);
 	ppc_opc_gen_helper_lx(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	jitc.asmBSWAP32(RDX);
 	return flowContinue;
@@ -2170,26 +2306,7 @@ JITCFlow ppc_opc_gen_lwz(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rD, rA, imm);
 	ppc_opc_gen_helper_l(jitc, PPC_GPR(rA), imm);
-#if 0
-	jitc.asmALU32(X86_TEST, RAX, 3);
-	NativeAddress fixup3 = jitc.asmJxxFixup(X86_NZ);
-	ppc_opc_gen_helper_tlb(jitc, RAX, RDX, RCX);
-	
-	jitc.asmALU32(X86_CMP, RCX, curCPUsib(tlb_data_read_eff, 4, RDX));
-	NativeAddress fixup1 = jitc.asmJxxFixup(X86_E);
-	jitc.asmResolveFixup(fixup3, jitc.asmHERE());
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
-	NativeAddress fixup2 = jitc.asmJMPFixup();
-	
-	jitc.asmResolveFixup(fixup1, jitc.asmHERE());
-	jitc.asmALU64(X86_ADD, RAX, curCPUsib(tlb_data_read_phys, 8, RDX));
-	jitc.asmALU32(X86_MOV, RDX, RAX, 0u);
-	jitc.asmBSWAP32(RDX);
-
-	jitc.asmResolveFixup(fixup2, jitc.asmHERE());
-#else
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
-#endif
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	return flowContinue;
 }
@@ -2216,36 +2333,12 @@ JITCFlow ppc_opc_gen_lwzu(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rD, rA, imm);
 	ppc_opc_gen_helper_lu(jitc, PPC_GPR(rA), imm);
-#if 0
-	jitc.asmALU32(X86_TEST, RAX, 3);
-	NativeAddress fixup3 = jitc.asmJxxFixup(X86_NZ);
-	ppc_opc_gen_helper_tlb(jitc, RAX, RDX, RCX);
-	
-	jitc.asmALU32(X86_CMP, RCX, curCPUsib(tlb_data_read_eff, 4, RDX));
-	NativeAddress fixup1 = jitc.asmJxxFixup(X86_E);
-	jitc.asmResolveFixup(fixup3, jitc.asmHERE());
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
-	NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA), NATIVE_REG | RAX);
-	if (imm) {
-		jitc.asmALU32(X86_ADD, a, imm);
-	}
-	NativeAddress fixup2 = jitc.asmJMPFixup();
-	
-	jitc.asmResolveFixup(fixup1, jitc.asmHERE());
-	jitc.asmALU64(X86_MOV, RDX, curCPUsib(tlb_data_read_phys, 8, RDX));
-	jitc.asmALU32(X86_ADD, RDX, RAX);
-	jitc.asmALU32(X86_MOV, RDX, RDX, 0u);
-	jitc.asmBSWAP32(RDX);
-	
-	jitc.asmResolveFixup(fixup2, jitc.asmHERE());
-#else
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	if (imm) {
 		NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA));
 		jitc.asmALU32(X86_ADD, a, imm);
 	}
-#endif
 	return flowContinue;
 }
 /*
@@ -2269,7 +2362,7 @@ JITCFlow ppc_opc_gen_lwzux(JITC &jitc)
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rD, rA, rB);
 	ppc_opc_gen_helper_lux(jitc, PPC_GPR(rA), PPC_GPR(rB));
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 	if (rD == rB) {
 		// don't ask...
 		NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA), NATIVE_REG | RAX);
@@ -2302,26 +2395,7 @@ JITCFlow ppc_opc_gen_lwzx(JITC &jitc)
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rD, rA, rB);
 	ppc_opc_gen_helper_lx(jitc, PPC_GPR(rA), PPC_GPR(rB));
-#if 0
-	jitc.asmALU32(X86_TEST, RAX, 3);
-	NativeAddress fixup3 = jitc.asmJxxFixup(X86_NZ);	
-	ppc_opc_gen_helper_tlb(jitc, RAX, RDX, RCX);
-	
-	jitc.asmALU32(X86_CMP, RCX, curCPUsib(tlb_data_read_eff, 4, RDX));
-	NativeAddress fixup1 = jitc.asmJxxFixup(X86_E);
-	jitc.asmResolveFixup(fixup3, jitc.asmHERE());
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
-	NativeAddress fixup2 = jitc.asmJMPFixup();
-	
-	jitc.asmResolveFixup(fixup1, jitc.asmHERE());
-	jitc.asmALU64(X86_ADD, RAX, curCPUsib(tlb_data_read_phys, 8, RDX));
-	jitc.asmALU32(X86_MOV, RDX, RAX, 0u);
-	jitc.asmBSWAP32(RDX);
-
-	jitc.asmResolveFixup(fixup2, jitc.asmHERE());
-#else
-	jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
-#endif
+	ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 	jitc.mapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | RDX);
 	return flowContinue;
 }
@@ -2918,26 +2992,7 @@ JITCFlow ppc_opc_gen_stb(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rS, rA, imm);
 	ppc_opc_gen_helper_st(jitc, PPC_GPR(rA), imm, PPC_GPR(rS));
-#if 0
-	jitc.asmALU32(X86_MOV, RBX, RAX);
-	jitc.asmALU32(X86_MOV, RCX, RAX);
-	jitc.asmShift32(X86_SHR, RBX, 12);
-	jitc.asmALU32(X86_AND, RCX, 0xfffff000);
-	jitc.asmALU32(X86_AND, RBX, TLB_ENTRIES-1);
-	
-	jitc.asmALU32(X86_CMP, RCX, curCPUsib(tlb_data_write_eff, 4, RBX));
-	NativeAddress fixup1 = jitc.asmJxxFixup(X86_E);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_byte_asm);
-	NativeAddress fixup2 = jitc.asmJMPFixup();
-	
-	jitc.asmResolveFixup(fixup1, jitc.asmHERE());
-	jitc.asmALU64(X86_ADD, RAX, curCPUsib(tlb_data_write_phys, 8, RBX));
-	jitc.asmALU8(X86_MOV, RAX, 0u, RDX);
-	
-	jitc.asmResolveFixup(fixup2, jitc.asmHERE());
-#else
-	jitc.asmCALL((NativeAddress)ppc_write_effective_byte_asm);
-#endif
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_byte_asm, 1);
 	return flowEndBlock;
 }
 /*
@@ -2962,7 +3017,7 @@ JITCFlow ppc_opc_gen_stbu(JITC &jitc)
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rS, rA, imm);
 	// FIXME: check rA!=0
 	ppc_opc_gen_helper_stu(jitc, PPC_GPR(rA), imm, PPC_GPR(rS));
-	jitc.asmCALL((NativeAddress)ppc_write_effective_byte_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_byte_asm, 1);
 	if (imm) {
 		NativeReg r = jitc.getClientRegisterDirty(PPC_GPR(rA));
 		jitc.asmALU32(X86_ADD, r, imm);
@@ -2988,7 +3043,7 @@ JITCFlow ppc_opc_gen_stbux(JITC &jitc)
 	int rA, rS, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rS, rA, rB);
 	ppc_opc_gen_helper_stux(jitc, PPC_GPR(rA), PPC_GPR(rB), PPC_GPR(rS));
-	jitc.asmCALL((NativeAddress)ppc_write_effective_byte_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_byte_asm, 1);
 	NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA));
 	NativeReg b = jitc.getClientRegister(PPC_GPR(rB));
 	jitc.asmALU32(X86_ADD, a, b);
@@ -3009,7 +3064,7 @@ JITCFlow ppc_opc_gen_stbx(JITC &jitc)
 	int rA, rS, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rS, rA, rB);
 	ppc_opc_gen_helper_stx(jitc, PPC_GPR(rA), PPC_GPR(rB), PPC_GPR(rS));
-	jitc.asmCALL((NativeAddress)ppc_write_effective_byte_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_byte_asm, 1);
 	return flowEndBlock;
 }
 /*
@@ -3046,29 +3101,8 @@ JITCFlow ppc_opc_gen_stfd(JITC &jitc)
 		jitc.asmALU32(X86_MOV, RAX, imm);
 	}
 	jitc.clobberAll();
-#if 0
-	jitc.asmALU32(X86_TEST, RAX, 7);
-	NativeAddress fixup3 = jitc.asmJxxFixup(X86_NZ);
-	
-	ppc_opc_gen_helper_tlb(jitc, RAX, RBX, RCX);
-	
-	jitc.asmALU32(X86_CMP, RCX, curCPUsib(tlb_data_write_eff, 4, RBX));
-	NativeAddress fixup1 = jitc.asmJxxFixup(X86_E);
-	jitc.asmResolveFixup(fixup3, jitc.asmHERE());
-	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_dword_asm);
-	NativeAddress fixup2 = jitc.asmJMPFixup();
-	
-	jitc.asmResolveFixup(fixup1, jitc.asmHERE());
-	jitc.asmALU64(X86_ADD, RAX, curCPUsib(tlb_data_write_phys, 8, RBX));
-	jitc.asmBSWAP64(RDX);
-	jitc.asmALU64(X86_MOV, RAX, 0u, RDX);
-	
-	jitc.asmResolveFixup(fixup2, jitc.asmHERE());
-#else
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_dword_asm);
-#endif
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_dword_asm, 8);
 	return flowEndBlock;
 }
 /*
@@ -3107,7 +3141,7 @@ JITCFlow ppc_opc_gen_stfdu(JITC &jitc)
 	}
 	jitc.clobberAll();
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_dword_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_dword_asm, 8);
 	if (imm) {
 		NativeReg r = jitc.getClientRegisterDirty(PPC_GPR(rA));
 		jitc.asmALU32(X86_ADD, r, imm);
@@ -3146,7 +3180,7 @@ JITCFlow ppc_opc_gen_stfdux(JITC &jitc)
 	jitc.asmALU32(X86_ADD, RAX, curCPUreg(PPC_GPR(rB)));
 	jitc.clobberAll();
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_dword_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_dword_asm, 8);
 	NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA));
 	NativeReg b = jitc.getClientRegister(PPC_GPR(rB));
 	jitc.asmALU32(X86_ADD, a, b);
@@ -3183,7 +3217,7 @@ JITCFlow ppc_opc_gen_stfdx(JITC &jitc)
 	}
 	jitc.clobberAll();
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_dword_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_dword_asm, 8);
 	return flowEndBlock;
 }
 /*
@@ -3208,7 +3242,7 @@ JITCFlow ppc_opc_gen_stfiwx(JITC &jitc)
 	jitc.floatRegisterClobberAll();
 	ppc_opc_gen_helper_stx(jitc, PPC_GPR(rA), PPC_GPR(rB), PPC_FPR(frS));
 	// FIXME64: loading lower half would be enough
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
 	return flowEndBlock;
 }
 /*
@@ -3252,7 +3286,7 @@ JITCFlow ppc_opc_gen_stfs(JITC &jitc)
 	}
 	jitc.clobberAll();
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
 	return flowEndBlock;
 }
 /*
@@ -3297,7 +3331,7 @@ JITCFlow ppc_opc_gen_stfsu(JITC &jitc)
 	}
 	jitc.clobberAll();
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
 	if (imm) {
 		NativeReg r = jitc.getClientRegisterDirty(PPC_GPR(rA));
 		jitc.asmALU32(X86_ADD, r, imm);
@@ -3342,7 +3376,7 @@ JITCFlow ppc_opc_gen_stfsux(JITC &jitc)
 	jitc.asmALU32(X86_ADD, RAX, curCPUreg(PPC_GPR(rB)));
 	jitc.clobberAll();
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
 	NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA));
 	NativeReg b = jitc.getClientRegister(PPC_GPR(rB));
 	jitc.asmALU32(X86_ADD, a, b);
@@ -3385,7 +3419,7 @@ JITCFlow ppc_opc_gen_stfsx(JITC &jitc)
 	}
 	jitc.clobberAll();
 	jitc.asmALU32(X86_MOV, RSI, jitc.pc);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
 	return flowEndBlock;
 }
 /*
@@ -3405,7 +3439,7 @@ JITCFlow ppc_opc_gen_sth(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rS, rA, imm);
 	ppc_opc_gen_helper_st(jitc, PPC_GPR(rA), imm, PPC_GPR(rS));
-	jitc.asmCALL((NativeAddress)ppc_write_effective_half_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_half_asm, 2);
 	return flowEndBlock;
 }
 /*
@@ -3424,7 +3458,7 @@ JITCFlow ppc_opc_gen_sthbrx(JITC &jitc)
 	PPC_OPC_TEMPL_X(jitc.current_opc, rS, rA, rB);
 	ppc_opc_gen_helper_stx(jitc, PPC_GPR(rA), PPC_GPR(rB), PPC_GPR(rS));
 	jitc.asmShift16(X86_ROL, RDX, 8);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_half_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_half_asm, 2);
 	return flowEndBlock;
 }
 /*
@@ -3449,7 +3483,7 @@ JITCFlow ppc_opc_gen_sthu(JITC &jitc)
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rS, rA, imm);
 	// FIXME: check rA!=0
 	ppc_opc_gen_helper_stu(jitc, PPC_GPR(rA), imm, PPC_GPR(rS));
-	jitc.asmCALL((NativeAddress)ppc_write_effective_half_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_half_asm, 2);
 	if (imm) {
 		NativeReg r = jitc.getClientRegisterDirty(PPC_GPR(rA));
 		jitc.asmALU32(X86_ADD, r, imm);
@@ -3475,7 +3509,7 @@ JITCFlow ppc_opc_gen_sthux(JITC &jitc)
 	int rA, rS, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rS, rA, rB);
 	ppc_opc_gen_helper_stux(jitc, PPC_GPR(rA), PPC_GPR(rB), PPC_GPR(rS));
-	jitc.asmCALL((NativeAddress)ppc_write_effective_half_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_half_asm, 2);
 	NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA));
 	NativeReg b = jitc.getClientRegister(PPC_GPR(rB));
 	jitc.asmALU32(X86_ADD, a, b);
@@ -3496,7 +3530,7 @@ JITCFlow ppc_opc_gen_sthx(JITC &jitc)
 	int rA, rS, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rS, rA, rB);
 	ppc_opc_gen_helper_stx(jitc, PPC_GPR(rA), PPC_GPR(rB), PPC_GPR(rS));
-	jitc.asmCALL((NativeAddress)ppc_write_effective_half_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_half_asm, 2);
 	return flowEndBlock;
 }
 /*
@@ -3525,7 +3559,7 @@ JITCFlow ppc_opc_gen_stmw(JITC &jitc)
         while (rS <= 31) {
                 ppc_opc_gen_helper_st(jitc, PPC_GPR(rA), imm, PPC_GPR(rS));
 //                jitc.getClientRegister(PPC_GPR(rS), NATIVE_REG | RDX);
-                jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
+                ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
                 rS += 1;
                 imm += 4;
         } 
@@ -3647,29 +3681,8 @@ JITCFlow ppc_opc_gen_stw(JITC &jitc)
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rS, rA, imm);
 	ppc_opc_gen_helper_st(jitc, PPC_GPR(rA), imm, PPC_GPR(rS));
-#if 0
-	jitc.asmALU32(X86_TEST, RAX, 3);
-	NativeAddress fixup3 = jitc.asmJxxFixup(X86_NZ);
-	
-	ppc_opc_gen_helper_tlb(jitc, RAX, RBX, RCX);
-	
-	jitc.asmALU32(X86_CMP, RCX, curCPUsib(tlb_data_write_eff, 4, RBX));
-	NativeAddress fixup1 = jitc.asmJxxFixup(X86_E);
-	jitc.asmResolveFixup(fixup3, jitc.asmHERE());
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
-	NativeAddress fixup2 = jitc.asmJMPFixup();
-	
-	jitc.asmResolveFixup(fixup1, jitc.asmHERE());
-	jitc.asmALU64(X86_ADD, RAX, curCPUsib(tlb_data_write_phys, 8, RBX));
-	jitc.asmBSWAP32(RDX);
-	jitc.asmALU32(X86_MOV, RAX, 0u, RDX);
-	
-	jitc.asmResolveFixup(fixup2, jitc.asmHERE());
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
 	return flowEndBlock;
-#else
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
-	return flowEndBlock;
-#endif
 }
 /*
  *	stwbrx		Store Word Byte-Reverse Indexed
@@ -3688,7 +3701,7 @@ JITCFlow ppc_opc_gen_stwbrx(JITC &jitc)
 	PPC_OPC_TEMPL_X(jitc.current_opc, rS, rA, rB);
 	ppc_opc_gen_helper_stx(jitc, PPC_GPR(rA), PPC_GPR(rB), PPC_GPR(rS));
 	jitc.asmBSWAP32(RDX);
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
 	return flowEndBlock;
 }
 /*
@@ -3726,12 +3739,12 @@ JITCFlow ppc_opc_gen_stwcx_(JITC &jitc)
 	jitc.asmBTx32(X86_BTR, curCPU(have_reservation), 0);
 	NativeAddress no_reservation = jitc.asmJxxFixup(X86_NC);
 		ppc_opc_gen_helper_lx(jitc, PPC_GPR(rA), PPC_GPR(rB));
-		jitc.asmCALL((NativeAddress)ppc_read_effective_word_asm);
+		ppc_opc_gen_read_effective(jitc, (NativeAddress)ppc_read_effective_word_asm, 4);
 		jitc.asmALU32(X86_CMP, RDX, curCPU(reserve));
 		// FIXME: mapFlags?
 		NativeAddress fixup = jitc.asmJxxFixup(X86_NE);
 		ppc_opc_gen_helper_stx(jitc, PPC_GPR(rA), PPC_GPR(rB), PPC_GPR(rS));
-		jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
+		ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
 		jitc.asmOR32(curCPU(cr), 0x20000000);  // CR_CR0_EQ
 	
 	jitc.asmResolveFixup(fixup, jitc.asmHERE());
@@ -3765,7 +3778,7 @@ JITCFlow ppc_opc_gen_stwu(JITC &jitc)
 	PPC_OPC_TEMPL_D_SImm(jitc.current_opc, rS, rA, imm);
 	// FIXME: check rA!=0
 	ppc_opc_gen_helper_stu(jitc, PPC_GPR(rA), imm, PPC_GPR(rS));
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
 	if (imm) {
 		NativeReg r = jitc.getClientRegisterDirty(PPC_GPR(rA));
 		jitc.asmALU32(X86_ADD, r, imm);
@@ -3791,7 +3804,7 @@ JITCFlow ppc_opc_gen_stwux(JITC &jitc)
 	int rA, rS, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rS, rA, rB);
 	ppc_opc_gen_helper_stux(jitc, PPC_GPR(rA), PPC_GPR(rB), PPC_GPR(rS));
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
 	NativeReg a = jitc.getClientRegisterDirty(PPC_GPR(rA));
 	NativeReg b = jitc.getClientRegister(PPC_GPR(rB));
 	jitc.asmALU32(X86_ADD, a, b);
@@ -3812,27 +3825,7 @@ JITCFlow ppc_opc_gen_stwx(JITC &jitc)
 	int rA, rS, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rS, rA, rB);
 	ppc_opc_gen_helper_stx(jitc, PPC_GPR(rA), PPC_GPR(rB), PPC_GPR(rS));
-#if 0
-	jitc.asmALU32(X86_TEST, RAX, 3);
-	NativeAddress fixup3 = jitc.asmJxxFixup(X86_NZ);
-	
-	ppc_opc_gen_helper_tlb(jitc, RAX, RBX, RCX);
-	
-	jitc.asmALU32(X86_CMP, RCX, curCPUsib(tlb_data_write_eff, 4, RBX));
-	NativeAddress fixup1 = jitc.asmJxxFixup(X86_E);
-	jitc.asmResolveFixup(fixup3, jitc.asmHERE());
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
-	NativeAddress fixup2 = jitc.asmJMPFixup();
-	
-	jitc.asmResolveFixup(fixup1, jitc.asmHERE());
-	jitc.asmALU64(X86_ADD, RAX, curCPUsib(tlb_data_write_phys, 8, RBX));
-	jitc.asmBSWAP32(RDX);
-	jitc.asmALU32(X86_MOV, RAX, 0u, RDX);
-	
-	jitc.asmResolveFixup(fixup2, jitc.asmHERE());
-#else
-	jitc.asmCALL((NativeAddress)ppc_write_effective_word_asm);
-#endif
+	ppc_opc_gen_write_effective(jitc, (NativeAddress)ppc_write_effective_word_asm, 4);
 	return flowEndBlock;
 }
 
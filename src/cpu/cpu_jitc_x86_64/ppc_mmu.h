@@ -38,7 +38,20 @@ extern uint32 gMemorySize;
 int FASTCALL ppc_effective_to_physical(PPC_CPU_State &aCPU, uint32 addr, int flags, uint32 &result);
 int FASTCALL ppc_effective_to_physical_vm(PPC_CPU_State &aCPU, uint32 addr, int flags, uint32 &result);
 bool FASTCALL ppc_mmu_set_sdr1(PPC_CPU_State &aCPU, uint32 newval, bool quiesce);
+/*
+ *	The low bits of the effective page of a TLB entry hold the
+ *	translation context it was created in (MSR[PR], MSR[IR] and
+ *	MSR[DR]), so switching between user, kernel and real mode
+ *	selects another set of entries instead of flushing the TLB.
+ *	Bit 0 is the code page tag (see ppc_mmu_tlb_tag_code).
+ *	Keep in sync with tlb_set_context in jitc_tools.S
+ */
+#define PPC_MMU_TLB_CONTEXT(msr) ((((msr) >> 3) & 6) | (((msr) >> 11) & 8))
+
 void ppc_mmu_tlb_invalidate(PPC_CPU_State &aCPU);
+void ppc_mmu_tlb_invalidate_segment(PPC_CPU_State &aCPU, int sr);
+void FASTCALL ppc_mmu_set_sr(PPC_CPU_State &aCPU, uint32 sr, uint32 value);
+void ppc_mmu_tlb_tag_code(PPC_CPU_State &aCPU, uint32 pa, bool code);
 
 int FASTCALL ppc_read_physical_dword(uint32 addr, uint64 &result);
 int FASTCALL ppc_read_physical_word(uint32 addr, uint32 &result);
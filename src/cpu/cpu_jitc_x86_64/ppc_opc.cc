@@ -24,6 +24,7 @@
 #include "info.h"
 #include "ppc_cpu.h"
 #include "ppc_exc.h"
+#include "ppc_fpu.h"
 #include "ppc_mmu.h"
 #include "ppc_opc.h"
 #include "ppc_dec.h"
@@ -88,7 +89,6 @@ void ppc_set_msr(PPC_CPU_State &aCPU, uint32 newmsr)
 			aCPU.ext_exception = true;
 		}
 	}*/
-	ppc_mmu_tlb_invalidate(aCPU);
 #ifndef PPC_CPU_ENABLE_SINGLESTEP
 	if (newmsr & MSR_SE) {
 		SINGLESTEP("");
@@ -105,7 +105,7 @@ void ppc_set_msr(PPC_CPU_State &aCPU, uint32 newmsr)
 		newmsr &= ~MSR_POW;
 	}
 	aCPU.msr = newmsr;
-	
+	aCPU.tlb_context = PPC_MMU_TLB_CONTEXT(newmsr);
 }
 
 void ppc_opc_gen_check_privilege(JITC &jitc)
@@ -135,17 +135,115 @@ static inline void ppc_opc_gen_set_pc_rel(JITC &jitc, uint32 li)
 {
 	li += jitc.pc;
 	if (li < 4096) {		
+		if (!(jitc.current_opc & PPC_OPC_LK) && jitc.isTraceBackEdge(li)) {
+			// loops without going through the heartbeat
+			jitcEmitTraceBackEdge(jitc);
+		}
+		/*
+		 *	Must not be split, a saved site takes
+		 *	its li from the heartbeat (see jitcSaveSnapshotPage)
+		 */
+		jitc.emitAssure(5+5+5+5+4);
 		jitc.asmMOV32_NoFlags(RAX, li);
 		jitc.asmCALL((NativeAddress)ppc_heartbeat_ext_rel_asm);
 		/*
-		 *	This will be patched:
+		 *	This will be patched (see jitcNewPCThisPage),
+		 *	the call is followed by the offset of the branch
 		 */
-		jitc.emitAssure(5+5);
+		jitc.asmReloc(jitc.asmHERE(), relocPatch);
 		jitc.asmMOV32_NoFlags(RAX, li); // 5
 		jitc.asmCALL((NativeAddress)ppc_new_pc_this_page_asm); // 5
+		uint32 tail = jitc.pc;
+		if (jitc.traceTail) tail |= JITC_SITE_NO_TRACE;
+		jitc.emit((byte *)&tail, 4);
 	} else {
+		jitcEmitChainedJump(jitc, li);
+	}
+}
+
+/*
+ *	Sets lr to the instruction behind the branch. If call is set,
+ *	it is also pushed onto the return stack, so the blr returning
+ *	there can jump directly to the return stub (see
+ *	ppc_new_pc_return_asm). Returns where the stub must be filled
+ *	in by ppc_opc_gen_return_stub behind the branch (or NULL).
+ *	Preserves RAX.
+ */
+static NativeAddress ppc_opc_gen_set_lr(JITC &jitc, bool call)
+{
+	jitc.asmALU32(X86_MOV, RCX, curCPU(current_code_base));
+	jitc.asmALU32(X86_ADD, RCX, jitc.pc+4);
+	jitc.asmALU32(X86_MOV, curCPU(lr), RCX);
+	if (!call) return NULL;
+	if (jitc.pc+4 >= 4096) {
+		// no stub, but keep the return stack balanced
+		jitc.asmALU32(X86_MOV, RCX, PPC_RAS_EMPTY);
+		jitc.asmCALL((NativeAddress)ppc_ras_push_asm);
+		return NULL;
+	}
+	byte instr[7] = {0x48, 0x8d, 0x15};	// lea rdx, [rip+stub]
+	jitc.emit(instr, sizeof instr);
+	NativeAddress fixup = jitc.asmHERE() - 4;
+	jitc.asmReloc(fixup);
+	jitc.asmCALL((NativeAddress)ppc_ras_push_asm);
+	return fixup;
+}
+
+/*
+ *	The return stub is an in-page jump to the instruction behind
+ *	the branch. It is entered behind its heartbeat, since
+ *	ppc_new_pc_return_asm already did that.
+ */
+static void ppc_opc_gen_return_stub(JITC &jitc, NativeAddress fixup)
+{
+	if (!fixup) return;
+	ppc_opc_gen_set_pc_rel(jitc, 4);
+	NativeAddress stub = jitc.asmHERE() - 14;
+	*(uint32 *)fixup = uint32(stub - (fixup + 4));
+}
+
+/*
+ *	The branch of bx and bcx, li as in the instruction
+ */
+static void ppc_opc_gen_branch(JITC &jitc, uint32 li)
+{
+	NativeAddress ret = NULL;
+	if (jitc.current_opc & PPC_OPC_LK) {
+		// bcl 20,31,$+4 only reads the pc, it isn't a call
+		bool call = (jitc.current_opc & PPC_OPC_AA) || li != 4;
+		ret = ppc_opc_gen_set_lr(jitc, call);
+	}
+	if (jitc.current_opc & PPC_OPC_AA) {
 		jitc.asmALU32(X86_MOV, RAX, li);
-		jitc.asmJMP((NativeAddress)ppc_new_pc_rel_asm);
+		jitc.asmJMP((NativeAddress)ppc_new_pc_asm);
+	} else {
+		ppc_opc_gen_set_pc_rel(jitc, li);
+	}
+	ppc_opc_gen_return_stub(jitc, ret);
+}
+
+/*
+ *	The backward branch of a trace keeps the (dirty) registers
+ *	for the loop, see jitcEmitTraceBackEdge.
+ *	li as in the instruction.
+ */
+static inline bool ppc_opc_gen_is_trace_back_edge(JITC &jitc, uint32 li)
+{
+	return !(jitc.current_opc & (PPC_OPC_LK | PPC_OPC_AA)) && jitc.isTraceBackEdge(li + jitc.pc);
+}
+
+/*
+ *	Decrements ctr, the x86 flags are set accordingly.
+ *	ctr is only mapped in traces (or if it already is),
+ *	where it can stay in a register around the loop.
+ */
+static void ppc_opc_gen_dec_ctr(JITC &jitc)
+{
+	if (jitc.traceTail || jitc.getClientRegisterMapping(PPC_CTR) != REG_NO) {
+		NativeReg ctr = jitc.getClientRegisterDirty(PPC_CTR);
+		jitc.asmDEC32(ctr);
+	} else {
+		jitc.asmALU32(X86_SUB, curCPU(ctr), 1);
 	}
 }
 
@@ -170,18 +268,14 @@ JITCFlow ppc_opc_gen_bx(JITC &jitc)
 {
 	uint32 li;
 	PPC_OPC_TEMPL_I(jitc.current_opc, li);
-	jitc.clobberAll();
-	if (jitc.current_opc & PPC_OPC_LK) {
-		jitc.asmALU32(X86_MOV, RAX, curCPU(current_code_base));
-		jitc.asmALU32(X86_ADD, RAX, jitc.pc+4);
-		jitc.asmALU32(X86_MOV, curCPU(lr), RAX);
-	}
-	if (jitc.current_opc & PPC_OPC_AA) {
-		jitc.asmALU32(X86_MOV, RAX, li);
-		jitc.asmJMP((NativeAddress)ppc_new_pc_asm);
+	if (ppc_opc_gen_is_trace_back_edge(jitc, li)) {
+		// keep the mapping for the loop
+		jitc.clobberCarryAndFlags();
+		jitc.floatRegisterClobberAll();
 	} else {
-		ppc_opc_gen_set_pc_rel(jitc, li);
+		jitc.clobberAll();
 	}
+	ppc_opc_gen_branch(jitc, li);
 	return flowEndBlockUnreachable;
 }
 
@@ -227,15 +321,26 @@ JITCFlow ppc_opc_gen_bcx(JITC &jitc)
 				// and not SO flag (which isnt mapped)
 				jitc.clobberRegister(NATIVE_REG | RDI);
 				NativeAddress fixup2=NULL;
+				JITCFlagsType type = jitc.getFlagsType();
 				switch (BI%4) {
 				case 0:
 					// less than
-					fixup = jitc.asmJxxFixup((BO & 8) ? X86_NS : X86_S);
+					if (type == flagsSigned) {
+						fixup = jitc.asmJxxFixup((BO & 8) ? X86_GE : X86_L);
+					} else if (type == flagsUnsigned) {
+						fixup = jitc.asmJxxFixup((BO & 8) ? X86_AE : X86_B);
+					} else {
+						fixup = jitc.asmJxxFixup((BO & 8) ? X86_NS : X86_S);
+					}
 					break;
 				case 1:
 					// greater than
-					// there seems to be no equivalent instruction on the x86
-					if (BO & 8) {
+					if (type == flagsSigned) {
+						fixup = jitc.asmJxxFixup((BO & 8) ? X86_LE : X86_G);
+					} else if (type == flagsUnsigned) {
+						fixup = jitc.asmJxxFixup((BO & 8) ? X86_BE : X86_A);
+					} else if (BO & 8) {
+						// there seems to be no equivalent instruction on the x86
 						fixup = jitc.asmJxxFixup(X86_S);
 						fixup2 = jitc.asmJxxFixup(X86_Z);
 					} else {
@@ -255,19 +360,11 @@ JITCFlow ppc_opc_gen_bcx(JITC &jitc)
 				if (jitc.carryMapped()) {
 					jitc.asmSET8(X86_C, curCPU(xer_ca));
 				}
-				jitc.asmCALL((NativeAddress)ppc_flush_flags_asm);
-				jitc.flushRegisterDirty();
-				if (jitc.current_opc & PPC_OPC_LK) {
-					jitc.asmALU32(X86_MOV, RAX, curCPU(current_code_base));
-					jitc.asmALU32(X86_ADD, RAX, jitc.pc+4);
-					jitc.asmALU32(X86_MOV, curCPU(lr), RAX);
-				}
-				if (jitc.current_opc & PPC_OPC_AA) {
-					jitc.asmALU32(X86_MOV, RAX, BD);
-					jitc.asmJMP((NativeAddress)ppc_new_pc_asm);
-				} else {
-					ppc_opc_gen_set_pc_rel(jitc, BD);
+				jitc.flushFlagsDirty();
+				if (!ppc_opc_gen_is_trace_back_edge(jitc, BD)) {
+					jitc.flushRegisterDirty();
 				}
+				ppc_opc_gen_branch(jitc, BD);
 				jitc.asmResolveFixup(fixup, jitc.asmHERE());
 				if (fixup2) {
 					jitc.asmResolveFixup(fixup2, jitc.asmHERE());
@@ -282,23 +379,14 @@ JITCFlow ppc_opc_gen_bcx(JITC &jitc)
 		} else {
 			// decrement and check condition
 			jitc.clobberCarryAndFlags();
-			NativeReg ctr = jitc.getClientRegisterDirty(PPC_CTR);
-			jitc.asmDEC32(ctr);
+			ppc_opc_gen_dec_ctr(jitc);
 			NativeAddress fixup = jitc.asmJxxFixup((BO & 2) ? X86_NZ : X86_Z);
 			jitc.asmTEST32(curCPU(cr), 1<<(31-BI));
 			NativeAddress fixup2 = jitc.asmJxxFixup((BO & 8) ? X86_Z : X86_NZ);
-			jitc.flushRegisterDirty();
-			if (jitc.current_opc & PPC_OPC_LK) {
-				jitc.asmALU32(X86_MOV, RAX, curCPU(current_code_base));
-				jitc.asmALU32(X86_ADD, RAX, jitc.pc+4);
-				jitc.asmALU32(X86_MOV, curCPU(lr), RAX);
-			}
-			if (jitc.current_opc & PPC_OPC_AA) {
-				jitc.asmALU32(X86_MOV, RAX, BD);
-				jitc.asmJMP((NativeAddress)ppc_new_pc_asm);
-			} else {
-				ppc_opc_gen_set_pc_rel(jitc, BD);
+			if (!ppc_opc_gen_is_trace_back_edge(jitc, BD)) {
+				jitc.flushRegisterDirty();
 			}
+			ppc_opc_gen_branch(jitc, BD);
 			jitc.asmResolveFixup(fixup, jitc.asmHERE());
 			jitc.asmResolveFixup(fixup2, jitc.asmHERE());
 			return flowContinue;
@@ -308,39 +396,22 @@ JITCFlow ppc_opc_gen_bcx(JITC &jitc)
 		if (BO & 4) {
 			// always branch
 			jitc.clobberCarryAndFlags();
-			jitc.flushRegister();
-			if (jitc.current_opc & PPC_OPC_LK) {
-				jitc.asmALU32(X86_MOV, RAX, curCPU(current_code_base));
-				jitc.asmALU32(X86_ADD, RAX, jitc.pc+4);
-				jitc.asmALU32(X86_MOV, curCPU(lr), RAX);
-			}
-			if (jitc.current_opc & PPC_OPC_AA) {
-				jitc.asmALU32(X86_MOV, RAX, BD);
-				jitc.asmJMP((NativeAddress)ppc_new_pc_asm);
-		    	} else {
-				ppc_opc_gen_set_pc_rel(jitc, BD);
+			if (!ppc_opc_gen_is_trace_back_edge(jitc, BD)) {
+				jitc.flushRegister();
 			}
+			ppc_opc_gen_branch(jitc, BD);
 			return flowEndBlockUnreachable;
 		} else {
 			// decrement ctr and branch on ctr
 			jitc.clobberCarryAndFlags();
-			NativeReg ctr = jitc.getClientRegisterDirty(PPC_CTR);
-			jitc.asmDEC32(ctr);
+			ppc_opc_gen_dec_ctr(jitc);
 			fixup = jitc.asmJxxFixup((BO & 2) ? X86_NZ : X86_Z);
 		}
 	}
-	jitc.flushRegisterDirty();
-	if (jitc.current_opc & PPC_OPC_LK) {
-		jitc.asmALU32(X86_MOV, RAX, curCPU(current_code_base));
-		jitc.asmALU32(X86_ADD, RAX, jitc.pc+4);
-		jitc.asmALU32(X86_MOV, curCPU(lr), RAX);
-	}
-	if (jitc.current_opc & PPC_OPC_AA) {
-		jitc.asmALU32(X86_MOV, RAX, BD);
-		jitc.asmJMP((NativeAddress)ppc_new_pc_asm);
-	} else {
-		ppc_opc_gen_set_pc_rel(jitc, BD);
+	if (!ppc_opc_gen_is_trace_back_edge(jitc, BD)) {
+		jitc.flushRegisterDirty();
 	}
+	ppc_opc_gen_branch(jitc, BD);
 	jitc.asmResolveFixup(fixup, jitc.asmHERE());
 	return flowContinue;
 }
@@ -375,13 +446,13 @@ JITCFlow ppc_opc_gen_bcctrx(JITC &jitc)
 		jitc.clobberCarryAndFlags();
 		jitc.flushRegister();
 		jitc.getClientRegister(PPC_CTR, NATIVE_REG | RAX);
+		NativeAddress ret = NULL;
 		if (jitc.current_opc & PPC_OPC_LK) {
-			jitc.asmALU32(X86_MOV, RCX, curCPU(current_code_base));
-			jitc.asmALU32(X86_ADD, RCX, jitc.pc+4);
-			jitc.asmALU32(X86_MOV, curCPU(lr), RCX);
+			ret = ppc_opc_gen_set_lr(jitc, true);
 		}
 		jitc.asmALU32(X86_AND, RAX, 0xfffffffc);
-		jitc.asmJMP((NativeAddress)ppc_new_pc_asm);
+		jitcEmitIndirectJump(jitc);
+		ppc_opc_gen_return_stub(jitc, ret);
 		return flowEndBlockUnreachable;
 	} else {
 		// test specific crX bit
@@ -390,13 +461,13 @@ JITCFlow ppc_opc_gen_bcctrx(JITC &jitc)
 		jitc.getClientRegister(PPC_CTR, NATIVE_REG | RAX);
 		NativeAddress fixup = jitc.asmJxxFixup((BO & 8) ? X86_Z : X86_NZ);
 		jitc.flushRegisterDirty();
+		NativeAddress ret = NULL;
 		if (jitc.current_opc & PPC_OPC_LK) {
-			jitc.asmALU32(X86_MOV, RCX, curCPU(current_code_base));
-			jitc.asmALU32(X86_ADD, RCX, jitc.pc+4);
-			jitc.asmALU32(X86_MOV, curCPU(lr), RCX);
+			ret = ppc_opc_gen_set_lr(jitc, true);
 		}
 		jitc.asmALU32(X86_AND, RAX, 0xfffffffc);
-		jitc.asmJMP((NativeAddress)ppc_new_pc_asm);
+		jitcEmitIndirectJump(jitc);
+		ppc_opc_gen_return_stub(jitc, ret);
 		jitc.asmResolveFixup(fixup, jitc.asmHERE());	
 		return flowContinue;
 	}
@@ -439,13 +510,16 @@ JITCFlow ppc_opc_gen_bclrx(JITC &jitc)
 		jitc.clobberCarryAndFlags();
 		jitc.flushRegister();
 		jitc.getClientRegister(PPC_LR, NATIVE_REG | RAX);
+		NativeAddress ret = NULL;
+		jitc.asmALU32(X86_AND, RAX, 0xfffffffc);
 		if (jitc.current_opc & PPC_OPC_LK) {
-			jitc.asmALU32(X86_MOV, RCX, curCPU(current_code_base));
-			jitc.asmALU32(X86_ADD, RCX, jitc.pc+4);
-			jitc.asmALU32(X86_MOV, curCPU(lr), RCX);
+			// blrl is a call, not a return
+			ret = ppc_opc_gen_set_lr(jitc, true);
+			jitcEmitIndirectJump(jitc);
+		} else {
+			jitc.asmJMP((NativeAddress)ppc_new_pc_return_asm);
 		}
-		jitc.asmALU32(X86_AND, RAX, 0xfffffffc);
-		jitc.asmJMP((NativeAddress)ppc_new_pc_asm);
+		ppc_opc_gen_return_stub(jitc, ret);
 		return flowEndBlockUnreachable;
 	} else {
 		jitc.clobberCarryAndFlags();
@@ -454,13 +528,16 @@ JITCFlow ppc_opc_gen_bclrx(JITC &jitc)
 		jitc.getClientRegister(PPC_LR, NATIVE_REG | RAX);
 		NativeAddress fixup = jitc.asmJxxFixup((BO & 8) ? X86_Z : X86_NZ);
 		jitc.flushRegisterDirty();
+		NativeAddress ret = NULL;
+		jitc.asmALU32(X86_AND, RAX, 0xfffffffc);
 		if (jitc.current_opc & PPC_OPC_LK) {
-			jitc.asmALU32(X86_MOV, RCX, curCPU(current_code_base));
-			jitc.asmALU32(X86_ADD, RCX, jitc.pc+4);
-			jitc.asmALU32(X86_MOV, curCPU(lr), RCX);
+			// blrl is a call, not a return
+			ret = ppc_opc_gen_set_lr(jitc, true);
+			jitcEmitIndirectJump(jitc);
+		} else {
+			jitc.asmJMP((NativeAddress)ppc_new_pc_return_asm);
 		}
-		jitc.asmALU32(X86_AND, RAX, 0xfffffffc);
-		jitc.asmJMP((NativeAddress)ppc_new_pc_asm);
+		ppc_opc_gen_return_stub(jitc, ret);
 		jitc.asmResolveFixup(fixup, jitc.asmHERE());
 		return flowContinue;
 	}
@@ -645,8 +722,10 @@ void ppc_opc_mcrf(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_mcrf(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_mcrf);
-	return flowEndBlock;
+	ppc_opc_gen_interpret_inline(jitc, ppc_opc_mcrf,
+		PPC_INTERPRET_CR,
+		PPC_INTERPRET_CR);
+	return flowContinue;
 }
 /*
  *	mcrfs		Move to Condition Register from FPSCR
@@ -677,8 +756,10 @@ void ppc_opc_mcrxr(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_mcrxr(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_mcrxr);
-	return flowEndBlock;
+	ppc_opc_gen_interpret_inline(jitc, ppc_opc_mcrxr,
+		PPC_INTERPRET_CR | PPC_INTERPRET_XER,
+		PPC_INTERPRET_CR | PPC_INTERPRET_XER);
+	return flowContinue;
 }
 
 static void inline move_reg(JITC &jitc, PPC_Register creg1, PPC_Register creg2)
@@ -723,6 +804,7 @@ void ppc_opc_mffsx(PPC_CPU_State &aCPU)
 	int frD, rA, rB;
 	PPC_OPC_TEMPL_X(aCPU.current_opc, frD, rA, rB);
 	PPC_OPC_ASSERT(rA==0 && rB==0);
+	ppc_fpu_sync_fpscr(aCPU);
 	aCPU.fpr[frD] = aCPU.fpscr;
 	if (aCPU.current_opc & PPC_OPC_Rc) {
 		// update cr1 flags
@@ -731,8 +813,10 @@ void ppc_opc_mffsx(PPC_CPU_State &aCPU)
 }
 JITCFlow ppc_opc_gen_mffsx(JITC &jitc)
 {
-	ppc_opc_gen_interpret(jitc, ppc_opc_mffsx);
-	return flowEndBlock;
+	ppc_opc_gen_interpret_inline(jitc, ppc_opc_mffsx,
+		PPC_INTERPRET_FPSCR,
+		PPC_INTERPRET_FPR_D | PPC_INTERPRET_FPSCR);
+	return flowContinue;
 }
 
 /*
@@ -1210,6 +1294,7 @@ JITCFlow ppc_opc_gen_mtfsb0x(JITC &jitc)
 	int crbD, n1, n2;
 	PPC_OPC_TEMPL_X(jitc.current_opc, crbD, n1, n2);
 	if (crbD != 1 && crbD != 2) {
+		ppc_opc_gen_sync_fpscr(jitc);
 		jitc.getClientRegister(PPC_FPSCR, NATIVE_REG | RAX);
 		jitc.clobberAll();
 		jitc.asmALU32(X86_AND, RAX, ~(1<<(31-crbD)));
@@ -1246,6 +1331,7 @@ JITCFlow ppc_opc_gen_mtfsb1x(JITC &jitc)
 	int crbD, n1, n2;
 	PPC_OPC_TEMPL_X(jitc.current_opc, crbD, n1, n2);
 	if (crbD != 1 && crbD != 2) {
+		ppc_opc_gen_sync_fpscr(jitc);
 		jitc.getClientRegister(PPC_FPSCR, NATIVE_REG | RAX);
 		jitc.clobberAll();
 		jitc.asmALU32(X86_OR, RAX, 1<<(31-crbD));
@@ -1286,6 +1372,7 @@ JITCFlow ppc_opc_gen_mtfsfx(JITC &jitc)
 	FM = ((fm&0x80)?0xf0000000:0)|((fm&0x40)?0x0f000000:0)|((fm&0x20)?0x00f00000:0)|((fm&0x10)?0x000f0000:0)|
 	     ((fm&0x08)?0x0000f000:0)|((fm&0x04)?0x00000f00:0)|((fm&0x02)?0x000000f0:0)|((fm&0x01)?0x0000000f:0);
 	     
+	ppc_opc_gen_sync_fpscr(jitc);
 	NativeReg fpscr = jitc.getClientRegister(PPC_FPSCR);
 	NativeReg b = jitc.getClientRegister(PPC_FPR(frB));
 	jitc.clobberAll();
@@ -1336,6 +1423,7 @@ JITCFlow ppc_opc_gen_mtfsfix(JITC &jitc)
 	crfD >>= 2;
 	imm >>= 1;
 	crfD = 7-crfD;
+	ppc_opc_gen_sync_fpscr(jitc);
 	NativeReg fpscr = jitc.getClientRegister(PPC_FPSCR);
 	jitc.clobberAll();
 	jitc.asmALU32(X86_AND, fpscr, ppc_cmp_and_mask[crfD]);
@@ -1781,7 +1869,7 @@ JITCFlow ppc_opc_gen_mtspr(JITC &jitc)
 		}
 		jitc.clobberAll();
 		jitc.asmALU64(X86_LEA, RDI, curCPU(all));
-		jitc.asmCALL((NativeAddress)ppc_mmu_tlb_invalidate_all_asm);
+		jitc.asmCALL((NativeAddress)ppc_mmu_tlb_invalidate_all_chains_asm);
 		jitc.asmALU32(X86_MOV, RAX, jitc.pc+4);
 		jitc.asmJMP((NativeAddress)ppc_new_pc_rel_asm);
 		return flowEndBlockUnreachable;
@@ -1830,7 +1918,7 @@ void ppc_opc_mtsr(PPC_CPU_State &aCPU)
 	int rS, SR, rB;
 	PPC_OPC_TEMPL_X(aCPU.current_opc, rS, SR, rB);
 	// FIXME: check insn
-	aCPU.sr[SR & 0xf] = aCPU.gpr[rS];
+	ppc_mmu_set_sr(aCPU, SR, aCPU.gpr[rS]);
 }
 JITCFlow ppc_opc_gen_mtsr(JITC &jitc)
 {
@@ -1839,10 +1927,11 @@ JITCFlow ppc_opc_gen_mtsr(JITC &jitc)
 	int rS, SR, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rS, SR, rB);
 	// FIXME: check insn
-	move_reg(jitc, PPC_SR(SR & 0xf), PPC_GPR(rS));
+	jitc.getClientRegister(PPC_GPR(rS), NATIVE_REG | RDX);
 	jitc.clobberAll();
+	jitc.asmALU32(X86_MOV, RSI, SR & 0xf);
 	jitc.asmALU64(X86_LEA, RDI, curCPU(all));
-	jitc.asmCALL((NativeAddress)ppc_mmu_tlb_invalidate_all_asm);
+	jitc.asmCALL((NativeAddress)ppc_mmu_set_sr);
 	// sync
 //	jitc.asmALU32(X86_MOV, EAX, jitc.pc+4);
 //	jitc.asmJMP((NativeAddress)ppc_new_pc_rel_asm);
@@ -1862,7 +1951,7 @@ void ppc_opc_mtsrin(PPC_CPU_State &aCPU)
 	int rS, rA, rB;
 	PPC_OPC_TEMPL_X(aCPU.current_opc, rS, rA, rB);
 	// FIXME: check insn
-	aCPU.sr[aCPU.gpr[rB] >> 28] = aCPU.gpr[rS];
+	ppc_mmu_set_sr(aCPU, aCPU.gpr[rB] >> 28, aCPU.gpr[rS]);
 }
 JITCFlow ppc_opc_gen_mtsrin(JITC &jitc)
 {
@@ -1871,18 +1960,17 @@ JITCFlow ppc_opc_gen_mtsrin(JITC &jitc)
 	int rS, rA, rB;
 	PPC_OPC_TEMPL_X(jitc.current_opc, rS, rA, rB);
 	// FIXME: check insn
-	NativeReg b = jitc.getClientRegister(PPC_GPR(rB));
-	NativeReg s = jitc.getClientRegister(PPC_GPR(rS));
-	if (b == s) {
-		s = jitc.allocRegister();
-		jitc.asmALU32(X86_MOV, s, b);
+	jitc.getClientRegister(PPC_GPR(rS), NATIVE_REG | RDX);
+	if (rB == rS) {
+		jitc.clobberAll();
+		jitc.asmALU32(X86_MOV, RSI, RDX);
+	} else {
+		jitc.getClientRegister(PPC_GPR(rB), NATIVE_REG | RSI);
+		jitc.clobberAll();
 	}
-	jitc.clobberAll();
-	jitc.asmShift32(X86_SHR, b, 28);
-	// mov [4*b+sr], s
-	jitc.asmALU32(X86_MOV, curCPUsib(sr, 4, b), s);
+	jitc.asmShift32(X86_SHR, RSI, 28);
 	jitc.asmALU64(X86_LEA, RDI, curCPU(all));
-	jitc.asmCALL((NativeAddress)ppc_mmu_tlb_invalidate_all_asm);
+	jitc.asmCALL((NativeAddress)ppc_mmu_set_sr);
 	// sync
 //	jitc.asmALU32(X86_MOV, EAX, jitc.pc+4);
 //	jitc.asmJMP((NativeAddress)ppc_new_pc_rel_asm);
@@ -1983,6 +2071,7 @@ void ppc_opc_tlbia(PPC_CPU_State &aCPU)
 	int rS, rA, rB;
 	PPC_OPC_TEMPL_X(aCPU.current_opc, rS, rA, rB);
 	// FIXME: check rS.. for 0
+	__atomic_fetch_add(&aCPU.chain_epoch, 1, __ATOMIC_RELAXED);
 	ppc_mmu_tlb_invalidate(aCPU);
 }
 JITCFlow ppc_opc_gen_tlbia(JITC &jitc)
@@ -1990,7 +2079,7 @@ JITCFlow ppc_opc_gen_tlbia(JITC &jitc)
 	jitc.clobberAll();
 	ppc_opc_gen_check_privilege(jitc);
 	jitc.asmALU64(X86_LEA, RDI, curCPU(all));
-	jitc.asmCALL((NativeAddress)ppc_mmu_tlb_invalidate_all_asm);
+	jitc.asmCALL((NativeAddress)ppc_mmu_tlb_invalidate_all_chains_asm);
 	jitc.asmALU32(X86_MOV, RAX, jitc.pc+4);
 	jitc.asmJMP((NativeAddress)ppc_new_pc_rel_asm);
 	return flowEndBlockUnreachable;
@@ -2009,6 +2098,7 @@ void ppc_opc_tlbie(PPC_CPU_State &aCPU)
 	int rS, rA, rB;
 	PPC_OPC_TEMPL_X(aCPU.current_opc, rS, rA, rB);
 	// FIXME: check rS.. for 0
+	__atomic_fetch_add(&aCPU.chain_epoch, 1, __ATOMIC_RELAXED);
 	ppc_mmu_tlb_invalidate(aCPU);
 }
 JITCFlow ppc_opc_gen_tlbie(JITC &jitc)
@@ -24,6 +24,7 @@
 #include "system/types.h"
 #include "jitc_types.h"
 #include "jitc.h"
+#include "ppc_dec.h"
 
 static inline void ppc_update_cr0(PPC_CPU_State &aCPU, uint32 r)
 {
@@ -47,6 +48,55 @@ static UNUSED void ppc_opc_gen_interpret(JITC &jitc, ppc_opc_function func)
 	jitc.asmCALL((NativeAddress)func);
 }
 
+/*
+ *	Register sets for ppc_opc_gen_interpret_inline,
+ *	the operands are decoded from the opcode
+ */
+#define PPC_INTERPRET_GPR_D	(1<<0)	// bits 6-10 (rD/rS)
+#define PPC_INTERPRET_GPR_A	(1<<1)	// bits 11-15
+#define PPC_INTERPRET_GPR_B	(1<<2)	// bits 16-20
+#define PPC_INTERPRET_FPR_D	(1<<3)
+#define PPC_INTERPRET_FPR_A	(1<<4)
+#define PPC_INTERPRET_FPR_B	(1<<5)
+#define PPC_INTERPRET_FPR_C	(1<<6)	// bits 21-25
+#define PPC_INTERPRET_CR	(1<<7)
+#define PPC_INTERPRET_XER	(1<<8)
+#define PPC_INTERPRET_FPSCR	(1<<9)
+#define PPC_INTERPRET_Rc	(1<<10)	// cr0 and xer[SO] if Rc is set
+
+static inline void ppc_opc_interpret_regs(uint32 opc, uint set, bool write, PPC_Register *regs)
+{
+	int D = (opc>>21)&0x1f, A = (opc>>16)&0x1f, B = (opc>>11)&0x1f, C = (opc>>6)&0x1f;
+	if ((set & PPC_INTERPRET_Rc) && (opc & PPC_OPC_Rc)) {
+		set |= write ? PPC_INTERPRET_CR : PPC_INTERPRET_CR | PPC_INTERPRET_XER;
+	}
+	if (set & PPC_INTERPRET_GPR_D) *regs++ = PPC_GPR(D);
+	if (set & PPC_INTERPRET_GPR_A) *regs++ = PPC_GPR(A);
+	if (set & PPC_INTERPRET_GPR_B) *regs++ = PPC_GPR(B);
+	if (set & PPC_INTERPRET_FPR_D) *regs++ = PPC_FPR(D);
+	if (set & PPC_INTERPRET_FPR_A) *regs++ = PPC_FPR(A);
+	if (set & PPC_INTERPRET_FPR_B) *regs++ = PPC_FPR(B);
+	if (set & PPC_INTERPRET_FPR_C) *regs++ = PPC_FPR(C);
+	if (set & PPC_INTERPRET_CR) *regs++ = PPC_CR;
+	if (set & PPC_INTERPRET_XER) *regs++ = PPC_XER;
+	if (set & PPC_INTERPRET_FPSCR) *regs++ = PPC_FPSCR;
+	*regs = PPC_REG_NO;
+}
+
+/*
+ *	Like ppc_opc_gen_interpret, but only the client registers
+ *	func reads or writes are flushed, so the block can continue
+ *	(return flowContinue).
+ *	func must not raise exceptions or change msr or pc.
+ */
+static UNUSED void ppc_opc_gen_interpret_inline(JITC &jitc, ppc_opc_function func, uint reads, uint writes)
+{
+	PPC_Register r[12], w[12];
+	ppc_opc_interpret_regs(jitc.current_opc, reads, false, r);
+	ppc_opc_interpret_regs(jitc.current_opc, writes, true, w);
+	jitc.asmCALLInterpret((NativeAddress)func, r, w);
+}
+
 
 void ppc_opc_bx(PPC_CPU_State &aCPU);
 void ppc_opc_bcx(PPC_CPU_State &aCPU);
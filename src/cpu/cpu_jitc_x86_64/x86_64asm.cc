@@ -61,6 +61,11 @@ void x86GetCaps(X86CPUCaps &caps)
 	caps._3dnow2 = id2.features & (1<<30);
 	caps.sse3 = id2.features2 & (1<<0);
 	caps.ssse3 = id2.features2 & (1<<9);
+	// FMA3 is VEX encoded, so the OS must save the YMM state (OSXSAVE, XCR0)
+	if ((id2.features2 & (1<<12)) && (id2.features2 & (1<<27))
+	 && (id2.features2 & (1<<28))) {
+		caps.fma = (ppc_xgetbv_asm(0) & 6) == 6;
+	}
 	
 	ppc_cpuid_asm(0x80000000, &id);
 	if (id.level >= 0x80000001) {
@@ -530,6 +535,58 @@ void JITC::invalidateAll()
 #endif
 }
 
+/*
+ *	Returns the mapping of the native registers,
+ *	their dirty flags and their LRU order
+ *
+ *	Will never produce code
+ */
+void JITC::getRegisterState(JITCRegisterState &state)
+{
+	memcpy(state.nativeReg, nativeReg, sizeof state.nativeReg);
+	memcpy(state.nativeRegState, nativeRegState, sizeof state.nativeRegState);
+	int i = 0;
+	for (NativeRegType *reg = LRUreg; reg; reg = reg->moreRU) {
+		state.lru[i++] = reg->reg;
+	}
+	while (i < 16) state.lru[i++] = REG_NO;
+}
+
+/*
+ *	Invalidates all mappings and maps the native registers
+ *	like state (including the dirty flags). If load is set,
+ *	the client registers are loaded.
+ *
+ *	Will produce loads if load is set
+ */
+void JITC::setRegisterState(const JITCRegisterState &state, bool load)
+{
+	invalidateAll();
+	NativeRegType *prev = NULL;
+	for (int i=0; i < 16 && state.lru[i] != REG_NO; i++) {
+		NativeRegType *reg = nativeRegsList[state.lru[i]];
+		reg->lessRU = prev;
+		if (prev) {
+			prev->moreRU = reg;
+		} else {
+			LRUreg = reg;
+		}
+		prev = reg;
+	}
+	prev->moreRU = NULL;
+	MRUreg = prev;
+	for (NativeReg i = RAX; i <= R15; i = (NativeReg)(i+1)) {
+		PPC_Register creg = state.nativeReg[i];
+		if (creg == PPC_REG_NO) continue;
+		if (load) {
+			loadRegister(i, creg);
+		} else {
+			mapRegister(i, creg);
+		}
+		nativeRegState[i] = state.nativeRegState[i];
+	}
+}
+
 /*
  *	Gets the client carry flags into the native carry flag
  *	
@@ -544,9 +601,14 @@ void JITC::getClientCarry()
 	}
 }
 
-void JITC::mapFlagsDirty(PPC_CRx cr)
+/*
+ *	Maps the x86 flags to crX. The field is only
+ *	written when the flags are clobbered (see flushFlags)
+ */
+void JITC::mapFlagsDirty(PPC_CRx cr, JITCFlagsType type)
 {
 	nativeFlags = cr;
+	nativeFlagsType = type;
 	nativeFlagsState = rsDirty;
 }
 
@@ -555,6 +617,26 @@ PPC_CRx JITC::getFlagsMapping()
 	return nativeFlags;
 }
 
+JITCFlagsType JITC::getFlagsType()
+{
+	return nativeFlagsType;
+}
+
+/*
+ *	Called before an instruction which sets all of crX
+ *	(apart from SO) without reading it. If the mapped flags
+ *	belong to crX they are dropped instead of flushed.
+ *	Clobbers carry and flags.
+ */
+void JITC::overwriteFlags(PPC_CRx cr)
+{
+	if (nativeFlagsState == rsDirty && nativeFlags == cr) {
+		nativeFlagsState = rsUnused;
+		flags_dead++;
+	}
+	clobberCarryAndFlags();
+}
+
 bool JITC::flagsMapped()
 {
 	return nativeFlagsState != rsUnused;
@@ -577,9 +659,50 @@ void JITC::flushCarry()
 
 #if 1
 
+static void (*const jitcFlushFlagsSigned[8])() = {
+	ppc_flush_flags_signed_cr0_asm, ppc_flush_flags_signed_cr1_asm,
+	ppc_flush_flags_signed_cr2_asm, ppc_flush_flags_signed_cr3_asm,
+	ppc_flush_flags_signed_cr4_asm, ppc_flush_flags_signed_cr5_asm,
+	ppc_flush_flags_signed_cr6_asm, ppc_flush_flags_signed_cr7_asm,
+};
+
+static void (*const jitcFlushFlagsUnsigned[8])() = {
+	ppc_flush_flags_unsigned_cr0_asm, ppc_flush_flags_unsigned_cr1_asm,
+	ppc_flush_flags_unsigned_cr2_asm, ppc_flush_flags_unsigned_cr3_asm,
+	ppc_flush_flags_unsigned_cr4_asm, ppc_flush_flags_unsigned_cr5_asm,
+	ppc_flush_flags_unsigned_cr6_asm, ppc_flush_flags_unsigned_cr7_asm,
+};
+
+/*
+ *	Writes the mapped flags into their crX field.
+ *	Destroys the x86 flags.
+ */
 void JITC::flushFlags()
 {
-	asmCALL((NativeAddress)ppc_flush_flags_asm);
+	switch (nativeFlagsType) {
+	case flagsResult:
+		// only record forms, always cr0
+		asmCALL((NativeAddress)ppc_flush_flags_asm);
+		break;
+	case flagsSigned:
+		asmCALL((NativeAddress)jitcFlushFlagsSigned[nativeFlags]);
+		break;
+	case flagsUnsigned:
+		asmCALL((NativeAddress)jitcFlushFlagsUnsigned[nativeFlags]);
+		break;
+	}
+}
+
+/*
+ *	Flushes the flags, but doesn't unmap them.
+ *	The x86 flags are destroyed, so only use this
+ *	if the code doesn't continue (e.g. a taken branch).
+ */
+void JITC::flushFlagsDirty()
+{
+	if (nativeFlagsState == rsDirty) {
+		flushFlags();
+	}
 }
 
 #else
@@ -1045,6 +1168,8 @@ void JITC::asmMOVABS(NativeReg reg, uint64 value)
 	byte instr[10] = {byte(0x48 + (reg>>3)), byte(0xb8 + (reg&7))};
 	U64(instr + 2) = value;
 	emit(instr, sizeof instr);
+	// might be a host address
+	asmReloc(currentPage->tcp - 8, relocPinned);
 }
 
 void JITC::asmSimpleALU32(X86ALUopc opc, NativeReg reg, uint32 imm)
@@ -1497,6 +1622,67 @@ void JITC::asmALU8(X86ALUopc opc, NativeReg base, uint32 disp, uint8 imm)
 	emit(instr, len+1);
 }
 
+void JITC::asmALU8(X86ALUopc opc, NativeReg base, int scale, NativeReg index, uint32 disp, uint8 imm)
+{
+	byte instr[15];
+	uint len = 0, rex = 0;
+	if ((base | index) & 8) {
+		rex = 0x40;
+		len++;
+	}
+	switch (opc) {
+	case X86_MOV:
+		instr[len++] = 0xc6;
+		instr[len] = 0;
+		break;
+	case X86_XCHG:
+	case X86_TEST:
+		// internal error
+		return;
+	default:
+		instr[len++] = 0x80;
+		instr[len] = (opc<<3);
+	}
+	len += mksib(instr+len, base, scale, index, disp, rex);
+	if (rex) instr[0] = rex;
+	instr[len] = imm;
+	emit(instr, len+1);
+}
+
+void JITC::asmALU64(X86ALUopc opc, NativeReg base, uint32 disp, uint32 imm)
+{
+	byte instr[15];
+	uint len = 0;
+	instr[len++] = 0x48+(base>>3);
+	switch (opc) {
+	case X86_MOV:
+		instr[len++] = 0xc7;
+		instr[len] = 0;
+		len += mkmodrm(instr+len, base, disp);
+		U32(instr + len) = imm;
+		emit(instr, len+4);
+		break;
+	case X86_XCHG:
+	case X86_TEST:
+		// internal error
+		break;
+	default:
+		if (imm <= 0x7f || imm >= 0xffffff80) {
+			instr[len++] = 0x83;
+			instr[len] = (opc<<3);
+			len += mkmodrm(instr+len, base, disp);
+			instr[len] = imm;
+			emit(instr, len+1);
+		} else {
+			instr[len++] = 0x81;
+			instr[len] = (opc<<3);
+			len += mkmodrm(instr+len, base, disp);
+			U32(instr + len) = imm;
+			emit(instr, len+4);
+		}
+	}
+}
+
 void JITC::asmMOVxx32_16(X86MOVxx opc, NativeReg reg1, NativeReg reg2)
 {
 	if (reg1 > 7 || reg2 > 4) {
@@ -1538,6 +1724,35 @@ void JITC::asmMOVxx32_8(X86MOVxx opc, NativeReg reg, NativeReg base, uint32 disp
 	emit(instr, len);
 }
 
+void JITC::asmMOVxx32_16(X86MOVxx opc, NativeReg reg, NativeReg base, uint32 disp)
+{
+	byte instr[15];
+	uint len=0;
+	if (reg > 7 || base > 7) {
+		instr[0] = byte(0x40+((reg>>3)<<2)+(base>>3));
+		len++;
+	}
+	instr[len++] = 0x0f;
+	instr[len++] = opc+1;
+	instr[len] = (reg & 7) << 3;
+	len += mkmodrm(instr+len, base, disp);
+	emit(instr, len);
+}
+
+void JITC::asmMOV16(NativeReg base, uint32 disp, NativeReg reg)
+{
+	byte instr[15];
+	uint len=0;
+	instr[len++] = 0x66;
+	if ((reg | base) > 7) {
+		instr[len++] = 0x40+((reg>>3)<<2)+(base>>3);
+	}
+	instr[len++] = 0x89;
+	instr[len] = (reg&7)<<3;
+	len += mkmodrm(instr+len, base, disp);
+	emit(instr, len);
+}
+
 void JITC::asmSET8(X86FlagTest flags, NativeReg reg)
 {
 	if (reg > 3) {
@@ -1787,6 +2002,83 @@ void JITC::asmBSWAP32(NativeReg reg)
 	}
 }
 
+void JITC::asmBTx64(X86BitTest opc, NativeReg reg1, int value)
+{
+	byte instr[5] = {byte(0x48+(reg1>>3)), 0x0f, 0xba, byte(0xc0+(opc<<3)+(reg1&7)), byte(value)};
+	emit(instr, sizeof instr);
+}
+
+void JITC::asmALUSD(X86ALUSDopc opc, NativeVectorReg reg1, NativeVectorReg reg2)
+{
+	byte instr[5];
+	uint len = 0;
+	instr[len++] = opc >> 8;
+	if ((reg1 | reg2) > 7) {
+		instr[len++] = 0x40+((reg1>>3)<<2)+(reg2>>3);
+	}
+	instr[len++] = 0x0f;
+	instr[len++] = opc;
+	instr[len++] = 0xc0+((reg1&7)<<3)+(reg2&7);
+	emit(instr, len);
+}
+
+void JITC::asmMOVSD(NativeVectorReg reg, NativeReg base, uint32 disp)
+{
+	byte instr[15];
+	uint len = 0;
+	instr[len++] = 0xf2;
+	if ((reg | base) > 7) {
+		instr[len++] = 0x40+((reg>>3)<<2)+(base>>3);
+	}
+	instr[len++] = 0x0f;
+	instr[len++] = 0x10;
+	instr[len] = (reg&7)<<3;
+	len += mkmodrm(instr+len, base, disp);
+	emit(instr, len);
+}
+
+void JITC::asmMOVQ(NativeVectorReg reg1, NativeReg reg2)
+{
+	byte instr[5] = {0x66, byte(0x48+((reg1>>3)<<2)+(reg2>>3)),
+	                 0x0f, 0x6e, byte(0xc0+((reg1&7)<<3)+(reg2&7))};
+	emit(instr, sizeof instr);
+}
+
+void JITC::asmMOVQ(NativeReg reg1, NativeVectorReg reg2)
+{
+	byte instr[5] = {0x66, byte(0x48+((reg2>>3)<<2)+(reg1>>3)),
+	                 0x0f, 0x7e, byte(0xc0+((reg2&7)<<3)+(reg1&7))};
+	emit(instr, sizeof instr);
+}
+
+void JITC::asmCVTSD2SI32(X86CVTSD2SIopc opc, NativeReg reg1, NativeVectorReg reg2)
+{
+	byte instr[5];
+	uint len = 0;
+	instr[len++] = 0xf2;
+	if ((reg1 | reg2) > 7) {
+		instr[len++] = 0x40+((reg1>>3)<<2)+(reg2>>3);
+	}
+	instr[len++] = 0x0f;
+	instr[len++] = opc;
+	instr[len++] = 0xc0+((reg1&7)<<3)+(reg2&7);
+	emit(instr, len);
+}
+
+/*
+ *	reg1 = reg1 * reg2 +/- reg3 (VEX encoded, check hostCPUCaps.fma)
+ */
+void JITC::asmFMA(X86FMAopc opc, NativeVectorReg reg1, NativeVectorReg reg2, NativeVectorReg reg3)
+{
+	byte instr[5];
+	instr[0] = 0xc4;
+	instr[1] = ((~reg1 & 8) << 4) | 0x40 | ((~reg3 & 8) << 2) | 0x02;
+	instr[2] = 0x80 | ((~reg2 & 0xf) << 3) | 0x01;
+	instr[3] = opc;
+	instr[4] = 0xc0+((reg1&7)<<3)+(reg3&7);
+	emit(instr, sizeof instr);
+}
+
 void JITC::asmJMP(NativeAddress to)
 {
 	/*
@@ -1807,6 +2099,7 @@ restart:
 		instr[0] = 0xe9;
 		U32(instr + 1) = uint32(to - (currentPage->tcp+5));
 		emit(instr, 5);
+		asmReloc(currentPage->tcp - 4);
 	}
 }
 
@@ -1826,6 +2119,7 @@ restart:
 		instr[1] = 0x80+flags;
 		U32(instr + 2) = uint32(to - (currentPage->tcp+6));
 		emit(instr, 6);
+		asmReloc(currentPage->tcp - 4);
 	}
 }
 
@@ -1833,10 +2127,9 @@ NativeAddress JITC::asmJMPFixup()
 {
 	byte instr[5];
 	instr[0] = 0xe9;
-#ifdef JITC_DEBUG
 	memset(instr+1, 0, 4);
-#endif
 	emit(instr, 5);
+	asmReloc(currentPage->tcp - 4);
 	return currentPage->tcp - 4;
 }
 
@@ -1845,10 +2138,9 @@ NativeAddress JITC::asmJxxFixup(X86FlagTest flags)
 	byte instr[6];
 	instr[0] = 0x0f;
 	instr[1] = 0x80+flags;
-#ifdef JITC_DEBUG
 	memset(instr+2, 0, 4);
-#endif
 	emit(instr, 6);
+	asmReloc(currentPage->tcp - 4);
 	return currentPage->tcp - 4;
 }
 
@@ -1859,6 +2151,59 @@ void JITC::asmCALL(NativeAddress to)
 	instr[0] = 0xe8;
 	U32(instr + 1) = uint32(to - (currentPage->tcp+5));
 	emit(instr, 5);
+	asmReloc(currentPage->tcp - 4);
+}
+
+/*
+ *	Calls func(PPC_CPU_State &) without changing the register mapping,
+ *	i.e. the code behind the call continues as if it never happened:
+ *	Dirty registers are written back before and all mapped registers
+ *	are reloaded after the call, since func may change any of them
+ *	(and the caller-saved ones anyway).
+ *	Carry and flags must not be mapped.
+ */
+void JITC::asmCALLInPlace(NativeAddress func)
+{
+	flushRegisterDirty();
+	asmALU64(X86_LEA, RDI, curCPU(all));
+	asmCALL(func);
+	for (NativeReg i = RAX; i <= R15; i = (NativeReg)(i+1)) {
+		if (nativeRegState[i] != rsUnused) {
+			PPC_Register creg = getRegisterMapping(i);
+			if (creg >= PPC_FPR(0) && creg <= PPC_FPR(31)) {
+				asmALU64(X86_MOV, i, curCPUreg(creg));
+			} else {
+				asmALU32(X86_MOV, i, curCPUreg(creg));
+			}
+		}
+	}
+}
+
+/*
+ *	Calls the interpreter function func (see ppc_opc_gen_interpret_inline).
+ *	Only the client registers in reads are written back and only those
+ *	in writes (and the ones in caller-saved native registers) are unmapped.
+ *	Both lists are terminated by PPC_REG_NO.
+ */
+void JITC::asmCALLInterpret(NativeAddress func, const PPC_Register *reads, const PPC_Register *writes)
+{
+	static const NativeReg callerSaved[] = {RAX, RCX, RDX, RSI, RDI, R8, R9, R10, R11};
+
+	clobberCarryAndFlags();
+	for (; *reads != PPC_REG_NO; reads++) {
+		NativeReg reg = getClientRegisterMapping(*reads);
+		if (reg != REG_NO) flushSingleRegister(reg);
+	}
+	for (; *writes != PPC_REG_NO; writes++) {
+		NativeReg reg = getClientRegisterMapping(*writes);
+		if (reg != REG_NO) clobberAndDiscardRegister(reg);
+	}
+	for (uint i = 0; i < sizeof callerSaved / sizeof callerSaved[0]; i++) {
+		clobberAndDiscardRegister(callerSaved[i]);
+	}
+	asmALU64(X86_LEA, RDI, curCPU(all));
+	asmALU32(X86_MOV, curCPU(current_opc), current_opc);
+	asmCALL(func);
 }
 
 void JITC::asmSimple(X86SimpleOpc simple)
@@ -31,6 +31,14 @@ bool	ppc_dma_write(uint32 dest, const void *src, uint32 size);
 bool	ppc_dma_read(void *dest, uint32 src, uint32 size);
 bool	ppc_dma_set(uint32 dest, int c, uint32 size);
 
+/*
+ *	Direct access to client memory, so host I/O can transfer
+ *	into it without a bounce buffer. Call ppc_dma_written()
+ *	once memory obtained by ppc_dma_map() has been modified.
+ */
+bool	ppc_dma_map(uint32 addr, uint32 size, byte *&ptr);
+void	ppc_dma_written(uint32 dest, uint32 size);
+
 void	ppc_cpu_map_framebuffer(uint32 pa, uint32 ea);
 
 /*
@@ -34,12 +34,14 @@
 #include "cpu/debug.h"
 #include "cpu/mem.h"
 #include "system/sysethtun.h"
+#include "system/sysioloop.h"
 #include "system/arch/sysendian.h"
 #include "tools/crc32.h"
 #include "tools/data.h"
 #include "tools/endianess.h"
 #include "tools/except.h"
 #include "tools/snprintf.h"
+#include "io/io.h"
 #include "io/pic/pic.h"
 #include "io/pci/pci.h"
 #include "debug/tracers.h"
@@ -50,6 +52,11 @@
 #endif
 
 #define MAX_PACKET_SIZE		16384
+// a transmitted frame may be padded up to MAX_PACKET_SIZE and get a CRC
+#define MAX_TX_FRAME_SIZE	(MAX_PACKET_SIZE + 4)
+// limits of the host side receive ring and transmit batch
+#define MAX_RX_RING		256
+#define MAX_TX_BATCH		64
 
 enum Command {
 	CmdTotalReset = 0<<11,
@@ -483,6 +490,9 @@ struct UPDFragDesc {
 #define MAX_UPD_FRAGS	63
 #define MAX_UPD_SIZE	(sizeof(UPD) + sizeof(UPDFragDesc)*MAX_UPD_FRAGS) // 512
 
+// appended to short frames
+static byte gZeroPadding[64];
+
 enum UpPktStatusBits {
 	UPS_upPktLen = 0x1fff,
 	/* 13 unspecified */
@@ -523,6 +533,9 @@ static int compareMACs(byte a[6], byte b[6])
 	return 0;
 }
 
+static void _3c90xRxReady(int fd, void *nic);
+static void _3c90xRxComplete(void *nic);
+
 /*
  *
  */
@@ -537,8 +550,44 @@ protected:
 	bool		mTxEnabled;
 	bool		mUpStalled;
 	bool		mDnStalled;
-	byte		mRxPacket[MAX_PACKET_SIZE];
-	uint		mRxPacketSize;
+	/*
+	 *	Received frames wait in mRxRing until the guest
+	 *	provides UPDs to upload them into
+	 */
+	byte		(*mRxRing)[MAX_PACKET_SIZE];
+	uint		*mRxRingSize;
+	uint		mRxRingLen;
+	uint		mRxFirst;
+	uint		mRxCount;
+	uint		mRxGeneration;
+	sys_semaphore	mRxSpace;
+	byte		*mRxScratch;
+	/*
+	 *	With an I/O loop, frames are received from its thread and
+	 *	mRxFD is disabled while the ring is full. The interrupts
+	 *	are raised by mRxCompletion within the CPU thread.
+	 */
+	int		mRxFD;
+	bool		mRxPaused;
+	bool		mRxIndicate;
+	IOCompletion	mRxCompletion;
+	/*
+	 *	Frames of one DnList walk are sent as a batch. Their
+	 *	fragments point into guest memory (or into mTxBatch)
+	 */
+	byte		(*mTxBatch)[MAX_TX_FRAME_SIZE];
+	PacketBuf	mTxFrags[MAX_TX_BATCH][MAX_DPD_FRAGS+1];
+	uint		mTxFragCount[MAX_TX_BATCH];
+	uint		mTxBatchLen;
+	uint		mTxCount;
+	// append CRCs to transmitted frames (tunnels don't need them)
+	bool		mCRC;
+	/*
+	 *	maximum number of uploaded frames per interrupt, more are
+	 *	only uploaded after the guest has acknowledged upComplete
+	 */
+	uint		mIntrCoalesce;
+	uint		mUpSinceAck;
 	EthTunDevice *	mEthTun;
 	sys_mutex	mLock;
 	
@@ -600,10 +649,11 @@ void totalReset()
 	mTxEnabled = false;
 	mUpStalled = false;
 	mDnStalled = false;
-	w3.MaxPktSize = 1514 /* FIXME: should depend on sizeof mRxPacket*/;
+	mUpSinceAck = 0;
+	w3.MaxPktSize = 1514 /* FIXME: should depend on MAX_PACKET_SIZE */;
 	w3.RxFree = 16*1024;
 	w3.TxFree = 16*1024;
-	mRxPacketSize = 0;
+	rxFlush();
 	w5.TxStartThresh = 8188;
 	memset(mEEPROM, 0, sizeof mEEPROM);
 	mEEPROM[EEPROM_NodeAddress0] =		(mMAC[0]<<8) | mMAC[1];
@@ -1144,6 +1194,7 @@ void setCR(uint16 cr)
 		break;
 	case CmdRxReset:
 		IO_3C90X_TRACE("RxReset\n");
+		rxFlush();
 		break;
 	case CmdSetIndicationEnable: {
 		RegWindow5 &w5 = (RegWindow5&)mWindows[5];
@@ -1306,55 +1357,57 @@ void txDPD0(DPD0 *dpd)
 		IO_3C90X_TRACE("dpd empty\n");
 		return;
 	}
-	byte pbuf[MAX_PACKET_SIZE];
-	byte *p = pbuf;
+	if (mTxCount == mTxBatchLen) txFlush();
+	/*
+	 *	The frame is normally sent straight from guest memory,
+	 *	mTxBatch is only needed if the frame has to be modified.
+	 */
+	PacketBuf *pkt = mTxFrags[mTxCount];
+	uint npkt = 0;
 	// some packet drivers need padding
 	uint framePrefix = mEthTun->getWriteFramePrefix();
-	memset(p, 0, framePrefix);
-	p += framePrefix;
+	uint psize = framePrefix;
 	//
 	uint i = 0;
-	// assemble packet from fragments (up to MAX_DPD_FRAGS fragments)
+	// gather packet from fragments (up to MAX_DPD_FRAGS fragments)
 	while (i < MAX_DPD_FRAGS) {
 		uint addr = frags->DnFragAddr;
 		uint len = frags->DnFragLen & 0x1fff;
 		IO_3C90X_TRACE("frag %d: %08x, len %04x (full: %08x)\n", i, addr, len, frags->DnFragLen);
 //		dumpMem(addr, len);
-		if (p-pbuf+len >= sizeof pbuf) {
-			IO_3C90X_WARN("packet too big ! (%d >= %d)\n", p-pbuf+len, sizeof pbuf);
+		if (psize+len >= MAX_PACKET_SIZE) {
+			IO_3C90X_WARN("packet too big ! (%d >= %d)\n", psize+len, MAX_PACKET_SIZE);
 			SINGLESTEP("");
 			return;
 		}
-		if (!ppc_dma_read(p, addr, len)) {
+		byte *ptr;
+		if (!ppc_dma_map(addr, len, ptr)) {
 			IO_3C90X_WARN("frag addr invalid! cancelling\n");
 			SINGLESTEP("");
 			return;
 		}
-		p += len;
+		pkt[npkt].buf = ptr;
+		pkt[npkt].size = len;
+		npkt++;
+		psize += len;
 		// last fragment ?
 		if (frags->DnFragLen & 0x80000000) break;
 		frags++;
 		i++;
 	}
-	uint psize = p-pbuf;
+	uint gap = 0;
 	if (!(fsh & FSH_rndupDefeat)) {
 		// round packet length
 		switch (fsh & FSH_rndupBndry) {
-		case 0: {
+		case 0:
 			// 4 bytes
-			uint gap = ((psize+3) & ~3) -psize;
-			memset(pbuf+psize, 0, gap);
-			psize += gap;
+			gap = ((psize+3) & ~3) -psize;
 			break;
-		}
-		case 2: {
+		case 2:
 			// 2 bytes
-			uint gap = ((psize+1) & ~1) -psize;
-			memset(pbuf+psize, 0, gap);
-			psize += gap;
+			gap = ((psize+1) & ~1) -psize;
 			break;
 		}
-		}
 	}
 	//FSH_reArmDisable =	1<<23,
 	//FSH_lastKap =		1<<24,
@@ -1366,34 +1419,45 @@ void txDPD0(DPD0 *dpd)
 		SINGLESTEP("");
 	}
 
-	if (psize<60) {
+	if (psize+gap < 60) {
 		// pad packet to at least 60 bytes (+4 bytes crc = 64 bytes)
-		memset(pbuf+psize, 0, (60-psize));
-		psize = 60;
+		gap = 60-psize;
 	}
-	// append crc
-	if (!(fsh & FSH_crcAppendDisable)) {
-		uint32 crc = ether_crc(psize, pbuf);
-		pbuf[psize+0] = crc;
-		pbuf[psize+1] = crc>>8;
-		pbuf[psize+2] = crc>>16;
-		pbuf[psize+3] = crc>>24;
-		psize += 4;
-		IO_3C90X_TRACE("packet has crc: %08x\n", crc);
-	}
-
-//	IO_3C90X_TRACE("tx(%d):\n", psize);
-//	dumpMem(pbuf, psize);
-	uint w = mEthTun->sendPacket(pbuf, psize);
-	if (w) {
-		if (w == psize) {
-			IO_3C90X_TRACE("EthTun: %d bytes sent.\n", psize);
-		} else {
-			IO_3C90X_TRACE("EthTun: ARGH! send error: only %d of %d bytes sent\n", w, psize);
+	bool appendCRC = mCRC && !(fsh & FSH_crcAppendDisable);
+	if (framePrefix || appendCRC) {
+		// assemble the frame
+		byte *pbuf = mTxBatch[mTxCount];
+		byte *p = pbuf;
+		memset(p, 0, framePrefix);
+		p += framePrefix;
+		for (uint j = 0; j < npkt; j++) {
+			memcpy(p, pkt[j].buf, pkt[j].size);
+			p += pkt[j].size;
 		}
-	} else {
-		IO_3C90X_TRACE("EthTun: ARGH! send error in packet driver.\n");
+		memset(p, 0, gap);
+		psize += gap;
+		// append crc
+		if (appendCRC) {
+			uint32 crc = ether_crc(psize, pbuf);
+			pbuf[psize+0] = crc;
+			pbuf[psize+1] = crc>>8;
+			pbuf[psize+2] = crc>>16;
+			pbuf[psize+3] = crc>>24;
+			psize += 4;
+			IO_3C90X_TRACE("packet has crc: %08x\n", crc);
+		}
+		pkt[0].buf = pbuf;
+		pkt[0].size = psize;
+		npkt = 1;
+	} else if (gap) {
+		pkt[npkt].buf = gZeroPadding;
+		pkt[npkt].size = gap;
+		npkt++;
 	}
+
+	// sent by txFlush()
+	mTxFragCount[mTxCount] = npkt;
+	mTxCount++;
 	// indications
 	mRegisters.DmaCtrl |= DC_dnComplete;
 	uint inds = 0;
@@ -1406,8 +1470,21 @@ void txDPD0(DPD0 *dpd)
 	mRegisters.DnListPtr = dpd->DnNextPtr;
 	uint pktId = (fsh & FSH_pktId) >> 2;
 	mRegisters.TxPktId = pktId;
-	// maybe generate interrupt
-	maybeRaiseIntr();
+}
+
+void txFlush()
+{
+	if (!mTxCount) return;
+	uint sent = 0;
+	for (uint i = 0; i < mTxCount; i++) {
+		if (mEthTun->sendPacketv(mTxFrags[i], mTxFragCount[i])) sent++;
+	}
+	if (sent == mTxCount) {
+		IO_3C90X_TRACE("EthTun: %d packets sent.\n", sent);
+	} else {
+		IO_3C90X_TRACE("EthTun: ARGH! send error: only %d of %d packets sent\n", sent, mTxCount);
+	}
+	mTxCount = 0;
 }
 
 bool passesRxFilter(byte *pbuf, uint psize)
@@ -1436,7 +1513,11 @@ bool passesRxFilter(byte *pbuf, uint psize)
 	return false;
 }
 
-void rxUPD(UPD *upd)
+/*
+ *	Uploads the frame pbuf into upd. Returns false if the frame
+ *	couldn't be consumed and must be retried later.
+ */
+bool rxUPD(UPD *upd, byte *pbuf, uint psize)
 {
 	// FIXME: threading to care about (mRegisters.DmaCtrl & DC_upAltSeqDisable)
 	IO_3C90X_TRACE("rxUPD()\n");
@@ -1451,7 +1532,7 @@ void rxUPD(UPD *upd)
 		// the ring buffers are filled.
 
 		mUpStalled = true;
-		return;
+		return false;
 	}
 
 	uint upPktStatus = 0;
@@ -1459,29 +1540,29 @@ void rxUPD(UPD *upd)
 	if (mRegisters.UpPoll) {
 		IO_3C90X_WARN("UpPoll unsupported\n");
 		SINGLESTEP("");
-		return;
+		return false;
 	}
 	// FIXME:
 //	if (mRegisters.DmaCtrl & DC_upRxEarlyEnable)
 //		IO_3C90X_ERR("DC_upRxEarlyEnable unsupported\n");
 
-	if ((mRxPacketSize > 0x1fff) || (mRxPacketSize > sizeof mRxPacket)) {
+	if ((psize > 0x1fff) || (psize > MAX_PACKET_SIZE)) {
 		IO_3C90X_TRACE("oversized frame\n");
 		upd->UpPktStatus = UPS_upError | UPS_oversizedFrame;
 		error = true;
 	}
 
-	if (mRxPacketSize < 60) {
+	if (psize < 60) {
 		// pad packet to at least 60 bytes (+4 bytes crc = 64 bytes)
-		memset(mRxPacket+mRxPacketSize, 0, (60-mRxPacketSize));
-		mRxPacketSize = 60;
+		memset(pbuf+psize, 0, (60-psize));
+		psize = 60;
 	}
 
-	// IO_3C90X_TRACE("rx(%d):\n", mRxPacketSize);
-	// dumpMem((unsigned char*)mRxPacket, mRxPacketSize);
+	// IO_3C90X_TRACE("rx(%d):\n", psize);
+	// dumpMem((unsigned char*)pbuf, psize);
 
 /*	RegWindow5 &w5 = (RegWindow5&)mWindows[5];
-	if ((mRxPacketSize < 60) && (w5.RxEarlyThresh >= 60)) {
+	if ((psize < 60) && (w5.RxEarlyThresh >= 60)) {
 		IO_3C90X_TRACE("runt frame\n");
 		upPktStatus |= UPS_upError | UPS_runtFrame;
 		upd->UpPktStatus = upPktStatus;
@@ -1490,17 +1571,17 @@ void rxUPD(UPD *upd)
 	if (upd->UpPktStatus & UPD_impliedBufferEnable) {
 		IO_3C90X_WARN("UPD_impliedBufferEnable unsupported\n");
 		SINGLESTEP("");
-		return;
+		return false;
 	}
 	UPDFragDesc *frags = (UPDFragDesc*)(upd+1);
 
-	byte *p = mRxPacket;
+	byte *p = pbuf;
 	uint i = 0;
 	while (!error && i < MAX_UPD_FRAGS) {	// (up to MAX_UPD_FRAGS fragments)
 		uint32 addr = frags->UpFragAddr;
 		uint len = frags->UpFragLen & 0x1fff;
 		IO_3C90X_TRACE("frag %d: %08x, len %04x (full: %08x)\n", i, addr, len, frags->UpFragLen);
-		if (p-mRxPacket+len > sizeof mRxPacket) {
+		if (p-pbuf+len > MAX_PACKET_SIZE) {
 	    		upPktStatus |= UPS_upError | UPS_upOverflow;
 			upd->UpPktStatus = upPktStatus;
 			IO_3C90X_TRACE("UPD overflow!\n");
@@ -1525,14 +1606,21 @@ void rxUPD(UPD *upd)
 	}
 
 	if (!error) {
-		IO_3C90X_TRACE("successfully uploaded packet of %d bytes\n", mRxPacketSize);
+		IO_3C90X_TRACE("successfully uploaded packet of %d bytes\n", psize);
 	}
-	upPktStatus |= mRxPacketSize & 0x1fff;
+	upPktStatus |= psize & 0x1fff;
+	rxCompleteUPD(upd, upPktStatus);
+	return true;
+}
+
+/*
+ *	Hands the current UPD back to the guest
+ */
+void rxCompleteUPD(UPD *upd, uint upPktStatus)
+{
 	upPktStatus |= UPS_upComplete;
 	upd->UpPktStatus = upPktStatus;
 
-	mRxPacketSize = 0;
-
 	/* the client OS is waiting for a change in status, but won't see it */
 	/* until we dma our local copy upd->UpPktStatus back to the client address space */
 	if (!ppc_dma_write(mRegisters.UpListPtr+4, &upd->UpPktStatus, sizeof(upd->UpPktStatus))) {
@@ -1540,7 +1628,6 @@ void rxUPD(UPD *upd)
 	  upd->UpPktStatus = upPktStatus; /* can't get this error out, anyways */
 	  IO_3C90X_WARN("invalid UPD UpListPtr address! (%08x)\n",mRegisters.UpListPtr+4);
 	  SINGLESTEP("");
-	  error = true;
 	}
 
 	mRegisters.UpListPtr = upd->UpNextPtr;
@@ -1548,7 +1635,71 @@ void rxUPD(UPD *upd)
 	// indications
 	mRegisters.DmaCtrl |= DC_upComplete;
 	indicate(IS_upComplete);
-	maybeRaiseIntr();
+}
+
+/*
+ *	Receives the next frame from mEthTun straight into the buffers
+ *	of the current UPD. Returns -1 if this isn't possible (the frame
+ *	then has to go through mRxRing), otherwise the number of frames
+ *	received (0 or 1).
+ */
+int rxDirect()
+{
+	if (!mRxEnabled || mUpStalled || mRxCount || !mRegisters.UpListPtr || mRegisters.UpPoll) return -1;
+	byte updbuf[MAX_UPD_SIZE];
+	if (!ppc_dma_read(updbuf, mRegisters.UpListPtr, sizeof updbuf)) return -1;
+	UPD *upd = (UPD*)updbuf;
+	if (upd->UpPktStatus & (UPS_upComplete | UPD_impliedBufferEnable)) return -1;
+	UPDFragDesc *frags = (UPDFragDesc*)(upd+1);
+	PacketBuf pkt[MAX_UPD_FRAGS+1];
+	uint32 addr[MAX_UPD_FRAGS];
+	uint n = 0;
+	uint room = 0;
+	while (n < MAX_UPD_FRAGS) {
+		uint len = frags->UpFragLen & 0x1fff;
+		byte *ptr;
+		if (room+len > MAX_PACKET_SIZE || !ppc_dma_map(frags->UpFragAddr, len, ptr)) return -1;
+		addr[n] = frags->UpFragAddr;
+		pkt[n].buf = ptr;
+		pkt[n].size = len;
+		n++;
+		room += len;
+		// last fragment ?
+		if (frags->UpFragLen & 0x80000000) break;
+		frags++;
+	}
+	// the part of a frame which doesn't fit into the UPD
+	pkt[n].buf = mRxScratch+room;
+	pkt[n].size = MAX_PACKET_SIZE-room;
+	uint size = mEthTun->recvPacketv(pkt, n+1);
+	byte hdr[sizeof(EthFrameII)];
+	uint ofs = 0;
+	for (uint i = 0; i < n && ofs < size; i++) {
+		uint len = MIN(pkt[i].size, size-ofs);
+		if (ofs < sizeof hdr) memcpy(hdr+ofs, pkt[i].buf, MIN(len, sizeof hdr-ofs));
+		ppc_dma_written(addr[i], len);
+		ofs += len;
+	}
+	if (size <= sizeof(EthFrameII)) return 0;
+	// see rxComplete()
+	mRxIndicate = true;
+	if (!passesRxFilter(hdr, size)) {
+		IO_3C90X_TRACE("EthTun: %d bytes received. But they don't pass the filter.\n", size);
+		return 1;
+	}
+	IO_3C90X_TRACE("EthTun: %d bytes received.\n", size);
+	if (size < 60 || size > room) {
+		// needs padding or doesn't fit, let rxUPD() deal with it
+		ofs = 0;
+		for (uint i = 0; i < n; i++) {
+			memcpy(mRxScratch+ofs, pkt[i].buf, pkt[i].size);
+			ofs += pkt[i].size;
+		}
+		rxUPD(upd, mRxScratch, size);
+		return 1;
+	}
+	rxCompleteUPD(upd, size & 0x1fff);
+	return 1;
 }
 
 void indicate(uint indications)
@@ -1578,6 +1729,11 @@ void acknowledge(uint indications)
 		mRegisters.DmaCtrl &= ~DC_dnComplete;
 	}
 	IO_3C90X_TRACE("acknowledge(%08x) mIntStatus now = %08x\n", indications, mIntStatus);
+	if ((indications & IS_upComplete) && mUpSinceAck) {
+		// continue where checkUpWork() held back
+		mUpSinceAck = 0;
+		checkUpWork();
+	}
 }
 
 void maybeRaiseIntr()
@@ -1592,6 +1748,7 @@ void maybeRaiseIntr()
 
 void checkDnWork()
 {
+	bool sent = false;
 	while (!mDnStalled && (mRegisters.DnListPtr != 0)) {
 		byte dpd[512];
 		
@@ -1605,6 +1762,7 @@ void checkDnWork()
 				IO_3C90X_TRACE("Got a type 0 DPD !\n");
 				IO_3C90X_TRACE("DnNextPtr is %08x\n", p->DnNextPtr);
 				txDPD0(p);
+				sent = true;
 				break;
 			}
 			case 1: {
@@ -1625,31 +1783,100 @@ void checkDnWork()
 			break;
 		}
 	}
+	if (sent) {
+		txFlush();
+		// one interrupt for the whole walk
+		maybeRaiseIntr();
+	}
+}
+
+/*
+ *	True if the guest is interrupted for upComplete and hasn't
+ *	acknowledged the last mIntrCoalesce uploaded frames yet
+ */
+bool upCoalesced()
+{
+	RegWindow5 &w5 = (RegWindow5&)mWindows[5];
+	return mUpSinceAck >= mIntrCoalesce && (mIntStatus & IS_upComplete)
+		&& (w5.IndicationEnable & w5.InterruptEnable & IS_upComplete);
 }
 
 void checkUpWork()
 {
-	if (mRxEnabled && !mUpStalled && mRxPacketSize && (mRegisters.UpListPtr != 0) ) {
+	uint uploaded = 0;
+	while (mRxEnabled && !mUpStalled && mRxCount && (mRegisters.UpListPtr != 0) && !upCoalesced()) {
 		byte upd[MAX_UPD_SIZE];
-		if (ppc_dma_read(upd, mRegisters.UpListPtr, sizeof upd)) {
-			UPD *p = (UPD*)upd;
-			rxUPD(p);
-		} else {
+		if (!ppc_dma_read(upd, mRegisters.UpListPtr, sizeof upd)) {
 			IO_3C90X_WARN("invalid address in UpListPtr!\n");
 			SINGLESTEP("");
+			break;
 		}
+		UPD *p = (UPD*)upd;
+		if (!rxUPD(p, mRxRing[mRxFirst], mRxRingSize[mRxFirst])) break;
+		mRxFirst = (mRxFirst + 1) % mRxRingLen;
+		mRxCount--;
+		mUpSinceAck++;
+		uploaded++;
+	}
+	if (uploaded) {
+		maybeRaiseIntr();
+		rxWakeup();
 	} else {
-		IO_3C90X_TRACE("Not uploading, because: mUpStalled(=%d) or UpListPtr == 0 (=%08x) or not mRxPacketSize(=%d)\n", mUpStalled, mRegisters.UpListPtr, mRxPacketSize);
+		IO_3C90X_TRACE("Not uploading, because: mUpStalled(=%d) or UpListPtr == 0 (=%08x) or no packet (%d) or not acknowledged (%d)\n", mUpStalled, mRegisters.UpListPtr, mRxCount, mUpSinceAck);
+	}
+}
+
+/*
+ *	Drops all received frames which haven't been uploaded yet
+ */
+void rxFlush()
+{
+	mRxFirst = 0;
+	mRxCount = 0;
+	// frames the receiver is currently reading belong to the old ring
+	mRxGeneration++;
+	rxWakeup();
+}
+
+/*
+ *	Lets the receiver continue after the ring was full
+ */
+void rxWakeup()
+{
+	if (mRxFD >= 0) {
+		if (mRxPaused) {
+			mRxPaused = false;
+			sys_ioloop_enable_fd(mRxFD, true);
+		}
+	} else {
+		sys_lock_semaphore(mRxSpace);
+		sys_signal_semaphore(mRxSpace);
+		sys_unlock_semaphore(mRxSpace);
 	}
 }
 
 public:
-_3c90x_NIC(EthTunDevice *aEthTun, const byte *mac)
+_3c90x_NIC(EthTunDevice *aEthTun, const byte *mac, uint rxRing, uint txBatch, uint intrCoalesce, bool crc)
 : PCI_Device("3c90x Network interface card", 0x1, 0xc)
 {
 	int e;
 	if ((e = sys_create_mutex(&mLock))) throw IOException(e);
+	if ((e = sys_create_semaphore(&mRxSpace))) throw IOException(e);
 	mEthTun = aEthTun;
+	mRxRingLen = MIN(MAX(rxRing, 1U), (uint)MAX_RX_RING);
+	mRxRing = (byte (*)[MAX_PACKET_SIZE])malloc(mRxRingLen * MAX_PACKET_SIZE);
+	mRxRingSize = (uint *)malloc(mRxRingLen * sizeof (uint));
+	mRxGeneration = 0;
+	mRxScratch = (byte *)malloc(MAX_PACKET_SIZE);
+	mRxFD = -1;
+	mRxPaused = false;
+	mRxIndicate = false;
+	io_init_completion(mRxCompletion, _3c90xRxComplete, this);
+	mTxBatchLen = MIN(MAX(txBatch, 1U), (uint)MAX_TX_BATCH);
+	mTxBatch = (byte (*)[MAX_TX_FRAME_SIZE])malloc(mTxBatchLen * MAX_TX_FRAME_SIZE);
+	mTxCount = 0;
+	mIntrCoalesce = MAX(intrCoalesce, 1U);
+	mCRC = crc;
 	memcpy(mMAC, mac, 6);
 	PCIReset();
 	totalReset();
@@ -1659,6 +1886,11 @@ virtual ~_3c90x_NIC()
 {
 	mEthTun->shutdownDevice();
 	delete mEthTun;
+	free(mRxRing);
+	free(mRxRingSize);
+	free(mRxScratch);
+	free(mTxBatch);
+	sys_destroy_semaphore(mRxSpace);
 	sys_destroy_mutex(mLock);
 }
 
@@ -1839,7 +2071,116 @@ bool writeDeviceIO(uint r, uint32 port, uint32 data, uint size)
 	return retval;
 }
 
-/* new */
+/*
+ *	Receive from the I/O loop instead of an own thread
+ */
+bool attachIOLoop()
+{
+	int fd = mEthTun->getRecvFD();
+	if (fd < 0) return false;
+	mRxFD = fd;
+	if (!sys_ioloop_add_fd(fd, _3c90xRxReady, this)) {
+		mRxFD = -1;
+		return false;
+	}
+	return true;
+}
+
+/*
+ *	Receives the frames pending on mEthTun, called by the I/O loop
+ *	or the rx thread. Returns false if nothing was received.
+ */
+bool rxPoll()
+{
+	PacketBuf pkts[MAX_RX_RING];
+	sys_lock_mutex(mLock);
+	/*
+	 *	While nothing is queued and the guest provides UPDs,
+	 *	frames are received straight into guest memory
+	 */
+	uint direct = 0;
+	int r = -1;
+	while (direct < mRxRingLen && (r = rxDirect()) > 0) direct++;
+	if (direct < mRxRingLen && r == 0) {
+		sys_unlock_mutex(mLock);
+		if (direct) io_post_completion(mRxCompletion);
+		return direct;
+	}
+	if (mRxCount == mRxRingLen) {
+		IO_3C90X_TRACE("rx ring full. waiting for uploads...\n");
+		if (mRxFD >= 0) {
+			// until checkUpWork() makes room
+			mRxPaused = true;
+			sys_ioloop_enable_fd(mRxFD, false);
+			sys_unlock_mutex(mLock);
+		} else {
+			// checkUpWork() signals mRxSpace with mLock held
+			sys_lock_semaphore(mRxSpace);
+			sys_unlock_mutex(mLock);
+			sys_wait_semaphore(mRxSpace);
+			sys_unlock_semaphore(mRxSpace);
+		}
+		if (direct) io_post_completion(mRxCompletion);
+		return true;
+	}
+	/*
+	 *	Read into the free part of the ring without holding
+	 *	mLock. Only the receiver fills slots.
+	 */
+	uint free = mRxRingLen - mRxCount;
+	uint first = (mRxFirst + mRxCount) % mRxRingLen;
+	uint generation = mRxGeneration;
+	sys_unlock_mutex(mLock);
+	for (uint i = 0; i < free; i++) {
+		pkts[i].buf = mRxRing[(first + i) % mRxRingLen];
+		pkts[i].size = MAX_PACKET_SIZE;
+	}
+	uint n = mEthTun->recvPackets(pkts, free);
+	sys_lock_mutex(mLock);
+	if (generation != mRxGeneration) {
+		IO_3C90X_TRACE("EthTun: %d packets received during reset, dropped.\n", n);
+		n = 0;
+	}
+	uint accepted = 0;
+	bool received = false;
+	for (uint i = 0; i < n; i++) {
+		uint size = pkts[i].size;
+		if (!mRxEnabled || (size <= sizeof(EthFrameII))) continue;
+		received = true;
+		if (!passesRxFilter((byte *)pkts[i].buf, size)) {
+			IO_3C90X_TRACE("EthTun: %d bytes received. But they don't pass the filter.\n", size);
+			continue;
+		}
+		IO_3C90X_TRACE("EthTun: %d bytes received.\n", size);
+		// close gaps left by dropped frames
+		uint slot = (first + accepted) % mRxRingLen;
+		if (pkts[i].buf != mRxRing[slot]) memcpy(mRxRing[slot], pkts[i].buf, size);
+		mRxRingSize[slot] = size;
+		accepted++;
+	}
+	mRxCount += accepted;
+	if (received) mRxIndicate = true;
+	sys_unlock_mutex(mLock);
+	if (received || direct) io_post_completion(mRxCompletion);
+	return received || direct;
+}
+
+/*
+ *	Runs within the CPU thread after rxPoll() received frames
+ */
+void rxComplete()
+{
+	sys_lock_mutex(mLock);
+	if (mRxIndicate) {
+		mRxIndicate = false;
+		indicate(IS_rxComplete);
+		maybeRaiseIntr();
+		acknowledge(IS_rxComplete);
+	}
+	checkUpWork();
+	sys_unlock_mutex(mLock);
+}
+
 void handleRxQueue()
 {
 	while (1) {
@@ -1847,29 +2188,10 @@ void handleRxQueue()
 			// don't block the system in case of (repeated) error(s)
 			sys_suspend();
 		}
-		sys_lock_mutex(mLock);
-		if (mRxPacketSize) {
-			IO_3C90X_TRACE("Argh. old packet not yet uploaded. waiting some more...\n");
-		} else {
-			mRxPacketSize = mEthTun->recvPacket(mRxPacket, sizeof mRxPacket);
-			if (mRxEnabled && (mRxPacketSize > sizeof(EthFrameII))) {
-				indicate(IS_rxComplete);
-				maybeRaiseIntr();
-				acknowledge(IS_rxComplete);
-				if (!passesRxFilter(mRxPacket, mRxPacketSize)) {
-					IO_3C90X_TRACE("EthTun: %d bytes received. But they don't pass the filter.\n", mRxPacketSize);
-					mRxPacketSize = 0;
-				} else {
-					IO_3C90X_TRACE("EthTun: %d bytes received.\n", mRxPacketSize);
-				}
-			}  else {
-				// don't block the system in case of (repeated) error(s)
-				mRxPacketSize = 0;
-				sys_suspend();
-			}
+		if (!rxPoll()) {
+			// don't block the system in case of (repeated) error(s)
+			sys_suspend();
 		}
-		checkUpWork();
-		sys_unlock_mutex(mLock);
 	}
 }
 
@@ -1882,6 +2204,18 @@ static void *_3c90xHandleRxQueue(void *nic)
 	return NULL;
 }
 
+static void _3c90xRxReady(int fd, void *nic)
+{
+	_3c90x_NIC *NIC = (_3c90x_NIC *)nic;
+	NIC->rxPoll();
+}
+
+static void _3c90xRxComplete(void *nic)
+{
+	_3c90x_NIC *NIC = (_3c90x_NIC *)nic;
+	NIC->rxComplete();
+}
+
 #include "configparser.h"
 #include "tools/strtools.h"
 
@@ -1889,6 +2223,10 @@ bool _3c90x_installed = false;
 
 #define _3C90X_KEY_INSTALLED	"pci_3c90x_installed"
 #define _3C90X_KEY_MAC		"pci_3c90x_mac"
+#define _3C90X_KEY_RX_RING	"pci_3c90x_rx_ring"
+#define _3C90X_KEY_TX_BATCH	"pci_3c90x_tx_batch"
+#define _3C90X_KEY_INTR_COALESCE	"pci_3c90x_intr_coalesce"
+#define _3C90X_KEY_CRC		"pci_3c90x_crc"
 
 void _3c90x_init()
 {
@@ -1939,10 +2277,16 @@ void _3c90x_init()
 		}
 		printf("\n");
 #endif
-		_3c90x_NIC *MyNIC = new _3c90x_NIC(ethTun, mac);
+		_3c90x_NIC *MyNIC = new _3c90x_NIC(ethTun, mac,
+			gConfig->getConfigInt(_3C90X_KEY_RX_RING),
+			gConfig->getConfigInt(_3C90X_KEY_TX_BATCH),
+			gConfig->getConfigInt(_3C90X_KEY_INTR_COALESCE),
+			gConfig->getConfigInt(_3C90X_KEY_CRC));
 		gPCI_Devices->insert(MyNIC);
-		sys_thread rxthread;
-		sys_create_thread(&rxthread, 0, _3c90xHandleRxQueue, MyNIC);
+		if (!MyNIC->attachIOLoop()) {
+			sys_thread rxthread;
+			sys_create_thread(&rxthread, 0, _3c90xHandleRxQueue, MyNIC);
+		}
 	}
 }
 
@@ -1954,4 +2298,8 @@ void _3c90x_init_config()
 {
 	gConfig->acceptConfigEntryIntDef(_3C90X_KEY_INSTALLED, 0);
 	gConfig->acceptConfigEntryString(_3C90X_KEY_MAC, false);
+	gConfig->acceptConfigEntryIntDef(_3C90X_KEY_RX_RING, 32);
+	gConfig->acceptConfigEntryIntDef(_3C90X_KEY_TX_BATCH, 16);
+	gConfig->acceptConfigEntryIntDef(_3C90X_KEY_INTR_COALESCE, 8);
+	gConfig->acceptConfigEntryIntDef(_3C90X_KEY_CRC, 0);
 }
@@ -39,11 +39,13 @@
 #include "cpu/cpu.h"
 #include "tools/snprintf.h"
 #include "debug/tracers.h"
+#include "io/io.h"
 #include "io/pic/pic.h"
 #include "system/keyboard.h"
 #include "system/mouse.h"
 #include "system/sys.h"
 #include "system/sysclk.h"
+#include "system/sysioloop.h"
 #include "system/systhread.h"
 
 #include "cuda.h"
@@ -215,6 +217,14 @@ struct cuda_control {
 static cuda_control	gCUDA;
 static sys_mutex	gCUDAMutex;
 
+/*
+ *	With an I/O loop, events are fed to the guest by
+ *	cudaProcessEvents() within the CPU thread
+ */
+static IOCompletion	gCUDAEventCompletion;
+static sys_ioloop_timer	gCUDAEventTimer = NULL;
+static bool		gCUDAEventWaiting = false;
+
 static void cuda_send_packet(uint8 type, int nb, ...)
 {
 	gCUDA.data[0] = type;
@@ -623,6 +633,7 @@ void cuda_write(uint32 addr, uint32 data, int size)
 			}
 			gCUDA.state = cuda_idle;
 			sys_signal_semaphore(gCUDA.idle_sem);
+			if (gCUDAEventWaiting) io_post_completion(gCUDAEventCompletion);
 			IO_CUDA_TRACE2("CUDA CHANGE STATE %d: to %d\n", __LINE__, gCUDA.state);
 		} else {
 			gCUDA.rB = data;
@@ -837,6 +848,7 @@ static bool cudaEventHandler(const SystemEvent &ev)
 	gCUDAEvents.enQueue(new SystemEventObject(ev));
 	sys_signal_semaphore(gCUDAEventSem);
 	sys_unlock_semaphore(gCUDAEventSem);
+	if (gCUDAEventTimer) io_post_completion(gCUDAEventCompletion);
 	return true;
 }
 
@@ -939,6 +951,49 @@ static void *cudaEventLoop(void *arg)
 	return NULL;
 }
 
+/*
+ *	Like cudaEventLoop(), but runs within the CPU thread. While the
+ *	CUDA is busy, the event is retried when it becomes idle or
+ *	by gCUDAEventTimer.
+ */
+static void cudaProcessEvents(void *arg)
+{
+	static SystemEventObject *seo = NULL;
+	static uint64 time_end;
+	while (1) {
+		if (!seo) {
+			sys_lock_semaphore(gCUDAEventSem);
+			seo = (SystemEventObject*)gCUDAEvents.deQueue();
+			sys_unlock_semaphore(gCUDAEventSem);
+			if (!seo) break;
+			uint timeout_msec = 200;
+			time_end = sys_get_hiresclk_ticks() + sys_get_hiresclk_ticks_per_second()
+				* timeout_msec / 1000;
+		}
+		sys_lock_mutex(gCUDAMutex);
+		bool idle = gCUDA.state == cuda_idle && !gCUDA.left;
+		if (idle) doProcessCudaEvent(seo->mEv);
+		sys_unlock_mutex(gCUDAMutex);
+		if (!idle) {
+			if (sys_get_hiresclk_ticks() < time_end) {
+				gCUDAEventWaiting = true;
+				sys_ioloop_set_timer(gCUDAEventTimer, 10);
+				return;
+			}
+			IO_CUDA_WARN("Event processing timed out. Event dropped.\n");
+		}
+		delete seo;
+		seo = NULL;
+	}
+	gCUDAEventWaiting = false;
+	sys_ioloop_cancel_timer(gCUDAEventTimer);
+}
+
+static void cudaEventTimer(sys_ioloop_timer t, void *arg)
+{
+	io_post_completion(gCUDAEventCompletion);
+}
+
 bool cuda_prom_get_key(uint32 &key)
 {
 	if (gCUDA.left == 5 && gCUDA.data[2] == 0x2c) {
@@ -980,12 +1035,20 @@ void cuda_init()
 		IO_CUDA_ERR("Can't create semaphore\n");
 	}
 
-	sys_thread cudaEventLoopThread;
-	sys_create_thread(&cudaEventLoopThread, 0, cudaEventLoop, NULL);
+	io_init_completion(gCUDAEventCompletion, cudaProcessEvents, NULL);
+	gCUDAEventTimer = sys_ioloop_create_timer(cudaEventTimer, NULL);
+	if (gCUDAEventTimer) {
+		gKeyboard->attachEventHandler(cudaEventHandler);
+		gMouse->attachEventHandler(cudaEventHandler);
+	} else {
+		sys_thread cudaEventLoopThread;
+		sys_create_thread(&cudaEventLoopThread, 0, cudaEventLoop, NULL);
+	}
 }
 
 void cuda_done()
 {
+	sys_ioloop_delete_timer(gCUDAEventTimer);
 	sys_destroy_mutex(gCUDAMutex);
 	sys_destroy_semaphore(gCUDA.idle_sem);
 }
@@ -19,12 +19,16 @@
  */
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <errno.h>
 
 #include "debug/tracers.h"
+#include "system/arch/sysendian.h"
 #include "ata.h"
+#include "idecache.h"
 
+#include "tools/endianess.h"
 #include "tools/snprintf.h"
 
 ATADevice::ATADevice(const char *name)
@@ -56,10 +60,11 @@ uint ATADevice::getBlockCount()
 /*
  *
  */
-ATADeviceFile::ATADeviceFile(const char *name, const char *filename)
+ATADeviceFile::ATADeviceFile(const char *name, const char *filename, bool readonly)
 	: ATADevice(name)
 {
-	mFile = sys_fopen(filename, SYS_OPEN_READ | SYS_OPEN_WRITE);
+	mPos = 0;
+	mFile = sys_fopen(filename, readonly ? SYS_OPEN_READ : SYS_OPEN_READ | SYS_OPEN_WRITE);
 	if (mFile) {
 		sys_fseek(mFile, 0, SYS_SEEK_END);
 		uint64 size = sys_ftell(mFile);
@@ -82,22 +87,33 @@ ATADeviceFile::ATADeviceFile(const char *name, const char *filename)
 
 ATADeviceFile::~ATADeviceFile()
 {
+	if (mFile) {
+		ide_cache_forget(mFile);
+		sys_fclose(mFile);
+	}
 }
 
+/*
+ *	All data transfers use positional I/O on the image, so the
+ *	I/O threads and the emulation thread never share a stream
+ *	position or stdio buffer. They go through the IDE block cache.
+ */
 bool ATADeviceFile::seek(uint64 blockno)
 {
-	sys_fseek(mFile, 512 * (uint64)blockno);
+	mPos = 512 * (uint64)blockno;
 	return true;
 }
 
 void ATADeviceFile::flush()
 {
+	ide_cache_flush(mFile);
 	sys_flush(mFile);
 }
 
 int ATADeviceFile::readBlock(byte *buf)
 {
-	sys_fread(mFile, buf, 512);
+	ide_cache_read(mFile, (FileOfs)blocks * 512, mPos, buf, 512);
+	mPos += 512;
 	if (mMode & ATA_DEVICE_MODE_ECC) {
 		// add ECC bytes..
 		IO_IDE_ERR("ATADeviceFile: ECC not implemented\n");
@@ -107,17 +123,478 @@ int ATADeviceFile::readBlock(byte *buf)
 
 int ATADeviceFile::writeBlock(byte *buf)
 {
-	sys_fwrite(mFile, buf, 512);
+	ide_cache_write(mFile, (FileOfs)blocks * 512, mPos, buf, 512);
+	mPos += 512;
 	return 0;
 }
 
+bool ATADeviceFile::readv(uint64 blockno, const sys_iovec *iov, int count)
+{
+	FileOfs ofs = 512 * blockno;
+	for (int i = 0; i < count; i++) {
+		if (!ide_cache_read(mFile, (FileOfs)blocks * 512, ofs, iov[i].base, iov[i].size)) return false;
+		ofs += iov[i].size;
+	}
+	return true;
+}
+
+bool ATADeviceFile::writev(uint64 blockno, const sys_iovec *iov, int count)
+{
+	FileOfs ofs = 512 * blockno;
+	for (int i = 0; i < count; i++) {
+		if (!ide_cache_write(mFile, (FileOfs)blocks * 512, ofs, iov[i].base, iov[i].size)) return false;
+		ofs += iov[i].size;
+	}
+	return true;
+}
+
 bool ATADeviceFile::promSeek(FileOfs pos)
 {
-	return sys_fseek(mFile, pos) == 0;
+	mPos = pos;
+	return true;
 }
 
 uint ATADeviceFile::promRead(byte *buf, uint size)
 {
-	return sys_fread(mFile, buf, size);
+	FileOfs end = (FileOfs)blocks * 512;
+	if (mPos >= end) return 0;
+	if (mPos + size > end) size = end - mPos;
+	if (!ide_cache_read(mFile, end, mPos, buf, size)) return 0;
+	mPos += size;
+	return size;
+}
+
+/*
+ *	Overlay images
+ *
+ *	All numbers are big endian. The first cluster holds the header:
+ *
+ *	  0	char[8]		magic "PPCOVL1\n"
+ *	  8	uint32		log2 of the cluster size (12..22)
+ *	 12	uint32		reserved
+ *	 16	uint64		virtual disk size in bytes
+ *	 24	uint64		offset of the L1 table
+ *	 32	uint32		number of L1 entries
+ *	 36	uint32		reserved
+ *	 40	char[472]	name of the base image, empty if none.
+ *				Relative names are relative to the working
+ *				directory, like the image names in the config.
+ *
+ *	The L1 table holds the offsets of the L2 tables, which are one
+ *	cluster each and hold the offsets of the data clusters. Offset 0
+ *	means not allocated, the data comes from the base image (or reads
+ *	as zeros without one). OVERLAY_ZERO marks a discarded cluster, it
+ *	reads as zeros. Tables and clusters are cluster aligned.
+ *
+ *	Clusters freed by discard() are reused while the image is open,
+ *	but leak once it is closed.
+ */
+#define OVERLAY_MAGIC		"PPCOVL1\n"
+#define OVERLAY_HEADER_SIZE	512
+#define OVERLAY_BASE_OFS	40
+#define OVERLAY_BASE_SIZE	(OVERLAY_HEADER_SIZE-OVERLAY_BASE_OFS)
+#define OVERLAY_CLUSTER_BITS	16
+#define OVERLAY_ZERO		1ULL
+
+static bool overlay_pread(SYS_FILE *file, FileOfs ofs, void *buf, uint size)
+{
+	sys_iovec v = {buf, size};
+	return sys_freadv(file, ofs, &v, 1) == (int)size;
+}
+
+static bool overlay_pwrite(SYS_FILE *file, FileOfs ofs, const void *buf, uint size)
+{
+	sys_iovec v = {(void *)buf, size};
+	return sys_fwritev(file, ofs, &v, 1) == (int)size;
+}
+
+static ATADevice *overlay_open_image(const char *filename, bool readonly)
+{
+	if (ATADeviceOverlay::probe(filename)) {
+		return new ATADeviceOverlay(filename, filename, readonly);
+	} else {
+		return new ATADeviceFile(filename, filename, readonly);
+	}
+}
+
+ATADeviceOverlay::ATADeviceOverlay(const char *name, const char *filename, bool readonly)
+	: ATADevice(name)
+{
+	mReadOnly = readonly;
+	mBase = NULL;
+	mBaseSize = 0;
+	mPos = 0;
+	mL1 = NULL;
+	mL2 = NULL;
+	mFreeClusters = NULL;
+	mFreeCount = 0;
+	mFreeMax = 0;
+	mClusterBuf = NULL;
+	mFile = sys_fopen(filename, readonly ? SYS_OPEN_READ : SYS_OPEN_READ | SYS_OPEN_WRITE);
+	if (!mFile) {
+		char buf[256];
+		ht_snprintf(buf, sizeof buf, "%s: could not open file (%s)", filename, strerror(errno));
+		setError(buf);
+		return;
+	}
+	open(filename);
+}
+
+ATADeviceOverlay::~ATADeviceOverlay()
+{
+	if (mL2) {
+		for (uint32 i = 0; i < mL1Entries; i++) free(mL2[i]);
+		free(mL2);
+	}
+	free(mL1);
+	free(mFreeClusters);
+	free(mClusterBuf);
+	delete mBase;
+	if (mFile) sys_fclose(mFile);
 }
 
+bool ATADeviceOverlay::open(const char *filename)
+{
+	byte hdr[OVERLAY_HEADER_SIZE];
+	char buf[256];
+	if (!overlay_pread(mFile, 0, hdr, sizeof hdr) || memcmp(hdr, OVERLAY_MAGIC, 8) != 0) {
+		ht_snprintf(buf, sizeof buf, "%s: not an overlay image", filename);
+		setError(buf);
+		return false;
+	}
+	mClusterBits = createHostInt(hdr+8, 4, big_endian);
+	uint64 size = createHostInt64(hdr+16, 8, big_endian);
+	mL1Offset = createHostInt64(hdr+24, 8, big_endian);
+	mL1Entries = createHostInt(hdr+32, 4, big_endian);
+	mL2Bits = mClusterBits - 3;
+	if (mClusterBits < 12 || mClusterBits > 22 || !size || (size & 511)
+	 || mL1Entries != ((size - 1) >> (mClusterBits + mL2Bits)) + 1) {
+		ht_snprintf(buf, sizeof buf, "%s: corrupt overlay header", filename);
+		setError(buf);
+		return false;
+	}
+	sys_fseek(mFile, 0, SYS_SEEK_END);
+	FileOfs fileSize = sys_ftell(mFile);
+	FileOfs cmask = (1 << mClusterBits) - 1;
+	mFileEnd = (fileSize + cmask) & ~cmask;
+	if ((mL1Offset & cmask) || mL1Offset < (FileOfs)OVERLAY_HEADER_SIZE
+	 || mL1Offset > fileSize || (FileOfs)mL1Entries * 8 > fileSize - mL1Offset) {
+		ht_snprintf(buf, sizeof buf, "%s: corrupt overlay header", filename);
+		setError(buf);
+		return false;
+	}
+	mL1 = (uint64 *)malloc(mL1Entries * sizeof (uint64));
+	mL2 = (uint64 **)calloc(mL1Entries, sizeof (uint64 *));
+	mClusterBuf = (byte *)malloc(1 << mClusterBits);
+	if (!overlay_pread(mFile, mL1Offset, mL1, mL1Entries * sizeof (uint64))) {
+		ht_snprintf(buf, sizeof buf, "%s: could not read overlay tables", filename);
+		setError(buf);
+		return false;
+	}
+	for (uint32 i = 0; i < mL1Entries; i++) {
+		mL1[i] = ppc_dword_from_BE(mL1[i]);
+		if (mL1[i] && !validCluster(mL1[i])) {
+			ht_snprintf(buf, sizeof buf, "%s: corrupt overlay table (L2 table %d at %qx)", filename, i, mL1[i]);
+			setError(buf);
+			return false;
+		}
+	}
+
+	hdr[OVERLAY_HEADER_SIZE-1] = 0;
+	const char *base = (const char *)hdr + OVERLAY_BASE_OFS;
+	if (*base && !openBase(filename, base)) return false;
+
+	blocks = size / 512;
+	uint64 cyl = blocks / (16 * 63);
+	init(16, MIN(cyl, 65535), 63);
+	return true;
+}
+
+bool ATADeviceOverlay::openBase(const char *filename, const char *base)
+{
+	mBase = overlay_open_image(base, true);
+	const char *error = mBase->getError();
+	if (error) {
+		char buf[512];
+		ht_snprintf(buf, sizeof buf, "%s: base image %s", filename, error);
+		setError(buf);
+		return false;
+	}
+	mBaseSize = (FileOfs)mBase->getBlockCount() * 512;
+	mBase->setMode(ATA_DEVICE_MODE_PLAIN, 512);
+	return true;
+}
+
+bool ATADeviceOverlay::probe(const char *filename)
+{
+	SYS_FILE *f = sys_fopen(filename, SYS_OPEN_READ);
+	if (!f) return false;
+	byte magic[8];
+	bool ret = overlay_pread(f, 0, magic, sizeof magic) && memcmp(magic, OVERLAY_MAGIC, 8) == 0;
+	sys_fclose(f);
+	return ret;
+}
+
+/*
+ *	Creates an empty overlay of base, refuses to overwrite an existing file
+ */
+bool ATADeviceOverlay::create(const char *filename, const char *base, char *error, int errorlen)
+{
+	SYS_FILE *f = sys_fopen(filename, SYS_OPEN_READ);
+	if (f) {
+		sys_fclose(f);
+		ht_snprintf(error, errorlen, "%s: file exists and isn't an overlay image", filename);
+		return false;
+	}
+	if (strlen(base) >= OVERLAY_BASE_SIZE) {
+		ht_snprintf(error, errorlen, "%s: base image name too long", base);
+		return false;
+	}
+	ATADevice *b = overlay_open_image(base, true);
+	if (b->getError()) {
+		ht_snprintf(error, errorlen, "%s", b->getError());
+		delete b;
+		return false;
+	}
+	uint64 size = (uint64)b->getBlockCount() * 512;
+	delete b;
+
+	uint bits = OVERLAY_CLUSTER_BITS;
+	uint32 l1entries = ((size - 1) >> (bits + bits - 3)) + 1;
+	uint l1clusters = ((l1entries * 8) >> bits) + 1;
+	uint len = (1 + l1clusters) << bits;
+	byte *buf = (byte *)calloc(1, len);
+	memcpy(buf, OVERLAY_MAGIC, 8);
+	createForeignInt(buf+8, bits, 4, big_endian);
+	createForeignInt64(buf+16, size, 8, big_endian);
+	createForeignInt64(buf+24, 1 << bits, 8, big_endian);
+	createForeignInt(buf+32, l1entries, 4, big_endian);
+	strcpy((char *)buf + OVERLAY_BASE_OFS, base);
+
+	f = sys_fopen(filename, SYS_OPEN_CREATE | SYS_OPEN_WRITE);
+	bool ok = f && overlay_pwrite(f, 0, buf, len);
+	if (f) sys_fclose(f);
+	free(buf);
+	if (!ok) {
+		ht_snprintf(error, errorlen, "%s: could not create file (%s)", filename, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+/*
+ *	A table or data cluster must be cluster aligned, inside the file
+ *	and mustn't overlap the header or the L1 table
+ */
+bool ATADeviceOverlay::validCluster(uint64 ofs) const
+{
+	uint64 csize = 1ULL << mClusterBits;
+	if ((ofs & (csize - 1)) || !ofs || ofs > mFileEnd - csize) return false;
+	return ofs + csize <= mL1Offset || ofs >= mL1Offset + (FileOfs)mL1Entries * 8;
+}
+
+/*
+ *	Returns the L2 table for L1 entry l1, NULL if there is none
+ *	and alloc is false (or on errors, see readWrite())
+ */
+uint64 *ATADeviceOverlay::getL2(uint32 l1, bool alloc)
+{
+	if (mL2[l1]) return mL2[l1];
+	uint csize = 1 << mClusterBits;
+	if (!mL1[l1]) {
+		if (!alloc) return NULL;
+		uint64 ofs = allocCluster();
+		memset(mClusterBuf, 0, csize);
+		if (!overlay_pwrite(mFile, ofs, mClusterBuf, csize)) return NULL;
+		uint64 e = ppc_dword_to_BE(ofs);
+		if (!overlay_pwrite(mFile, mL1Offset + (FileOfs)l1 * 8, &e, 8)) return NULL;
+		mL1[l1] = ofs;
+	} else if (!validCluster(mL1[l1])) {
+		IO_IDE_WARN("%y: corrupt L2 table offset %qx\n", this, mL1[l1]);
+		return NULL;
+	}
+	uint64 *t = (uint64 *)malloc(csize);
+	if (!overlay_pread(mFile, mL1[l1], t, csize)) {
+		free(t);
+		return NULL;
+	}
+	for (uint i = 0; i < (csize >> 3); i++) t[i] = ppc_dword_from_BE(t[i]);
+	mL2[l1] = t;
+	return t;
+}
+
+uint64 ATADeviceOverlay::allocCluster()
+{
+	if (mFreeCount) return mFreeClusters[--mFreeCount];
+	uint64 ofs = mFileEnd;
+	mFileEnd += 1 << mClusterBits;
+	return ofs;
+}
+
+bool ATADeviceOverlay::setEntry(uint64 cluster, uint64 value)
+{
+	uint64 *t = getL2(cluster >> mL2Bits, true);
+	if (!t) return false;
+	uint idx = cluster & ((1 << mL2Bits) - 1);
+	t[idx] = value;
+	uint64 e = ppc_dword_to_BE(value);
+	return overlay_pwrite(mFile, mL1[cluster >> mL2Bits] + idx * 8, &e, 8);
+}
+
+bool ATADeviceOverlay::readBase(FileOfs ofs, byte *buf, uint size)
+{
+	uint n = 0;
+	if (ofs < mBaseSize) {
+		n = MIN(size, mBaseSize - ofs);
+		if (!mBase->promSeek(ofs) || mBase->promRead(buf, n) != n) return false;
+	}
+	memset(buf + n, 0, size - n);
+	return true;
+}
+
+bool ATADeviceOverlay::readWrite(FileOfs ofs, byte *buf, uint size, bool write)
+{
+	if (!mL1 || (write && mReadOnly)) return false;
+	if (ofs + size > (FileOfs)blocks * 512) return false;
+	uint csize = 1 << mClusterBits;
+	while (size) {
+		uint64 cluster = ofs >> mClusterBits;
+		uint in = ofs & (csize - 1);
+		uint n = MIN(size, csize - in);
+		uint64 *t = getL2(cluster >> mL2Bits, write);
+		if (!t && (write || mL1[cluster >> mL2Bits])) return false;
+		uint64 entry = t ? t[cluster & ((1 << mL2Bits) - 1)] : 0;
+		if (entry > OVERLAY_ZERO && !validCluster(entry)) {
+			IO_IDE_WARN("%y: corrupt cluster offset %qx\n", this, entry);
+			return false;
+		}
+		if (!write) {
+			if (entry > OVERLAY_ZERO) {
+				if (!overlay_pread(mFile, entry + in, buf, n)) return false;
+			} else if (entry == OVERLAY_ZERO || !mBase) {
+				memset(buf, 0, n);
+			} else {
+				if (!readBase(ofs, buf, n)) return false;
+			}
+		} else if (entry > OVERLAY_ZERO) {
+			if (!overlay_pwrite(mFile, entry + in, buf, n)) return false;
+		} else {
+			/*
+			 *	copy on write: new clusters are always written
+			 *	completely, they may be recycled ones
+			 */
+			const byte *data = buf;
+			if (n != csize) {
+				if (entry == OVERLAY_ZERO || !mBase) {
+					memset(mClusterBuf, 0, csize);
+				} else {
+					if (!readBase(ofs - in, mClusterBuf, csize)) return false;
+				}
+				memcpy(mClusterBuf + in, buf, n);
+				data = mClusterBuf;
+			}
+			uint64 c = allocCluster();
+			if (!overlay_pwrite(mFile, c, data, csize)) return false;
+			if (!setEntry(cluster, c)) return false;
+		}
+		ofs += n;
+		buf += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool ATADeviceOverlay::seek(uint64 blockno)
+{
+	mPos = 512 * (uint64)blockno;
+	return true;
+}
+
+void ATADeviceOverlay::flush()
+{
+	sys_flush(mFile);
+}
+
+int ATADeviceOverlay::readBlock(byte *buf)
+{
+	if (!readWrite(mPos, buf, 512, false)) {
+		IO_IDE_WARN("%y: read failed at %qx\n", this, mPos);
+	}
+	mPos += 512;
+	return 0;
+}
+
+int ATADeviceOverlay::writeBlock(byte *buf)
+{
+	if (!readWrite(mPos, buf, 512, true)) {
+		IO_IDE_WARN("%y: write failed at %qx\n", this, mPos);
+	}
+	mPos += 512;
+	return 0;
+}
+
+bool ATADeviceOverlay::readv(uint64 blockno, const sys_iovec *iov, int count)
+{
+	FileOfs ofs = 512 * blockno;
+	for (int i = 0; i < count; i++) {
+		if (!readWrite(ofs, (byte *)iov[i].base, iov[i].size, false)) return false;
+		ofs += iov[i].size;
+	}
+	return true;
+}
+
+bool ATADeviceOverlay::writev(uint64 blockno, const sys_iovec *iov, int count)
+{
+	FileOfs ofs = 512 * blockno;
+	for (int i = 0; i < count; i++) {
+		if (!readWrite(ofs, (byte *)iov[i].base, iov[i].size, true)) return false;
+		ofs += iov[i].size;
+	}
+	return true;
+}
+
+/*
+ *	Drops all clusters completely inside the range
+ */
+bool ATADeviceOverlay::discard(uint64 blockno, uint64 count)
+{
+	if (!mL1 || mReadOnly) return false;
+	uint64 first = ((512 * blockno) + (1 << mClusterBits) - 1) >> mClusterBits;
+	uint64 end = (512 * (blockno + count)) >> mClusterBits;
+	uint64 value = mBase ? OVERLAY_ZERO : 0;
+	for (uint64 cluster = first; cluster < end; cluster++) {
+		uint64 *t = getL2(cluster >> mL2Bits, false);
+		if (!t && mL1[cluster >> mL2Bits]) return false;
+		uint64 entry = t ? t[cluster & ((1 << mL2Bits) - 1)] : 0;
+		if (entry == value) continue;
+		if (entry > OVERLAY_ZERO) {
+			if (!validCluster(entry)) {
+				IO_IDE_WARN("%y: corrupt cluster offset %qx\n", this, entry);
+				return false;
+			}
+			if (mFreeCount == mFreeMax) {
+				mFreeMax = mFreeMax ? mFreeMax * 2 : 64;
+				mFreeClusters = (uint64 *)realloc(mFreeClusters, mFreeMax * sizeof (uint64));
+			}
+			mFreeClusters[mFreeCount++] = entry;
+		}
+		if (!setEntry(cluster, value)) return false;
+	}
+	return true;
+}
+
+bool ATADeviceOverlay::promSeek(FileOfs pos)
+{
+	mPos = pos;
+	return true;
+}
+
+uint ATADeviceOverlay::promRead(byte *buf, uint size)
+{
+	FileOfs end = (FileOfs)blocks * 512;
+	if (mPos >= end) return 0;
+	size = MIN(size, end - mPos);
+	if (!readWrite(mPos, buf, size, false)) return 0;
+	mPos += size;
+	return size;
+}
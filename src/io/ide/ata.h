@@ -44,14 +44,66 @@ public:
 
 class ATADeviceFile: public ATADevice {
 	SYS_FILE *mFile;
+	FileOfs mPos;
 public:
-		ATADeviceFile(const char *name, const char *filename);
+		ATADeviceFile(const char *name, const char *filename, bool readonly = false);
 	virtual ~ATADeviceFile();
 
 	virtual bool	seek(uint64 blockno);
 	virtual void	flush();
 	virtual int	readBlock(byte *buf);
 	virtual int	writeBlock(byte *buf);
+	virtual bool	readv(uint64 blockno, const sys_iovec *iov, int count);
+	virtual bool	writev(uint64 blockno, const sys_iovec *iov, int count);
+
+	virtual bool	promSeek(uint64 pos);
+	virtual uint	promRead(byte *buf, uint size);
+};
+
+/*
+ *	Sparse copy-on-write image on top of an (optional) read-only
+ *	base image. The format is described in ata.cc.
+ */
+class ATADeviceOverlay: public ATADevice {
+	SYS_FILE	*mFile;
+	bool		mReadOnly;
+	ATADevice	*mBase;
+	FileOfs		mBaseSize;
+	FileOfs		mPos;
+	uint		mClusterBits;
+	uint		mL2Bits;
+	uint64		*mL1;
+	uint32		mL1Entries;
+	FileOfs		mL1Offset;
+	uint64		**mL2;
+	FileOfs		mFileEnd;
+	uint64		*mFreeClusters;
+	uint		mFreeCount;
+	uint		mFreeMax;
+	byte		*mClusterBuf;
+
+		bool	open(const char *filename);
+		bool	openBase(const char *filename, const char *base);
+		bool	validCluster(uint64 ofs) const;
+		uint64 *getL2(uint32 l1, bool alloc);
+		uint64	allocCluster();
+		bool	setEntry(uint64 cluster, uint64 value);
+		bool	readBase(FileOfs ofs, byte *buf, uint size);
+		bool	readWrite(FileOfs ofs, byte *buf, uint size, bool write);
+public:
+		ATADeviceOverlay(const char *name, const char *filename, bool readonly = false);
+	virtual ~ATADeviceOverlay();
+
+	static	bool	probe(const char *filename);
+	static	bool	create(const char *filename, const char *base, char *error, int errorlen);
+
+	virtual bool	seek(uint64 blockno);
+	virtual void	flush();
+	virtual int	readBlock(byte *buf);
+	virtual int	writeBlock(byte *buf);
+	virtual bool	readv(uint64 blockno, const sys_iovec *iov, int count);
+	virtual bool	writev(uint64 blockno, const sys_iovec *iov, int count);
+	virtual bool	discard(uint64 blockno, uint64 count);
 
 	virtual bool	promSeek(uint64 pos);
 	virtual uint	promRead(byte *buf, uint size);
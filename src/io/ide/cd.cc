@@ -25,6 +25,7 @@
 #include "debug/tracers.h"
 #include "tools/data.h"
 #include "cd.h"
+#include "idecache.h"
 #include "scsicmds.h"
 
 #define MM_DEVICE_PROFILE_CDROM 0x0008 // .242
@@ -384,7 +385,10 @@ CDROMDeviceFile::CDROMDeviceFile(const char *name)
 
 CDROMDeviceFile::~CDROMDeviceFile()
 {
-	if (mFile) sys_fclose(mFile);
+	if (mFile) {
+		ide_cache_forget(mFile);
+		sys_fclose(mFile);
+	}
 }
 
 uint32 CDROMDeviceFile::getCapacity()
@@ -395,7 +399,6 @@ uint32 CDROMDeviceFile::getCapacity()
 bool CDROMDeviceFile::seek(uint64 blockno)
 {
 	curLBA = blockno;
-	sys_fseek(mFile, (uint64)blockno * 2048);
 	return true;
 }
 
@@ -422,7 +425,7 @@ int CDROMDeviceFile::readBlock(byte *buf)
 		*(buf++) = 0x01; // mode 1 data
 	}
 	if (mMode & IDE_ATAPI_TRANSFER_DATA) {
-		sys_fread(mFile, buf, 2048);
+		ide_cache_read(mFile, mSize, (FileOfs)curLBA * 2048, buf, 2048);
 		buf += 2048;
 	}
 	if (mMode & IDE_ATAPI_TRANSFER_ECC) {
@@ -446,7 +449,10 @@ uint CDROMDeviceFile::promRead(byte *buf, uint size)
 
 bool CDROMDeviceFile::changeDataSource(const char *file)
 {
-	if (mFile) sys_fclose(mFile);
+	if (mFile) {
+		ide_cache_forget(mFile);
+		sys_fclose(mFile);
+	}
 	mFile = sys_fopen(file, SYS_OPEN_READ);
 	if (!mFile) {
 		char buf[256];
@@ -456,6 +462,7 @@ bool CDROMDeviceFile::changeDataSource(const char *file)
 	}
 	sys_fseek(mFile, 0, SYS_SEEK_END);
 	FileOfs fsize = sys_ftell(mFile);
+	mSize = fsize;
 	mCapacity = fsize / 2048 + !!(fsize % 2048);
 
 	if (!is_dvd && (mCapacity > 1151850)) {
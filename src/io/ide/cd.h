@@ -97,6 +97,7 @@ protected:
 
 class CDROMDeviceFile: public CDROMDevice {
 	SYS_FILE	*mFile;
+	FileOfs		mSize;
 	LBA		curLBA;
 	uint32		mCapacity;
 public:
@@ -35,6 +35,7 @@
 #include "ide.h"
 #include "ata.h"
 #include "cd.h"
+#include "idecache.h"
 #include "system/syscdrom.h"
 
 #define IDE_ADDRESS_ISA_BASE	0x1f0
@@ -306,12 +307,27 @@ IDEState gIDEState;
 	| BM_IDE_SR_DMA0_CAPABLE | BM_IDE_SR_DMA1_CAPABLE | BM_IDE_SR_SIMPLEX_ONLY \
 	| BM_IDE_SR_ACTIVE)
 
+struct prd_entry {
+	uint32 addr PACKED;
+	uint32 size PACKED;
+};
+
 class IDE_Controller: public PCI_Device {
+	/*
+	 *	Taken for every register access and by the I/O threads
+	 *	when an asynchronous transfer completes
+	 */
+	sys_mutex	mLock;
+	IDEIORequest	mRequest[2];
+	uint32		mRequestAddr[2][IDE_IO_MAX_IOV];
+	bool		mRequestPrdExhausted[2];
 public:
 
 	IDE_Controller()
 	    :PCI_Device("IDE-Controller", 0x01, 0x01)
 	{
+		sys_create_mutex(&mLock);
+
 		mIORegSize[IDE_PCI_REG_0_CMD] = 0x10;
 		mIORegSize[IDE_PCI_REG_0_CTRL] = 0x10;
 		mIORegSize[IDE_PCI_REG_1_CMD] = 0;		// no secondary controller for now
@@ -1098,11 +1114,6 @@ void receive_atapi_packet()
 	{
 		IO_IDE_TRACE("BM IDE transfer: prd_addr = %08x, lba = %08x, size = %08x\n", prd_addr, lba, count ? count : gIDEState.state[gIDEState.drive].sector_count);
 
-		struct prd_entry {
-			uint32 addr PACKED;
-			uint32 size PACKED;
-		};
-
 		prd_entry prd;
 		if (!ppc_dma_read(&prd, prd_addr, 8)) return false;
 		prd.addr = ppc_word_from_LE(prd.addr);
@@ -1185,6 +1196,107 @@ void receive_atapi_packet()
 		return true;
         }
 
+	/*
+	 *	Hands an ATA DMA transfer to an I/O thread: all PRD segments
+	 *	are mapped into client memory and transferred by a single
+	 *	vectored request, the interrupt is raised on completion.
+	 *	Returns false if the transfer has to be done synchronously
+	 *	by bm_ide_dotransfer().
+	 */
+	bool bm_ide_start_async(uint32 prd_addr, byte bmide_command)
+	{
+		int drive = gIDEState.drive;
+		if (!ide_io_active() || gIDEState.config[drive].protocol != IDE_ATA
+		 || gIDEState.state[drive].dma_lba_count) return false;
+
+		IDEIORequest &req = mRequest[drive];
+		uint32 left = gIDEState.state[drive].sector_count;
+		if (!left) left = 256;
+		left *= 512;
+		bool prd_exhausted = false;
+		req.iovcnt = 0;
+		while (left) {
+			if (req.iovcnt == IDE_IO_MAX_IOV) return false;
+			prd_entry prd;
+			if (!ppc_dma_read(&prd, prd_addr, 8)) return false;
+			prd.addr = ppc_word_from_LE(prd.addr);
+			prd.size = ppc_word_from_LE(prd.size);
+			uint32 pr_size = prd.size & 0xffff;
+			if (!pr_size) pr_size = 64*1024;
+			uint32 len = MIN(pr_size, left);
+			byte *ptr;
+			if (!ppc_dma_map(prd.addr, len, ptr)) return false;
+			mRequestAddr[drive][req.iovcnt] = prd.addr;
+			req.iov[req.iovcnt].base = ptr;
+			req.iov[req.iovcnt].size = len;
+			req.iovcnt++;
+			left -= len;
+			if (prd.size & 0x80000000) {
+				// let bm_ide_dotransfer() deal with a short prd table
+				if (left) return false;
+				prd_exhausted = len == pr_size;
+				break;
+			}
+			prd_addr += 8;
+		}
+
+		IO_IDE_TRACE("BM IDE async transfer: lba = %08x, %d segments\n", gIDEState.state[drive].dma_lba_start, req.iovcnt);
+		mRequestPrdExhausted[drive] = prd_exhausted;
+		req.device = gIDEState.config[drive].device;
+		req.write = !(bmide_command & BM_IDE_CR_WRITE);
+		req.blockno = gIDEState.state[drive].dma_lba_start;
+		req.done = bm_ide_async_done;
+		req.context = this;
+		gIDEState.state[drive].status |= IDE_STATUS_BSY;
+		mConfig[BMIDESR0] |= BM_IDE_SR_ACTIVE;
+		mConfig[BMIDESR0] &= ~BM_IDE_SR_ERROR;
+		// the I/O thread acquires the device itself
+		req.device->release();
+		ide_io_submit(&req);
+		return true;
+	}
+
+	static void bm_ide_async_done(IDEIORequest *req)
+	{
+		((IDE_Controller *)req->context)->bm_ide_complete_async(req);
+	}
+
+	/*
+	 *	Called by the I/O thread
+	 */
+	void bm_ide_complete_async(IDEIORequest *req)
+	{
+		int drive = req - mRequest;
+		sys_lock_mutex(mLock);
+		// the register helpers work on the selected drive
+		int selected = gIDEState.drive;
+		gIDEState.drive = drive;
+		if (req->ok) {
+			if (!req->write) {
+				for (int i = 0; i < req->iovcnt; i++) {
+					ppc_dma_written(mRequestAddr[drive][i], req->iov[i].size);
+				}
+			}
+			do {
+				incAddress();
+			} while (gIDEState.state[drive].sector_count);
+			gIDEState.state[drive].status = IDE_STATUS_RDY | IDE_STATUS_SKC;
+			if (mRequestPrdExhausted[drive]) {
+				mConfig[BMIDESR0] &= ~BM_IDE_SR_ACTIVE;
+			}
+			mConfig[BMIDESR0] |= BM_IDE_SR_INTERRUPT;
+		} else {
+			IO_IDE_WARN("%s failed!\n", req->write ? "write" : "read");
+			gIDEState.state[drive].status = IDE_STATUS_RDY | IDE_STATUS_ERR;
+			gIDEState.state[drive].error = 0x40; // uncorrectable data error
+			mConfig[BMIDESR0] &= ~BM_IDE_SR_ACTIVE;
+			mConfig[BMIDESR0] |= BM_IDE_SR_ERROR | BM_IDE_SR_INTERRUPT;
+		}
+		raiseInterrupt(0);
+		gIDEState.drive = selected;
+		sys_unlock_mutex(mLock);
+	}
+
 	bool read_bmdma_reg(uint32 port, uint32 &data, uint size)
 	{
 		IO_IDE_TRACE("bm-dma: read port: %08x, size: %d from (%08x)\n", port, size, ppc_cpu_get_pc(0));
@@ -1251,6 +1363,9 @@ void receive_atapi_packet()
 		uint32 bmide_prd_addr;
 		memcpy(&bmide_prd_addr, &mConfig[DTPR0], 4);
 		bmide_prd_addr = ppc_word_from_LE(bmide_prd_addr);
+		if (bm_ide_start_async(bmide_prd_addr, mConfig[BMIDECR0])) {
+			return true;
+		}
 		if (bm_ide_dotransfer(prd_exhausted, bmide_prd_addr, 
 				mConfig[BMIDECR0], mConfig[BMIDESR0], 
 				gIDEState.state[gIDEState.drive].dma_lba_start, 
@@ -1902,32 +2017,44 @@ void ide_read_reg(uint32 addr, uint32 &data, int size)
  */	
 	virtual bool	readDeviceIO(uint r, uint32 port, uint32 &data, uint size)
 	{
+		bool ret = true;
+		sys_lock_mutex(mLock);
 		switch (r) {
 		case IDE_PCI_REG_0_CMD:
 			ide_read_reg(port, data, size);
-			return true;
+			break;
 		case IDE_PCI_REG_0_CTRL:
 			ide_read_reg(port+0x10, data, size);
-			return true;
+			break;
 		case IDE_PCI_REG_BMDMA:
-			return read_bmdma_reg(port, data, size);
+			ret = read_bmdma_reg(port, data, size);
+			break;
+		default:
+			ret = false;
 		}
-		return false;
+		sys_unlock_mutex(mLock);
+		return ret;
 	}
 	
 	virtual bool	writeDeviceIO(uint r, uint32 port, uint32 data, uint size)
 	{
+		bool ret = true;
+		sys_lock_mutex(mLock);
 		switch (r) {
 		case IDE_PCI_REG_0_CMD:
 			ide_write_reg(port, data, size);
-			return true;
+			break;
 		case IDE_PCI_REG_0_CTRL:
 			ide_write_reg(port+0x10, data, size);
-			return true;
+			break;
 		case IDE_PCI_REG_BMDMA:
-			return write_bmdma_reg(port, data, size);
+			ret = write_bmdma_reg(port, data, size);
+			break;
+		default:
+			ret = false;
 		}
-		return false;
+		sys_unlock_mutex(mLock);
+		return ret;
 	}
 	
 	virtual void	readConfig(uint reg)
@@ -1950,7 +2077,9 @@ void ide_read_reg(uint32 addr, uint32 &data, int size)
 			// FIXME: please fix this. I won't.
 			if (size != 1) IO_IDE_ERR("size != 1 bla in writeConfig()\n");
 			uint32 data = (gPCI_Data >> (offset*8)) & 0xff;
+			sys_lock_mutex(mLock);
 			write_bmdma_reg(reg-BMIDECR0+offset, data, size);
+			sys_unlock_mutex(mLock);
 			return ;
 		}
 		PCI_Device::writeConfig(reg, offset, size);
@@ -1979,12 +2108,22 @@ IDEConfig *ide_get_config(int disk)
 #define IDE_KEY_IDE0_SLAVE_INSTALLED	"pci_ide0_slave_installed"
 #define IDE_KEY_IDE0_SLAVE_TYPE		"pci_ide0_slave_type"
 #define IDE_KEY_IDE0_SLAVE_IMG		"pci_ide0_slave_image"
+#define IDE_KEY_IDE0_MASTER_BASE	"pci_ide0_master_base"
+#define IDE_KEY_IDE0_SLAVE_BASE		"pci_ide0_slave_base"
+#define IDE_KEY_IDE0_IO_THREADS		"pci_ide0_io_threads"
+#define IDE_KEY_IDE0_CACHE_SIZE		"pci_ide0_cache_size"
 
 #include "configparser.h"
 #include "tools/except.h"
 void ide_init()
 {
 	memset(&gIDEState, 0, sizeof gIDEState);
+	if (gConfig->getConfigInt(IDE_KEY_IDE0_MASTER_INSTALLED) || gConfig->getConfigInt(IDE_KEY_IDE0_SLAVE_INSTALLED)) {
+		uint cache = gConfig->getConfigInt(IDE_KEY_IDE0_CACHE_SIZE);
+		if (cache && !ide_cache_init(MIN(cache, 1024U) << 20)) {
+			IO_IDE_WARN("could not set up a %d MiB block cache\n", cache);
+		}
+	}
 	for (int DISK=0; DISK<2; DISK++) {
 		const char *instkeys[] = {IDE_KEY_IDE0_MASTER_INSTALLED, IDE_KEY_IDE0_SLAVE_INSTALLED};
 		const char *instkey = instkeys[DISK];
@@ -1992,6 +2131,8 @@ void ide_init()
 		const char *typekey = typekeys[DISK];
 		const char *imgkeys[] = {IDE_KEY_IDE0_MASTER_IMG, IDE_KEY_IDE0_SLAVE_IMG};
 		const char *imgkey = imgkeys[DISK];
+		const char *basekeys[] = {IDE_KEY_IDE0_MASTER_BASE, IDE_KEY_IDE0_SLAVE_BASE};
+		const char *basekey = basekeys[DISK];
 		if (gConfig->getConfigInt(instkey)) {
 			const char *masterslave[] = {"master", "slave"};
 			if (!gConfig->haveKey(imgkey)) throw MsgfException("no disk image specified for ide%d %s.", 0, masterslave[DISK]);
@@ -2002,6 +2143,8 @@ void ide_init()
 				gConfig->getConfigString(typekey, type);
 				if (type == (String)"hd") {
 					ext = "img";
+				} else if (type == (String)"overlay") {
+					ext = "ovl";
 				} else if (type == (String)"cdrom") {
 					ext = "iso";
 				} else if (type == (String)"dvdrom") {
@@ -2009,7 +2152,7 @@ void ide_init()
 				} else if (type == (String)"nativecdrom") {
 					ext = "nativecdrom";
 				} else {
-					IO_IDE_ERR("key '%s' must be set to 'hd', 'cdrom' or 'nativecdrom'\n", typekey);
+					IO_IDE_ERR("key '%s' must be set to 'hd', 'overlay', 'cdrom' or 'nativecdrom'\n", typekey);
 				}
 			} else {
 				// type isn't specified, so we must rely on the file extension
@@ -2019,9 +2162,21 @@ void ide_init()
 			}
 			String name;
 			name.assignFormat("ide%d", DISK);
-			if (ext == "img") {
+			if (ext == "img" || ext == "ovl") {
 				gIDEState.config[DISK].protocol = IDE_ATA;
-				gIDEState.config[DISK].device = new ATADeviceFile(name.contentChar(), img.contentChar());
+				if (gConfig->haveKey(basekey) && !ATADeviceOverlay::probe(img.contentChar())) {
+					String base;
+					gConfig->getConfigString(basekey, base);
+					char error[512];
+					if (!ATADeviceOverlay::create(img.contentChar(), base.contentChar(), error, sizeof error)) {
+						IO_IDE_ERR("%s\n", error);
+					}
+				}
+				if (ext == "ovl" || ATADeviceOverlay::probe(img.contentChar())) {
+					gIDEState.config[DISK].device = new ATADeviceOverlay(name.contentChar(), img.contentChar());
+				} else {
+					gIDEState.config[DISK].device = new ATADeviceFile(name.contentChar(), img.contentChar());
+				}
 				const char *error;
 				if ((error = gIDEState.config[DISK].device->getError())) IO_IDE_ERR("%s\n", error);
 				gIDEState.config[DISK].hd.cyl = ((ATADevice*)gIDEState.config[DISK].device)->mCyl;
@@ -2074,14 +2229,18 @@ void ide_init()
 	gIDEState.state[1].status = IDE_STATUS_RDY;
 	gIDEState.one_time_shit = false;
 	if (gIDEState.config[0].installed || gIDEState.config[1].installed) {
+		ide_io_init(gConfig->getConfigInt(IDE_KEY_IDE0_IO_THREADS));
 		gPCI_Devices->insert(new IDE_Controller());
 	}
 }
 
 void ide_done()
 {
+	ide_io_done();
+	ide_cache_display_stats();
 	delete gIDEState.config[0].device;
 	delete gIDEState.config[1].device;
+	ide_cache_done();
 }
 
 void ide_init_config()
@@ -2092,5 +2251,9 @@ void ide_init_config()
 	gConfig->acceptConfigEntryIntDef(IDE_KEY_IDE0_SLAVE_INSTALLED, 0);
 	gConfig->acceptConfigEntryString(IDE_KEY_IDE0_SLAVE_TYPE, false);
 	gConfig->acceptConfigEntryString(IDE_KEY_IDE0_SLAVE_IMG, false);
+	gConfig->acceptConfigEntryString(IDE_KEY_IDE0_MASTER_BASE, false);
+	gConfig->acceptConfigEntryString(IDE_KEY_IDE0_SLAVE_BASE, false);
+	gConfig->acceptConfigEntryIntDef(IDE_KEY_IDE0_IO_THREADS, 2);
+	gConfig->acceptConfigEntryIntDef(IDE_KEY_IDE0_CACHE_SIZE, 32);
 }
 
@@ -0,0 +1,522 @@
+/*
+ *	PearPC
+ *	idecache.cc
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include "system/systhread.h"
+#include "tools/snprintf.h"
+#include "idecache.h"
+
+#define IDE_CACHE_CHUNK_MASK	(IDE_CACHE_CHUNK_SIZE - 1)
+// maximum readahead window in chunks
+#define IDE_CACHE_MAX_READAHEAD	16
+// number of files whose access pattern is tracked
+#define IDE_CACHE_STREAMS	8
+
+struct IDECacheEntry {
+	SYS_FILE	*file;
+	uint64		chunk;
+	byte		*data;
+	/*
+	 *	A chunk which is not valid only holds the dirty range
+	 *	(it was written without being read first)
+	 */
+	bool		valid;
+	bool		readahead;
+	/*
+	 *	Host I/O on the chunk is in flight, the cache is unlocked
+	 *	meanwhile. A busy chunk isn't touched by anyone else.
+	 */
+	bool		busy;
+	uint		dirty_lo;
+	uint		dirty_hi;
+	IDECacheEntry	*hash_next;
+	IDECacheEntry	*moreRU;
+	IDECacheEntry	*lessRU;
+};
+
+/*
+ *	Per file access pattern
+ */
+struct IDECacheStream {
+	SYS_FILE	*file;
+	FileOfs		next;		// where a sequential read would continue
+	uint		window;		// current readahead in chunks
+	IDECacheEntry	*dirty;		// chunk being written to
+};
+
+static sys_semaphore	gCacheSem;	// protects everything below
+static IDECacheEntry	*gCacheEntries;
+static uint		gCacheCount;
+static IDECacheEntry	**gCacheHash;
+static uint		gCacheHashMask;
+static IDECacheEntry	*gCacheMRU;
+static IDECacheEntry	*gCacheLRU;
+static IDECacheStream	gCacheStreams[IDE_CACHE_STREAMS];
+static uint		gCacheNextStream;
+static IDECacheStats	gCacheStats;
+
+/*
+ *	Waits until some busy chunk is done. Bounded, since signalling
+ *	all waiters only wakes one of them on some hosts.
+ */
+static void cache_wait()
+{
+	sys_wait_semaphore_bounded(gCacheSem, 10);
+}
+
+static inline uint cache_hash(SYS_FILE *file, uint64 chunk)
+{
+	return ((uint)(((size_t)file) >> 4) ^ (uint)(chunk * 0x9e3779b1)) & gCacheHashMask;
+}
+
+static IDECacheEntry *cache_lookup(SYS_FILE *file, uint64 chunk)
+{
+	IDECacheEntry *e = gCacheHash[cache_hash(file, chunk)];
+	while (e) {
+		if (e->file == file && e->chunk == chunk) return e;
+		e = e->hash_next;
+	}
+	return NULL;
+}
+
+static void cache_unhash(IDECacheEntry *e)
+{
+	IDECacheEntry **p = &gCacheHash[cache_hash(e->file, e->chunk)];
+	while (*p != e) p = &(*p)->hash_next;
+	*p = e->hash_next;
+	e->file = NULL;
+}
+
+static void cache_unlink(IDECacheEntry *e)
+{
+	if (e->moreRU) e->moreRU->lessRU = e->lessRU; else gCacheMRU = e->lessRU;
+	if (e->lessRU) e->lessRU->moreRU = e->moreRU; else gCacheLRU = e->moreRU;
+}
+
+static void cache_touch(IDECacheEntry *e)
+{
+	if (gCacheMRU == e) return;
+	cache_unlink(e);
+	e->moreRU = NULL;
+	e->lessRU = gCacheMRU;
+	gCacheMRU->moreRU = e;
+	gCacheMRU = e;
+}
+
+static void cache_demote(IDECacheEntry *e)
+{
+	if (gCacheLRU == e) return;
+	cache_unlink(e);
+	e->lessRU = NULL;
+	e->moreRU = gCacheLRU;
+	gCacheLRU->lessRU = e;
+	gCacheLRU = e;
+}
+
+static void cache_unbusy(IDECacheEntry *e)
+{
+	e->busy = false;
+	sys_signal_all_semaphore(gCacheSem);
+}
+
+/*
+ *	Writes back the dirty range of e. The cache is unlocked
+ *	meanwhile, so everything but e may have changed afterwards.
+ */
+static bool cache_writeback(IDECacheEntry *e)
+{
+	while (e->busy) cache_wait();
+	if (e->dirty_lo >= e->dirty_hi) return true;
+	sys_iovec v = {e->data + e->dirty_lo, e->dirty_hi - e->dirty_lo};
+	FileOfs ofs = (e->chunk << IDE_CACHE_CHUNK_BITS) + e->dirty_lo;
+	SYS_FILE *file = e->file;
+	gCacheStats.writebacks++;
+	e->busy = true;
+	sys_unlock_semaphore(gCacheSem);
+	bool ok = sys_fwritev(file, ofs, &v, 1) == (int)v.size;
+	sys_lock_semaphore(gCacheSem);
+	e->dirty_lo = e->dirty_hi = 0;
+	cache_unbusy(e);
+	return ok;
+}
+
+/*
+ *	Streams are only hints, so a stream may be reused
+ *	for another file while its dirty chunk is written back
+ */
+static IDECacheStream *cache_stream(SYS_FILE *file)
+{
+	for (int i = 0; i < IDE_CACHE_STREAMS; i++) {
+		if (gCacheStreams[i].file == file) return &gCacheStreams[i];
+	}
+	IDECacheStream *s = &gCacheStreams[gCacheNextStream];
+	gCacheNextStream = (gCacheNextStream + 1) % IDE_CACHE_STREAMS;
+	IDECacheEntry *dirty = s->dirty;
+	s->file = file;
+	s->next = 0;
+	s->window = 0;
+	s->dirty = NULL;
+	if (dirty) cache_writeback(dirty);
+	return s;
+}
+
+/*
+ *	Removes the least recently used entry which isn't busy from
+ *	the cache and returns it marked busy, dirty data is written
+ *	back. The cache may be unlocked meanwhile.
+ *	If all entries are busy, waits or returns NULL (!wait). Don't
+ *	wait while holding busy entries, their owner may wait for us.
+ */
+static IDECacheEntry *cache_evict(bool wait = true)
+{
+	while (1) {
+		IDECacheEntry *e = gCacheLRU;
+		while (e && e->busy) e = e->moreRU;
+		if (!e) {
+			if (!wait) return NULL;
+			cache_wait();
+			continue;
+		}
+		if (e->file && e->dirty_lo < e->dirty_hi) {
+			cache_writeback(e);
+			// it may have been used again meanwhile
+			continue;
+		}
+		if (e->file) {
+			for (int i = 0; i < IDE_CACHE_STREAMS; i++) {
+				if (gCacheStreams[i].dirty == e) gCacheStreams[i].dirty = NULL;
+			}
+			cache_unhash(e);
+		}
+		cache_touch(e);
+		e->busy = true;
+		return e;
+	}
+}
+
+/*
+ *	Gives back an entry of cache_evict which wasn't used
+ */
+static void cache_release(IDECacheEntry *e)
+{
+	cache_demote(e);
+	cache_unbusy(e);
+}
+
+static void cache_insert(IDECacheEntry *e, SYS_FILE *file, uint64 chunk)
+{
+	uint h = cache_hash(file, chunk);
+	e->file = file;
+	e->chunk = chunk;
+	e->valid = false;
+	e->readahead = false;
+	e->dirty_lo = e->dirty_hi = 0;
+	e->hash_next = gCacheHash[h];
+	gCacheHash[h] = e;
+}
+
+/*
+ *	Reads chunk and up to ra following chunks which aren't cached
+ *	yet with one host request. e may already hold chunk (with dirty
+ *	data, which is written back first).
+ *	The cache is unlocked during the host I/O, so the caller has
+ *	to look up chunk again afterwards (it may even be gone again).
+ */
+static bool cache_fill(SYS_FILE *file, FileOfs size, uint64 chunk, IDECacheEntry *e, uint ra)
+{
+	IDECacheEntry *fill[1 + IDE_CACHE_MAX_READAHEAD];
+	sys_iovec iov[1 + IDE_CACHE_MAX_READAHEAD];
+	uint64 last = size ? (size - 1) >> IDE_CACHE_CHUNK_BITS : 0;
+	if (e) {
+		if (!cache_writeback(e)) return false;
+		if (e->file != file || e->chunk != chunk || e->valid || e->dirty_lo < e->dirty_hi) {
+			// changed meanwhile
+			return true;
+		}
+		cache_touch(e);
+		e->busy = true;
+	} else {
+		e = cache_evict();
+		if (cache_lookup(file, chunk)) {
+			// someone else was faster
+			cache_release(e);
+			return true;
+		}
+		cache_insert(e, file, chunk);
+	}
+	fill[0] = e;
+	int n = 1;
+	while (ra-- && chunk + n <= last && !cache_lookup(file, chunk + n)) {
+		IDECacheEntry *r = cache_evict(false);
+		if (!r) break;
+		if (cache_lookup(file, chunk + n)) {
+			cache_release(r);
+			break;
+		}
+		cache_insert(r, file, chunk + n);
+		r->readahead = true;
+		fill[n++] = r;
+	}
+	for (int i = 0; i < n; i++) {
+		iov[i].base = fill[i]->data;
+		iov[i].size = IDE_CACHE_CHUNK_SIZE;
+	}
+	sys_unlock_semaphore(gCacheSem);
+	int r = sys_freadv(file, chunk << IDE_CACHE_CHUNK_BITS, iov, n);
+	sys_lock_semaphore(gCacheSem);
+	if (r < 0) {
+		for (int i = 0; i < n; i++) {
+			cache_unhash(fill[i]);
+			cache_release(fill[i]);
+		}
+		return false;
+	}
+	for (int i = 0; i < n; i++) {
+		int got = r - i * IDE_CACHE_CHUNK_SIZE;
+		if (got < 0) got = 0;
+		if (got < IDE_CACHE_CHUNK_SIZE) memset(fill[i]->data + got, 0, IDE_CACHE_CHUNK_SIZE - got);
+		fill[i]->valid = true;
+		fill[i]->busy = false;
+	}
+	sys_signal_all_semaphore(gCacheSem);
+	gCacheStats.readahead += n - 1;
+	return true;
+}
+
+bool ide_cache_init(uint size)
+{
+	gCacheCount = size >> IDE_CACHE_CHUNK_BITS;
+	if (gCacheCount < 4 * IDE_CACHE_MAX_READAHEAD) {
+		gCacheCount = 0;
+		return false;
+	}
+	if (sys_create_semaphore(&gCacheSem)) {
+		gCacheCount = 0;
+		return false;
+	}
+	uint hsize = 1;
+	while (hsize < gCacheCount) hsize <<= 1;
+	gCacheHashMask = hsize - 1;
+	gCacheHash = (IDECacheEntry **)calloc(hsize, sizeof (IDECacheEntry *));
+	gCacheEntries = (IDECacheEntry *)calloc(gCacheCount, sizeof (IDECacheEntry));
+	for (uint i = 0; i < gCacheCount; i++) {
+		gCacheEntries[i].data = (byte *)malloc(IDE_CACHE_CHUNK_SIZE);
+		gCacheEntries[i].moreRU = i ? &gCacheEntries[i-1] : NULL;
+		gCacheEntries[i].lessRU = (i+1 < gCacheCount) ? &gCacheEntries[i+1] : NULL;
+	}
+	gCacheMRU = &gCacheEntries[0];
+	gCacheLRU = &gCacheEntries[gCacheCount-1];
+	memset(gCacheStreams, 0, sizeof gCacheStreams);
+	memset(&gCacheStats, 0, sizeof gCacheStats);
+	return true;
+}
+
+void ide_cache_done()
+{
+	if (!gCacheCount) return;
+	sys_lock_semaphore(gCacheSem);
+	for (uint i = 0; i < gCacheCount; i++) {
+		if (gCacheEntries[i].file) cache_writeback(&gCacheEntries[i]);
+	}
+	for (uint i = 0; i < gCacheCount; i++) {
+		free(gCacheEntries[i].data);
+	}
+	free(gCacheEntries);
+	free(gCacheHash);
+	gCacheCount = 0;
+	sys_unlock_semaphore(gCacheSem);
+	sys_destroy_semaphore(gCacheSem);
+}
+
+bool ide_cache_read(SYS_FILE *file, FileOfs size, FileOfs ofs, void *buf, uint len)
+{
+	if (!gCacheCount) {
+		sys_iovec v = {buf, len};
+		int r = sys_freadv(file, ofs, &v, 1);
+		if (r < 0) return false;
+		if ((uint)r < len) memset((byte *)buf + r, 0, len - r);
+		return true;
+	}
+	byte *p = (byte *)buf;
+	bool ok = true;
+	sys_lock_semaphore(gCacheSem);
+	IDECacheStream *s = cache_stream(file);
+	if (ofs == s->next) {
+		s->window = s->window ? MIN(s->window * 2, IDE_CACHE_MAX_READAHEAD) : 1;
+	} else {
+		s->window = 0;
+	}
+	s->next = ofs + len;
+	while (len) {
+		uint64 chunk = ofs >> IDE_CACHE_CHUNK_BITS;
+		uint in = ofs & IDE_CACHE_CHUNK_MASK;
+		uint n = MIN(len, IDE_CACHE_CHUNK_SIZE - in);
+		IDECacheEntry *e = cache_lookup(file, chunk);
+		if (e && e->busy) {
+			cache_wait();
+			continue;
+		}
+		if (e && (e->valid || (in >= e->dirty_lo && in + n <= e->dirty_hi))) {
+			gCacheStats.hits++;
+			if (e->readahead) {
+				gCacheStats.readahead_hits++;
+				e->readahead = false;
+			}
+			cache_touch(e);
+		} else {
+			gCacheStats.misses++;
+			if (!cache_fill(file, size, chunk, e, s->window)) {
+				ok = false;
+				break;
+			}
+			// look again, the cache was unlocked
+			continue;
+		}
+		memcpy(p, e->data + in, n);
+		ofs += n;
+		p += n;
+		len -= n;
+	}
+	sys_unlock_semaphore(gCacheSem);
+	return ok;
+}
+
+bool ide_cache_write(SYS_FILE *file, FileOfs size, FileOfs ofs, const void *buf, uint len)
+{
+	if (!gCacheCount) {
+		sys_iovec v = {(void *)buf, len};
+		return sys_fwritev(file, ofs, &v, 1) == (int)len;
+	}
+	const byte *p = (const byte *)buf;
+	bool ok = true;
+	sys_lock_semaphore(gCacheSem);
+	IDECacheStream *s = cache_stream(file);
+	gCacheStats.writes++;
+	while (len) {
+		uint64 chunk = ofs >> IDE_CACHE_CHUNK_BITS;
+		uint in = ofs & IDE_CACHE_CHUNK_MASK;
+		uint n = MIN(len, IDE_CACHE_CHUNK_SIZE - in);
+		IDECacheEntry *e = cache_lookup(file, chunk);
+		if (e && e->busy) {
+			cache_wait();
+			continue;
+		}
+		/*
+		 *	Everything which unlocks the cache starts over,
+		 *	e may be gone afterwards
+		 */
+		if (s->dirty && s->dirty != e) {
+			// the writer moved on, write back its last chunk
+			IDECacheEntry *dirty = s->dirty;
+			s->dirty = NULL;
+			if (!cache_writeback(dirty)) ok = false;
+			continue;
+		}
+		if (!e) {
+			e = cache_evict();
+			if (cache_lookup(file, chunk)) {
+				cache_release(e);
+				continue;
+			}
+			cache_insert(e, file, chunk);
+			e->valid = n == IDE_CACHE_CHUNK_SIZE;
+			cache_unbusy(e);
+		} else {
+			cache_touch(e);
+		}
+		if (e->dirty_lo >= e->dirty_hi) {
+			e->dirty_lo = in;
+			e->dirty_hi = in + n;
+		} else if (e->valid || (in <= e->dirty_hi && in + n >= e->dirty_lo)) {
+			// a valid chunk may be written back with clean data in between
+			e->dirty_lo = MIN(e->dirty_lo, in);
+			e->dirty_hi = MAX(e->dirty_hi, in + n);
+		} else {
+			if (!cache_writeback(e)) ok = false;
+			continue;
+		}
+		memcpy(e->data + in, p, n);
+		e->readahead = false;
+		s->dirty = e;
+		ofs += n;
+		p += n;
+		len -= n;
+	}
+	// a write invalidates sequential readahead
+	s->next = 0;
+	s->window = 0;
+	sys_unlock_semaphore(gCacheSem);
+	return ok;
+}
+
+bool ide_cache_flush(SYS_FILE *file)
+{
+	if (!gCacheCount) return true;
+	bool ok = true;
+	sys_lock_semaphore(gCacheSem);
+	for (uint i = 0; i < gCacheCount; i++) {
+		if (gCacheEntries[i].file == file) {
+			if (!cache_writeback(&gCacheEntries[i])) ok = false;
+		}
+	}
+	sys_unlock_semaphore(gCacheSem);
+	return ok;
+}
+
+void ide_cache_forget(SYS_FILE *file)
+{
+	if (!gCacheCount) return;
+	sys_lock_semaphore(gCacheSem);
+	for (int i = 0; i < IDE_CACHE_STREAMS; i++) {
+		if (gCacheStreams[i].file == file) memset(&gCacheStreams[i], 0, sizeof gCacheStreams[i]);
+	}
+	for (uint i = 0; i < gCacheCount; i++) {
+		IDECacheEntry *e = &gCacheEntries[i];
+		while (e->file == file) {
+			if (e->busy || e->dirty_lo < e->dirty_hi) {
+				// waits until e isn't busy
+				cache_writeback(e);
+				continue;
+			}
+			for (int j = 0; j < IDE_CACHE_STREAMS; j++) {
+				if (gCacheStreams[j].dirty == e) gCacheStreams[j].dirty = NULL;
+			}
+			cache_unhash(e);
+			cache_demote(e);
+		}
+	}
+	sys_unlock_semaphore(gCacheSem);
+}
+
+void ide_cache_get_stats(IDECacheStats &stats)
+{
+	if (gCacheCount) sys_lock_semaphore(gCacheSem);
+	stats = gCacheStats;
+	if (gCacheCount) sys_unlock_semaphore(gCacheSem);
+}
+
+void ide_cache_display_stats()
+{
+	if (!gCacheCount) return;
+	IDECacheStats st;
+	ide_cache_get_stats(st);
+	ht_printf("[IO/IDE] cache: hits: %qd   misses: %qd   readahead: %qd (used %qd)   writes: %qd   writebacks: %qd\n",
+		st.hits, st.misses, st.readahead, st.readahead_hits, st.writes, st.writebacks);
+}
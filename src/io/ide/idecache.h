@@ -0,0 +1,63 @@
+/*
+ *	PearPC
+ *	idecache.h
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __IDECACHE_H__
+#define __IDECACHE_H__
+
+#include "system/types.h"
+#include "system/file.h"
+
+/*
+ *	Block cache for the image files of all IDE devices.
+ *
+ *	Files are cached in chunks of IDE_CACHE_CHUNK_SIZE bytes.
+ *	Sequential reads enlarge a per-file readahead window, small
+ *	writes to the same chunk are coalesced into one host write.
+ *	All functions may be called from any thread.
+ */
+#define IDE_CACHE_CHUNK_BITS	16
+#define IDE_CACHE_CHUNK_SIZE	(1 << IDE_CACHE_CHUNK_BITS)
+
+struct IDECacheStats {
+	uint64	hits;
+	uint64	misses;
+	uint64	readahead;	// chunks read ahead
+	uint64	readahead_hits;	// ... and later used
+	uint64	writes;
+	uint64	writebacks;	// host writes
+};
+
+bool	ide_cache_init(uint size);
+void	ide_cache_done();
+
+/*
+ *	size is the size of the file, bytes beyond it read as zeros.
+ *	Return false on I/O errors.
+ */
+bool	ide_cache_read(SYS_FILE *file, FileOfs size, FileOfs ofs, void *buf, uint len);
+bool	ide_cache_write(SYS_FILE *file, FileOfs size, FileOfs ofs, const void *buf, uint len);
+/* writes back all dirty data of file */
+bool	ide_cache_flush(SYS_FILE *file);
+/* flushes and drops all data of file, call before closing it */
+void	ide_cache_forget(SYS_FILE *file);
+
+void	ide_cache_get_stats(IDECacheStats &stats);
+/* prints nothing if the cache is disabled */
+void	ide_cache_display_stats();
+
+#endif
@@ -182,6 +182,29 @@ int IDEDevice::write(byte *buf, int size)
 	return buf-oldbuf;
 }
 
+bool IDEDevice::readv(uint64 blockno, const sys_iovec *iov, int count)
+{
+	if (!seek(blockno)) return false;
+	for (int i = 0; i < count; i++) {
+		if (read((byte *)iov[i].base, iov[i].size) != (int)iov[i].size) return false;
+	}
+	return true;
+}
+
+bool IDEDevice::writev(uint64 blockno, const sys_iovec *iov, int count)
+{
+	if (!seek(blockno)) return false;
+	for (int i = 0; i < count; i++) {
+		if (write((byte *)iov[i].base, iov[i].size) != (int)iov[i].size) return false;
+	}
+	return true;
+}
+
+bool IDEDevice::discard(uint64 blockno, uint64 count)
+{
+	return false;
+}
+
 File *IDEDevice::promGetRawFile()
 {
 	return new IDEDeviceFile(*this);
@@ -191,3 +214,102 @@ int IDEDevice::toString(char *buf, int buflen) const
 {
 	return ht_snprintf(buf, buflen, "%s", mName);
 }
+
+/*
+ *	I/O threads
+ *
+ *	Requests are queued in submission order and picked up by
+ *	the first idle thread. The device is acquired by the thread
+ *	for the duration of the transfer.
+ */
+#define IDE_IO_MAX_THREADS 8
+
+static sys_semaphore	gIDEIOSem;
+static sys_thread	gIDEIOThreads[IDE_IO_MAX_THREADS];
+static int		gIDEIOThreadCount;
+static IDEIORequest	*gIDEIOHead;
+static IDEIORequest	*gIDEIOTail;
+static bool		gIDEIOQuit;
+
+static void *ide_io_thread(void *arg)
+{
+	while (true) {
+		sys_lock_semaphore(gIDEIOSem);
+		while (!gIDEIOHead && !gIDEIOQuit) {
+			sys_wait_semaphore(gIDEIOSem);
+		}
+		IDEIORequest *req = gIDEIOHead;
+		if (req) {
+			gIDEIOHead = req->next;
+			if (!gIDEIOHead) gIDEIOTail = NULL;
+		}
+		sys_unlock_semaphore(gIDEIOSem);
+		if (!req) break;
+
+		req->device->acquire();
+		if (req->write) {
+			req->ok = req->device->writev(req->blockno, req->iov, req->iovcnt);
+		} else {
+			req->ok = req->device->readv(req->blockno, req->iov, req->iovcnt);
+		}
+		req->device->release();
+		req->done(req);
+	}
+	return NULL;
+}
+
+bool ide_io_init(int threads)
+{
+	if (threads > IDE_IO_MAX_THREADS) threads = IDE_IO_MAX_THREADS;
+	gIDEIOHead = gIDEIOTail = NULL;
+	gIDEIOQuit = false;
+	gIDEIOThreadCount = 0;
+	if (threads <= 0) return false;
+	if (sys_create_semaphore(&gIDEIOSem)) return false;
+	while (gIDEIOThreadCount < threads) {
+		if (sys_create_thread(&gIDEIOThreads[gIDEIOThreadCount], 0, ide_io_thread, NULL)) break;
+		gIDEIOThreadCount++;
+	}
+	if (!gIDEIOThreadCount) {
+		sys_destroy_semaphore(gIDEIOSem);
+		return false;
+	}
+	return true;
+}
+
+/*
+ *	Finishes all pending requests and stops the threads
+ */
+void ide_io_done()
+{
+	if (!gIDEIOThreadCount) return;
+	sys_lock_semaphore(gIDEIOSem);
+	gIDEIOQuit = true;
+	sys_signal_all_semaphore(gIDEIOSem);
+	sys_unlock_semaphore(gIDEIOSem);
+	for (int i = 0; i < gIDEIOThreadCount; i++) {
+		sys_join_thread(gIDEIOThreads[i]);
+		sys_destroy_thread(gIDEIOThreads[i]);
+	}
+	gIDEIOThreadCount = 0;
+	sys_destroy_semaphore(gIDEIOSem);
+}
+
+bool ide_io_active()
+{
+	return gIDEIOThreadCount > 0;
+}
+
+void ide_io_submit(IDEIORequest *req)
+{
+	req->next = NULL;
+	sys_lock_semaphore(gIDEIOSem);
+	if (gIDEIOTail) {
+		gIDEIOTail->next = req;
+	} else {
+		gIDEIOHead = req;
+	}
+	gIDEIOTail = req;
+	sys_signal_semaphore(gIDEIOSem);
+	sys_unlock_semaphore(gIDEIOSem);
+}
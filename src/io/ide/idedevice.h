@@ -21,6 +21,7 @@
 #ifndef __IDEDEVICE_H__
 #define __IDEDEVICE_H__
 
+#include "system/file.h"
 #include "system/systhread.h"
 #include "tools/data.h"
 #include "tools/stream.h"
@@ -28,6 +29,9 @@
 // The maximum size of a CD sector
 #define IDE_MAX_BLOCK_SIZE 2352
 
+// The maximum number of segments of an asynchronous request
+#define IDE_IO_MAX_IOV 256
+
 class IDEDevice: public Object {
 protected:
 	int	mMode; // this is implementation specific
@@ -59,6 +63,11 @@ public:
 	/* these will always fetch a whole sector */
 	virtual int	readBlock(byte *buf) = 0;
 	virtual int	writeBlock(byte *buf) = 0;
+	/* scatter/gather transfer starting at blockno, used by the I/O threads */
+	virtual bool	readv(uint64 blockno, const sys_iovec *iov, int count);
+	virtual bool	writev(uint64 blockno, const sys_iovec *iov, int count);
+	/* tell the device that the blocks aren't in use anymore (TRIM) */
+	virtual bool	discard(uint64 blockno, uint64 count);
 	/* only for prom */
 	virtual File *	promGetRawFile();
 	virtual bool	promSeek(uint64 pos) = 0;
@@ -67,4 +76,29 @@ public:
 	virtual	int	toString(char *buf, int buflen) const;
 };
 
+struct IDEIORequest;
+typedef void (*IDEIOCallback)(IDEIORequest *req);
+
+/*
+ *	A block transfer executed by one of the I/O threads.
+ *	done is called from the I/O thread once the transfer
+ *	has finished, ok tells whether it succeeded.
+ */
+struct IDEIORequest {
+	IDEDevice	*device;
+	bool		write;
+	uint64		blockno;
+	sys_iovec	iov[IDE_IO_MAX_IOV];
+	int		iovcnt;
+	bool		ok;
+	IDEIOCallback	done;
+	void		*context;
+	IDEIORequest	*next;
+};
+
+bool	ide_io_init(int threads);
+void	ide_io_done();
+bool	ide_io_active();
+void	ide_io_submit(IDEIORequest *req);
+
 #endif
@@ -28,6 +28,8 @@
 #include "io/pci/pci.h"
 #include "io/cuda/cuda.h"
 #include "io/nvram/nvram.h"
+#include "system/sysioloop.h"
+#include "tools/snprintf.h"
 
 
 /*
@@ -130,8 +132,53 @@ extern "C" void FASTCALL io_mem_write128_native_glue(uint32 addr, uint128 *data)
 	io_mem_write128_native(addr, data);
 }
  
+// posted completions, last posted first
+static IOCompletion *volatile gIOCompletions = NULL;
+
+void io_init_completion(IOCompletion &c, void (*func)(void *context), void *context)
+{
+	c.next = NULL;
+	c.queued = 0;
+	c.func = func;
+	c.context = context;
+}
+
+void io_post_completion(IOCompletion &c)
+{
+	if (!__sync_bool_compare_and_swap(&c.queued, 0, 1)) return;
+	IOCompletion *head;
+	do {
+		head = gIOCompletions;
+		c.next = head;
+	} while (!__sync_bool_compare_and_swap(&gIOCompletions, head, &c));
+	ppc_cpu_raise_io_exception();
+}
+
+void io_run_completions()
+{
+	// the CPU is the only consumer, so it can take the whole list at once
+	IOCompletion *list = __sync_lock_test_and_set(&gIOCompletions, (IOCompletion *)NULL);
+	IOCompletion *c = NULL;
+	while (list) {
+		IOCompletion *next = list->next;
+		list->next = c;
+		c = list;
+		list = next;
+	}
+	while (c) {
+		IOCompletion *next = c->next;
+		// may be posted again from now on
+		__sync_lock_release(&c->queued);
+		c->func(c->context);
+		c = next;
+	}
+}
+
 void io_init()
 {
+	if (!sys_ioloop_init()) {
+		IO_CORE_TRACE("no I/O loop, devices use their own threads\n");
+	}
 	pci_init();
 	cuda_init();
 	pic_init();
@@ -140,6 +187,15 @@ void io_init()
 
 void io_done()
 {
+	if (sys_ioloop_available()) {
+		sys_ioloop_stats st;
+		sys_ioloop_get_stats(st);
+		uint64 secs = st.nsecs / 1000000000ULL;
+		ht_printf("[IO] event loop: %qd wakeups (%qd/s)   %qd timers\n",
+			st.wakeups, secs ? st.wakeups / secs : st.wakeups, st.timers);
+	}
+	// no handler may run while the devices go away
+	sys_ioloop_done();
 	pci_done();
 	cuda_done();
 	pic_done();
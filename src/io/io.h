@@ -202,4 +202,22 @@ void io_init();
 void io_done();
 void io_init_config();
 
+/*
+ *	Work which has to be done within the CPU thread, posted
+ *	by device or I/O threads. A completion is queued at most once:
+ *	posting it again before it has run does nothing.
+ */
+struct IOCompletion {
+	IOCompletion	*next;
+	volatile int	queued;
+	void		(*func)(void *context);
+	void		*context;
+};
+
+void	io_init_completion(IOCompletion &c, void (*func)(void *context), void *context);
+/* thread-safe and lock-free, c runs at the next heartbeat of the CPU */
+void	io_post_completion(IOCompletion &c);
+/* may only be called from within the CPU thread */
+void	io_run_completions();
+
 #endif
@@ -39,11 +39,13 @@
 #include "cpu/mem.h"
 #include "cpu/debug.h"
 #include "system/sysethtun.h"
+#include "system/sysioloop.h"
 #include "tools/crc32.h"
 #include "tools/data.h"
 #include "tools/debug.h"
 #include "tools/except.h"
 #include "tools/snprintf.h"
+#include "io/io.h"
 #include "io/pic/pic.h"
 #include "io/pci/pci.h"
 #include "debug/tracers.h"
@@ -175,6 +177,9 @@ enum EEPROMField {
         EEPROM_Checksum =               0x20
 };
 
+static void rtl8139RxReady(int fd, void *nic);
+static void rtl8139RxComplete(void *nic);
+
 /*
  *
  */
@@ -188,6 +193,7 @@ protected:
 	bool	 	mGoodBSA;
 	EthTunDevice *	mEthTun;
 	sys_mutex	mLock;
+	bool		mCRC;
 	int		mVerbose;
 	byte		mHead;
 	byte		mTail;
@@ -197,6 +203,8 @@ protected:
 	byte            mLastPackets[2];
 	uint32		mPid;
 	Packet		mPackets[MAX_PACKETS];
+	// the CPU thread hands received packets to the guest
+	IOCompletion	mRxCompletion;
 	byte		mMAC[6];
 
 void PCIReset()
@@ -321,26 +329,35 @@ void maybeRaiseIntr()
 
 void TxPacket(uint32 address, uint32 size)
 {
-	byte	pbuf[MAX_PACKET_SIZE];
 	byte *	p;
 	uint32	crc;
 	uint32	psize;
 
-	p = pbuf;
 	IO_RTL8139_TRACE("address: %08x, size: %04x\n", address, size);
-	if (ppc_dma_read(pbuf, address, size)) {
+	if (size + 4 > MAX_PACKET_SIZE) {
+		IO_RTL8139_WARN("packet too big ! (%d)\n", size);
+		return;
+	}
+	if (ppc_dma_map(address, size, p)) {
 /*		if (mVerbose > 1) {
 			debugDumpMem(ppc_addr, size);
 		}*/
-		crc = ether_crc(size, p);
+		uint w;
 		psize = size;
-		pbuf[psize+0] = crc;
-		pbuf[psize+1] = crc>>8;
-		pbuf[psize+2] = crc>>16;
-		pbuf[psize+3] = crc>>24;
-		psize += 4;
-
-		uint w = mEthTun->sendPacket(pbuf, psize);
+		if (mCRC) {
+			byte pbuf[MAX_PACKET_SIZE];
+			memcpy(pbuf, p, size);
+			crc = ether_crc(size, p);
+			pbuf[psize+0] = crc;
+			pbuf[psize+1] = crc>>8;
+			pbuf[psize+2] = crc>>16;
+			pbuf[psize+3] = crc>>24;
+			psize += 4;
+			w = mEthTun->sendPacket(pbuf, psize);
+		} else {
+			// tunnels don't need a crc, send straight from guest memory
+			w = mEthTun->sendPacket(p, psize);
+		}
 		if (w) {
 			if (w == psize) {
 				IO_RTL8139_TRACE("EthTun: %d bytes sent.\n", psize);
@@ -355,14 +372,16 @@ void TxPacket(uint32 address, uint32 size)
 }
 
 public:
-rtl8139_NIC(EthTunDevice *aEthTun, const byte *mac)
+rtl8139_NIC(EthTunDevice *aEthTun, const byte *mac, bool crc)
 : PCI_Device("rtl8139 Network interface card", 0x1, 0xd)
 {
 	int e;
 	if ((e = sys_create_mutex(&mLock))) throw IOException(e);
 	mEthTun = aEthTun;
+	mCRC = crc;
 	memcpy(mMAC, mac, 6);
 	mPid = 0;
+	io_init_completion(mRxCompletion, rtl8139RxComplete, this);
 	PCIReset();
 	totalReset();
 }
@@ -626,86 +645,122 @@ bool writeDeviceIO(uint r, uint32 port, uint32 data, uint size)
 	return retval;
 }
 
-void handleRxQueue()
+/*
+ *	Receive from the I/O loop instead of an own thread
+ */
+bool attachIOLoop()
+{
+	return sys_ioloop_add_fd(mEthTun->getRecvFD(), rtl8139RxReady, this);
+}
+
+/*
+ *	Receives one packet, called by the I/O loop or the rx thread.
+ *	Returns false if there was none.
+ */
+bool rxPoll()
 {
 	uint16		header;
 	uint16		psize;
-	byte            rxPacket[MAX_PACKET_SIZE];
+	byte            *rxPacket;
 	uint16          rxPacketSize;
 	byte		tmp;
 	static byte	broadcast[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
 
+	/*
+	 *	Receive into the next free packet buffer (only the
+	 *	receiver advances mHead), leave room for the header
+	 *	and padding.
+	 */
+	rxPacket = &mPackets[mHead].packet[4];
+	rxPacketSize = mEthTun->recvPacket(rxPacket, MAX_PACKET_SIZE - 8);
+	if (!rxPacketSize) return false;
+	IO_RTL8139_TRACE("got packet from the world at large\n");
+	if (!mGoodBSA) return true;
+/*	if (mVerbose > 1) {
+		debugDumpMem(rxPacket, rxPacketSize);
+	}*/
+	header = 0;
+	if (rxPacketSize < 64) {
+		for ( ; rxPacketSize < 60; rxPacketSize++) {
+			rxPacket[rxPacketSize] = 0;
+		}
+		//header |= Rx_RUNT; // set runt status
+	}
+	/* pad to a 4 byte boundary */
+	for (int i = 4-(rxPacketSize % 4); i != 0; i--) {
+		rxPacket[rxPacketSize++] = 0;
+	}
+	if (memcmp(rxPacket, broadcast, 6) == 0) {
+		header |= Rx_BAR;
+	}
+//	IO_RTL8139_TRACE("rxPoll waiting for mLock\n");
+	sys_lock_mutex(mLock);
+//	IO_RTL8139_TRACE("rxPoll has mLock\n");
+	if (memcmp(rxPacket, (byte*)&(mRegisters.id0), 6) == 0) {
+		/*if (mVerbose > 1) IO_RTL8139_TRACE("Physical Address Match\n");*/
+		header |= Rx_PAM;
+	}
+	// check crc?
+	header |= Rx_ROK;
+	psize = rxPacketSize;
+	IO_RTL8139_TRACE("Incoming - Pid: %08x, Header: %04x, Size: %04x\n", mPid, header, psize);
+	mPackets[mHead].packet[0] = header;
+	mPackets[mHead].packet[1] = header>>8;
+	mPackets[mHead].packet[2] = psize;
+	mPackets[mHead].packet[3] = psize>>8;
+	if (rxPacket != &mPackets[mHead].packet[4]) {
+		// the card was reset in the meantime
+		memmove(&mPackets[mHead].packet[4], rxPacket, rxPacketSize);
+	}
+	mPackets[mHead].size = rxPacketSize+4;
+	mPackets[mHead].pid = mPid;
+	tmp = mHead;
+	if (mHead == mTail) { /* first recent packet buffer */
+		mHead = (mHead+1) % MAX_PACKETS;
+	} else {
+		mHead = (mHead+1) % MAX_PACKETS;
+		if (mHead == mTail) {
+			mHead = tmp; // reset it back 
+			IO_RTL8139_WARN("Internal Buffer wrapped around\n");
+		} 
+	}
+	if (tmp != mHead) {
+		mPid++;
+		mActive++;
+		if (mActive > mWatermark) {
+			IO_RTL8139_TRACE("Watermark: %02x\n", mWatermark);
+			mWatermark = mActive;
+		}
+	}
+	sys_unlock_mutex(mLock);
+//	IO_RTL8139_TRACE("rxPoll freed mLock\n");
+	io_post_completion(mRxCompletion);
+	return true;
+}
+
+/*
+ *	Runs within the CPU thread after rxPoll() received packets
+ */
+void rxComplete()
+{
+	sys_lock_mutex(mLock);
+	if (mRegisters.CommandRegister & 1) { /* no packets in process, kick one out */
+		transferPacket(true);
+	}
+	sys_unlock_mutex(mLock);
+}
+
+void handleRxQueue()
+{
 	while (1) {
 		while (mEthTun->waitRecvPacket() != 0) {
 			// don't block the system in case of (repeated) error(s)
 			sys_suspend();
 		}
-		rxPacketSize = mEthTun->recvPacket(rxPacket, sizeof rxPacket);
-		if (!rxPacketSize) {
+		if (!rxPoll()) {
 			// don't block the system in case of (repeated) error(s)
 			sys_suspend();
-			continue;
-		}
-		IO_RTL8139_TRACE("got packet from the world at large\n");
-		if (!mGoodBSA) continue;
-/*		if (mVerbose > 1) {
-			debugDumpMem(rxPacket, rxPacketSize);
-		}*/
-		header = 0;
-		if (rxPacketSize < 64) {
-			for ( ; rxPacketSize < 60; rxPacketSize++) {
-				rxPacket[rxPacketSize] = 0;
-			}
-			//header |= Rx_RUNT; // set runt status
-		}
-		/* pad to a 4 byte boundary */
-		for (int i = 4-(rxPacketSize % 4); i != 0; i--) {
-			rxPacket[rxPacketSize++] = 0;
-		}
-		if (memcmp(rxPacket, broadcast, 6) == 0) {
-			header |= Rx_BAR;
-		}
-//		IO_RTL8139_TRACE("handleRxQueue waiting for mLock\n");
-		sys_lock_mutex(mLock);
-//		IO_RTL8139_TRACE("handleRxQueue has mLock\n");
-		if (memcmp(rxPacket, (byte*)&(mRegisters.id0), 6) == 0) {
-			/*if (mVerbose > 1) IO_RTL8139_TRACE("Physical Address Match\n");*/
-			header |= Rx_PAM;
 		}
-		// check crc?
-		header |= Rx_ROK;
-		psize = rxPacketSize;
-		IO_RTL8139_TRACE("Incoming - Pid: %08x, Header: %04x, Size: %04x\n", mPid, header, psize);
-		mPackets[mHead].packet[0] = header;
-		mPackets[mHead].packet[1] = header>>8;
-		mPackets[mHead].packet[2] = psize;
-		mPackets[mHead].packet[3] = psize>>8;
-		memcpy(&(mPackets[mHead].packet[4]), rxPacket, rxPacketSize);
-		mPackets[mHead].size = rxPacketSize+4;
-		mPackets[mHead].pid = mPid;
-		tmp = mHead;
-		if (mHead == mTail) { /* first recent packet buffer */
-			mHead = (mHead+1) % MAX_PACKETS;
-		} else {
-			mHead = (mHead+1) % MAX_PACKETS;
-			if (mHead == mTail) {
-				mHead = tmp; // reset it back 
-				IO_RTL8139_WARN("Internal Buffer wrapped around\n");
-			} 
-		}
-		if (tmp != mHead) {
-			mPid++;
-			mActive++;
-			if (mActive > mWatermark) {
-				IO_RTL8139_TRACE("Watermark: %02x\n", mWatermark);
-				mWatermark = mActive;
-			}
-		}
-		if (mRegisters.CommandRegister & 1) { /* no packets in process, kick one out */
-			transferPacket(true);
-		}
-		sys_unlock_mutex(mLock);
-//		IO_RTL8139_TRACE("handleRxQueue freed mLock\n");
 	}
 }
 
@@ -718,6 +773,19 @@ static void *rtl8139HandleRxQueue(void *nic)
 	return NULL;
 }
 
+static void rtl8139RxReady(int fd, void *nic)
+{
+	rtl8139_NIC *NIC = (rtl8139_NIC *)nic;
+	// the descriptor is non-blocking, take what's there
+	for (int i = 0; i < MAX_PACKETS && NIC->rxPoll(); i++);
+}
+
+static void rtl8139RxComplete(void *nic)
+{
+	rtl8139_NIC *NIC = (rtl8139_NIC *)nic;
+	NIC->rxComplete();
+}
+
 bool rtl8139_installed = false;
 
 #include "configparser.h"
@@ -725,6 +793,7 @@ bool rtl8139_installed = false;
 
 #define RTL8139_KEY_INSTALLED   "pci_rtl8139_installed"
 #define RTL8139_KEY_MAC         "pci_rtl8139_mac"
+#define RTL8139_KEY_CRC         "pci_rtl8139_crc"
 
 void rtl8139_init()
 {
@@ -777,10 +846,12 @@ void rtl8139_init()
 		}
 		printf("\n");
 #endif
-		rtl8139_NIC *MyNIC = new rtl8139_NIC(ethTun, mac);
+		rtl8139_NIC *MyNIC = new rtl8139_NIC(ethTun, mac, gConfig->getConfigInt(RTL8139_KEY_CRC));
 		gPCI_Devices->insert(MyNIC);
-		sys_thread rxthread;
-		sys_create_thread(&rxthread, 0, rtl8139HandleRxQueue, MyNIC);
+		if (!MyNIC->attachIOLoop()) {
+			sys_thread rxthread;
+			sys_create_thread(&rxthread, 0, rtl8139HandleRxQueue, MyNIC);
+		}
 	}
 }
 
@@ -792,4 +863,5 @@ void rtl8139_init_config()
 {
 	gConfig->acceptConfigEntryIntDef(RTL8139_KEY_INSTALLED, 0);
 	gConfig->acceptConfigEntryString(RTL8139_KEY_MAC, false);
+	gConfig->acceptConfigEntryIntDef(RTL8139_KEY_CRC, 0);
 }
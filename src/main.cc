@@ -232,6 +232,7 @@ int main(int argc, char *argv[])
 		gConfig->acceptConfigEntryIntDef("memory_size", 128*1024*1024);
 		gConfig->acceptConfigEntryIntDef("page_table_pa", 0x00300000);
 		gConfig->acceptConfigEntryIntDef("redraw_interval_msec", 20);
+		gConfig->acceptConfigEntryIntDef("redraw_change_detection", 0);
 		gConfig->acceptConfigEntryStringDef("key_compose_dialog", "F11");
 		gConfig->acceptConfigEntryStringDef("key_change_cd_0", "none");
 		gConfig->acceptConfigEntryStringDef("key_change_cd_1", "none");
@@ -350,6 +351,7 @@ int main(int argc, char *argv[])
 		cuda_pre_init();
 
 		initUI(APPNAME " " APPVERSION, gm, msec, keyConfig, fullscreen);
+		gDisplay->setChangeDetection(gConfig->getConfigInt("redraw_change_detection"));
 
 		io_init();
 
@@ -18,19 +18,12 @@
  *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#include <immintrin.h>
+
 #include "system/sysvaccel.h"
 
 #include "tools/snprintf.h"
 
-#if 0
-extern "C" void __attribute__((regparm (3))) x86_mmx_convert_2be555_to_2le555(uint32 pixel, byte *input, byte *output);
-extern "C" void __attribute__((regparm (3))) x86_mmx_convert_2be555_to_2le565(uint32 pixel, byte *input, byte *output);
-extern "C" void __attribute__((regparm (3))) x86_mmx_convert_2be555_to_4le888(uint32 pixel, byte *input, byte *output);
-extern "C" void __attribute__((regparm (3))) x86_sse2_convert_2be555_to_2le555(uint32 pixel, byte *input, byte *output);
-extern "C" void __attribute__((regparm (3))) x86_sse2_convert_2be555_to_2le565(uint32 pixel, byte *input, byte *output);
-extern "C" void __attribute__((regparm (3))) x86_sse2_convert_2be555_to_4le888(uint32 pixel, byte *input, byte *output);
-extern "C" void __attribute__((regparm (3))) x86_convert_4be888_to_4le888(uint32 pixel, byte *input, byte *output);
-#endif
 
 static inline void convertBaseColor(uint &b, uint fromBits, uint toBits)
 {
@@ -97,6 +90,257 @@ static inline void genericConvertDisplay(
 	}
 }
 
+/*
+ *	Line converters for the common client/host format pairs.
+ *	Each one converts |n| pixels of a single scanline, the vector
+ *	versions leave the remaining pixels to the scalar ones.
+ */
+typedef void (*ConvertLineFunc)(const byte *src, byte *dest, int n);
+
+static inline uint convert555to565(uint p)
+{
+	return ((p & 0x7fe0) << 1) | (p & 0x1f);
+}
+
+static inline uint convert555to888(uint p)
+{
+	return ((p & 0x7c00) << 9) | ((p & 0x03e0) << 6) | ((p & 0x1f) << 3);
+}
+
+static void scalar_2be555_to_2le555(const byte *src, byte *dest, int n)
+{
+	for (int i=0; i < n; i++) {
+		uint p = ((src[0] << 8) | src[1]) & 0x7fff;
+		dest[0] = p; dest[1] = p>>8;
+		src += 2; dest += 2;
+	}
+}
+
+static void scalar_2be555_to_2le565(const byte *src, byte *dest, int n)
+{
+	for (int i=0; i < n; i++) {
+		uint p = convert555to565((src[0] << 8) | src[1]);
+		dest[0] = p; dest[1] = p>>8;
+		src += 2; dest += 2;
+	}
+}
+
+static void scalar_2be555_to_4le888(const byte *src, byte *dest, int n)
+{
+	for (int i=0; i < n; i++) {
+		*(uint32*)dest = convert555to888((src[0] << 8) | src[1]);
+		src += 2; dest += 4;
+	}
+}
+
+static void scalar_4be888_to_4le888(const byte *src, byte *dest, int n)
+{
+	for (int i=0; i < n; i++) {
+		*(uint32*)dest = (src[1] << 16) | (src[2] << 8) | src[3];
+		src += 4; dest += 4;
+	}
+}
+
+/*
+ *	SSE2 is part of the x86_64 baseline, so these need no check.
+ */
+static inline __m128i sse2_bswap16(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static inline __m128i sse2_555to888(__m128i p)
+{
+	__m128i r = _mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0x7c00)), 9);
+	__m128i g = _mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0x03e0)), 6);
+	__m128i b = _mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0x001f)), 3);
+	return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+static void sse2_2be555_to_2le555(const byte *src, byte *dest, int n)
+{
+	const __m128i mask = _mm_set1_epi16(0x7fff);
+	int i = 0;
+	for (; i+8 <= n; i += 8) {
+		__m128i p = sse2_bswap16(_mm_loadu_si128((const __m128i*)(src+2*i)));
+		_mm_storeu_si128((__m128i*)(dest+2*i), _mm_and_si128(p, mask));
+	}
+	scalar_2be555_to_2le555(src+2*i, dest+2*i, n-i);
+}
+
+static void sse2_2be555_to_2le565(const byte *src, byte *dest, int n)
+{
+	const __m128i rg = _mm_set1_epi16(0x7fe0);
+	const __m128i b = _mm_set1_epi16(0x001f);
+	int i = 0;
+	for (; i+8 <= n; i += 8) {
+		__m128i p = sse2_bswap16(_mm_loadu_si128((const __m128i*)(src+2*i)));
+		p = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(p, rg), 1), _mm_and_si128(p, b));
+		_mm_storeu_si128((__m128i*)(dest+2*i), p);
+	}
+	scalar_2be555_to_2le565(src+2*i, dest+2*i, n-i);
+}
+
+static void sse2_2be555_to_4le888(const byte *src, byte *dest, int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i+8 <= n; i += 8) {
+		__m128i p = sse2_bswap16(_mm_loadu_si128((const __m128i*)(src+2*i)));
+		_mm_storeu_si128((__m128i*)(dest+4*i), sse2_555to888(_mm_unpacklo_epi16(p, zero)));
+		_mm_storeu_si128((__m128i*)(dest+4*i+16), sse2_555to888(_mm_unpackhi_epi16(p, zero)));
+	}
+	scalar_2be555_to_4le888(src+2*i, dest+4*i, n-i);
+}
+
+static void sse2_4be888_to_4le888(const byte *src, byte *dest, int n)
+{
+	const __m128i mask = _mm_set1_epi32(0x00ffffff);
+	int i = 0;
+	for (; i+4 <= n; i += 4) {
+		__m128i p = _mm_loadu_si128((const __m128i*)(src+4*i));
+		p = _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, 0xb1), 0xb1);
+		p = _mm_and_si128(sse2_bswap16(p), mask);
+		_mm_storeu_si128((__m128i*)(dest+4*i), p);
+	}
+	scalar_4be888_to_4le888(src+4*i, dest+4*i, n-i);
+}
+
+/*
+ *	SSSE3: pshufb swaps the bytes and clears the alpha byte in one go.
+ */
+__attribute__((target("ssse3")))
+static void ssse3_4be888_to_4le888(const byte *src, byte *dest, int n)
+{
+	const __m128i shuf = _mm_setr_epi8(3, 2, 1, -1, 7, 6, 5, -1,
+		11, 10, 9, -1, 15, 14, 13, -1);
+	int i = 0;
+	for (; i+4 <= n; i += 4) {
+		__m128i p = _mm_loadu_si128((const __m128i*)(src+4*i));
+		_mm_storeu_si128((__m128i*)(dest+4*i), _mm_shuffle_epi8(p, shuf));
+	}
+	scalar_4be888_to_4le888(src+4*i, dest+4*i, n-i);
+}
+
+/*
+ *	AVX2: same as above on 256 bit. vpshufb works per 128 bit lane,
+ *	so the masks are repeated for both lanes.
+ */
+__attribute__((target("avx2")))
+static inline __m256i avx2_bswap16(__m256i v)
+{
+	const __m256i shuf = _mm256_setr_epi8(
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	return _mm256_shuffle_epi8(v, shuf);
+}
+
+__attribute__((target("avx2")))
+static void avx2_2be555_to_2le555(const byte *src, byte *dest, int n)
+{
+	const __m256i mask = _mm256_set1_epi16(0x7fff);
+	int i = 0;
+	for (; i+16 <= n; i += 16) {
+		__m256i p = avx2_bswap16(_mm256_loadu_si256((const __m256i*)(src+2*i)));
+		_mm256_storeu_si256((__m256i*)(dest+2*i), _mm256_and_si256(p, mask));
+	}
+	sse2_2be555_to_2le555(src+2*i, dest+2*i, n-i);
+}
+
+__attribute__((target("avx2")))
+static void avx2_2be555_to_2le565(const byte *src, byte *dest, int n)
+{
+	const __m256i rg = _mm256_set1_epi16(0x7fe0);
+	const __m256i b = _mm256_set1_epi16(0x001f);
+	int i = 0;
+	for (; i+16 <= n; i += 16) {
+		__m256i p = avx2_bswap16(_mm256_loadu_si256((const __m256i*)(src+2*i)));
+		p = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(p, rg), 1), _mm256_and_si256(p, b));
+		_mm256_storeu_si256((__m256i*)(dest+2*i), p);
+	}
+	sse2_2be555_to_2le565(src+2*i, dest+2*i, n-i);
+}
+
+__attribute__((target("avx2")))
+static void avx2_2be555_to_4le888(const byte *src, byte *dest, int n)
+{
+	const __m128i shuf = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+		9, 8, 11, 10, 13, 12, 15, 14);
+	const __m256i rm = _mm256_set1_epi32(0x7c00);
+	const __m256i gm = _mm256_set1_epi32(0x03e0);
+	const __m256i bm = _mm256_set1_epi32(0x001f);
+	int i = 0;
+	for (; i+8 <= n; i += 8) {
+		__m128i s = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src+2*i)), shuf);
+		__m256i p = _mm256_cvtepu16_epi32(s);
+		__m256i r = _mm256_slli_epi32(_mm256_and_si256(p, rm), 9);
+		__m256i g = _mm256_slli_epi32(_mm256_and_si256(p, gm), 6);
+		__m256i b = _mm256_slli_epi32(_mm256_and_si256(p, bm), 3);
+		_mm256_storeu_si256((__m256i*)(dest+4*i), _mm256_or_si256(_mm256_or_si256(r, g), b));
+	}
+	scalar_2be555_to_4le888(src+2*i, dest+4*i, n-i);
+}
+
+__attribute__((target("avx2")))
+static void avx2_4be888_to_4le888(const byte *src, byte *dest, int n)
+{
+	const __m256i shuf = _mm256_setr_epi8(
+		3, 2, 1, -1, 7, 6, 5, -1, 11, 10, 9, -1, 15, 14, 13, -1,
+		3, 2, 1, -1, 7, 6, 5, -1, 11, 10, 9, -1, 15, 14, 13, -1);
+	int i = 0;
+	for (; i+8 <= n; i += 8) {
+		__m256i p = _mm256_loadu_si256((const __m256i*)(src+4*i));
+		_mm256_storeu_si256((__m256i*)(dest+4*i), _mm256_shuffle_epi8(p, shuf));
+	}
+	ssse3_4be888_to_4le888(src+4*i, dest+4*i, n-i);
+}
+
+static inline bool isFormat(const DisplayCharacteristics &chr, int bytesPerPixel,
+	int redShift, int redSize, int greenShift, int greenSize, int blueShift, int blueSize)
+{
+	return chr.bytesPerPixel == bytesPerPixel
+		&& chr.redShift == redShift && chr.redSize == redSize
+		&& chr.greenShift == greenShift && chr.greenSize == greenSize
+		&& chr.blueShift == blueShift && chr.blueSize == blueSize;
+}
+
+/*
+ *	Returns the best line converter for the given pair of formats
+ *	or NULL if there is none and the generic path has to be taken.
+ */
+static ConvertLineFunc selectConvertLine(const DisplayCharacteristics &aSrcChar,
+	const DisplayCharacteristics &aDestChar)
+{
+	bool avx2 = __builtin_cpu_supports("avx2");
+	bool ssse3 = __builtin_cpu_supports("ssse3");
+	if (isFormat(aSrcChar, 2, 10, 5, 5, 5, 0, 5)) {
+		if (isFormat(aDestChar, 2, 10, 5, 5, 5, 0, 5)) {
+			return avx2 ? avx2_2be555_to_2le555 : sse2_2be555_to_2le555;
+		}
+		if (isFormat(aDestChar, 2, 11, 5, 5, 6, 0, 5)) {
+			return avx2 ? avx2_2be555_to_2le565 : sse2_2be555_to_2le565;
+		}
+		if (isFormat(aDestChar, 4, 16, 8, 8, 8, 0, 8)) {
+			return avx2 ? avx2_2be555_to_4le888 : sse2_2be555_to_4le888;
+		}
+	} else if (isFormat(aSrcChar, 4, 16, 8, 8, 8, 0, 8)) {
+		if (isFormat(aDestChar, 4, 16, 8, 8, 8, 0, 8)) {
+			if (avx2) return avx2_4be888_to_4le888;
+			return ssse3 ? ssse3_4be888_to_4le888 : sse2_4be888_to_4le888;
+		}
+	}
+	return NULL;
+}
+
+/*
+ *	The converter is only looked up again when either side
+ *	changes its mode.
+ */
+static DisplayCharacteristics gConvertSrcChar;
+static DisplayCharacteristics gConvertDestChar;
+static ConvertLineFunc gConvertLine;
+static bool gConvertSelected = false;
+
 void sys_convert_display(
 	const DisplayCharacteristics &aSrcChar,
 	const DisplayCharacteristics &aDestChar,
@@ -105,26 +349,22 @@ void sys_convert_display(
 	int firstLine,
 	int lastLine)
 {
-#if 1
-	genericConvertDisplay(aSrcChar, aDestChar, aSrcBuf, aDestBuf, firstLine, lastLine);
-#else
-	byte *src = (byte*)aSrcBuf + aSrcChar.bytesPerPixel * aSrcChar.width * firstLine;
-	byte *dest = (byte*)aDestBuf + aDestChar.bytesPerPixel * aDestChar.width * firstLine;
-	uint32 pixel = (lastLine-firstLine+1) * aSrcChar.width;
-	if (aSrcChar.bytesPerPixel == 2 && aDestChar.bytesPerPixel == 2) {
-		if (aDestChar.redSize == 5 && aDestChar.greenSize == 6 && aDestChar.blueSize == 5) {
-			x86_mmx_convert_2be555_to_2le565(pixel, src, dest);
-		} else if (aDestChar.redSize == 5 && aDestChar.greenSize == 5 && aDestChar.blueSize == 5) {
-			x86_mmx_convert_2be555_to_2le555(pixel, src, dest);
-		} else {
-			genericConvertDisplay(aSrcChar, aDestChar, aSrcBuf, aDestBuf, firstLine, lastLine);
-		}
-	} else if (aSrcChar.bytesPerPixel == 2 && aDestChar.bytesPerPixel == 4) {
-		x86_mmx_convert_2be555_to_4le888(pixel, src, dest);
-	} else if (aSrcChar.bytesPerPixel == 4 && aDestChar.bytesPerPixel == 4) {
-		x86_convert_4be888_to_4le888(pixel, src, dest);
-	} else {
+	if (!gConvertSelected || gConvertSrcChar.compareTo(&aSrcChar) != 0
+	 || gConvertDestChar.compareTo(&aDestChar) != 0) {
+		gConvertSrcChar = aSrcChar;
+		gConvertDestChar = aDestChar;
+		gConvertLine = selectConvertLine(aSrcChar, aDestChar);
+		gConvertSelected = true;
+	}
+	if (!gConvertLine) {
 		genericConvertDisplay(aSrcChar, aDestChar, aSrcBuf, aDestBuf, firstLine, lastLine);
+		return;
+	}
+	const byte *src = (const byte*)aSrcBuf + aSrcChar.bytesPerPixel * aSrcChar.width * firstLine;
+	byte *dest = (byte*)aDestBuf + aDestChar.bytesPerPixel * aDestChar.width * firstLine;
+	for (int y=firstLine; y <= lastLine; y++) {
+		gConvertLine(src, dest, aSrcChar.width);
+		src += aSrcChar.scanLineLength;
+		dest += aDestChar.scanLineLength;
 	}
-#endif
 }
@@ -32,14 +32,18 @@
 #include "io/cuda/cuda.h"
 #include "system/sys.h"
 #include "system/keyboard.h"
+#include "system/sysvaccel.h"
 
 byte *	gFrameBuffer = NULL;
-int 	gDamageAreaFirstAddr, gDamageAreaLastAddr;
+uint32	gDamageBlocks[DAMAGE_BLOCK_WORDS];
 
-extern "C" void damageFrameBufferExt(int addr)
+void damageFrameBufferRange(int first, int last)
 {
-	damageFrameBuffer(addr);
-	damageFrameBuffer(addr+0xfff);
+	if (first < 0) first = 0;
+	if (last >= DAMAGE_MAX_FRAMEBUFFER) last = DAMAGE_MAX_FRAMEBUFFER-1;
+	for (int block = first >> DAMAGE_BLOCK_SHIFT; block <= last >> DAMAGE_BLOCK_SHIFT; block++) {
+		damageFrameBuffer(block << DAMAGE_BLOCK_SHIFT);
+	}
 }
 
 #define IS_FGTRANS(c) (VC_GET_BASECOLOR(VCP_FOREGROUND((c)))==VC_TRANSPARENT)
@@ -146,11 +150,230 @@ SystemDisplay::SystemDisplay(const DisplayCharacteristics &aClientChr, int redra
 	mFullscreen = false;
 
 	mExposed = false;
+
+	mDamageCols = mDamageRows = 0;
+	mDamageTiles = NULL;
+	mDamageHashes = NULL;
+	mDamageHashesValid = false;
+	mChangeDetection = false;
+	sys_create_mutex(&mDamageMutex);
 }
 
 SystemDisplay::~SystemDisplay()
 {
 	delete mMenu;
+	free(mDamageTiles);
+	free(mDamageHashes);
+	sys_destroy_mutex(mDamageMutex);
+}
+
+/*
+ *	Intern.
+ *	Called when the mode has changed, everything is damaged then.
+ */
+void SystemDisplay::damageResize()
+{
+	mDamageChar = mClientChar;
+	mDamageCols = (mClientChar.width + DAMAGE_TILE_WIDTH - 1) / DAMAGE_TILE_WIDTH;
+	mDamageRows = (mClientChar.height + DAMAGE_TILE_HEIGHT - 1) / DAMAGE_TILE_HEIGHT;
+	free(mDamageTiles);
+	free(mDamageHashes);
+	mDamageTiles = (byte*)malloc(mDamageCols * mDamageRows);
+	mDamageHashes = (uint64*)malloc(mDamageCols * mDamageRows * sizeof (uint64));
+	memset(mDamageTiles, 1, mDamageCols * mDamageRows);
+	mDamageHashesValid = false;
+}
+
+/*
+ *	Intern.
+ *	Moves the damaged blocks to the tiles. The bits are cleared
+ *	atomically, so writes while we're presenting aren't lost.
+ */
+void SystemDisplay::damageCollectBlocks()
+{
+	int bpp = mDamageChar.bytesPerPixel;
+	int scanLineLength = mDamageChar.scanLineLength;
+	uint size = scanLineLength * mDamageChar.height;
+	uint words = (size + DAMAGE_BLOCK_SIZE*32 - 1) / (DAMAGE_BLOCK_SIZE*32);
+	if (words > DAMAGE_BLOCK_WORDS) words = DAMAGE_BLOCK_WORDS;
+	for (uint i=0; i < words; i++) {
+		if (!gDamageBlocks[i]) continue;
+		uint32 bits = __sync_fetch_and_and(&gDamageBlocks[i], 0);
+		for (uint b=0; bits; b++, bits >>= 1) {
+			if (!(bits & 1)) continue;
+			uint first = (i*32 + b) << DAMAGE_BLOCK_SHIFT;
+			uint last = first + DAMAGE_BLOCK_SIZE - 1;
+			if (first >= size) break;
+			if (last >= size) last = size - 1;
+			int firstLine = first / scanLineLength;
+			int lastLine = last / scanLineLength;
+			for (int y = firstLine; y <= lastLine; y++) {
+				int x0 = (y == firstLine) ? (first % scanLineLength) / bpp : 0;
+				int x1 = (y == lastLine) ? (last % scanLineLength) / bpp : mDamageChar.width - 1;
+				// the end of a scanline may be padding
+				if (x1 >= mDamageChar.width) x1 = mDamageChar.width - 1;
+				if (x0 > x1) continue;
+				byte *row = mDamageTiles + (y / DAMAGE_TILE_HEIGHT) * mDamageCols;
+				for (int c = x0 / DAMAGE_TILE_WIDTH; c <= x1 / DAMAGE_TILE_WIDTH; c++) {
+					row[c] = 1;
+				}
+			}
+		}
+	}
+}
+
+/*
+ *	Intern.
+ *	For writers which don't mark their damage: compares a
+ *	hash of every tile with the one last presented.
+ */
+void SystemDisplay::damageDetectChanges()
+{
+	int bpp = mDamageChar.bytesPerPixel;
+	int scanLineLength = mDamageChar.scanLineLength;
+	for (int r=0; r < mDamageRows; r++) {
+		int y0 = r * DAMAGE_TILE_HEIGHT;
+		int h = MIN(DAMAGE_TILE_HEIGHT, mDamageChar.height - y0);
+		for (int c=0; c < mDamageCols; c++) {
+			int x0 = c * DAMAGE_TILE_WIDTH;
+			int bytes = MIN(DAMAGE_TILE_WIDTH, mDamageChar.width - x0) * bpp;
+			const byte *p = gFrameBuffer + y0 * scanLineLength + x0 * bpp;
+			// FNV-1a on 64 bit words
+			uint64 hash = 0xcbf29ce484222325ULL;
+			for (int y=0; y < h; y++) {
+				int i = 0;
+				for (; i+8 <= bytes; i += 8) {
+					uint64 v;
+					memcpy(&v, p+i, 8);
+					hash = (hash ^ v) * 0x100000001b3ULL;
+				}
+				for (; i < bytes; i++) {
+					hash = (hash ^ p[i]) * 0x100000001b3ULL;
+				}
+				p += scanLineLength;
+			}
+			int t = r * mDamageCols + c;
+			if (!mDamageHashesValid || mDamageHashes[t] != hash) {
+				mDamageHashes[t] = hash;
+				mDamageTiles[t] = 1;
+			}
+		}
+	}
+	mDamageHashesValid = true;
+}
+
+/*
+ *	Returns the damaged parts of the framebuffer (since the last call)
+ *	as at most maxRects rectangles, sorted by y. Adjacent damaged
+ *	tiles are merged. If there would be more rectangles, their
+ *	bounding box is returned instead.
+ */
+int SystemDisplay::getDamage(DamageRect *rects, int maxRects)
+{
+	sys_lock_mutex(mDamageMutex);
+	if (!mDamageTiles || mDamageChar.compareTo(&mClientChar) != 0) {
+		damageResize();
+	}
+	damageCollectBlocks();
+	if (mChangeDetection) damageDetectChanges();
+
+	int count = 0;
+	bool overflow = false;
+	int bx0 = mDamageCols, by0 = mDamageRows, bx1 = -1, by1 = -1;
+	for (int r=0; r < mDamageRows; r++) {
+		byte *row = mDamageTiles + r * mDamageCols;
+		int c = 0;
+		while (c < mDamageCols) {
+			if (!row[c]) {
+				c++;
+				continue;
+			}
+			int c0 = c;
+			while (c < mDamageCols && row[c]) row[c++] = 0;
+			bx0 = MIN(bx0, c0);
+			bx1 = MAX(bx1, c-1);
+			by0 = MIN(by0, r);
+			by1 = r;
+			if (overflow) continue;
+			// continue a rectangle of the row above with the same columns
+			int i;
+			for (i=0; i < count; i++) {
+				if (rects[i].x == c0 && rects[i].w == c-c0
+				 && rects[i].y + rects[i].h == r) break;
+			}
+			if (i < count) {
+				rects[i].h++;
+			} else if (count < maxRects) {
+				rects[count].x = c0;
+				rects[count].y = r;
+				rects[count].w = c-c0;
+				rects[count].h = 1;
+				count++;
+			} else {
+				overflow = true;
+			}
+		}
+	}
+	if (overflow) {
+		rects[0].x = bx0;
+		rects[0].y = by0;
+		rects[0].w = bx1-bx0+1;
+		rects[0].h = by1-by0+1;
+		count = 1;
+	}
+	// tiles to pixels
+	for (int i=0; i < count; i++) {
+		rects[i].x *= DAMAGE_TILE_WIDTH;
+		rects[i].y *= DAMAGE_TILE_HEIGHT;
+		rects[i].w = MIN(rects[i].w * DAMAGE_TILE_WIDTH, mDamageChar.width - rects[i].x);
+		rects[i].h = MIN(rects[i].h * DAMAGE_TILE_HEIGHT, mDamageChar.height - rects[i].y);
+	}
+	sys_unlock_mutex(mDamageMutex);
+	return count;
+}
+
+/*
+ *	For displays which can only present whole lines.
+ *	Returns false if nothing is damaged.
+ */
+bool SystemDisplay::getDamagedLines(int &firstLine, int &lastLine)
+{
+	DamageRect rects[DAMAGE_MAX_RECTS];
+	int count = getDamage(rects, DAMAGE_MAX_RECTS);
+	if (!count) return false;
+	firstLine = rects[0].y;
+	lastLine = 0;
+	for (int i=0; i < count; i++) {
+		lastLine = MAX(lastLine, rects[i].y + rects[i].h - 1);
+	}
+	return true;
+}
+
+/*
+ *	Converts the lines covered by rects (as returned by getDamage)
+ *	from gFrameBuffer to aHostBuf. Every line is converted once.
+ */
+void SystemDisplay::convertDamage(const DisplayCharacteristics &aHostChar, void *aHostBuf, const DamageRect *rects, int count)
+{
+	int done = -1;
+	for (int i=0; i < count; i++) {
+		int first = MAX(rects[i].y, done+1);
+		int last = rects[i].y + rects[i].h - 1;
+		if (first <= last) {
+			sys_convert_display(mClientChar, aHostChar, gFrameBuffer, aHostBuf, first, last);
+			done = last;
+		}
+	}
+}
+
+/*
+ *	Enables comparing the tiles with the ones last presented,
+ *	see damageDetectChanges
+ */
+void SystemDisplay::setChangeDetection(bool enable)
+{
+	mChangeDetection = enable;
+	mDamageHashesValid = false;
 }
 
 bool SystemDisplay::openVT(int width, int height, int dx, int dy, File &font)
@@ -21,10 +21,13 @@
 #ifndef __SYSTEM_DISPLAY_H__
 #define __SYSTEM_DISPLAY_H__
 
+#include <cstring>
+
 #include "tools/data.h"
 #include "tools/stream.h"
 #include "types.h"
 #include "keyboard.h"
+#include "systhread.h"
 
 /* codepages */
 
@@ -37,33 +40,59 @@
 #define	GC_TRANSPARENT		'0'		// transparent
 
 extern byte *	gFrameBuffer;
-extern int 	gDamageAreaFirstAddr, gDamageAreaLastAddr;
 
-extern "C" void damageFrameBufferExt(int addr);
+/*
+ *	Damage tracking
+ *
+ *	Writers mark the framebuffer in blocks of DAMAGE_BLOCK_SIZE bytes,
+ *	which doesn't depend on the display mode (and is cheap enough for
+ *	every store). The display folds the blocks into tiles of
+ *	DAMAGE_TILE_WIDTH x DAMAGE_TILE_HEIGHT pixels and presents
+ *	the damaged tiles as rectangles, see SystemDisplay::getDamage.
+ *	Accesses are assumed not to cross a block (aligned ones don't).
+ */
+#define DAMAGE_BLOCK_SHIFT	8
+#define DAMAGE_BLOCK_SIZE	(1 << DAMAGE_BLOCK_SHIFT)
+#define DAMAGE_MAX_FRAMEBUFFER	(16*1024*1024)
+#define DAMAGE_BLOCK_WORDS	(DAMAGE_MAX_FRAMEBUFFER / DAMAGE_BLOCK_SIZE / 32)
+
+#define DAMAGE_TILE_WIDTH	64
+#define DAMAGE_TILE_HEIGHT	16
+
+extern uint32	gDamageBlocks[DAMAGE_BLOCK_WORDS];
 
 inline void damageFrameBuffer(int addr)
 {
-	if (addr < gDamageAreaFirstAddr) {
-		gDamageAreaFirstAddr = addr;
-	}
-
-	if (addr > gDamageAreaLastAddr) {
-		gDamageAreaLastAddr = addr;
+	uint block = uint(addr) >> DAMAGE_BLOCK_SHIFT;
+	if (block >= DAMAGE_BLOCK_WORDS * 32) return;
+	uint32 bit = 1 << (block & 31);
+	// the display clears the bits concurrently
+	if (!(gDamageBlocks[block >> 5] & bit)) {
+		__sync_fetch_and_or(&gDamageBlocks[block >> 5], bit);
 	}
 }
 
+/*
+ *	first and last are framebuffer offsets (inclusive)
+ */
+void damageFrameBufferRange(int first, int last);
+
 inline void damageFrameBufferAll()
 {
-	gDamageAreaFirstAddr = 0;
-	gDamageAreaLastAddr = 0xffffff0;
+	memset(gDamageBlocks, 0xff, sizeof gDamageBlocks);
 }
 
 inline void healFrameBuffer()
 {
-	gDamageAreaFirstAddr = 0xffffff0;
-	gDamageAreaLastAddr = 0;
+	memset(gDamageBlocks, 0, sizeof gDamageBlocks);
 }
 
+struct DamageRect {
+	int x, y, w, h;
+};
+
+#define DAMAGE_MAX_RECTS	64
+
 /* virtual colors */
 
 typedef int vc;
@@ -189,6 +218,18 @@ protected:
 	int		mHWCursorVisible;
 	byte *		mHWCursorData;
 
+	/* damage tracking, see getDamage() */
+	DisplayCharacteristics	mDamageChar;	// mode the tiles belong to
+	int		mDamageCols, mDamageRows;
+	byte *		mDamageTiles;		// dirty tiles
+	uint64 *	mDamageHashes;		// of the tiles as last presented
+	bool		mDamageHashesValid;
+	bool		mChangeDetection;
+	sys_mutex	mDamageMutex;		// getDamage may be called by the CPU (setHWCursor)
+
+		void	damageResize();
+		void	damageCollectBlocks();
+		void	damageDetectChanges();
 public: // until we know better
 	/* menu */
 	int		mMenuX, mMenuHeight;
@@ -221,6 +262,12 @@ public:
 
 	virtual void	displayShow() = 0;
 
+	/* damage tracking */
+		int	getDamage(DamageRect *rects, int maxRects);
+		bool	getDamagedLines(int &firstLine, int &lastLine);
+		void	convertDamage(const DisplayCharacteristics &aHostChar, void *aHostBuf, const DamageRect *rects, int count);
+		void	setChangeDetection(bool enable);
+
 	/*
 	 *	Note: this function might do different things when in / not in fullscreen
 	 *	mode.
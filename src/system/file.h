@@ -132,6 +132,14 @@ typedef bool (*is_path_delim)(char c);
 
 #define	SYS_FILE void
 
+/*
+ *	one segment of a scatter/gather list for sys_freadv/sys_fwritev
+ */
+struct sys_iovec {
+	void	*base;
+	uint	size;
+};
+
 
 /* system-independent (implementation in sys.cc) */
 int		sys_basename(char *result, const char *filename);
@@ -163,6 +171,14 @@ int		sys_fwrite(SYS_FILE *file, byte *buf, int size);
 int		sys_fseek(SYS_FILE *file, FileOfs newofs, int seekmode = SYS_SEEK_SET);
 FileOfs		sys_ftell(SYS_FILE *file);
 void		sys_flush(SYS_FILE *file);
+/*
+ *	positional scatter/gather I/O, safe to call from any thread.
+ *	These don't use (or move) the stream position, so don't mix
+ *	them with sys_fread/sys_fwrite on the same file.
+ *	Return the number of bytes transferred or -1 on error.
+ */
+int		sys_freadv(SYS_FILE *file, FileOfs ofs, const sys_iovec *iov, int count);
+int		sys_fwritev(SYS_FILE *file, FileOfs ofs, const sys_iovec *iov, int count);
 //int		sys_geterror();
 
 #endif /* __FILE_H__ */
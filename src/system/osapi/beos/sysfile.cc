@@ -284,6 +284,34 @@ void sys_flush(SYS_FILE *file)
 	fflush((FILE *)file);
 }
 
+static int sys_frwv(SYS_FILE *file, FileOfs ofs, const sys_iovec *iov, int count, bool write)
+{
+	int fd = fileno((FILE *)file);
+	int done = 0;
+	for (int i = 0; i < count; i++) {
+		ssize_t r;
+		if (write) {
+			r = write_pos(fd, ofs + done, iov[i].base, iov[i].size);
+		} else {
+			r = read_pos(fd, ofs + done, iov[i].base, iov[i].size);
+		}
+		if (r < 0) return done ? done : -1;
+		done += r;
+		if ((uint)r != iov[i].size) break;
+	}
+	return done;
+}
+
+int sys_freadv(SYS_FILE *file, FileOfs ofs, const sys_iovec *iov, int count)
+{
+	return sys_frwv(file, ofs, iov, count, false);
+}
+
+int sys_fwritev(SYS_FILE *file, FileOfs ofs, const sys_iovec *iov, int count)
+{
+	return sys_frwv(file, ofs, iov, count, true);
+}
+
 FileOfs	sys_ftell(SYS_FILE *file)
 {
 	fpos_t pos;
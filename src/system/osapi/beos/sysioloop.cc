@@ -0,0 +1,75 @@
+/*
+ *	PearPC
+ *	sysioloop.cc
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "system/sysioloop.h"
+
+/*
+ *	No I/O loop here, devices keep their own threads
+ */
+bool sys_ioloop_init()
+{
+	return false;
+}
+
+void sys_ioloop_done()
+{
+}
+
+bool sys_ioloop_available()
+{
+	return false;
+}
+
+bool sys_ioloop_add_fd(int fd, sys_ioloop_fd_handler handler, void *context)
+{
+	return false;
+}
+
+void sys_ioloop_enable_fd(int fd, bool enable)
+{
+}
+
+void sys_ioloop_remove_fd(int fd)
+{
+}
+
+sys_ioloop_timer sys_ioloop_create_timer(sys_ioloop_timer_handler handler, void *context)
+{
+	return NULL;
+}
+
+void sys_ioloop_delete_timer(sys_ioloop_timer t)
+{
+}
+
+void sys_ioloop_set_timer(sys_ioloop_timer t, uint msecs)
+{
+}
+
+void sys_ioloop_set_timer_ns(sys_ioloop_timer t, uint64 nsecs)
+{
+}
+
+void sys_ioloop_cancel_timer(sys_ioloop_timer t)
+{
+}
+
+void sys_ioloop_get_stats(sys_ioloop_stats &stats)
+{
+	stats.wakeups = stats.timers = stats.nsecs = 0;
+}
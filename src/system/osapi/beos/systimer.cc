@@ -132,6 +132,11 @@ uint64 sys_get_timer_resolution(sys_timer t)
 	return 3*1000; // [ns] something like that.
 }
 
+bool sys_timer_callback_is_threaded(sys_timer t)
+{
+	return false;
+}
+
 uint64 sys_get_hiresclk_ticks()
 {
 	// so simple :p
@@ -32,6 +32,8 @@
 #include <cstdlib>
 #include <cstring>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <sys/select.h>
 
@@ -63,6 +65,9 @@ static int setenv(const char *name, const char *value, int overwrite)
 }
 #endif
 
+// maximum number of buffers per frame for readv()/writev()
+#define MAX_ETHTUN_IOV	64
+
 /**
  *	Unix ethernet tunnel devices should work using a file descriptor
  */
@@ -105,13 +110,81 @@ virtual	int waitRecvPacket()
 	return 0;
 }
 
+virtual	int getRecvFD()
+{
+	return mFD;
+}
+
+/*
+ *	The descriptor is non-blocking (so that recvPackets() can drain
+ *	it), a full transmit queue is waited for here.
+ */
 virtual	uint sendPacket(void *buf, uint size)
 {
-	ssize_t e = ::write(mFD, buf, size);
+	while (1) {
+		ssize_t e = ::write(mFD, buf, size);
+		if (e >= 0) return e;
+		if (errno == EINTR) continue;
+		if (errno != EAGAIN) return 0;
+		struct pollfd p;
+		p.fd = mFD;
+		p.events = POLLOUT;
+		::poll(&p, 1, -1);
+	}
+}
+
+/*
+ *	Frames are scattered/gathered with one readv()/writev()
+ *	straight from/to the callers buffers (usually guest memory).
+ */
+virtual	uint recvPacketv(const PacketBuf *frags, uint count)
+{
+	struct iovec iov[MAX_ETHTUN_IOV];
+	if (count > MAX_ETHTUN_IOV) return EthTunDevice::recvPacketv(frags, count);
+	for (uint i = 0; i < count; i++) {
+		iov[i].iov_base = frags[i].buf;
+		iov[i].iov_len = frags[i].size;
+	}
+	ssize_t e = ::readv(mFD, iov, count);
 	if (e < 0) return 0;
 	return e;
 }
 
+virtual	uint sendPacketv(const PacketBuf *frags, uint count)
+{
+	struct iovec iov[MAX_ETHTUN_IOV];
+	if (count > MAX_ETHTUN_IOV) return EthTunDevice::sendPacketv(frags, count);
+	for (uint i = 0; i < count; i++) {
+		iov[i].iov_base = frags[i].buf;
+		iov[i].iov_len = frags[i].size;
+	}
+	while (1) {
+		ssize_t e = ::writev(mFD, iov, count);
+		if (e >= 0) return e;
+		if (errno == EINTR) continue;
+		if (errno != EAGAIN) return 0;
+		struct pollfd p;
+		p.fd = mFD;
+		p.events = POLLOUT;
+		::poll(&p, 1, -1);
+	}
+}
+
+/*
+ *	Tunnel devices deliver one frame per read(), so a batch is
+ *	read by draining the descriptor until it would block.
+ */
+virtual	uint recvPackets(PacketBuf *pkts, uint count)
+{
+	uint n = 0;
+	while (n < count) {
+		ssize_t e = ::read(mFD, pkts[n].buf, pkts[n].size);
+		if (e <= 0) break;
+		pkts[n++].size = e;
+	}
+	return n;
+}
+
 virtual const char *devicePath()
 {
 	return NULL;
@@ -243,6 +316,9 @@ int initDevice()
 	/* don't checksum */
 	::ioctl(mFD, TUNSETNOCSUM, 1);
 
+	/* see UnixEthTunDevice::recvPackets() */
+	::fcntl(mFD, F_SETFL, ::fcntl(mFD, F_GETFL) | O_NONBLOCK);
+
 	/* Configure device */
 	if (execIFConfigScript("up", mIfName.contentChar())) {
 		::close(mFD);
@@ -18,6 +18,10 @@
  *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <cerrno>
 #include <fcntl.h>
 #include <cstdio>
@@ -29,11 +33,15 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 
 #include <limits.h>    /* for PAGESIZE */
 #ifndef PAGESIZE
 #define PAGESIZE 4096
 #endif
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
 
 #include "system/file.h"
 
@@ -269,3 +277,66 @@ FileOfs	sys_ftell(SYS_FILE *file)
 	return ftello((FILE *)file);
 }
 
+/*
+ *	advance the iovec array by done bytes, returns the new count
+ */
+static int sys_iovec_advance(struct iovec *&v, int count, size_t done)
+{
+	while (count && done >= v->iov_len) {
+		done -= v->iov_len;
+		v++;
+		count--;
+	}
+	if (count) {
+		v->iov_base = (char *)v->iov_base + done;
+		v->iov_len -= done;
+	}
+	return count;
+}
+
+static int sys_frwv(SYS_FILE *file, FileOfs ofs, const sys_iovec *iov, int count, bool write)
+{
+	int fd = fileno((FILE *)file);
+	struct iovec vec[count];
+	struct iovec *v = vec;
+	for (int i = 0; i < count; i++) {
+		vec[i].iov_base = iov[i].base;
+		vec[i].iov_len = iov[i].size;
+	}
+	size_t done = 0;
+	while (count) {
+		ssize_t r;
+#if defined(HAVE_PREADV) && defined(HAVE_PWRITEV)
+		int n = count < IOV_MAX ? count : IOV_MAX;
+		if (write) {
+			r = pwritev(fd, v, n, ofs + done);
+		} else {
+			r = preadv(fd, v, n, ofs + done);
+		}
+#else
+		if (write) {
+			r = pwrite(fd, v->iov_base, v->iov_len, ofs + done);
+		} else {
+			r = pread(fd, v->iov_base, v->iov_len, ofs + done);
+		}
+#endif
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (!r) break;
+		done += r;
+		count = sys_iovec_advance(v, count, r);
+	}
+	return done;
+}
+
+int sys_freadv(SYS_FILE *file, FileOfs ofs, const sys_iovec *iov, int count)
+{
+	return sys_frwv(file, ofs, iov, count, false);
+}
+
+int sys_fwritev(SYS_FILE *file, FileOfs ofs, const sys_iovec *iov, int count)
+{
+	return sys_frwv(file, ofs, iov, count, true);
+}
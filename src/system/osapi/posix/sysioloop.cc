@@ -0,0 +1,531 @@
+/*
+ *	PearPC
+ *	sysioloop.cc
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+#include "config.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+
+#include "system/sysioloop.h"
+#include "system/systhread.h"
+#include "tools/snprintf.h"
+
+#define MAX_IOLOOP_FDS		32
+// pseudo slots for the wake pipe and the timerfd
+#define IOLOOP_WAKE_SLOT	MAX_IOLOOP_FDS
+#define IOLOOP_TIMER_SLOT	(MAX_IOLOOP_FDS+1)
+#define IOLOOP_UNARMED		((uint)-1)
+
+struct IOLoopFD {
+	int			fd;	// -1 = free slot
+	bool			enabled;
+	sys_ioloop_fd_handler	handler;
+	void			*context;
+};
+
+struct IOLoopTimer {
+	uint			index;	// in gIOLoopHeap or IOLOOP_UNARMED
+	uint64			expires;	// ns, see ioloop_now()
+	sys_ioloop_timer_handler handler;
+	void			*context;
+};
+
+static bool		gIOLoopAvailable = false;
+static volatile bool	gIOLoopQuit;
+static sys_thread	gIOLoopThread;
+static sys_mutex	gIOLoopMutex;
+static int		gIOLoopWakeFD[2];
+static IOLoopFD		gIOLoopFDs[MAX_IOLOOP_FDS];
+/*
+ *	Armed timers as a binary min-heap on expires, so the next
+ *	expiry is always known exactly and (re-)arming is O(log n).
+ */
+static IOLoopTimer	**gIOLoopHeap;
+static uint		gIOLoopHeapSize;
+static uint		gIOLoopHeapAlloc;
+#ifdef HAVE_SYS_EPOLL_H
+static int		gIOLoopEpollFD;
+#endif
+#ifdef HAVE_SYS_TIMERFD_H
+// sleeps until the next expiry with ns resolution, -1 if unavailable
+static int		gIOLoopTimerFD;
+// expiry the timerfd is currently armed for, 0 = disarmed
+static uint64		gIOLoopTimerFDExpires;
+#endif
+static uint64		gIOLoopStart;
+static uint64		gIOLoopWakeups;
+static uint64		gIOLoopTimersRun;
+
+static uint64 ioloop_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ *	Makes the loop thread re-evaluate its descriptors and timers
+ */
+static void ioloop_wake()
+{
+	char c = 0;
+	while (::write(gIOLoopWakeFD[1], &c, 1) < 0 && errno == EINTR);
+}
+
+static void ioloop_drain_wake()
+{
+	char buf[64];
+	while (::read(gIOLoopWakeFD[0], buf, sizeof buf) > 0);
+}
+
+static int ioloop_find_fd(int fd)
+{
+	for (int i = 0; i < MAX_IOLOOP_FDS; i++) {
+		if (gIOLoopFDs[i].fd == fd) return i;
+	}
+	return -1;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/*
+ *	Disabled descriptors are removed from the epoll set, otherwise
+ *	EPOLLHUP/EPOLLERR would still be reported for them.
+ */
+static void ioloop_watch(int slot, bool watch)
+{
+	if (watch) {
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u32 = slot;
+		epoll_ctl(gIOLoopEpollFD, EPOLL_CTL_ADD, gIOLoopFDs[slot].fd, &ev);
+	} else {
+		struct epoll_event ev;
+		epoll_ctl(gIOLoopEpollFD, EPOLL_CTL_DEL, gIOLoopFDs[slot].fd, &ev);
+	}
+}
+
+#else
+
+static void ioloop_watch(int slot, bool watch)
+{
+	// the poll set is rebuilt before each wait
+	ioloop_wake();
+}
+
+#endif
+
+static void ioloop_heap_place(IOLoopTimer *t, uint i)
+{
+	gIOLoopHeap[i] = t;
+	t->index = i;
+}
+
+static void ioloop_heap_up(uint i)
+{
+	IOLoopTimer *t = gIOLoopHeap[i];
+	while (i) {
+		uint parent = (i-1) / 2;
+		if (gIOLoopHeap[parent]->expires <= t->expires) break;
+		ioloop_heap_place(gIOLoopHeap[parent], i);
+		i = parent;
+	}
+	ioloop_heap_place(t, i);
+}
+
+static void ioloop_heap_down(uint i)
+{
+	IOLoopTimer *t = gIOLoopHeap[i];
+	while (true) {
+		uint child = 2*i + 1;
+		if (child >= gIOLoopHeapSize) break;
+		if (child+1 < gIOLoopHeapSize
+		 && gIOLoopHeap[child+1]->expires < gIOLoopHeap[child]->expires) child++;
+		if (t->expires <= gIOLoopHeap[child]->expires) break;
+		ioloop_heap_place(gIOLoopHeap[child], i);
+		i = child;
+	}
+	ioloop_heap_place(t, i);
+}
+
+static void ioloop_heap_remove(IOLoopTimer *t)
+{
+	uint i = t->index;
+	t->index = IOLOOP_UNARMED;
+	IOLoopTimer *last = gIOLoopHeap[--gIOLoopHeapSize];
+	if (last == t) return;
+	ioloop_heap_place(last, i);
+	ioloop_heap_up(i);
+	ioloop_heap_down(last->index);
+}
+
+/*
+ *	Runs all expired timers, returns the expiry of the next one
+ *	(or 0)
+ */
+static uint64 ioloop_run_timers()
+{
+	sys_lock_mutex(gIOLoopMutex);
+	while (gIOLoopHeapSize) {
+		IOLoopTimer *t = gIOLoopHeap[0];
+		if (t->expires > ioloop_now()) {
+			uint64 expires = t->expires;
+			sys_unlock_mutex(gIOLoopMutex);
+			return expires;
+		}
+		ioloop_heap_remove(t);
+		sys_ioloop_timer_handler handler = t->handler;
+		void *context = t->context;
+		gIOLoopTimersRun++;
+		sys_unlock_mutex(gIOLoopMutex);
+		handler(t, context);
+		sys_lock_mutex(gIOLoopMutex);
+	}
+	sys_unlock_mutex(gIOLoopMutex);
+	return 0;
+}
+
+static void ioloop_dispatch(int slot)
+{
+	sys_lock_mutex(gIOLoopMutex);
+	IOLoopFD e = gIOLoopFDs[slot];
+	sys_unlock_mutex(gIOLoopMutex);
+	// the descriptor may have been disabled since the wait returned
+	if (e.fd >= 0 && e.enabled) e.handler(e.fd, e.context);
+}
+
+#ifdef HAVE_SYS_TIMERFD_H
+static void ioloop_ack_timerfd()
+{
+	uint64 expirations;
+	while (::read(gIOLoopTimerFD, &expirations, sizeof expirations) < 0 && errno == EINTR);
+	gIOLoopTimerFDExpires = 0;
+}
+#endif
+
+/*
+ *	Returns the poll timeout for sleeping until expires (0 = none).
+ *	With a timerfd the sleep itself is unbounded and the timerfd
+ *	becomes readable at expires, otherwise it is rounded up to
+ *	whole milliseconds.
+ */
+static int ioloop_timeout(uint64 expires)
+{
+#ifdef HAVE_SYS_TIMERFD_H
+	if (gIOLoopTimerFD >= 0) {
+		if (expires != gIOLoopTimerFDExpires) {
+			struct itimerspec its;
+			its.it_interval.tv_sec = 0;
+			its.it_interval.tv_nsec = 0;
+			its.it_value.tv_sec = expires / 1000000000ULL;
+			its.it_value.tv_nsec = expires % 1000000000ULL;
+			if (timerfd_settime(gIOLoopTimerFD, TFD_TIMER_ABSTIME, &its, NULL) == 0) {
+				gIOLoopTimerFDExpires = expires;
+			} else {
+				gIOLoopTimerFDExpires = 0;
+				if (expires) return 1;
+			}
+		}
+		return -1;
+	}
+#endif
+	if (!expires) return -1;
+	uint64 now = ioloop_now();
+	if (expires <= now) return 0;
+	return MIN((expires - now + 999999) / 1000000, 0x7fffffffULL);
+}
+
+static void ioloop_wait(uint64 expires)
+{
+	int timeout = ioloop_timeout(expires);
+#ifdef HAVE_SYS_EPOLL_H
+	struct epoll_event ev[MAX_IOLOOP_FDS+2];
+	int n = epoll_wait(gIOLoopEpollFD, ev, MAX_IOLOOP_FDS+2, timeout);
+	gIOLoopWakeups++;
+	for (int i = 0; i < n; i++) {
+		switch (ev[i].data.u32) {
+		case IOLOOP_WAKE_SLOT:
+			ioloop_drain_wake();
+			break;
+#ifdef HAVE_SYS_TIMERFD_H
+		case IOLOOP_TIMER_SLOT:
+			ioloop_ack_timerfd();
+			break;
+#endif
+		default:
+			ioloop_dispatch(ev[i].data.u32);
+		}
+	}
+#else
+	struct pollfd p[MAX_IOLOOP_FDS+2];
+	int slot[MAX_IOLOOP_FDS+2];
+	int n = 0;
+	p[n].fd = gIOLoopWakeFD[0];
+	p[n].events = POLLIN;
+	slot[n++] = IOLOOP_WAKE_SLOT;
+#ifdef HAVE_SYS_TIMERFD_H
+	if (gIOLoopTimerFD >= 0) {
+		p[n].fd = gIOLoopTimerFD;
+		p[n].events = POLLIN;
+		slot[n++] = IOLOOP_TIMER_SLOT;
+	}
+#endif
+	sys_lock_mutex(gIOLoopMutex);
+	for (int i = 0; i < MAX_IOLOOP_FDS; i++) {
+		if (gIOLoopFDs[i].fd < 0 || !gIOLoopFDs[i].enabled) continue;
+		p[n].fd = gIOLoopFDs[i].fd;
+		p[n].events = POLLIN;
+		slot[n++] = i;
+	}
+	sys_unlock_mutex(gIOLoopMutex);
+	int r = poll(p, n, timeout);
+	gIOLoopWakeups++;
+	if (r <= 0) return;
+	for (int i = 0; i < n; i++) {
+		if (!p[i].revents) continue;
+		switch (slot[i]) {
+		case IOLOOP_WAKE_SLOT:
+			ioloop_drain_wake();
+			break;
+#ifdef HAVE_SYS_TIMERFD_H
+		case IOLOOP_TIMER_SLOT:
+			ioloop_ack_timerfd();
+			break;
+#endif
+		default:
+			ioloop_dispatch(slot[i]);
+		}
+	}
+#endif
+}
+
+static void *ioloop_thread(void *arg)
+{
+	while (!gIOLoopQuit) {
+		uint64 expires = ioloop_run_timers();
+		if (gIOLoopQuit) break;
+		ioloop_wait(expires);
+	}
+	return NULL;
+}
+
+bool sys_ioloop_init()
+{
+	if (gIOLoopAvailable) return true;
+	for (int i = 0; i < MAX_IOLOOP_FDS; i++) gIOLoopFDs[i].fd = -1;
+	gIOLoopHeap = NULL;
+	gIOLoopHeapSize = 0;
+	gIOLoopHeapAlloc = 0;
+	gIOLoopQuit = false;
+	gIOLoopStart = ioloop_now();
+	gIOLoopWakeups = 0;
+	gIOLoopTimersRun = 0;
+	if (pipe(gIOLoopWakeFD)) return false;
+	for (int i = 0; i < 2; i++) {
+		fcntl(gIOLoopWakeFD[i], F_SETFL, fcntl(gIOLoopWakeFD[i], F_GETFL) | O_NONBLOCK);
+	}
+#ifdef HAVE_SYS_TIMERFD_H
+	// without a timerfd we fall back to millisecond poll timeouts
+	gIOLoopTimerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	gIOLoopTimerFDExpires = 0;
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+	if ((gIOLoopEpollFD = epoll_create(MAX_IOLOOP_FDS+2)) < 0) goto err_pipe;
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u32 = IOLOOP_WAKE_SLOT;
+	if (epoll_ctl(gIOLoopEpollFD, EPOLL_CTL_ADD, gIOLoopWakeFD[0], &ev)) goto err_epoll;
+#ifdef HAVE_SYS_TIMERFD_H
+	ev.data.u32 = IOLOOP_TIMER_SLOT;
+	if (gIOLoopTimerFD >= 0
+	 && epoll_ctl(gIOLoopEpollFD, EPOLL_CTL_ADD, gIOLoopTimerFD, &ev)) {
+		close(gIOLoopTimerFD);
+		gIOLoopTimerFD = -1;
+	}
+#endif
+#endif
+	if (sys_create_mutex(&gIOLoopMutex)) goto err_epoll;
+	if (sys_create_thread(&gIOLoopThread, 0, ioloop_thread, NULL)) {
+		sys_destroy_mutex(gIOLoopMutex);
+		goto err_epoll;
+	}
+	gIOLoopAvailable = true;
+	return true;
+
+err_epoll:
+#ifdef HAVE_SYS_EPOLL_H
+	close(gIOLoopEpollFD);
+err_pipe:
+#endif
+#ifdef HAVE_SYS_TIMERFD_H
+	if (gIOLoopTimerFD >= 0) close(gIOLoopTimerFD);
+#endif
+	close(gIOLoopWakeFD[0]);
+	close(gIOLoopWakeFD[1]);
+	return false;
+}
+
+void sys_ioloop_done()
+{
+	if (!gIOLoopAvailable) return;
+	gIOLoopQuit = true;
+	ioloop_wake();
+	sys_join_thread(gIOLoopThread);
+	gIOLoopAvailable = false;
+#ifdef HAVE_SYS_EPOLL_H
+	close(gIOLoopEpollFD);
+#endif
+#ifdef HAVE_SYS_TIMERFD_H
+	if (gIOLoopTimerFD >= 0) close(gIOLoopTimerFD);
+#endif
+	close(gIOLoopWakeFD[0]);
+	close(gIOLoopWakeFD[1]);
+	sys_destroy_mutex(gIOLoopMutex);
+	free(gIOLoopHeap);
+	gIOLoopHeap = NULL;
+	gIOLoopHeapSize = gIOLoopHeapAlloc = 0;
+}
+
+bool sys_ioloop_available()
+{
+	return gIOLoopAvailable;
+}
+
+bool sys_ioloop_add_fd(int fd, sys_ioloop_fd_handler handler, void *context)
+{
+	if (!gIOLoopAvailable || fd < 0) return false;
+	sys_lock_mutex(gIOLoopMutex);
+	int slot = ioloop_find_fd(-1);
+	if (slot < 0 || ioloop_find_fd(fd) >= 0) {
+		sys_unlock_mutex(gIOLoopMutex);
+		return false;
+	}
+	gIOLoopFDs[slot].fd = fd;
+	gIOLoopFDs[slot].enabled = true;
+	gIOLoopFDs[slot].handler = handler;
+	gIOLoopFDs[slot].context = context;
+	ioloop_watch(slot, true);
+	sys_unlock_mutex(gIOLoopMutex);
+	return true;
+}
+
+void sys_ioloop_enable_fd(int fd, bool enable)
+{
+	if (!gIOLoopAvailable) return;
+	sys_lock_mutex(gIOLoopMutex);
+	int slot = ioloop_find_fd(fd);
+	if (slot >= 0 && gIOLoopFDs[slot].enabled != enable) {
+		gIOLoopFDs[slot].enabled = enable;
+		ioloop_watch(slot, enable);
+	}
+	sys_unlock_mutex(gIOLoopMutex);
+}
+
+void sys_ioloop_remove_fd(int fd)
+{
+	if (!gIOLoopAvailable) return;
+	sys_lock_mutex(gIOLoopMutex);
+	int slot = ioloop_find_fd(fd);
+	if (slot >= 0) {
+		if (gIOLoopFDs[slot].enabled) ioloop_watch(slot, false);
+		gIOLoopFDs[slot].fd = -1;
+	}
+	sys_unlock_mutex(gIOLoopMutex);
+}
+
+sys_ioloop_timer sys_ioloop_create_timer(sys_ioloop_timer_handler handler, void *context)
+{
+	if (!gIOLoopAvailable) return NULL;
+	IOLoopTimer *t = new IOLoopTimer;
+	t->index = IOLOOP_UNARMED;
+	t->expires = 0;
+	t->handler = handler;
+	t->context = context;
+	return t;
+}
+
+void sys_ioloop_delete_timer(sys_ioloop_timer t)
+{
+	if (!t) return;
+	sys_ioloop_cancel_timer(t);
+	delete (IOLoopTimer *)t;
+}
+
+void sys_ioloop_set_timer_ns(sys_ioloop_timer t, uint64 nsecs)
+{
+	if (!gIOLoopAvailable) return;
+	IOLoopTimer *timer = (IOLoopTimer *)t;
+	uint64 expires = ioloop_now() + nsecs;
+	sys_lock_mutex(gIOLoopMutex);
+	if (timer->index == IOLOOP_UNARMED) {
+		if (gIOLoopHeapSize == gIOLoopHeapAlloc) {
+			gIOLoopHeapAlloc = gIOLoopHeapAlloc ? gIOLoopHeapAlloc*2 : 16;
+			gIOLoopHeap = (IOLoopTimer **)realloc(gIOLoopHeap, gIOLoopHeapAlloc * sizeof *gIOLoopHeap);
+		}
+		timer->expires = expires;
+		ioloop_heap_place(timer, gIOLoopHeapSize++);
+		ioloop_heap_up(timer->index);
+	} else {
+		timer->expires = expires;
+		ioloop_heap_up(timer->index);
+		ioloop_heap_down(timer->index);
+	}
+	bool first = (timer->index == 0);
+	sys_unlock_mutex(gIOLoopMutex);
+	// the loop may be sleeping for longer than that
+	if (first) ioloop_wake();
+}
+
+void sys_ioloop_set_timer(sys_ioloop_timer t, uint msecs)
+{
+	sys_ioloop_set_timer_ns(t, uint64(msecs) * 1000000);
+}
+
+void sys_ioloop_cancel_timer(sys_ioloop_timer t)
+{
+	// the heap is gone after sys_ioloop_done()
+	if (!gIOLoopAvailable) return;
+	IOLoopTimer *timer = (IOLoopTimer *)t;
+	sys_lock_mutex(gIOLoopMutex);
+	if (timer->index != IOLOOP_UNARMED) ioloop_heap_remove(timer);
+	sys_unlock_mutex(gIOLoopMutex);
+}
+
+void sys_ioloop_get_stats(sys_ioloop_stats &stats)
+{
+	if (!gIOLoopAvailable) {
+		stats.wakeups = stats.timers = stats.nsecs = 0;
+		return;
+	}
+	sys_lock_mutex(gIOLoopMutex);
+	stats.wakeups = gIOLoopWakeups;
+	stats.timers = gIOLoopTimersRun;
+	stats.nsecs = ioloop_now() - gIOLoopStart;
+	sys_unlock_mutex(gIOLoopMutex);
+}
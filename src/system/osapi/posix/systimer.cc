@@ -25,6 +25,7 @@
 #include <string.h>
 #include <sys/time.h>
 
+#include "system/sysioloop.h"
 #include "system/systimer.h"
 #include "tools/snprintf.h"
 
@@ -52,9 +53,12 @@ struct sys_timer_struct
 	sys_timer_callback callback;
 	int clock;
 	uint64 timer_res;
+	// if set, the timer runs in the I/O loop instead of a signal handler
+	sys_ioloop_timer ioloop_timer;
+	uint64 period;
 
 	sys_timer_struct(sys_timer_callback cb)
-			: callback(cb), clock(kClock), timer_res(0)
+			: callback(cb), clock(kClock), timer_res(0), ioloop_timer(NULL), period(0)
 	{
 #ifdef USE_POSIX_REALTIME_CLOCK
 		memset(&event_info, 0, sizeof event_info);
@@ -84,12 +88,32 @@ static void signal_handler(int signo)
 # endif
 #endif
 
+static void ioloop_timer_handler(sys_ioloop_timer t, void *context)
+{
+	sys_timer_struct *timer = reinterpret_cast<sys_timer_struct *>(context);
+	if (timer->period) sys_ioloop_set_timer_ns(t, timer->period);
+	timer->callback(reinterpret_cast<sys_timer>(timer));
+}
+
 bool sys_create_timer(sys_timer *t, sys_timer_callback cb_func)
 {
 	*t = 0;
 
 	sys_timer_struct *newTimer = new sys_timer_struct(cb_func);
 
+	/*
+	 *	Prefer the I/O loop: it sleeps exactly until the next expiry
+	 *	and doesn't interrupt the other threads with signals.
+	 */
+	if (sys_ioloop_available()) {
+		newTimer->ioloop_timer = sys_ioloop_create_timer(ioloop_timer_handler, newTimer);
+		if (newTimer->ioloop_timer) {
+			newTimer->timer_res = 1000;
+			*t = reinterpret_cast<sys_timer>(newTimer);
+			return true;
+		}
+	}
+
 #ifdef USE_POSIX_REALTIME_CLOCK
 	int clocks[] = {kClockRT, kClock};
 
@@ -164,6 +188,12 @@ void sys_delete_timer(sys_timer t)
 {
 	sys_timer_struct *timer = reinterpret_cast<sys_timer_struct *>(t);
 
+	if (timer->ioloop_timer) {
+		sys_ioloop_delete_timer(timer->ioloop_timer);
+		delete timer;
+		return;
+	}
+
 #ifdef USE_POSIX_REALTIME_CLOCK
 	timer_delete(timer->timer_id);
 #else
@@ -190,6 +220,12 @@ void sys_set_timer(sys_timer t, time_t secs, long int nanosecs, bool periodic)
 		timer->callback(t);
 		return;
 	}
+	if (timer->ioloop_timer) {
+		uint64 ns = uint64(secs) * 1000 * 1000 * 1000 + nanosecs;
+		timer->period = periodic ? ns : 0;
+		sys_ioloop_set_timer_ns(timer->ioloop_timer, ns);
+		return;
+	}
 #ifdef USE_POSIX_REALTIME_CLOCK
 	struct itimerspec itime;
 
@@ -236,6 +272,12 @@ uint64 sys_get_timer_resolution(sys_timer t)
 	return timer->timer_res;
 }
 
+bool sys_timer_callback_is_threaded(sys_timer t)
+{
+	sys_timer_struct *timer = reinterpret_cast<sys_timer_struct *>(t);
+	return timer->ioloop_timer != NULL;
+}
+
 uint64 sys_get_hiresclk_ticks()
 {
 #if HAVE_GETTIMEOFDAY
@@ -23,6 +23,7 @@
 #include <cerrno>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <sys/stat.h>
 
 #include "system/file.h"
@@ -417,6 +418,38 @@ FileOfs	sys_ftell(SYS_FILE *file)
 	return (((FileOfs)b)<<32)+((uint32)a);
 }
 
+static int sys_frwv(SYS_FILE *file, FileOfs ofs, const sys_iovec *iov, int count, bool write)
+{
+	int done = 0;
+	for (int i = 0; i < count; i++) {
+		OVERLAPPED ov;
+		DWORD r;
+		memset(&ov, 0, sizeof ov);
+		ov.Offset = (DWORD)(ofs + done);
+		ov.OffsetHigh = (DWORD)((ofs + done) >> 32);
+		BOOL ok;
+		if (write) {
+			ok = WriteFile(*(HANDLE *)file, iov[i].base, iov[i].size, &r, &ov);
+		} else {
+			ok = ReadFile(*(HANDLE *)file, iov[i].base, iov[i].size, &r, &ov);
+		}
+		if (!ok) return done ? done : -1;
+		done += r;
+		if (r != iov[i].size) break;
+	}
+	return done;
+}
+
+int sys_freadv(SYS_FILE *file, FileOfs ofs, const sys_iovec *iov, int count)
+{
+	return sys_frwv(file, ofs, iov, count, false);
+}
+
+int sys_fwritev(SYS_FILE *file, FileOfs ofs, const sys_iovec *iov, int count)
+{
+	return sys_frwv(file, ofs, iov, count, true);
+}
+
 void *sys_alloc_read_write_execute(size_t size)
 {
 	return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE);
@@ -115,6 +115,12 @@ uint64 sys_get_timer_resolution(sys_timer t)
 	return timer->timerRes;
 }
 
+bool sys_timer_callback_is_threaded(sys_timer t)
+{
+	// multimedia timer callbacks run in their own thread
+	return true;
+}
+
 uint64 sys_get_hiresclk_ticks()
 {
 	uint64 counter;
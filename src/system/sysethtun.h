@@ -23,10 +23,19 @@
 #ifndef __SYSETHTUN_H__
 #define __SYSETHTUN_H__
 
+#include <cstring>
 #include "system/types.h"
 
 // FIXME: reentrancy, threading specs
 
+/**
+ *	One packet of a batch for recvPackets() / sendPackets()
+ */
+struct PacketBuf {
+	void	*buf;
+	uint	size;
+};
+
 class PacketDevice {
 public:
 	virtual ~PacketDevice() {}
@@ -54,6 +63,19 @@ public:
 	 */
 	virtual	int	waitRecvPacket() = 0;
 
+	/**
+	 *	Get a host descriptor which becomes readable when a packet
+	 *	has been received (see sys_ioloop_add_fd()). Reading from
+	 *	it through recvPacket() etc. must not block.
+	 *
+	 *	@returns the descriptor or -1 if there is none (then
+	 *	waitRecvPacket() has to be used)
+	 */
+	virtual	int	getRecvFD()
+	{
+		return -1;
+	}
+
 	/**
 	 *	Write a packet from a buffer into the device
 	 *
@@ -62,6 +84,65 @@ public:
 	 *	@returns number of bytes sent and written into buf
 	 */
 	virtual	uint	sendPacket(void *buf, uint size) = 0;
+
+	/**
+	 *	Read a batch of packets from the device
+	 *
+	 *	Like recvPacket(), but continues to read packets which are
+	 *	already pending (without blocking) until count packets have
+	 *	been read.
+	 *
+	 *	@param pkts buffers to read into. On return their size is
+	 *	set to the number of bytes received
+	 *	@param count number of buffers in pkts
+	 *	@returns number of packets received
+	 */
+	virtual	uint	recvPackets(PacketBuf *pkts, uint count)
+	{
+		if (!count) return 0;
+		pkts[0].size = recvPacket(pkts[0].buf, pkts[0].size);
+		return pkts[0].size ? 1 : 0;
+	}
+
+	/**
+	 *	Read one packet and scatter it into several buffers
+	 *
+	 *	@param frags buffers to fill, in order
+	 *	@param count number of buffers in frags
+	 *	@returns number of bytes received (bytes which didn't fit
+	 *	into frags are lost)
+	 */
+	virtual	uint	recvPacketv(const PacketBuf *frags, uint count)
+	{
+		byte buf[16384];
+		uint size = recvPacket(buf, sizeof buf);
+		uint ofs = 0;
+		for (uint i = 0; i < count && ofs < size; i++) {
+			uint n = MIN(frags[i].size, size - ofs);
+			memcpy(frags[i].buf, buf + ofs, n);
+			ofs += n;
+		}
+		return ofs;
+	}
+
+	/**
+	 *	Write one packet gathered from several buffers
+	 *
+	 *	@param frags the parts of the packet, in order
+	 *	@param count number of buffers in frags
+	 *	@returns number of bytes sent
+	 */
+	virtual	uint	sendPacketv(const PacketBuf *frags, uint count)
+	{
+		byte buf[16384];
+		uint size = 0;
+		for (uint i = 0; i < count; i++) {
+			if (size + frags[i].size > sizeof buf) return 0;
+			memcpy(buf + size, frags[i].buf, frags[i].size);
+			size += frags[i].size;
+		}
+		return sendPacket(buf, size);
+	}
 };
 
 /**
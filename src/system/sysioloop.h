@@ -0,0 +1,65 @@
+/*
+ *	PearPC
+ *	sysioloop.h
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __SYSIOLOOP_H__
+#define __SYSIOLOOP_H__
+
+#include "types.h"
+
+/*
+ *	One host thread which waits for all registered file descriptors
+ *	and timers at once (instead of one thread per device).
+ *	Handlers are called from within this thread, one at a time.
+ *	They must not block.
+ */
+
+typedef void * sys_ioloop_timer;
+
+typedef void (*sys_ioloop_fd_handler)(int fd, void *context);
+typedef void (*sys_ioloop_timer_handler)(sys_ioloop_timer t, void *context);
+
+struct sys_ioloop_stats {
+	uint64	wakeups;	// returns from waiting
+	uint64	timers;		// timer handlers run
+	uint64	nsecs;		// since sys_ioloop_init()
+};
+
+/* system-dependent (implementation in $MYSYSTEM/sysioloop.cc) */
+
+/* returns false if this system has no I/O loop, devices then use their own threads */
+bool	sys_ioloop_init();
+/* stops the thread, no handler runs after this returns.
+   The fd and timer functions do nothing afterwards, timers may still be deleted */
+void	sys_ioloop_done();
+bool	sys_ioloop_available();
+
+/* handler is called as long as fd is readable and enabled */
+bool	sys_ioloop_add_fd(int fd, sys_ioloop_fd_handler handler, void *context);
+void	sys_ioloop_enable_fd(int fd, bool enable);
+void	sys_ioloop_remove_fd(int fd);
+
+sys_ioloop_timer sys_ioloop_create_timer(sys_ioloop_timer_handler handler, void *context);
+void	sys_ioloop_delete_timer(sys_ioloop_timer t);
+/* (re-)arms t to fire once in msecs milliseconds */
+void	sys_ioloop_set_timer(sys_ioloop_timer t, uint msecs);
+void	sys_ioloop_set_timer_ns(sys_ioloop_timer t, uint64 nsecs);
+void	sys_ioloop_cancel_timer(sys_ioloop_timer t);
+
+void	sys_ioloop_get_stats(sys_ioloop_stats &stats);
+
+#endif
@@ -80,4 +80,12 @@ void sys_set_timer(sys_timer t, time_t secs, long int nanosecs, bool periodic);
  */
 uint64 sys_get_timer_resolution(sys_timer t);
 
+/**
+ * Tells in which context the callback of the given timer runs.
+ *
+ * @return true if the callback runs in a host thread (and may block
+ * on mutexes), false if it runs in a signal handler.
+ */
+bool sys_timer_callback_is_threaded(sys_timer t);
+
 #endif /* _SYSTIMER_H_ */
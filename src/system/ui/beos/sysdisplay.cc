@@ -522,31 +522,9 @@ void BeOSSystemDisplay::setMouseGrab(bool enable)
 
 void BeOSSystemDisplay::displayShow()
 {
-	uint firstDamagedLine, lastDamagedLine;
-	// We've got problems with races here because gcard_write1/2/4
-	// might set gDamageAreaFirstAddr, gDamageAreaLastAddr.
-	// We can't use mutexes in gcard for speed reasons. So we'll
-	// try to minimize the probability of loosing the race.
+	int firstDamagedLine, lastDamagedLine;
 	if (!isExposed()) return;
-	if (gDamageAreaFirstAddr > gDamageAreaLastAddr+3) {
-	        return;
-	}
-	uint damageAreaFirstAddr = gDamageAreaFirstAddr;
-	uint damageAreaLastAddr = gDamageAreaLastAddr;
-	healFrameBuffer();
-	// end of race
-	damageAreaLastAddr += 3;	// this is a hack. For speed reasons we
-					// inaccurately set gDamageAreaLastAddr
-					// to the first (not last) byte accessed
-					// accesses are up to 4 bytes "long".
-
-	firstDamagedLine = damageAreaFirstAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-	lastDamagedLine = damageAreaLastAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-	// Overflow may happen, because of the hack used above
-	// and others, that set lastAddr = 0xfffffff0 (damageFrameBufferAll())
-	if (lastDamagedLine >= mClientChar.height) {
-		lastDamagedLine = mClientChar.height-1;
-	}
+	if (!getDamagedLines(firstDamagedLine, lastDamagedLine)) return;
 	//convertDisplayClientToServer(firstDamagedLine, lastDamagedLine);
 	// wtf, doesn't seem to work...
 	sys_convert_display(mClientChar, mBeChar, gFrameBuffer, gBeOSFramebuffer, firstDamagedLine, lastDamagedLine);
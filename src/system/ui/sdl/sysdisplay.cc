@@ -121,40 +121,26 @@ void SDLSystemDisplay::displayShow()
 {
 	if (!isExposed()) return;
 
-	int firstDamagedLine, lastDamagedLine;
-	// We've got problems with races here because gcard_write1/2/4
-	// might set gDamageAreaFirstAddr, gDamageAreaLastAddr.
-	// We can't use mutexes in gcard for speed reasons. So we'll
-	// try to minimize the probability of loosing the race.
-	if (gDamageAreaFirstAddr > gDamageAreaLastAddr+3) {
-	        return;
-	}
-	int damageAreaFirstAddr = gDamageAreaFirstAddr;
-	int damageAreaLastAddr = gDamageAreaLastAddr;
-	healFrameBuffer();
-	// end of race
-	damageAreaLastAddr += 3;	// this is a hack. For speed reasons we
-					// inaccurately set gDamageAreaLastAddr
-					// to the first (not last) byte accessed
-					// accesses are up to 4 bytes "long".
-	firstDamagedLine = damageAreaFirstAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-	lastDamagedLine = damageAreaLastAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-	// Overflow may happen, because of the hack used above
-	// and others, that set lastAddr = 0xfffffff0 (damageFrameBufferAll())
-	if (lastDamagedLine >= mClientChar.height) {
-		lastDamagedLine = mClientChar.height-1;
-	}
+	DamageRect rects[DAMAGE_MAX_RECTS];
+	int count = getDamage(rects, DAMAGE_MAX_RECTS);
+	if (!count) return;
 
 	sys_lock_mutex(mRedrawMutex);
 
 	if (SDL_MUSTLOCK(gSDLScreen)) SDL_LockSurface(gSDLScreen);
 
-	sys_convert_display(mClientChar, mSDLChar, gFrameBuffer,
-		(byte*)gSDLScreen->pixels, firstDamagedLine, lastDamagedLine);
+	convertDamage(mSDLChar, gSDLScreen->pixels, rects, count);
 
 	if (SDL_MUSTLOCK(gSDLScreen)) SDL_UnlockSurface(gSDLScreen);
 
-	SDL_UpdateRect(gSDLScreen, 0, firstDamagedLine, mClientChar.width, lastDamagedLine-firstDamagedLine+1);
+	SDL_Rect sdlRects[DAMAGE_MAX_RECTS];
+	for (int i=0; i < count; i++) {
+		sdlRects[i].x = rects[i].x;
+		sdlRects[i].y = rects[i].y;
+		sdlRects[i].w = rects[i].w;
+		sdlRects[i].h = rects[i].h;
+	}
+	SDL_UpdateRects(gSDLScreen, count, sdlRects);
 
 #if 0
 	if (mSDLFrameBuffer) { // using software-mode?
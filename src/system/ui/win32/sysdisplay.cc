@@ -340,36 +340,13 @@ void Win32Display::displayShow()
 {
 	if (!isExposed()) return;
 
-	uint firstDamagedLine, lastDamagedLine;
-	// We've got problems with races here because gcard_write1/2/4
-	// might set gDamageAreaFirstAddr, gDamageAreaLastAddr.
-	// We can't use mutexes in gcard for speed reasons. So we'll
-	// try to minimize the probability of loosing the race.
-	if (gDamageAreaFirstAddr > gDamageAreaLastAddr+3) {
-	        return;
-	}
-	uint damageAreaFirstAddr = gDamageAreaFirstAddr;
-	uint damageAreaLastAddr = gDamageAreaLastAddr;
-	healFrameBuffer();
-	// end of race
+	int firstDamagedLine, lastDamagedLine;
+	if (!getDamagedLines(firstDamagedLine, lastDamagedLine)) return;
 
 	// we enter the critical section early, so that
 	// changeResolution can't conflict here
 	EnterCriticalSection(&gDrawCS);
 
-	damageAreaLastAddr += 3;	// this is a hack. For speed reasons we
-					// inaccurately set gDamageAreaLastAddr
-					// to the first (not last) byte accessed
-					// accesses are up to 4 bytes "long".
-
-	firstDamagedLine = damageAreaFirstAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-	lastDamagedLine = damageAreaLastAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-	// Overflow may happen, because of the hack used above
-	// and others, that set lastAddr = 0xfffffff0
-	if (lastDamagedLine >= (uint)mClientChar.height) {
-		lastDamagedLine = mClientChar.height-1;
-	}
-
 	sys_convert_display(mClientChar, mWinChar, gFrameBuffer, winframebuffer, firstDamagedLine, lastDamagedLine);
 
 	HDC hdc = GetDC(gHWNDMain);
@@ -419,33 +419,12 @@ public:
 	{
 		if (!isExposed()) return;
 
-		int firstDamagedLine, lastDamagedLine;
-		// We've got problems with races here because gcard_write1/2/4
-		// might set gDamageAreaFirstAddr, gDamageAreaLastAddr.
-		// We can't use mutexes in gcard for speed reasons. So we'll
-		// try to minimize the probability of loosing the race.
-		if (gDamageAreaFirstAddr > gDamageAreaLastAddr+3) {
-		        return;
-		}
-		uint damageAreaFirstAddr = gDamageAreaFirstAddr;
-		uint damageAreaLastAddr = gDamageAreaLastAddr;
-		healFrameBuffer();
-		// end of race
-		damageAreaLastAddr += 3;	// this is a hack. For speed reasons we
-						// inaccurately set gDamageAreaLastAddr
-						// to the first (not last) byte accessed
-						// accesses are up to 4 bytes "long".
-
-		firstDamagedLine = damageAreaFirstAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-		lastDamagedLine = damageAreaLastAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-		// Overflow may happen, because of the hack used above
-		// and others, that set lastAddr = 0xfffffff0 (damageFrameBufferAll())
-		if (lastDamagedLine >= mClientChar.height) {
-			lastDamagedLine = mClientChar.height-1;
-		}
+		DamageRect rects[DAMAGE_MAX_RECTS];
+		int count = getDamage(rects, DAMAGE_MAX_RECTS);
+		if (!count) return;
 
 		if (mXFrameBuffer) {
-			sys_convert_display(mClientChar, mXChar, gFrameBuffer, mXFrameBuffer, firstDamagedLine, lastDamagedLine);
+			convertDamage(mXChar, mXFrameBuffer, rects, count);
 		}
 
 		sys_lock_mutex(gX11Mutex);
@@ -454,13 +433,15 @@ public:
 			mClientChar.width,
 			mMenuHeight);*/
 
-		XPutImage(gX11Display, gX11Window, mXGC, mXImage,
-			0,
-			firstDamagedLine,
-			0,
-			mMenuHeight+firstDamagedLine,
-			mClientChar.width,
-			lastDamagedLine-firstDamagedLine+1);
+		for (int i=0; i < count; i++) {
+			XPutImage(gX11Display, gX11Window, mXGC, mXImage,
+				rects[i].x,
+				rects[i].y,
+				rects[i].x,
+				mMenuHeight+rects[i].y,
+				rects[i].w,
+				rects[i].h);
+		}
 
 /*		if (mHWCursorVisible) {
 			XPutImage(gX11Display, gX11Window, mXGC, mMouseXImage, 0, 0, 